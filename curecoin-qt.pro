@@ -152,7 +152,17 @@ HEADERS += src/qt/curecoingui.h \
     src/sync.h \
     src/util.h \
     src/uint256.h \
+    src/arith_uint256.h \
     src/kernel.h \
+    src/perf.h \
+    src/blockstore.h \
+    src/blockindexmap.h \
+    src/compactblock.h \
+    src/orphantx.h \
+    src/bloom.h \
+    src/addressgroups.h \
+    src/coinselection.h \
+    src/bandwidth.h \
     src/serialize.h \
     src/strlcpy.h \
     src/main.h \
@@ -162,7 +172,6 @@ HEADERS += src/qt/curecoingui.h \
     src/walletdb.h \
     src/script.h \
     src/init.h \
-    src/mruset.h \
     src/json/json_spirit_writer_template.h \
     src/json/json_spirit_writer.h \
     src/json/json_spirit_value.h \
@@ -267,7 +276,16 @@ SOURCES += src/qt/curecoin.cpp src/qt/curecoingui.cpp \
     src/qt/trafficgraphwidget.cpp \
     src/qt/peertablemodel.cpp \
     src/noui.cpp \
-    src/kernel.cpp
+    src/kernel.cpp \
+    src/perf.cpp \
+    src/blockstore.cpp \
+    src/blockindexmap.cpp \
+    src/compactblock.cpp \
+    src/orphantx.cpp \
+    src/bloom.cpp \
+    src/addressgroups.cpp \
+    src/coinselection.cpp \
+    src/bandwidth.cpp
 
 RESOURCES += \
     src/qt/curecoin.qrc
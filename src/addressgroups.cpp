@@ -0,0 +1,67 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressgroups.h"
+
+unsigned int CAddressGroups::Find(unsigned int n)
+{
+    // Path halving: point every other node on the way at its grandparent
+    while (vParent[n] != n)
+    {
+        vParent[n] = vParent[vParent[n]];
+        n = vParent[n];
+    }
+    return n;
+}
+
+unsigned int CAddressGroups::Add(const CTxDestination& address)
+{
+    std::pair<std::map<CTxDestination, unsigned int>::iterator, bool> ret = mapIndex.insert(std::make_pair(address, vAddress.size()));
+    if (ret.second)
+    {
+        vAddress.push_back(address);
+        vParent.push_back(vParent.size());
+        vSize.push_back(1);
+    }
+    return (*ret.first).second;
+}
+
+void CAddressGroups::Merge(const CTxDestination& a, const CTxDestination& b)
+{
+    unsigned int nRootA = Find(Add(a));
+    unsigned int nRootB = Find(Add(b));
+    if (nRootA == nRootB)
+        return;
+    // The smaller tree goes under the larger one, keeping them shallow
+    if (vSize[nRootA] < vSize[nRootB])
+        std::swap(nRootA, nRootB);
+    vParent[nRootB] = nRootA;
+    vSize[nRootA] += vSize[nRootB];
+}
+
+bool CAddressGroups::SameGroup(const CTxDestination& a, const CTxDestination& b)
+{
+    std::map<CTxDestination, unsigned int>::const_iterator mi = mapIndex.find(a);
+    std::map<CTxDestination, unsigned int>::const_iterator mj = mapIndex.find(b);
+    if (mi == mapIndex.end() || mj == mapIndex.end())
+        return false;
+    return Find((*mi).second) == Find((*mj).second);
+}
+
+void CAddressGroups::GetGroups(std::set< std::set<CTxDestination> >& setGroups)
+{
+    std::map<unsigned int, std::set<CTxDestination> > mapGroups;
+    for (unsigned int n = 0; n < vAddress.size(); n++)
+        mapGroups[Find(n)].insert(vAddress[n]);
+    for (std::map<unsigned int, std::set<CTxDestination> >::iterator it = mapGroups.begin(); it != mapGroups.end(); ++it)
+        setGroups.insert((*it).second);
+}
+
+void CAddressGroups::Clear()
+{
+    mapIndex.clear();
+    vAddress.clear();
+    vParent.clear();
+    vSize.clear();
+}
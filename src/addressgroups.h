@@ -0,0 +1,42 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_ADDRESSGROUPS_H
+#define curecoin_ADDRESSGROUPS_H
+
+#include "script.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+/** Addresses partitioned into groups known to share an owner.
+ *
+ * A disjoint-set forest with union by size and path halving: adding an
+ * address and merging the groups of two addresses take near constant
+ * time, so groups can be kept up to date as transactions arrive instead
+ * of being rebuilt from the whole wallet on every query.
+ */
+class CAddressGroups
+{
+private:
+    std::map<CTxDestination, unsigned int> mapIndex;
+    std::vector<CTxDestination> vAddress;
+    std::vector<unsigned int> vParent;
+    std::vector<unsigned int> vSize;
+
+    unsigned int Find(unsigned int n);
+
+public:
+    /** Add address in a group of its own, if it isn't in one already */
+    unsigned int Add(const CTxDestination& address);
+    /** Join the groups of the two addresses, adding them as needed */
+    void Merge(const CTxDestination& a, const CTxDestination& b);
+    bool SameGroup(const CTxDestination& a, const CTxDestination& b);
+    void GetGroups(std::set< std::set<CTxDestination> >& setGroups);
+    void Clear();
+
+    size_t Size() const { return vAddress.size(); }
+};
+
+#endif
@@ -5,35 +5,46 @@
 #include "addrman.h"
 
 #include <algorithm>
+#include <cstring>
 #include <map>
 #include <set>
 #include <vector>
 
-int CAddrInfo::GetTriedBucket(const std::vector<unsigned char> &nKey) const
+// Keyed hash of a tag byte followed by a short byte string; the length goes
+// in the last byte so strings of different lengths don't collide
+static uint64 HashBucketData(uint64 nKey0, uint64 nKey1, char chTag, const std::vector<unsigned char>& vch)
 {
-    CDataStream ss1(SER_GETHASH, 0);
-    std::vector<unsigned char> vchKey = GetKey();
-    ss1 << nKey << vchKey;
-    uint64 hash1 = Hash(ss1.begin(), ss1.end()).Get64();
+    assert(vch.size() < 31);
+    uint256 n = 0;
+    unsigned char* p = n.begin();
+    p[0] = chTag;
+    if (!vch.empty())
+        memcpy(p + 1, &vch[0], vch.size());
+    p[31] = vch.size();
+    return SipHashUint256(nKey0, nKey1, n);
+}
+
+int CAddrInfo::GetTriedBucket(uint64 nKey0, uint64 nKey1) const
+{
+    uint64 hash1 = HashBucketData(nKey0, nKey1, 'K', GetKey());
 
-    CDataStream ss2(SER_GETHASH, 0);
     std::vector<unsigned char> vchGroupKey = GetGroup();
-    ss2 << nKey << vchGroupKey << (hash1 % ADDRMAN_TRIED_BUCKETS_PER_GROUP);
-    uint64 hash2 = Hash(ss2.begin(), ss2.end()).Get64();
+    vchGroupKey.push_back(hash1 % ADDRMAN_TRIED_BUCKETS_PER_GROUP);
+    uint64 hash2 = HashBucketData(nKey0, nKey1, 'T', vchGroupKey);
     return hash2 % ADDRMAN_TRIED_BUCKET_COUNT;
 }
 
-int CAddrInfo::GetNewBucket(const std::vector<unsigned char> &nKey, const CNetAddr& src) const
+int CAddrInfo::GetNewBucket(uint64 nKey0, uint64 nKey1, const CNetAddr& src) const
 {
-    CDataStream ss1(SER_GETHASH, 0);
     std::vector<unsigned char> vchGroupKey = GetGroup();
     std::vector<unsigned char> vchSourceGroupKey = src.GetGroup();
-    ss1 << nKey << vchGroupKey << vchSourceGroupKey;
-    uint64 hash1 = Hash(ss1.begin(), ss1.end()).Get64();
+    std::vector<unsigned char> vch(vchGroupKey);
+    vch.push_back(vchGroupKey.size());
+    vch.insert(vch.end(), vchSourceGroupKey.begin(), vchSourceGroupKey.end());
+    uint64 hash1 = HashBucketData(nKey0, nKey1, 'G', vch);
 
-    CDataStream ss2(SER_GETHASH, 0);
-    ss2 << nKey << vchSourceGroupKey << (hash1 % ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP);
-    uint64 hash2 = Hash(ss2.begin(), ss2.end()).Get64();
+    vchSourceGroupKey.push_back(hash1 % ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP);
+    uint64 hash2 = HashBucketData(nKey0, nKey1, 'N', vchSourceGroupKey);
     return hash2 % ADDRMAN_NEW_BUCKET_COUNT;
 }
 
@@ -80,29 +91,133 @@ double CAddrInfo::GetChance(int64 nNow) const
     return fChance;
 }
 
+void CAddrMan::SetHashKeys()
+{
+    assert(nKey.size() >= 16);
+    memcpy(&nKey0, &nKey[0], 8);
+    memcpy(&nKey1, &nKey[8], 8);
+}
+
+void CAddrMan::Clear_()
+{
+    vInfo.clear();
+    vFreeIds.clear();
+    vAddrIndex.clear();
+    vRandom.clear();
+    tableTried.Clear();
+    tableNew.Clear();
+    nTried = 0;
+    nNew = 0;
+    vDirty.clear();
+    vRemoved.clear();
+}
+
+void CAddrMan::ClearChanges_()
+{
+    for (std::vector<int>::const_iterator it = vDirty.begin(); it != vDirty.end(); it++)
+        vInfo[*it].fDirty = false;
+    vDirty.clear();
+    vRemoved.clear();
+}
+
+size_t CAddrMan::IndexSlot(const CNetAddr& addr) const
+{
+    size_t nMask = vAddrIndex.size() - 1;
+    size_t nSlot = addr.GetSipHash(nKey0, nKey1) & nMask;
+    while (vAddrIndex[nSlot] != -1 && (CNetAddr)vInfo[vAddrIndex[nSlot]] != addr)
+        nSlot = (nSlot + 1) & nMask;
+    return nSlot;
+}
+
+void CAddrMan::IndexResize(size_t nSlots)
+{
+    vAddrIndex.assign(nSlots, -1);
+    for (std::vector<int>::const_iterator it = vRandom.begin(); it != vRandom.end(); it++)
+        vAddrIndex[IndexSlot(vInfo[*it])] = *it;
+}
+
+void CAddrMan::IndexInsert(int nId)
+{
+    // keep the table at most half full; vRandom already counts nId
+    if (vAddrIndex.size() < 2 * vRandom.size())
+    {
+        size_t nSlots = 64;
+        while (nSlots < 4 * vRandom.size())
+            nSlots *= 2;
+        IndexResize(nSlots);
+    }
+    vAddrIndex[IndexSlot(vInfo[nId])] = nId;
+}
+
+void CAddrMan::IndexErase(int nId)
+{
+    size_t nMask = vAddrIndex.size() - 1;
+    size_t nHole = IndexSlot(vInfo[nId]);
+    assert(vAddrIndex[nHole] == nId);
+
+    // shift back any entry of the probe run after the hole that may move
+    // into it, so lookups never stop early at an empty slot
+    for (size_t nSlot = (nHole + 1) & nMask; vAddrIndex[nSlot] != -1; nSlot = (nSlot + 1) & nMask)
+    {
+        size_t nHome = vInfo[vAddrIndex[nSlot]].GetSipHash(nKey0, nKey1) & nMask;
+        if (((nSlot - nHome) & nMask) >= ((nSlot - nHole) & nMask))
+        {
+            vAddrIndex[nHole] = vAddrIndex[nSlot];
+            nHole = nSlot;
+        }
+    }
+    vAddrIndex[nHole] = -1;
+}
+
 CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int *pnId)
 {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
-    if (it == mapAddr.end())
+    if (vAddrIndex.empty())
+        return NULL;
+    int nId = vAddrIndex[IndexSlot(addr)];
+    if (nId == -1)
         return NULL;
     if (pnId)
-        *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
-    if (it2 != mapInfo.end())
-        return &(*it2).second;
-    return NULL;
+        *pnId = nId;
+    return &vInfo[nId];
 }
 
 CAddrInfo* CAddrMan::Create(const CAddress &addr, const CNetAddr &addrSource, int *pnId)
 {
-    int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
-    mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
+    int nId;
+    if (vFreeIds.empty())
+    {
+        nId = vInfo.size();
+        vInfo.push_back(CAddrInfo(addr, addrSource));
+    }
+    else
+    {
+        nId = vFreeIds.back();
+        vFreeIds.pop_back();
+        vInfo[nId] = CAddrInfo(addr, addrSource);
+    }
+    CAddrInfo &info = vInfo[nId];
+    info.nTriedBucket = info.GetTriedBucket(nKey0, nKey1);
+    info.nNewBucket = info.GetNewBucket(nKey0, nKey1);
+    info.nRandomPos = vRandom.size();
     vRandom.push_back(nId);
+    IndexInsert(nId);
+    MarkDirty(info, nId);
     if (pnId)
         *pnId = nId;
-    return &mapInfo[nId];
+    return &info;
+}
+
+void CAddrMan::Delete(int nId)
+{
+    CAddrInfo &info = vInfo[nId];
+    assert(!info.fInTried && info.nRefCount == 0);
+
+    SwapRandom(info.nRandomPos, vRandom.size() - 1);
+    vRandom.pop_back();
+    IndexErase(nId);
+    vRemoved.push_back(info);
+    info = CAddrInfo();
+    vFreeIds.push_back(nId);
 }
 
 void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
@@ -115,35 +230,56 @@ void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2)
     int nId1 = vRandom[nRndPos1];
     int nId2 = vRandom[nRndPos2];
 
-    assert(mapInfo.count(nId1) == 1);
-    assert(mapInfo.count(nId2) == 1);
-
-    mapInfo[nId1].nRandomPos = nRndPos2;
-    mapInfo[nId2].nRandomPos = nRndPos1;
+    vInfo[nId1].nRandomPos = nRndPos2;
+    vInfo[nId2].nRandomPos = nRndPos1;
 
     vRandom[nRndPos1] = nId2;
     vRandom[nRndPos2] = nId1;
 }
 
-int CAddrMan::SelectTried(int nKBucket)
+void CAddrMan::AddToNew(CAddrInfo& info, int nId, int nUBucket)
+{
+    assert(info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS);
+    info.anNewBucket[info.nRefCount] = nUBucket;
+    info.anNewPos[info.nRefCount] = tableNew.Insert(nUBucket, nId);
+    info.nRefCount++;
+}
+
+void CAddrMan::RemoveFromNew(CAddrInfo& info, int nRef)
+{
+    assert(nRef >= 0 && nRef < info.nRefCount);
+    int nUBucket = info.anNewBucket[nRef];
+    int nPos = info.anNewPos[nRef];
+    int nMoved = tableNew.Remove(nUBucket, nPos);
+    if (nMoved != -1)
+    {
+        CAddrInfo &infoMoved = vInfo[nMoved];
+        infoMoved.anNewPos[FindNewRef(infoMoved, nUBucket)] = nPos;
+    }
+
+    info.nRefCount--;
+    info.anNewBucket[nRef] = info.anNewBucket[info.nRefCount];
+    info.anNewPos[nRef] = info.anNewPos[info.nRefCount];
+}
+
+int CAddrMan::FindNewRef(const CAddrInfo& info, int nUBucket) const
 {
-    std::vector<int> &vTried = vvTried[nKBucket];
+    for (int n = 0; n < info.nRefCount; n++)
+        if (info.anNewBucket[n] == nUBucket)
+            return n;
+    return -1;
+}
 
-    // random shuffle the first few elements (using the entire list)
-    // find the least recently tried among them
-    int64 nOldest = -1;
+int CAddrMan::SelectTried(int nKBucket)
+{
+    // find the least recently tried among a few random entries
+    int nCount = tableTried.Count(nKBucket);
     int nOldestPos = -1;
-    for (unsigned int i = 0; i < ADDRMAN_TRIED_ENTRIES_INSPECT_ON_EVICT && i < vTried.size(); i++)
+    for (unsigned int i = 0; i < ADDRMAN_TRIED_ENTRIES_INSPECT_ON_EVICT; i++)
     {
-        int nPos = GetRandInt(vTried.size() - i) + i;
-        int nTemp = vTried[nPos];
-        vTried[nPos] = vTried[i];
-        vTried[i] = nTemp;
-        assert(nOldest == -1 || mapInfo.count(nTemp) == 1);
-        if (nOldest == -1 || mapInfo[nTemp].nLastSuccess < mapInfo[nOldest].nLastSuccess) {
-           nOldest = nTemp;
-           nOldestPos = nPos;
-        }
+        int nPos = GetRandInt(nCount);
+        if (nOldestPos == -1 || vInfo[tableTried.Get(nKBucket, nPos)].nLastSuccess < vInfo[tableTried.Get(nKBucket, nOldestPos)].nLastSuccess)
+            nOldestPos = nPos;
     }
 
     return nOldestPos;
@@ -151,80 +287,60 @@ int CAddrMan::SelectTried(int nKBucket)
 
 int CAddrMan::ShrinkNew(int nUBucket)
 {
-    assert(nUBucket >= 0 && (unsigned int)nUBucket < vvNew.size());
-    std::set<int> &vNew = vvNew[nUBucket];
+    assert(nUBucket >= 0 && nUBucket < ADDRMAN_NEW_BUCKET_COUNT);
+    int nCount = tableNew.Count(nUBucket);
 
     // first look for deletable items
-    for (std::set<int>::iterator it = vNew.begin(); it != vNew.end(); it++)
+    int nRemove = -1;
+    for (int nPos = 0; nPos < nCount; nPos++)
     {
-        assert(mapInfo.count(*it));
-        CAddrInfo &info = mapInfo[*it];
-        if (info.IsTerrible())
+        if (vInfo[tableNew.Get(nUBucket, nPos)].IsTerrible())
         {
-            if (--info.nRefCount == 0)
-            {
-                SwapRandom(info.nRandomPos, vRandom.size()-1);
-                vRandom.pop_back();
-                mapAddr.erase(info);
-                mapInfo.erase(*it);
-                nNew--;
-            }
-            vNew.erase(it);
-            return 0;
+            nRemove = tableNew.Get(nUBucket, nPos);
+            break;
         }
     }
+    int nRet = 0;
 
     // otherwise, select four randomly, and pick the oldest of those to replace
-    int n[4] = {GetRandInt(vNew.size()), GetRandInt(vNew.size()), GetRandInt(vNew.size()), GetRandInt(vNew.size())};
-    int nI = 0;
-    int nOldest = -1;
-    for (std::set<int>::iterator it = vNew.begin(); it != vNew.end(); it++)
+    if (nRemove == -1)
     {
-        if (nI == n[0] || nI == n[1] || nI == n[2] || nI == n[3])
+        nRet = 1;
+        for (int i = 0; i < 4; i++)
         {
-            assert(nOldest == -1 || mapInfo.count(*it) == 1);
-            if (nOldest == -1 || mapInfo[*it].nTime < mapInfo[nOldest].nTime)
-                nOldest = *it;
+            int nId = tableNew.Get(nUBucket, GetRandInt(nCount));
+            if (nRemove == -1 || vInfo[nId].nTime < vInfo[nRemove].nTime)
+                nRemove = nId;
         }
-        nI++;
     }
-    assert(mapInfo.count(nOldest) == 1);
-    CAddrInfo &info = mapInfo[nOldest];
-    if (--info.nRefCount == 0)
+
+    CAddrInfo &info = vInfo[nRemove];
+    RemoveFromNew(info, FindNewRef(info, nUBucket));
+    if (info.nRefCount == 0)
     {
-        SwapRandom(info.nRandomPos, vRandom.size()-1);
-        vRandom.pop_back();
-        mapAddr.erase(info);
-        mapInfo.erase(nOldest);
+        Delete(nRemove);
         nNew--;
     }
-    vNew.erase(nOldest);
 
-    return 1;
+    return nRet;
 }
 
 void CAddrMan::MakeTried(CAddrInfo& info, int nId, int nOrigin)
 {
-    assert(vvNew[nOrigin].count(nId) == 1);
+    assert(FindNewRef(info, nOrigin) != -1);
 
     // remove the entry from all new buckets
-    for (std::vector<std::set<int> >::iterator it = vvNew.begin(); it != vvNew.end(); it++)
-    {
-        if ((*it).erase(nId))
-            info.nRefCount--;
-    }
+    while (info.nRefCount > 0)
+        RemoveFromNew(info, info.nRefCount - 1);
     nNew--;
 
-    assert(info.nRefCount == 0);
-
     // what tried bucket to move the entry to
-    int nKBucket = info.GetTriedBucket(nKey);
-    std::vector<int> &vTried = vvTried[nKBucket];
+    int nKBucket = info.nTriedBucket;
 
     // first check whether there is place to just add it
-    if (vTried.size() < ADDRMAN_TRIED_BUCKET_SIZE)
+    if (!tableTried.IsFull(nKBucket))
     {
-        vTried.push_back(nId);
+        info.nTriedPos = tableTried.Insert(nKBucket, nId);
         nTried++;
         info.fInTried = true;
         return;
@@ -232,31 +348,26 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId, int nOrigin)
 
     // otherwise, find an item to evict
     int nPos = SelectTried(nKBucket);
-
-    // find which new bucket it belongs to
-    assert(mapInfo.count(vTried[nPos]) == 1);
-    int nUBucket = mapInfo[vTried[nPos]].GetNewBucket(nKey);
-    std::set<int> &vNew = vvNew[nUBucket];
+    int nIdOld = tableTried.Get(nKBucket, nPos);
 
     // remove the to-be-replaced tried entry from the tried set
-    CAddrInfo& infoOld = mapInfo[vTried[nPos]];
+    CAddrInfo& infoOld = vInfo[nIdOld];
     infoOld.fInTried = false;
-    infoOld.nRefCount = 1;
+    infoOld.nTriedPos = -1;
+    MarkDirty(infoOld, nIdOld);
     // do not update nTried, as we are going to move something else there immediately
 
-    // check whether there is place in that one,
-    if (vNew.size() < ADDRMAN_NEW_BUCKET_SIZE)
-    {
-        // if so, move it back there
-        vNew.insert(vTried[nPos]);
-    } else {
-        // otherwise, move it to the new bucket nId came from (there is certainly place there)
-        vvNew[nOrigin].insert(vTried[nPos]);
-    }
+    // move it back to the new bucket it belongs to if there is place there,
+    // otherwise to the new bucket nId came from (there is certainly place there)
+    int nUBucket = infoOld.nNewBucket;
+    if (tableNew.IsFull(nUBucket))
+        nUBucket = nOrigin;
+    AddToNew(infoOld, nIdOld, nUBucket);
     nNew++;
 
-    vTried[nPos] = nId;
-    // we just overwrote an entry in vTried; no need to update nTried
+    tableTried.Set(nKBucket, nPos, nId);
+    info.nTriedPos = nPos;
+    // we just overwrote an entry in the tried bucket; no need to update nTried
     info.fInTried = true;
     return;
 }
@@ -283,28 +394,19 @@ void CAddrMan::Good_(const CService &addr, int64 nTime)
     info.nLastTry = nTime;
     info.nTime = nTime;
     info.nAttempts = 0;
+    MarkDirty(info, nId);
 
     // if it is already in the tried set, don't do anything else
     if (info.fInTried)
         return;
 
-    // find a bucket it is in now
-    int nRnd = GetRandInt(vvNew.size());
-    int nUBucket = -1;
-    for (unsigned int n = 0; n < vvNew.size(); n++)
-    {
-        int nB = (n+nRnd) % vvNew.size();
-        std::set<int> &vNew = vvNew[nB];
-        if (vNew.count(nId))
-        {
-            nUBucket = nB;
-            break;
-        }
-    }
-
-    // if no bucket is found, something bad happened;
+    // if it is in no bucket, something bad happened;
     // TODO: maybe re-add the node, but for now, just bail out
-    if (nUBucket == -1) return;
+    if (info.nRefCount == 0)
+        return;
+
+    // pick one of the buckets it is in now
+    int nUBucket = info.anNewBucket[GetRandInt(info.nRefCount)];
 
     printf("Moving %s to tried\n", addr.ToString().c_str());
 
@@ -327,10 +429,17 @@ bool CAddrMan::Add_(const CAddress &addr, const CNetAddr& source, int64 nTimePen
         bool fCurrentlyOnline = (GetAdjustedTime() - addr.nTime < 24 * 60 * 60);
         int64 nUpdateInterval = (fCurrentlyOnline ? 60 * 60 : 24 * 60 * 60);
         if (addr.nTime && (!pinfo->nTime || pinfo->nTime < addr.nTime - nUpdateInterval - nTimePenalty))
+        {
             pinfo->nTime = std::max((int64)0, addr.nTime - nTimePenalty);
+            MarkDirty(*pinfo, nId);
+        }
 
         // add services
-        pinfo->nServices |= addr.nServices;
+        if ((pinfo->nServices | addr.nServices) != pinfo->nServices)
+        {
+            pinfo->nServices |= addr.nServices;
+            MarkDirty(*pinfo, nId);
+        }
 
         // do not update if no new information is present
         if (!addr.nTime || (pinfo->nTime && addr.nTime <= pinfo->nTime))
@@ -358,21 +467,20 @@ bool CAddrMan::Add_(const CAddress &addr, const CNetAddr& source, int64 nTimePen
         fNew = true;
     }
 
-    int nUBucket = pinfo->GetNewBucket(nKey, source);
-    std::set<int> &vNew = vvNew[nUBucket];
-    if (!vNew.count(nId))
+    int nUBucket = (CNetAddr)pinfo->source == source ? pinfo->nNewBucket : pinfo->GetNewBucket(nKey0, nKey1, source);
+    if (FindNewRef(*pinfo, nUBucket) == -1)
     {
-        pinfo->nRefCount++;
-        if (vNew.size() == ADDRMAN_NEW_BUCKET_SIZE)
+        if (tableNew.IsFull(nUBucket))
             ShrinkNew(nUBucket);
-        vvNew[nUBucket].insert(nId);
+        AddToNew(*pinfo, nId, nUBucket);
     }
     return fNew;
 }
 
 void CAddrMan::Attempt_(const CService &addr, int64 nTime)
 {
-    CAddrInfo *pinfo = Find(addr);
+    int nId;
+    CAddrInfo *pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -387,6 +495,7 @@ void CAddrMan::Attempt_(const CService &addr, int64 nTime)
     // update info
     info.nLastTry = nTime;
     info.nAttempts++;
+    MarkDirty(info, nId);
 }
 
 // Maximum iterations in Select_ to avoid long loops when all addresses have low chance
@@ -400,101 +509,86 @@ CAddress CAddrMan::Select_(int nUnkBias)
     int64 nNow = GetAdjustedTime();
     double nCorTried = sqrt(nTried) * (100.0 - nUnkBias);
     double nCorNew = sqrt(nNew) * nUnkBias;
-    if ((nCorTried + nCorNew)*GetRandInt(1<<30)/(1<<30) < nCorTried)
+    bool fTried = nNew == 0 || (nTried > 0 && (nCorTried + nCorNew)*GetRandInt(1<<30)/(1<<30) < nCorTried);
+
+    // pick a random nonempty bucket of the table, then a random entry in it,
+    // until one passes its chance
+    double fChanceFactor = 1.0;
+    CAddress addrFallback;
+    for (int nIter = 0; nIter < ADDRMAN_SELECT_MAX_ITERATIONS; nIter++)
     {
-        // use a tried node
-        double fChanceFactor = 1.0;
-        CAddress addrFallback;
-        for (int nIter = 0; nIter < ADDRMAN_SELECT_MAX_ITERATIONS; nIter++)
-        {
-            int nKBucket = GetRandInt(vvTried.size());
-            std::vector<int> &vTried = vvTried[nKBucket];
-            if (vTried.size() == 0) continue;
-            int nPos = GetRandInt(vTried.size());
-            assert(mapInfo.count(vTried[nPos]) == 1);
-            CAddrInfo &info = mapInfo[vTried[nPos]];
-            if (!addrFallback.IsValid())
-                addrFallback = info;
-            if (GetRandInt(1<<30) < fChanceFactor*info.GetChance(nNow)*(1<<30))
-                return info;
-            fChanceFactor *= 1.2;
-        }
-        return addrFallback;
-    } else {
-        // use a new node
-        double fChanceFactor = 1.0;
-        CAddress addrFallback;
-        for (int nIter = 0; nIter < ADDRMAN_SELECT_MAX_ITERATIONS; nIter++)
+        int nId;
+        if (fTried)
         {
-            int nUBucket = GetRandInt(vvNew.size());
-            std::set<int> &vNew = vvNew[nUBucket];
-            if (vNew.size() == 0) continue;
-            int nPos = GetRandInt(vNew.size());
-            std::set<int>::iterator it = vNew.begin();
-            while (nPos--)
-                it++;
-            assert(mapInfo.count(*it) == 1);
-            CAddrInfo &info = mapInfo[*it];
-            if (!addrFallback.IsValid())
-                addrFallback = info;
-            if (GetRandInt(1<<30) < fChanceFactor*info.GetChance(nNow)*(1<<30))
-                return info;
-            fChanceFactor *= 1.2;
+            int nKBucket = tableTried.RandomBucket();
+            nId = tableTried.Get(nKBucket, GetRandInt(tableTried.Count(nKBucket)));
+        } else {
+            int nUBucket = tableNew.RandomBucket();
+            nId = tableNew.Get(nUBucket, GetRandInt(tableNew.Count(nUBucket)));
         }
-        return addrFallback;
+        const CAddrInfo &info = vInfo[nId];
+        if (!addrFallback.IsValid())
+            addrFallback = info;
+        if (GetRandInt(1<<30) < fChanceFactor*info.GetChance(nNow)*(1<<30))
+            return info;
+        fChanceFactor *= 1.2;
     }
+    return addrFallback;
 }
 
-#ifdef DEBUG_ADDRMAN
 int CAddrMan::Check_()
 {
     std::set<int> setTried;
     std::map<int, int> mapNew;
 
-    if (vRandom.size() != nTried + nNew) return -7;
+    if (vRandom.size() != (size_t)(nTried + nNew)) return -7;
 
-    for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++)
+    for (int n = 0; n < (int)vInfo.size(); n++)
     {
-        int n = (*it).first;
-        CAddrInfo &info = (*it).second;
+        CAddrInfo &info = vInfo[n];
+        if (info.nRandomPos == -1)
+            continue;
         if (info.fInTried)
         {
 
             if (!info.nLastSuccess) return -1;
             if (info.nRefCount) return -2;
+            if (tableTried.Get(info.nTriedBucket, info.nTriedPos) != n) return -16;
             setTried.insert(n);
         } else {
             if (info.nRefCount < 0 || info.nRefCount > ADDRMAN_NEW_BUCKETS_PER_ADDRESS) return -3;
             if (!info.nRefCount) return -4;
+            for (int r = 0; r < info.nRefCount; r++)
+                if (tableNew.Get(info.anNewBucket[r], info.anNewPos[r]) != n) return -17;
             mapNew[n] = info.nRefCount;
         }
-        if (mapAddr[info] != n) return -5;
-        if (info.nRandomPos<0 || info.nRandomPos>=vRandom.size() || vRandom[info.nRandomPos] != n) return -14;
+        int nFound = -1;
+        if (Find(info, &nFound) == NULL || nFound != n) return -5;
+        if (info.nRandomPos<0 || info.nRandomPos>=(int)vRandom.size() || vRandom[info.nRandomPos] != n) return -14;
         if (info.nLastTry < 0) return -6;
         if (info.nLastSuccess < 0) return -8;
     }
 
-    if (setTried.size() != nTried) return -9;
-    if (mapNew.size() != nNew) return -10;
+    if (setTried.size() != (size_t)nTried) return -9;
+    if (mapNew.size() != (size_t)nNew) return -10;
 
-    for (int n=0; n<vvTried.size(); n++)
+    for (int b = 0; b < ADDRMAN_TRIED_BUCKET_COUNT; b++)
     {
-        std::vector<int> &vTried = vvTried[n];
-        for (std::vector<int>::iterator it = vTried.begin(); it != vTried.end(); it++)
+        for (int n = 0; n < tableTried.Count(b); n++)
         {
-            if (!setTried.count(*it)) return -11;
-            setTried.erase(*it);
+            if (!setTried.count(tableTried.Get(b, n))) return -11;
+            setTried.erase(tableTried.Get(b, n));
         }
     }
 
-    for (int n=0; n<vvNew.size(); n++)
+    for (int b = 0; b < ADDRMAN_NEW_BUCKET_COUNT; b++)
     {
-        std::set<int> &vNew = vvNew[n];
-        for (std::set<int>::iterator it = vNew.begin(); it != vNew.end(); it++)
+        for (int n = 0; n < tableNew.Count(b); n++)
         {
-            if (!mapNew.count(*it)) return -12;
-            if (--mapNew[*it] == 0)
-                mapNew.erase(*it);
+            int nId = tableNew.Get(b, n);
+            if (!mapNew.count(nId)) return -12;
+            if (--mapNew[nId] == 0)
+                mapNew.erase(nId);
         }
     }
 
@@ -503,7 +597,6 @@ int CAddrMan::Check_()
 
     return 0;
 }
-#endif
 
 void CAddrMan::GetAddr_(std::vector<CAddress> &vAddr)
 {
@@ -512,18 +605,19 @@ void CAddrMan::GetAddr_(std::vector<CAddress> &vAddr)
         nNodes = ADDRMAN_GETADDR_MAX;
 
     // perform a random shuffle over the first nNodes elements of vRandom (selecting from all)
+    vAddr.reserve(nNodes);
     for (int n = 0; n<nNodes; n++)
     {
         int nRndPos = GetRandInt(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
-        vAddr.push_back(mapInfo[vRandom[n]]);
+        vAddr.push_back(vInfo[vRandom[n]]);
     }
 }
 
 void CAddrMan::Connected_(const CService &addr, int64 nTime)
 {
-    CAddrInfo *pinfo = Find(addr);
+    int nId;
+    CAddrInfo *pinfo = Find(addr, &nId);
 
     // if not found, bail out
     if (!pinfo)
@@ -538,46 +632,97 @@ void CAddrMan::Connected_(const CService &addr, int64 nTime)
     // update info
     int64 nUpdateInterval = 20 * 60;
     if (nTime - info.nTime > nUpdateInterval)
+    {
         info.nTime = nTime;
+        MarkDirty(info, nId);
+    }
 }
 
 void CAddrMan::DeleteTried_(int nId)
 {
-    assert(mapInfo.count(nId));
-    CAddrInfo &info = mapInfo[nId];
+    CAddrInfo &info = vInfo[nId];
     assert(info.fInTried);
 
-    int nKBucket = info.GetTriedBucket(nKey);
-    std::vector<int> &vTried = vvTried[nKBucket];
-    std::vector<int>::iterator it = std::find(vTried.begin(), vTried.end(), nId);
-    if (it != vTried.end())
-    {
-        vTried.erase(it);
-        nTried--;
-    }
+    int nMoved = tableTried.Remove(info.nTriedBucket, info.nTriedPos);
+    if (nMoved != -1)
+        vInfo[nMoved].nTriedPos = info.nTriedPos;
+    nTried--;
 
-    SwapRandom(info.nRandomPos, vRandom.size() - 1);
-    vRandom.pop_back();
-    mapAddr.erase(info);
-    mapInfo.erase(nId);
+    info.fInTried = false;
+    Delete(nId);
 }
 
 void CAddrMan::DeleteNew_(int nId)
 {
-    assert(mapInfo.count(nId));
-    CAddrInfo &info = mapInfo[nId];
+    CAddrInfo &info = vInfo[nId];
     assert(!info.fInTried);
 
-    for (std::vector<std::set<int> >::iterator it = vvNew.begin(); it != vvNew.end(); it++)
+    while (info.nRefCount > 0)
+        RemoveFromNew(info, info.nRefCount - 1);
+
+    Delete(nId);
+    nNew--;
+}
+
+void CAddrMan::GetChanges(std::vector<CAddrChange>& vChanges)
+{
+    LOCK(cs);
+    vChanges.reserve(vChanges.size() + vRemoved.size() + vDirty.size());
+    for (std::vector<CService>::const_iterator it = vRemoved.begin(); it != vRemoved.end(); it++)
+        vChanges.push_back(CAddrChange(CAddrInfo(CAddress(*it), CNetAddr()), false, true));
+    for (std::vector<int>::const_iterator it = vDirty.begin(); it != vDirty.end(); it++)
     {
-        if ((*it).erase(nId))
-            info.nRefCount--;
+        CAddrInfo &info = vInfo[*it];
+        // freed since, or already collected under a reused nId
+        if (info.nRandomPos == -1 || !info.fDirty)
+            continue;
+        info.fDirty = false;
+        vChanges.push_back(CAddrChange(info, info.fInTried, false));
     }
-    assert(info.nRefCount == 0);
+    vDirty.clear();
+    vRemoved.clear();
+}
 
-    SwapRandom(info.nRandomPos, vRandom.size() - 1);
-    vRandom.pop_back();
-    mapAddr.erase(info);
-    mapInfo.erase(nId);
-    nNew--;
+void CAddrMan::ApplyChanges(const std::vector<CAddrChange>& vChanges)
+{
+    LOCK(cs);
+    Check();
+    for (std::vector<CAddrChange>::const_iterator it = vChanges.begin(); it != vChanges.end(); it++)
+    {
+        const CAddrInfo &infoIn = (*it).info;
+        int nId;
+        CAddrInfo *pinfo = Find(infoIn, &nId);
+        if (pinfo && (CService)*pinfo != (CService)infoIn)
+            continue;
+
+        if ((*it).fRemoved)
+        {
+            if (pinfo && pinfo->fInTried)
+                DeleteTried_(nId);
+            else if (pinfo)
+                DeleteNew_(nId);
+            continue;
+        }
+
+        if (!pinfo)
+        {
+            if (!infoIn.IsRoutable())
+                continue;
+            pinfo = Create(infoIn, infoIn.source, &nId);
+            if (tableNew.IsFull(pinfo->nNewBucket))
+                ShrinkNew(pinfo->nNewBucket);
+            AddToNew(*pinfo, nId, pinfo->nNewBucket);
+            nNew++;
+        }
+        pinfo->nTime = infoIn.nTime;
+        pinfo->nServices = infoIn.nServices;
+        pinfo->nLastSuccess = infoIn.nLastSuccess;
+        pinfo->nAttempts = infoIn.nAttempts;
+
+        // entries evicted from tried are left there until the next compaction
+        if ((*it).fTried && !pinfo->fInTried && pinfo->nLastSuccess && pinfo->nRefCount > 0)
+            MakeTried(*pinfo, nId, pinfo->anNewBucket[0]);
+    }
+    ClearChanges_();
+    Check();
 }
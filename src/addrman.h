@@ -16,6 +16,51 @@
 #include <openssl/rand.h>
 
 
+// total number of buckets for tried addresses
+#define ADDRMAN_TRIED_BUCKET_COUNT 64
+
+// maximum allowed number of entries in buckets for tried addresses
+#define ADDRMAN_TRIED_BUCKET_SIZE 64
+
+// total number of buckets for new addresses
+#define ADDRMAN_NEW_BUCKET_COUNT 256
+
+// maximum allowed number of entries in buckets for new addresses
+#define ADDRMAN_NEW_BUCKET_SIZE 64
+
+// over how many buckets entries with tried addresses from a single group (/16 for IPv4) are spread
+#define ADDRMAN_TRIED_BUCKETS_PER_GROUP 4
+
+// over how many buckets entries with new addresses originating from a single group are spread
+#define ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP 32
+
+// in how many buckets for entries with new addresses a single address may occur
+#define ADDRMAN_NEW_BUCKETS_PER_ADDRESS 4
+
+// how many entries in a bucket with tried addresses are inspected, when selecting one to replace
+#define ADDRMAN_TRIED_ENTRIES_INSPECT_ON_EVICT 4
+
+// how old addresses can maximally be
+#define ADDRMAN_HORIZON_DAYS 30
+
+// after how many failed attempts we give up on a new node
+#define ADDRMAN_RETRIES 3
+
+// how many successive failures are allowed ...
+#define ADDRMAN_MAX_FAILURES 10
+
+// ... in at least this many days
+#define ADDRMAN_MIN_FAIL_DAYS 7
+
+// the maximum percentage of nodes to return in a getaddr call
+#define ADDRMAN_GETADDR_MAX_PCT 23
+
+// the maximum number of nodes to return in a getaddr call
+#define ADDRMAN_GETADDR_MAX 2500
+
+// peers.dat format written by this version
+#define ADDRMAN_FORMAT_VERSION 1
+
 /** Extended statistics about a CAddress */
 class CAddrInfo : public CAddress
 {
@@ -38,9 +83,22 @@ private:
     // in tried set? (memory only)
     bool fInTried;
 
-    // position in vRandom
+    // position in vRandom, -1 for an unused table slot (memory only)
     int nRandomPos;
 
+    // the tried bucket, and the new bucket for its own source, hashed once (memory only)
+    int nTriedBucket;
+    int nNewBucket;
+
+    // where the entry sits: its slot in the tried bucket, or the first
+    // nRefCount new buckets and slots (memory only)
+    int nTriedPos;
+    short anNewBucket[ADDRMAN_NEW_BUCKETS_PER_ADDRESS];
+    short anNewPos[ADDRMAN_NEW_BUCKETS_PER_ADDRESS];
+
+    // changed since the last journal flush? (memory only)
+    bool fDirty;
+
     friend class CAddrMan;
 
 public:
@@ -61,6 +119,10 @@ public:
         nRefCount = 0;
         fInTried = false;
         nRandomPos = -1;
+        nTriedBucket = -1;
+        nNewBucket = -1;
+        nTriedPos = -1;
+        fDirty = false;
     }
 
     CAddrInfo(const CAddress &addrIn, const CNetAddr &addrSource) : CAddress(addrIn), source(addrSource)
@@ -74,15 +136,15 @@ public:
     }
 
     // Calculate in which "tried" bucket this entry belongs
-    int GetTriedBucket(const std::vector<unsigned char> &nKey) const;
+    int GetTriedBucket(uint64 nKey0, uint64 nKey1) const;
 
     // Calculate in which "new" bucket this entry belongs, given a certain source
-    int GetNewBucket(const std::vector<unsigned char> &nKey, const CNetAddr& src) const;
+    int GetNewBucket(uint64 nKey0, uint64 nKey1, const CNetAddr& src) const;
 
     // Calculate in which "new" bucket this entry belongs, using its default source
-    int GetNewBucket(const std::vector<unsigned char> &nKey) const
+    int GetNewBucket(uint64 nKey0, uint64 nKey1) const
     {
-        return GetNewBucket(nKey, source);
+        return GetNewBucket(nKey0, nKey1, source);
     }
 
     // Determine whether the statistics about this entry are bad enough so that it can just be deleted
@@ -93,6 +155,94 @@ public:
 
 };
 
+/** A change to one address, as kept in the peers.dat journal (peers.log).
+ * Holds the whole entry as it is now, so replaying is idempotent. */
+class CAddrChange
+{
+public:
+    CAddrInfo info;
+    bool fTried;
+    // the address was removed; info holds only the address
+    bool fRemoved;
+
+    CAddrChange() : fTried(false), fRemoved(false) {}
+    CAddrChange(const CAddrInfo& infoIn, bool fTriedIn, bool fRemovedIn) : info(infoIn), fTried(fTriedIn), fRemoved(fRemovedIn) {}
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(info);
+        READWRITE(fTried);
+        READWRITE(fRemoved);
+    )
+};
+
+/** Fixed-size array of buckets of entry ids.
+ *
+ * Each bucket is kept packed at the front, and the nonempty buckets are kept
+ * in a list of their own, so a random entry of a random nonempty bucket is
+ * found in constant time. Removing an entry moves the last one of its bucket
+ * into its slot; the caller updates that entry's cached position.
+ */
+template<int BUCKET_COUNT, int BUCKET_SIZE>
+class CAddrBucketTable
+{
+private:
+    int vEntry[BUCKET_COUNT][BUCKET_SIZE];
+    int vCount[BUCKET_COUNT];
+    int vNonEmpty[BUCKET_COUNT];
+    int vNonEmptyPos[BUCKET_COUNT];
+    int nNonEmpty;
+
+public:
+    CAddrBucketTable()
+    {
+        Clear();
+    }
+
+    void Clear()
+    {
+        for (int n = 0; n < BUCKET_COUNT; n++)
+            vCount[n] = 0;
+        nNonEmpty = 0;
+    }
+
+    int Count(int nBucket) const { return vCount[nBucket]; }
+    bool IsFull(int nBucket) const { return vCount[nBucket] == BUCKET_SIZE; }
+    bool IsEmpty() const { return nNonEmpty == 0; }
+    int Get(int nBucket, int nPos) const { return vEntry[nBucket][nPos]; }
+    void Set(int nBucket, int nPos, int nId) { vEntry[nBucket][nPos] = nId; }
+
+    // A random nonempty bucket; the table must not be empty
+    int RandomBucket() const { return vNonEmpty[GetRandInt(nNonEmpty)]; }
+
+    // Append nId to a bucket that isn't full, returning its slot
+    int Insert(int nBucket, int nId)
+    {
+        if (vCount[nBucket] == 0)
+        {
+            vNonEmptyPos[nBucket] = nNonEmpty;
+            vNonEmpty[nNonEmpty++] = nBucket;
+        }
+        vEntry[nBucket][vCount[nBucket]] = nId;
+        return vCount[nBucket]++;
+    }
+
+    // Empty a slot, returning the id moved into it, or -1 if none was
+    int Remove(int nBucket, int nPos)
+    {
+        int nLast = --vCount[nBucket];
+        if (nLast == 0)
+        {
+            int nMovedBucket = vNonEmpty[--nNonEmpty];
+            vNonEmpty[vNonEmptyPos[nBucket]] = nMovedBucket;
+            vNonEmptyPos[nMovedBucket] = vNonEmptyPos[nBucket];
+        }
+        if (nPos == nLast)
+            return -1;
+        vEntry[nBucket][nPos] = vEntry[nBucket][nLast];
+        return vEntry[nBucket][nPos];
+    }
+};
+
 // Stochastic address manager
 //
 // Design goals:
@@ -114,52 +264,17 @@ public:
 //      * The actual bucket is chosen from one of these, based on the full address.
 //      * When adding a new good address to a full bucket, a randomly chosen entry (with a bias favoring less recently
 //        tried ones) is evicted from it, back to the "new" buckets.
-//    * Bucket selection is based on cryptographic hashing, using a randomly-generated 256-bit key, which should not
+//    * Bucket selection is based on keyed hashing (SipHash), using a randomly-generated 256-bit key, which should not
 //      be observable by adversaries.
 //    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN will introduce frequent (and expensive)
 //      consistency checks for the entire data structure.
-
-// total number of buckets for tried addresses
-#define ADDRMAN_TRIED_BUCKET_COUNT 64
-
-// maximum allowed number of entries in buckets for tried addresses
-#define ADDRMAN_TRIED_BUCKET_SIZE 64
-
-// total number of buckets for new addresses
-#define ADDRMAN_NEW_BUCKET_COUNT 256
-
-// maximum allowed number of entries in buckets for new addresses
-#define ADDRMAN_NEW_BUCKET_SIZE 64
-
-// over how many buckets entries with tried addresses from a single group (/16 for IPv4) are spread
-#define ADDRMAN_TRIED_BUCKETS_PER_GROUP 4
-
-// over how many buckets entries with new addresses originating from a single group are spread
-#define ADDRMAN_NEW_BUCKETS_PER_SOURCE_GROUP 32
-
-// in how many buckets for entries with new addresses a single address may occur
-#define ADDRMAN_NEW_BUCKETS_PER_ADDRESS 4
-
-// how many entries in a bucket with tried addresses are inspected, when selecting one to replace
-#define ADDRMAN_TRIED_ENTRIES_INSPECT_ON_EVICT 4
-
-// how old addresses can maximally be
-#define ADDRMAN_HORIZON_DAYS 30
-
-// after how many failed attempts we give up on a new node
-#define ADDRMAN_RETRIES 3
-
-// how many successive failures are allowed ...
-#define ADDRMAN_MAX_FAILURES 10
-
-// ... in at least this many days
-#define ADDRMAN_MIN_FAIL_DAYS 7
-
-// the maximum percentage of nodes to return in a getaddr call
-#define ADDRMAN_GETADDR_MAX_PCT 23
-
-// the maximum number of nodes to return in a getaddr call
-#define ADDRMAN_GETADDR_MAX 2500
+//
+// Storage:
+//  * Entries live in one vector indexed by nId; ids of deleted entries are reused.
+//  * Addresses are found through an open addressing table of ids, keyed on a SipHash of the address.
+//  * Buckets are fixed-size arrays (CAddrBucketTable), and every entry remembers which buckets and slots it is in,
+//    so moving or deleting it never searches the tables.
+//  * Selection picks a random nonempty bucket and a random slot in it directly.
 
 /** Stochastical (IP) address manager */
 class CAddrMan
@@ -171,14 +286,18 @@ private:
     // secret key to randomize bucket select with
     std::vector<unsigned char> nKey;
 
-    // last used nId
-    int nIdCount;
+    // nKey as SipHash keys
+    uint64 nKey0;
+    uint64 nKey1;
 
-    // table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo;
+    // information about all nIds, indexed by nId
+    std::vector<CAddrInfo> vInfo;
 
-    // find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr;
+    // unused nIds in vInfo
+    std::vector<int> vFreeIds;
+
+    // open addressing table (linear probing) of nIds by network address, -1 for empty; power of two size
+    std::vector<int> vAddrIndex;
 
     // randomly-ordered vector of all nIds
     std::vector<int> vRandom;
@@ -186,17 +305,50 @@ private:
     // number of "tried" entries
     int nTried;
 
-    // list of "tried" buckets
-    std::vector<std::vector<int> > vvTried;
+    // "tried" buckets
+    CAddrBucketTable<ADDRMAN_TRIED_BUCKET_COUNT, ADDRMAN_TRIED_BUCKET_SIZE> tableTried;
 
     // number of (unique) "new" entries
     int nNew;
 
-    // list of "new" buckets
-    std::vector<std::set<int> > vvNew;
+    // "new" buckets
+    CAddrBucketTable<ADDRMAN_NEW_BUCKET_COUNT, ADDRMAN_NEW_BUCKET_SIZE> tableNew;
+
+    // nIds changed, and addresses removed, since the last GetChanges
+    std::vector<int> vDirty;
+    std::vector<CService> vRemoved;
 
 protected:
 
+    // Derive nKey0/nKey1 from nKey.
+    void SetHashKeys();
+
+    // Empty all tables, keeping the key.
+    void Clear_();
+
+    // Note that an entry changed, for the journal.
+    void MarkDirty(CAddrInfo& info, int nId)
+    {
+        if (!info.fDirty)
+        {
+            info.fDirty = true;
+            vDirty.push_back(nId);
+        }
+    }
+
+    // Forget the changes not yet collected.
+    void ClearChanges_();
+
+    // Slot in vAddrIndex where addr is, or the empty slot where it would go.
+    size_t IndexSlot(const CNetAddr& addr) const;
+
+    // Rebuild vAddrIndex with nSlots slots.
+    void IndexResize(size_t nSlots);
+
+    // Add an entry to / remove an entry from vAddrIndex.
+    void IndexInsert(int nId);
+    void IndexErase(int nId);
+
     // Find an entry.
     CAddrInfo* Find(const CNetAddr& addr, int *pnId = NULL);
 
@@ -204,9 +356,21 @@ protected:
     // nTime and nServices of found node is updated, if necessary.
     CAddrInfo* Create(const CAddress &addr, const CNetAddr &addrSource, int *pnId = NULL);
 
+    // Free an entry that is in no bucket.
+    void Delete(int nId);
+
     // Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2);
 
+    // Put an entry in a "new" bucket that isn't full and doesn't have it yet.
+    void AddToNew(CAddrInfo& info, int nId, int nUBucket);
+
+    // Take an entry out of the nRef'th "new" bucket it is in.
+    void RemoveFromNew(CAddrInfo& info, int nRef);
+
+    // Which of an entry's "new" references is to the given bucket, or -1.
+    int FindNewRef(const CAddrInfo& info, int nUBucket) const;
+
     // Return position in given bucket to replace.
     int SelectTried(int nKBucket);
 
@@ -216,7 +380,7 @@ protected:
     int ShrinkNew(int nUBucket);
 
     // Move an entry from the "new" table(s) to the "tried" table
-    // @pre vvUnkown[nOrigin].count(nId) != 0
+    // @pre info is in "new" bucket nOrigin
     void MakeTried(CAddrInfo& info, int nId, int nOrigin);
 
     // Mark an entry "good", possibly moving it from "new" to "tried".
@@ -232,10 +396,8 @@ protected:
     // nUnkBias determines how much to favor new addresses over tried ones (min=0, max=100)
     CAddress Select_(int nUnkBias);
 
-#ifdef DEBUG_ADDRMAN
     // Perform consistency check. Returns an error code or zero.
     int Check_();
-#endif
 
     // Select several addresses at once.
     void GetAddr_(std::vector<CAddress> &vAddr);
@@ -249,34 +411,60 @@ protected:
     // Remove a new entry by nId from all buckets.
     void DeleteNew_(int nId);
 
+    // Predicate for PruneTerrible.
+    struct CIsTerrible
+    {
+        int64 nNow;
+        CIsTerrible(int64 nNowIn) : nNow(nNowIn) {}
+        bool operator()(const CAddrInfo& info) const { return info.IsTerrible(nNow); }
+    };
+
+    // Remove every entry for which fRemove(info) is true.
+    template<typename F>
+    int RemoveIf_(F fRemove)
+    {
+        std::vector<int> vToRemove;
+        for (std::vector<int>::const_iterator it = vRandom.begin(); it != vRandom.end(); it++)
+            if (fRemove(vInfo[*it]))
+                vToRemove.push_back(*it);
+        for (std::vector<int>::const_iterator it = vToRemove.begin(); it != vToRemove.end(); it++)
+        {
+            if (vInfo[*it].fInTried)
+                DeleteTried_(*it);
+            else
+                DeleteNew_(*it);
+        }
+        return vToRemove.size();
+    }
+
 public:
 
     IMPLEMENT_SERIALIZE
     (({
         // serialized format:
-        // * version byte (currently 0)
+        // * format byte (ADDRMAN_FORMAT_VERSION)
         // * nKey
         // * nNew
         // * nTried
         // * number of "new" buckets
-        // * all nNew addrinfos in vvNew
-        // * all nTried addrinfos in vvTried
+        // * all nNew addrinfos in the new buckets
+        // * all nTried addrinfos in the tried buckets
         // * for each bucket:
         //   * number of elements
         //   * for each element: index
         //
-        // Notice that vvTried, mapAddr and vVector are never encoded explicitly;
+        // Notice that the tried buckets and the address index are never encoded explicitly;
         // they are instead reconstructed from the other information.
         //
-        // vvNew is serialized, but only used if ADDRMAN_UNKOWN_BUCKET_COUNT didn't change,
-        // otherwise it is reconstructed as well.
+        // The new buckets are serialized, but only used if ADDRMAN_NEW_BUCKET_COUNT and the
+        // format (which decides the bucket hash) didn't change, otherwise they are rebuilt.
         //
         // This format is more complex, but significantly smaller (at most 1.5 MiB), and supports
         // changes to the ADDRMAN_ parameters without breaking the on-disk structure.
         {
             LOCK(cs);
-            unsigned char nVersion = 0;
-            READWRITE(nVersion);
+            unsigned char nFormat = ADDRMAN_FORMAT_VERSION;
+            READWRITE(nFormat);
             READWRITE(nKey);
             READWRITE(nNew);
             READWRITE(nTried);
@@ -286,115 +474,170 @@ public:
             {
                 int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT;
                 READWRITE(nUBuckets);
-                std::map<int, int> mapUnkIds;
+                // new entries are numbered in the file in the order they are written
+                std::vector<int> vFileIndex(vInfo.size(), -1);
                 int nIds = 0;
-                for (std::map<int, CAddrInfo>::iterator it = am->mapInfo.begin(); it != am->mapInfo.end(); it++)
+                for (std::vector<int>::const_iterator it = vRandom.begin(); it != vRandom.end(); it++)
                 {
-                    if (nIds == nNew) break; // this means nNew was wrong, oh ow
-                    mapUnkIds[(*it).first] = nIds;
-                    CAddrInfo &info = (*it).second;
-                    if (info.nRefCount)
+                    CAddrInfo &info = am->vInfo[*it];
+                    if (!info.fInTried)
                     {
                         READWRITE(info);
-                        nIds++;
+                        vFileIndex[*it] = nIds++;
                     }
                 }
-                nIds = 0;
-                for (std::map<int, CAddrInfo>::iterator it = am->mapInfo.begin(); it != am->mapInfo.end(); it++)
+                for (std::vector<int>::const_iterator it = vRandom.begin(); it != vRandom.end(); it++)
                 {
-                    if (nIds == nTried) break; // this means nTried was wrong, oh ow
-                    CAddrInfo &info = (*it).second;
+                    CAddrInfo &info = am->vInfo[*it];
                     if (info.fInTried)
-                    {
                         READWRITE(info);
-                        nIds++;
-                    }
                 }
-                for (std::vector<std::set<int> >::iterator it = am->vvNew.begin(); it != am->vvNew.end(); it++)
+                for (int b = 0; b < ADDRMAN_NEW_BUCKET_COUNT; b++)
                 {
-                    const std::set<int> &vNew = (*it);
-                    int nSize = vNew.size();
+                    int nSize = tableNew.Count(b);
                     READWRITE(nSize);
-                    for (std::set<int>::iterator it2 = vNew.begin(); it2 != vNew.end(); it2++)
+                    for (int n = 0; n < nSize; n++)
                     {
-                        int nIndex = mapUnkIds[*it2];
+                        int nIndex = vFileIndex[tableNew.Get(b, n)];
                         READWRITE(nIndex);
                     }
                 }
-            } else {
+            } else if (fRead) {
                 int nUBuckets = 0;
                 READWRITE(nUBuckets);
-                am->nIdCount = 0;
-                am->mapInfo.clear();
-                am->mapAddr.clear();
-                am->vRandom.clear();
-                am->vvTried = std::vector<std::vector<int> >(ADDRMAN_TRIED_BUCKET_COUNT, std::vector<int>(0));
-                am->vvNew = std::vector<std::set<int> >(ADDRMAN_NEW_BUCKET_COUNT, std::set<int>());
-                for (int n = 0; n < am->nNew; n++)
+                int nNewIn = am->nNew;
+                int nTriedIn = am->nTried;
+                am->Clear_();
+                am->SetHashKeys();
+
+                // file index of each new entry -> nId, -1 for duplicates
+                std::vector<int> vFileId;
+                vFileId.reserve(nNewIn);
+                for (int n = 0; n < nNewIn; n++)
                 {
-                    CAddrInfo &info = am->mapInfo[n];
+                    CAddrInfo info;
                     READWRITE(info);
-                    am->mapAddr[info] = n;
-                    info.nRandomPos = vRandom.size();
-                    am->vRandom.push_back(n);
-                    if (nUBuckets != ADDRMAN_NEW_BUCKET_COUNT)
+                    if (am->Find(info))
                     {
-                        am->vvNew[info.GetNewBucket(am->nKey)].insert(n);
-                        info.nRefCount++;
+                        vFileId.push_back(-1);
+                        continue;
                     }
+                    int nId;
+                    CAddrInfo* pinfo = am->Create(info, info.source, &nId);
+                    pinfo->nLastSuccess = info.nLastSuccess;
+                    pinfo->nAttempts = info.nAttempts;
+                    vFileId.push_back(nId);
+                    am->nNew++;
                 }
-                am->nIdCount = am->nNew;
-                int nLost = 0;
-                for (int n = 0; n < am->nTried; n++)
+                for (int n = 0; n < nTriedIn; n++)
                 {
                     CAddrInfo info;
                     READWRITE(info);
-                    std::vector<int> &vTried = am->vvTried[info.GetTriedBucket(am->nKey)];
-                    if (vTried.size() < ADDRMAN_TRIED_BUCKET_SIZE)
-                    {
-                        info.nRandomPos = vRandom.size();
-                        info.fInTried = true;
-                        am->vRandom.push_back(am->nIdCount);
-                        am->mapInfo[am->nIdCount] = info;
-                        am->mapAddr[info] = am->nIdCount;
-                        vTried.push_back(am->nIdCount);
-                        am->nIdCount++;
-                    } else {
-                        nLost++;
-                    }
+                    if (am->Find(info) || am->tableTried.IsFull(info.GetTriedBucket(am->nKey0, am->nKey1)))
+                        continue;
+                    int nId;
+                    CAddrInfo* pinfo = am->Create(info, info.source, &nId);
+                    pinfo->nLastSuccess = info.nLastSuccess;
+                    pinfo->nAttempts = info.nAttempts;
+                    pinfo->fInTried = true;
+                    pinfo->nTriedPos = am->tableTried.Insert(pinfo->nTriedBucket, nId);
+                    am->nTried++;
                 }
-                am->nTried -= nLost;
+                bool fBucketsValid = (nFormat == ADDRMAN_FORMAT_VERSION && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT);
                 for (int b = 0; b < nUBuckets; b++)
                 {
-                    std::set<int> &vNew = am->vvNew[b];
                     int nSize = 0;
                     READWRITE(nSize);
                     for (int n = 0; n < nSize; n++)
                     {
                         int nIndex = 0;
                         READWRITE(nIndex);
-                        CAddrInfo &info = am->mapInfo[nIndex];
-                        if (nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS)
-                        {
-                            info.nRefCount++;
-                            vNew.insert(nIndex);
-                        }
+                        if (!fBucketsValid || nIndex < 0 || nIndex >= nNewIn || vFileId[nIndex] < 0)
+                            continue;
+                        int nId = vFileId[nIndex];
+                        CAddrInfo &info = am->vInfo[nId];
+                        if (info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS && !am->tableNew.IsFull(b) && am->FindNewRef(info, b) < 0)
+                            am->AddToNew(info, nId, b);
                     }
                 }
+                // put new entries the file didn't place in their own bucket, if there is room
+                for (std::vector<int>::const_iterator it = vFileId.begin(); it != vFileId.end(); it++)
+                {
+                    if (*it < 0)
+                        continue;
+                    CAddrInfo &info = am->vInfo[*it];
+                    if (info.nRefCount > 0)
+                        continue;
+                    if (am->tableNew.IsFull(info.nNewBucket))
+                    {
+                        am->Delete(*it);
+                        am->nNew--;
+                    }
+                    else
+                        am->AddToNew(info, *it, info.nNewBucket);
+                }
+                am->ClearChanges_();
             }
         }
     });)
 
-    CAddrMan() : vRandom(0), vvTried(ADDRMAN_TRIED_BUCKET_COUNT, std::vector<int>(0)), vvNew(ADDRMAN_NEW_BUCKET_COUNT, std::set<int>())
+    CAddrMan() : vRandom(0)
     {
          nKey.resize(32);
          RAND_bytes(&nKey[0], 32);
+         SetHashKeys();
 
-         nIdCount = 0;
          nTried = 0;
          nNew = 0;
     }
 
+    // Exchange all addresses and the key with another address manager.
+    void Swap(CAddrMan& other)
+    {
+        LOCK2(cs, other.cs);
+        nKey.swap(other.nKey);
+        std::swap(nKey0, other.nKey0);
+        std::swap(nKey1, other.nKey1);
+        vInfo.swap(other.vInfo);
+        vFreeIds.swap(other.vFreeIds);
+        vAddrIndex.swap(other.vAddrIndex);
+        vRandom.swap(other.vRandom);
+        std::swap(nTried, other.nTried);
+        std::swap(tableTried, other.tableTried);
+        std::swap(nNew, other.nNew);
+        std::swap(tableNew, other.tableNew);
+        vDirty.swap(other.vDirty);
+        vRemoved.swap(other.vRemoved);
+    }
+
+    // Copy all addresses into addrSnapshot, so it can be written out without
+    // holding this one's lock. The changes not yet collected are dropped:
+    // the snapshot has them.
+    void TakeSnapshot(CAddrMan& addrSnapshot)
+    {
+        LOCK2(cs, addrSnapshot.cs);
+        ClearChanges_();
+        addrSnapshot.nKey = nKey;
+        addrSnapshot.nKey0 = nKey0;
+        addrSnapshot.nKey1 = nKey1;
+        addrSnapshot.vInfo = vInfo;
+        addrSnapshot.vFreeIds = vFreeIds;
+        addrSnapshot.vAddrIndex = vAddrIndex;
+        addrSnapshot.vRandom = vRandom;
+        addrSnapshot.nTried = nTried;
+        addrSnapshot.tableTried = tableTried;
+        addrSnapshot.nNew = nNew;
+        addrSnapshot.tableNew = tableNew;
+        addrSnapshot.ClearChanges_();
+    }
+
+    // Collect the entries changed and the addresses removed since the last
+    // call (removals first), for appending to the journal.
+    void GetChanges(std::vector<CAddrChange>& vChanges);
+
+    // Replay changes read back from the journal.
+    void ApplyChanges(const std::vector<CAddrChange>& vChanges);
+
     // Return the number of (unique) addresses in all tables.
     int size()
     {
@@ -414,6 +657,14 @@ public:
 #endif
     }
 
+    // Consistency check whatever DEBUG_ADDRMAN is, for the tests. Returns
+    // an error code or zero.
+    int CheckConsistency()
+    {
+        LOCK(cs);
+        return Check_();
+    }
+
     // Add a single address.
     bool Add(const CAddress &addr, const CNetAddr& source, int64 nTimePenalty = 0)
     {
@@ -515,24 +766,7 @@ public:
         {
             LOCK(cs);
             Check();
-            std::vector<int> vToRemove;
-            for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++)
-            {
-                if (fIsUnsupported(it->second))
-                    vToRemove.push_back(it->first);
-            }
-            for (std::vector<int>::iterator it = vToRemove.begin(); it != vToRemove.end(); it++)
-            {
-                int nId = *it;
-                if (!mapInfo.count(nId))
-                    continue;
-                CAddrInfo &info = mapInfo[nId];
-                if (info.fInTried)
-                    DeleteTried_(nId);
-                else
-                    DeleteNew_(nId);
-                nRemoved++;
-            }
+            nRemoved = RemoveIf_(fIsUnsupported);
             Check();
         }
         return nRemoved;
@@ -546,25 +780,7 @@ public:
         {
             LOCK(cs);
             Check();
-            int64 nNow = GetAdjustedTime();
-            std::vector<int> vToRemove;
-            for (std::map<int, CAddrInfo>::iterator it = mapInfo.begin(); it != mapInfo.end(); it++)
-            {
-                if (it->second.IsTerrible(nNow))
-                    vToRemove.push_back(it->first);
-            }
-            for (std::vector<int>::iterator it = vToRemove.begin(); it != vToRemove.end(); it++)
-            {
-                int nId = *it;
-                if (!mapInfo.count(nId))
-                    continue;
-                CAddrInfo &info = mapInfo[nId];
-                if (info.fInTried)
-                    DeleteTried_(nId);
-                else
-                    DeleteNew_(nId);
-                nRemoved++;
-            }
+            nRemoved = RemoveIf_(CIsTerrible(GetAdjustedTime()));
             Check();
         }
         return nRemoved;
@@ -254,6 +254,46 @@ struct zero_after_free_allocator : public std::allocator<T>
     }
 };
 
+/** Network buffer pool, see util.cpp */
+void* NetBufferAllocate(std::size_t nSize);
+void NetBufferDeallocate(void* p, std::size_t nSize);
+
+//
+// Allocator for network buffers (CNetDataStream). Memory comes from a pool
+// of power of two sized chunks and is not wiped on free, as nothing secret
+// goes through the network buffers.
+//
+template<typename T>
+struct netbuffer_allocator : public std::allocator<T>
+{
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type  difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    netbuffer_allocator() throw() {}
+    netbuffer_allocator(const netbuffer_allocator& a) throw() : base(a) {}
+    template <typename U>
+    netbuffer_allocator(const netbuffer_allocator<U>& a) throw() : base(a) {}
+    ~netbuffer_allocator() throw() {}
+    template<typename _Other> struct rebind
+    { typedef netbuffer_allocator<_Other> other; };
+
+    T* allocate(std::size_t n, const void *hint = 0)
+    {
+        return static_cast<T*>(NetBufferAllocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (p != NULL)
+            NetBufferDeallocate(p, sizeof(T) * n);
+    }
+};
+
 // This is exactly like std::string, but with a custom allocator.
 typedef std::basic_string<char, std::char_traits<char>, secure_allocator<char> > SecureString;
 
@@ -0,0 +1,403 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2014 The Bitcoin developers
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_ARITH_UINT256_H
+#define curecoin_ARITH_UINT256_H
+
+#include "uint256.h"
+
+#include <stdexcept>
+#include <string>
+#include <string.h>
+
+class arith_uint_error : public std::runtime_error
+{
+public:
+    explicit arith_uint_error(const std::string& str) : std::runtime_error(str) {}
+};
+
+/** Fixed width unsigned integer for target and chain trust arithmetic.
+ * Unlike uint256, which is a hash, it has multiplication, division and the
+ * compact nBits encoding, so the consensus checks don't need a heap
+ * allocated CBigNum for every comparison.
+ */
+template<unsigned int BITS>
+class arith_uint
+{
+public:
+    enum { WIDTH=BITS/32 };
+    unsigned int pn[WIDTH];
+
+    arith_uint()
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+    }
+
+    arith_uint(uint64 b)
+    {
+        pn[0] = (unsigned int)b;
+        pn[1] = (unsigned int)(b >> 32);
+        for (int i = 2; i < WIDTH; i++)
+            pn[i] = 0;
+    }
+
+    // Zero extends or truncates
+    template<unsigned int BITS2>
+    explicit arith_uint(const arith_uint<BITS2>& b)
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = i < (int)arith_uint<BITS2>::WIDTH ? b.pn[i] : 0;
+    }
+
+    bool operator!() const
+    {
+        for (int i = 0; i < WIDTH; i++)
+            if (pn[i] != 0)
+                return false;
+        return true;
+    }
+
+    const arith_uint operator~() const
+    {
+        arith_uint ret;
+        for (int i = 0; i < WIDTH; i++)
+            ret.pn[i] = ~pn[i];
+        return ret;
+    }
+
+    const arith_uint operator-() const
+    {
+        arith_uint ret = ~*this;
+        ++ret;
+        return ret;
+    }
+
+    arith_uint& operator^=(const arith_uint& b)
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] ^= b.pn[i];
+        return *this;
+    }
+
+    arith_uint& operator&=(const arith_uint& b)
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] &= b.pn[i];
+        return *this;
+    }
+
+    arith_uint& operator|=(const arith_uint& b)
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] |= b.pn[i];
+        return *this;
+    }
+
+    arith_uint& operator<<=(unsigned int shift)
+    {
+        arith_uint a(*this);
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+        int k = shift / 32;
+        shift = shift % 32;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            if (i+k+1 < WIDTH && shift != 0)
+                pn[i+k+1] |= (a.pn[i] >> (32-shift));
+            if (i+k < WIDTH)
+                pn[i+k] |= (a.pn[i] << shift);
+        }
+        return *this;
+    }
+
+    arith_uint& operator>>=(unsigned int shift)
+    {
+        arith_uint a(*this);
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+        int k = shift / 32;
+        shift = shift % 32;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            if (i-k-1 >= 0 && shift != 0)
+                pn[i-k-1] |= (a.pn[i] << (32-shift));
+            if (i-k >= 0)
+                pn[i-k] |= (a.pn[i] >> shift);
+        }
+        return *this;
+    }
+
+    arith_uint& operator+=(const arith_uint& b)
+    {
+        uint64 carry = 0;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            uint64 n = carry + pn[i] + b.pn[i];
+            pn[i] = n & 0xffffffff;
+            carry = n >> 32;
+        }
+        return *this;
+    }
+
+    arith_uint& operator-=(const arith_uint& b)
+    {
+        *this += -b;
+        return *this;
+    }
+
+    arith_uint& operator*=(unsigned int b32)
+    {
+        uint64 carry = 0;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            uint64 n = carry + (uint64)b32 * pn[i];
+            pn[i] = n & 0xffffffff;
+            carry = n >> 32;
+        }
+        return *this;
+    }
+
+    arith_uint& operator*=(const arith_uint& b)
+    {
+        arith_uint a;
+        for (int j = 0; j < WIDTH; j++)
+        {
+            uint64 carry = 0;
+            for (int i = 0; i + j < WIDTH; i++)
+            {
+                uint64 n = carry + a.pn[i + j] + (uint64)pn[j] * b.pn[i];
+                a.pn[i + j] = n & 0xffffffff;
+                carry = n >> 32;
+            }
+        }
+        *this = a;
+        return *this;
+    }
+
+    arith_uint& operator/=(const arith_uint& b)
+    {
+        arith_uint div = b;     // make a copy, so we can shift
+        arith_uint num = *this; // make a copy, so we can subtract
+        *this = 0;
+        int num_bits = num.bits();
+        int div_bits = div.bits();
+        if (div_bits == 0)
+            throw arith_uint_error("Division by zero");
+        if (div_bits > num_bits) // the result is certainly 0
+            return *this;
+        int shift = num_bits - div_bits;
+        div <<= shift; // shift so that div and num align
+        while (shift >= 0)
+        {
+            if (num >= div)
+            {
+                num -= div;
+                pn[shift / 32] |= (1 << (shift & 31)); // set a bit of the result
+            }
+            div >>= 1; // shift back
+            shift--;
+        }
+        // num now contains the remainder of the division
+        return *this;
+    }
+
+    arith_uint& operator++()
+    {
+        // prefix operator
+        int i = 0;
+        while (i < WIDTH && ++pn[i] == 0)
+            i++;
+        return *this;
+    }
+
+    const arith_uint operator++(int)
+    {
+        // postfix operator
+        const arith_uint ret = *this;
+        ++(*this);
+        return ret;
+    }
+
+    arith_uint& operator--()
+    {
+        // prefix operator
+        int i = 0;
+        while (i < WIDTH && --pn[i] == (unsigned int)-1)
+            i++;
+        return *this;
+    }
+
+    const arith_uint operator--(int)
+    {
+        // postfix operator
+        const arith_uint ret = *this;
+        --(*this);
+        return ret;
+    }
+
+    int CompareTo(const arith_uint& b) const
+    {
+        for (int i = WIDTH-1; i >= 0; i--)
+        {
+            if (pn[i] < b.pn[i])
+                return -1;
+            if (pn[i] > b.pn[i])
+                return 1;
+        }
+        return 0;
+    }
+
+    bool EqualTo(uint64 b) const
+    {
+        for (int i = WIDTH-1; i >= 2; i--)
+            if (pn[i])
+                return false;
+        if (pn[1] != (b >> 32))
+            return false;
+        if (pn[0] != (b & 0xfffffffful))
+            return false;
+        return true;
+    }
+
+    friend inline const arith_uint operator+(const arith_uint& a, const arith_uint& b) { return arith_uint(a) += b; }
+    friend inline const arith_uint operator-(const arith_uint& a, const arith_uint& b) { return arith_uint(a) -= b; }
+    friend inline const arith_uint operator*(const arith_uint& a, const arith_uint& b) { return arith_uint(a) *= b; }
+    friend inline const arith_uint operator/(const arith_uint& a, const arith_uint& b) { return arith_uint(a) /= b; }
+    friend inline const arith_uint operator|(const arith_uint& a, const arith_uint& b) { return arith_uint(a) |= b; }
+    friend inline const arith_uint operator&(const arith_uint& a, const arith_uint& b) { return arith_uint(a) &= b; }
+    friend inline const arith_uint operator^(const arith_uint& a, const arith_uint& b) { return arith_uint(a) ^= b; }
+    friend inline const arith_uint operator>>(const arith_uint& a, int shift) { return arith_uint(a) >>= shift; }
+    friend inline const arith_uint operator<<(const arith_uint& a, int shift) { return arith_uint(a) <<= shift; }
+    friend inline const arith_uint operator*(const arith_uint& a, unsigned int b) { return arith_uint(a) *= b; }
+    friend inline bool operator==(const arith_uint& a, const arith_uint& b) { return memcmp(a.pn, b.pn, sizeof(a.pn)) == 0; }
+    friend inline bool operator!=(const arith_uint& a, const arith_uint& b) { return memcmp(a.pn, b.pn, sizeof(a.pn)) != 0; }
+    friend inline bool operator>(const arith_uint& a, const arith_uint& b) { return a.CompareTo(b) > 0; }
+    friend inline bool operator<(const arith_uint& a, const arith_uint& b) { return a.CompareTo(b) < 0; }
+    friend inline bool operator>=(const arith_uint& a, const arith_uint& b) { return a.CompareTo(b) >= 0; }
+    friend inline bool operator<=(const arith_uint& a, const arith_uint& b) { return a.CompareTo(b) <= 0; }
+    friend inline bool operator==(const arith_uint& a, uint64 b) { return a.EqualTo(b); }
+    friend inline bool operator!=(const arith_uint& a, uint64 b) { return !a.EqualTo(b); }
+
+    /** Position of the highest set bit plus one, 0 for zero */
+    unsigned int bits() const
+    {
+        for (int pos = WIDTH - 1; pos >= 0; pos--)
+        {
+            if (pn[pos])
+            {
+                for (int nbits = 31; nbits > 0; nbits--)
+                    if (pn[pos] & 1U << nbits)
+                        return 32 * pos + nbits + 1;
+                return 32 * pos + 1;
+            }
+        }
+        return 0;
+    }
+
+    uint64 GetLow64() const
+    {
+        return pn[0] | (uint64)pn[1] << 32;
+    }
+
+    double getdouble() const
+    {
+        double ret = 0.0;
+        double fact = 1.0;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            ret += fact * pn[i];
+            fact *= 4294967296.0;
+        }
+        return ret;
+    }
+
+    /**
+     * The "compact" format is a representation of a whole number N using an
+     * unsigned 32 bit number similar to a floating point format. The most
+     * significant 8 bits are the unsigned exponent of base 256, the lower 23
+     * bits are the mantissa and bit 24 (0x800000) is the sign of N:
+     *     N = (-1^sign) * mantissa * 256^(exponent-3)
+     *
+     * This is the encoding of CBigNum::SetCompact/GetCompact, which goes
+     * through OpenSSL's MPI format. A negative or overflowing value is
+     * reported through the flags; the caller decides what that means.
+     */
+    arith_uint& SetCompact(unsigned int nCompact, bool* pfNegative = NULL, bool* pfOverflow = NULL)
+    {
+        int nSize = nCompact >> 24;
+        unsigned int nWord = nCompact & 0x007fffff;
+        if (nSize <= 3)
+        {
+            nWord >>= 8 * (3 - nSize);
+            *this = nWord;
+        }
+        else
+        {
+            *this = nWord;
+            *this <<= 8 * (nSize - 3);
+        }
+        if (pfNegative)
+            *pfNegative = nWord != 0 && (nCompact & 0x00800000) != 0;
+        if (pfOverflow)
+            *pfOverflow = nWord != 0 && ((nSize > (int)BITS/8 + 2) ||
+                                         (nWord > 0xff && nSize > (int)BITS/8 + 1) ||
+                                         (nWord > 0xffff && nSize > (int)BITS/8));
+        return *this;
+    }
+
+    unsigned int GetCompact(bool fNegative = false) const
+    {
+        int nSize = (bits() + 7) / 8;
+        unsigned int nCompact = 0;
+        if (nSize <= 3)
+            nCompact = GetLow64() << 8 * (3 - nSize);
+        else
+            nCompact = (*this >> 8 * (nSize - 3)).GetLow64();
+        // The 0x00800000 bit denotes the sign, so if it is already set
+        // divide the mantissa by 256 and increase the exponent.
+        if (nCompact & 0x00800000)
+        {
+            nCompact >>= 8;
+            nSize++;
+        }
+        nCompact |= nSize << 24;
+        nCompact |= (fNegative && (nCompact & 0x007fffff) ? 0x00800000 : 0);
+        return nCompact;
+    }
+
+    std::string GetHex() const
+    {
+        char psz[sizeof(pn)*2 + 1];
+        for (unsigned int i = 0; i < sizeof(pn); i++)
+            sprintf(psz + i*2, "%02x", ((unsigned char*)pn)[sizeof(pn) - i - 1]);
+        return std::string(psz, psz + sizeof(pn)*2);
+    }
+
+    std::string ToString() const
+    {
+        return GetHex();
+    }
+};
+
+typedef arith_uint<256> arith_uint256;
+typedef arith_uint<320> arith_uint320;
+
+/** Both types store their words least significant first */
+inline arith_uint256 UintToArith256(const uint256& a)
+{
+    arith_uint256 b;
+    memcpy(b.pn, &a, sizeof(b.pn));
+    return b;
+}
+
+inline uint256 ArithToUint256(const arith_uint256& a)
+{
+    uint256 b;
+    memcpy(&b, a.pn, sizeof(a.pn));
+    return b;
+}
+
+#endif
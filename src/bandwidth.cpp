@@ -0,0 +1,82 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bandwidth.h"
+
+#include <limits>
+
+void CTokenBucket::SetRate(int64 nRateIn, int64 nBurstIn)
+{
+    nRate = nRateIn;
+    nBurst = std::max(nBurstIn, nRateIn);
+    nTokens = std::min(nTokens, nBurst);
+}
+
+int64 CTokenBucket::Available(int64 nTimeMicros)
+{
+    if (nRate <= 0)
+        return std::numeric_limits<int64>::max();
+
+    if (nLastRefill == 0 || nTimeMicros < nLastRefill)
+    {
+        nTokens = nBurst;
+        nLastRefill = nTimeMicros;
+    }
+    int64 nElapsed = nTimeMicros - nLastRefill;
+    int64 nAdd = nElapsed * nRate / 1000000;
+    if (nAdd > 0)
+    {
+        nTokens = std::min(nBurst, nTokens + nAdd);
+        // Keep the remainder, so small steps still add up
+        nLastRefill += nAdd * 1000000 / nRate;
+    }
+    if (nTokens >= nBurst)
+        nLastRefill = nTimeMicros;
+    return std::max(nTokens, (int64)0);
+}
+
+void CTokenBucket::Consume(int64 nBytes)
+{
+    if (nRate > 0)
+        nTokens -= nBytes;
+}
+
+void CUploadTarget::Roll(int64 nTime)
+{
+    if (nCycleStart == 0 || nTime - nCycleStart >= UPLOAD_TARGET_TIMEFRAME || nTime < nCycleStart)
+    {
+        nCycleStart = nTime;
+        nCycleBytes = 0;
+    }
+}
+
+void CUploadTarget::Add(uint64 nBytes, int64 nTime)
+{
+    Roll(nTime);
+    nCycleBytes += nBytes;
+}
+
+bool CUploadTarget::IsReached(int64 nTime)
+{
+    if (nTarget == 0)
+        return false;
+    Roll(nTime);
+    return nCycleBytes >= nTarget;
+}
+
+uint64 CUploadTarget::GetBytesLeft(int64 nTime)
+{
+    if (nTarget == 0)
+        return 0;
+    Roll(nTime);
+    return nCycleBytes >= nTarget ? 0 : nTarget - nCycleBytes;
+}
+
+int64 CUploadTarget::GetTimeLeft(int64 nTime)
+{
+    if (nTarget == 0)
+        return 0;
+    Roll(nTime);
+    return nCycleStart + UPLOAD_TARGET_TIMEFRAME - nTime;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_BANDWIDTH_H
+#define curecoin_BANDWIDTH_H
+
+#include "util.h"
+
+/** Length of an upload target cycle (seconds) */
+static const int64 UPLOAD_TARGET_TIMEFRAME = 24 * 60 * 60;
+/** Blocks older than this are not served once the upload target is reached */
+static const int64 UPLOAD_TARGET_HISTORICAL_AGE = 7 * 24 * 60 * 60;
+
+/** Token bucket rate limiter.
+ *
+ * Tokens are bytes. They accrue at nRate per second up to nBurst, and
+ * sending spends them. A rate of zero means no limit.
+ */
+class CTokenBucket
+{
+private:
+    int64 nRate;
+    int64 nBurst;
+    int64 nTokens;
+    int64 nLastRefill;
+
+public:
+    CTokenBucket() : nRate(0), nBurst(0), nTokens(0), nLastRefill(0) {}
+
+    void SetRate(int64 nRateIn, int64 nBurstIn);
+    int64 GetRate() const { return nRate; }
+    bool IsLimited() const { return nRate > 0; }
+
+    /** Bytes that may be sent at nTimeMicros */
+    int64 Available(int64 nTimeMicros);
+    void Consume(int64 nBytes);
+};
+
+/** Daily upload budget (-maxuploadtarget).
+ *
+ * Counts bytes sent in the current cycle of UPLOAD_TARGET_TIMEFRAME
+ * seconds. Once the target is reached, historical blocks are no longer
+ * served until the next cycle starts.
+ */
+class CUploadTarget
+{
+private:
+    uint64 nTarget;
+    int64 nCycleStart;
+    uint64 nCycleBytes;
+
+    void Roll(int64 nTime);
+
+public:
+    CUploadTarget() : nTarget(0), nCycleStart(0), nCycleBytes(0) {}
+
+    void SetTarget(uint64 nTargetIn) { nTarget = nTargetIn; }
+    uint64 GetTarget() const { return nTarget; }
+
+    void Add(uint64 nBytes, int64 nTime);
+    bool IsReached(int64 nTime);
+    uint64 GetBytesLeft(int64 nTime);
+    int64 GetTimeLeft(int64 nTime);
+};
+
+#endif
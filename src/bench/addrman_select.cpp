@@ -0,0 +1,51 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include "addrman.h"
+
+// Fill an address manager with nAddresses IPv4 addresses spread over many
+// /16 groups, coming from a handful of sources, and mark every tenth as tried.
+static void FillAddrMan(CAddrMan& addrman, int nAddresses)
+{
+    int64 nNow = GetAdjustedTime();
+    for (int n = 0; n < nAddresses; n++)
+    {
+        CNetAddr source(strprintf("250.%d.%d.1", (n % 16) + 1, (n / 16) % 256));
+        CAddress addr(CService(strprintf("%d.%d.%d.%d", 1 + (n % 200), (n / 200) % 256, (n / 51200) % 256, 1 + n % 250), 8333));
+        addr.nTime = nNow - 3600;
+        addrman.Add(addr, source);
+        if (n % 10 == 0)
+            addrman.Good(addr, nNow);
+    }
+}
+
+static void AddrManAdd(benchmark::State& state)
+{
+    while (state.KeepRunning())
+    {
+        CAddrMan addrman;
+        FillAddrMan(addrman, 1000);
+    }
+}
+
+static void AddrManSelect(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman, 20000);
+    while (state.KeepRunning())
+        addrman.Select();
+}
+
+static void AddrManGetAddr(benchmark::State& state)
+{
+    CAddrMan addrman;
+    FillAddrMan(addrman, 20000);
+    while (state.KeepRunning())
+        addrman.GetAddr();
+}
+
+BENCHMARK(AddrManAdd);
+BENCHMARK(AddrManSelect);
+BENCHMARK(AddrManGetAddr);
@@ -0,0 +1,115 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include <chrono>
+#include <limits>
+#include <stdio.h>
+
+static double GetTimeDouble()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+namespace benchmark {
+
+State::State(const std::string& strNameIn, double dMaxElapsedIn, CBenchResult* pResultIn) :
+    strName(strNameIn), dMaxElapsed(dMaxElapsedIn), pResult(pResultIn)
+{
+    dBeginTime = dLastTime = 0;
+    dMinTime = std::numeric_limits<double>::max();
+    dMaxTime = 0;
+    nCount = 0;
+    nCountMask = 1;
+    dCountMaskInv = 1.0 / (nCountMask + 1);
+}
+
+bool State::KeepRunning()
+{
+    if (nCount & nCountMask)
+    {
+        ++nCount;
+        return true;
+    }
+
+    double dNow;
+    if (nCount == 0)
+    {
+        dLastTime = dBeginTime = dNow = GetTimeDouble();
+    }
+    else
+    {
+        dNow = GetTimeDouble();
+        double dElapsed = dNow - dLastTime;
+        double dElapsedOne = dElapsed * dCountMaskInv;
+        if (dElapsedOne < dMinTime) dMinTime = dElapsedOne;
+        if (dElapsedOne > dMaxTime) dMaxTime = dElapsedOne;
+
+        // If a batch was much too short to time reliably (1/128th of the
+        // budget), grow the batch size by 8x.
+        if (dElapsed * 128 < dMaxElapsed)
+        {
+            nCountMask = ((nCountMask << 3) | 7) & ((1ULL << 60) - 1);
+            dCountMaskInv = 1.0 / (nCountMask + 1);
+        }
+    }
+    dLastTime = dNow;
+    ++nCount;
+
+    if (dNow - dBeginTime < dMaxElapsed)
+        return true;
+
+    --nCount;
+    pResult->strName = strName;
+    pResult->nIterations = nCount;
+    pResult->dTotal = dNow - dBeginTime;
+    pResult->dMin = (nCount ? dMinTime : 0) * 1e9;
+    pResult->dMax = dMaxTime * 1e9;
+    pResult->dAverage = (nCount ? pResult->dTotal / nCount : 0) * 1e9;
+    return false;
+}
+
+BenchRunner::BenchmarkMap& BenchRunner::benchmarks()
+{
+    static BenchmarkMap benchmarks_map;
+    return benchmarks_map;
+}
+
+BenchRunner::BenchRunner(const std::string& strName, BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(strName, func));
+}
+
+std::vector<CBenchResult> BenchRunner::RunAll(const std::string& strFilter, double dElapsedTimeForOne)
+{
+    std::vector<CBenchResult> vResults;
+    for (BenchmarkMap::iterator it = benchmarks().begin(); it != benchmarks().end(); ++it)
+    {
+        if (!strFilter.empty() && it->first.find(strFilter) == std::string::npos)
+            continue;
+        CBenchResult result;
+        State state(it->first, dElapsedTimeForOne, &result);
+        it->second(state);
+        vResults.push_back(result);
+    }
+    return vResults;
+}
+
+void PrintResults(const std::vector<CBenchResult>& vResults, bool fJson)
+{
+    if (!fJson)
+        fprintf(stdout, "# benchmark,iterations,total_s,min_ns,max_ns,average_ns\n");
+    for (std::vector<CBenchResult>::const_iterator it = vResults.begin(); it != vResults.end(); ++it)
+    {
+        if (fJson)
+            fprintf(stdout, "{\"benchmark\":\"%s\",\"iterations\":%llu,\"total_s\":%.6f,\"min_ns\":%.1f,\"max_ns\":%.1f,\"average_ns\":%.1f}\n",
+                it->strName.c_str(), (unsigned long long)it->nIterations, it->dTotal, it->dMin, it->dMax, it->dAverage);
+        else
+            fprintf(stdout, "%s,%llu,%.6f,%.1f,%.1f,%.1f\n",
+                it->strName.c_str(), (unsigned long long)it->nIterations, it->dTotal, it->dMin, it->dMax, it->dAverage);
+    }
+    fflush(stdout);
+}
+
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_BENCH_BENCH_H
+#define curecoin_BENCH_BENCH_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+// Simple micro-benchmarking framework.
+//
+// A benchmark is a function taking a benchmark::State. Setup and teardown
+// go outside of the KeepRunning() loop and are not timed:
+//
+//   static void CodeToTime(benchmark::State& state)
+//   {
+//       ... setup ...
+//       while (state.KeepRunning())
+//       {
+//           ... code to time ...
+//       }
+//   }
+//
+//   BENCHMARK(CodeToTime);
+//
+// Each benchmark is run for -mintime milliseconds. The loop body is timed in
+// batches whose size grows until a batch is long enough to be measured
+// reliably, so even very cheap operations report a stable per-iteration time.
+
+namespace benchmark {
+
+/** Result of a single benchmark run, all times in nanoseconds per iteration */
+struct CBenchResult
+{
+    std::string strName;
+    uint64_t nIterations;
+    double dTotal;      // seconds spent inside the KeepRunning() loop
+    double dMin;
+    double dMax;
+    double dAverage;
+};
+
+class State
+{
+    std::string strName;
+    double dMaxElapsed;
+    double dBeginTime;
+    double dLastTime;
+    double dMinTime;
+    double dMaxTime;
+    uint64_t nCount;
+    uint64_t nCountMask;
+    double dCountMaskInv;
+    CBenchResult* pResult;
+
+public:
+    State(const std::string& strNameIn, double dMaxElapsedIn, CBenchResult* pResultIn);
+    bool KeepRunning();
+};
+
+typedef void (*BenchFunction)(State&);
+
+class BenchRunner
+{
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+public:
+    BenchRunner(const std::string& strName, BenchFunction func);
+
+    // Run every registered benchmark whose name contains strFilter (all if empty)
+    static std::vector<CBenchResult> RunAll(const std::string& strFilter, double dElapsedTimeForOne);
+};
+
+/** Print results as CSV (default) or as one JSON object per line */
+void PrintResults(const std::vector<CBenchResult>& vResults, bool fJson);
+
+}
+
+// BENCHMARK(foo) expands to: benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif
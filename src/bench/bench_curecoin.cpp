@@ -0,0 +1,61 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include "init.h"
+#include "main.h"
+#include "ui_interface.h"
+#include "util.h"
+
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+
+// init.cpp is not linked into the benchmark binary, so provide the few
+// globals the core sources expect from it.
+CWallet* pwalletMain;
+CClientUIInterface uiInterface;
+
+void Shutdown(void* parg)
+{
+    exit(0);
+}
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+int main(int argc, char* argv[])
+{
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("--help"))
+    {
+        fprintf(stdout,
+            "Usage: bench_curecoin [options]\n"
+            "  -filter=<str>   Only run benchmarks whose name contains <str>\n"
+            "  -mintime=<n>    Milliseconds to run each benchmark (default: 1000)\n"
+            "  -json           Print one JSON object per benchmark instead of CSV\n");
+        return 0;
+    }
+
+    // Keep debug output away from stdout and from the user's data directory,
+    // so the results can be piped straight into a regression tracker.
+    fPrintToConsole = false;
+    fPrintToDebugger = true;
+
+    // Benchmarks that touch disk (block files) work in a scratch data directory
+    boost::filesystem::path pathScratch = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("bench_curecoin_%%%%%%%%");
+    boost::filesystem::create_directories(pathScratch);
+    mapArgs["-datadir"] = pathScratch.string();
+
+    std::vector<benchmark::CBenchResult> vResults =
+        benchmark::BenchRunner::RunAll(GetArg("-filter", ""), GetArg("-mintime", 1000) / 1000.0);
+    benchmark::PrintResults(vResults, GetBoolArg("-json"));
+
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(pathScratch, ec);
+    return 0;
+}
@@ -0,0 +1,53 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include "main.h"
+
+// A block index the size of a long chain, keyed on real looking hashes
+static void FillBlockIndexMap(CBlockIndexMap& map, std::vector<uint256>& vHashes, int nBlocks)
+{
+    map.reserve(nBlocks);
+    for (int n = 0; n < nBlocks; n++)
+    {
+        uint256 hash = Hash(BEGIN(n), END(n));
+        CBlockIndex* pindex = map.NewIndex();
+        pindex->phashBlock = &map.insert(std::make_pair(hash, pindex)).first->first;
+        pindex->nHeight = n;
+        vHashes.push_back(hash);
+    }
+}
+
+// mapBlockIndex.count/find on the message path: inv and getdata for blocks
+// we have, and for blocks we don't
+static void BlockIndexLookup(benchmark::State& state)
+{
+    CBlockIndexMap map;
+    std::vector<uint256> vHashes;
+    FillBlockIndexMap(map, vHashes, 1000000);
+
+    size_t i = 0;
+    uint256 hashMiss = 1;
+    while (state.KeepRunning())
+    {
+        i = (i + 7919) % vHashes.size();
+        if (map.find(vHashes[i]) == map.end())
+            throw std::runtime_error("BlockIndexLookup : missing entry");
+        ++hashMiss;
+        map.count(hashMiss);
+    }
+}
+
+static void BlockIndexInsert(benchmark::State& state)
+{
+    while (state.KeepRunning())
+    {
+        CBlockIndexMap map;
+        std::vector<uint256> vHashes;
+        FillBlockIndexMap(map, vHashes, 10000);
+    }
+}
+
+BENCHMARK(BlockIndexLookup);
+BENCHMARK(BlockIndexInsert);
@@ -0,0 +1,117 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include "coinselection.h"
+#include "wallet.h"
+
+#include <algorithm>
+#include <functional>
+
+// An in-memory wallet holding nOutputs unconfirmed outputs paying to a
+// single key. Values follow a fixed pseudo-random sequence between 0.01 and
+// 100 coins, roughly the spread of a staking wallet's payouts.
+static void FillWallet(CWallet& wallet, int nOutputs)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    wallet.AddKey(key);
+    CScript scriptPubKey;
+    scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+    uint64 nRand = 0x2545f4914f6cdd1dULL;
+    for (int n = 0; n < nOutputs; n++)
+    {
+        nRand = nRand * 6364136223846793005ULL + 1442695040888963407ULL;
+        CTransaction tx;
+        tx.nTime = 1400000000;
+        tx.vin.push_back(CTxIn(Hash(BEGIN(n), END(n)), 0));
+        tx.vout.push_back(CTxOut(CENT + (int64)((nRand >> 33) % (100 * COIN)), scriptPubKey));
+
+        CWalletTx wtx(&wallet, tx);
+        CWalletTx& wtxInserted = wallet.mapWallet[wtx.GetHash()];
+        wtxInserted = wtx;
+        wtxInserted.BindWallet(&wallet);
+    }
+}
+
+static void AvailableCoins(benchmark::State& state, int nOutputs)
+{
+    CWallet wallet;
+    FillWallet(wallet, nOutputs);
+    std::vector<COutput> vCoins;
+    while (state.KeepRunning())
+        wallet.AvailableCoins(vCoins, false);
+}
+
+static void SelectCoinsMinConf(benchmark::State& state, int nOutputs)
+{
+    CWallet wallet;
+    FillWallet(wallet, nOutputs);
+    std::vector<COutput> vCoins;
+    wallet.AvailableCoins(vCoins, false);
+
+    std::set<std::pair<const CWalletTx*,unsigned int> > setCoins;
+    int64 nValue;
+    while (state.KeepRunning())
+        wallet.SelectCoinsMinConf(500 * COIN, 1400000000, 0, 0, vCoins, setCoins, nValue);
+}
+
+// nCoins coin values, largest first, as the wallet hands them to the
+// selection searches: one in ten between 1 and 100 coins, the rest dust
+// between 0.0001 and 0.01 coins, like a wallet collecting small payouts
+static std::vector<int64> DustyValues(int nCoins)
+{
+    std::vector<int64> vValue;
+    vValue.reserve(nCoins);
+    uint64 nRand = 0x2545f4914f6cdd1dULL;
+    for (int n = 0; n < nCoins; n++)
+    {
+        nRand = nRand * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (n % 10 == 0)
+            vValue.push_back(COIN + (int64)((nRand >> 33) % (99 * COIN)));
+        else
+            vValue.push_back(MIN_TX_FEE + (int64)((nRand >> 33) % CENT));
+    }
+    std::sort(vValue.begin(), vValue.end(), std::greater<int64>());
+    return vValue;
+}
+
+static void CoinSelectionBnB(benchmark::State& state, int nCoins)
+{
+    std::vector<int64> vValue = DustyValues(nCoins);
+    std::vector<char> vfSelected;
+    int64 nBest;
+    while (state.KeepRunning())
+        SelectCoinsBnB(vValue, 250 * COIN + 12345, MIN_TXOUT_AMOUNT - 1, vfSelected, nBest);
+}
+
+static void CoinSelectionKnapsack(benchmark::State& state, int nCoins)
+{
+    std::vector<int64> vValue = DustyValues(nCoins);
+    std::vector<char> vfSelected;
+    int64 nBest;
+    while (state.KeepRunning())
+        ApproximateBestSubset(vValue, 250 * COIN + 12345, vfSelected, nBest);
+}
+
+static void AvailableCoins1k(benchmark::State& state) { AvailableCoins(state, 1000); }
+static void AvailableCoins10k(benchmark::State& state) { AvailableCoins(state, 10000); }
+static void SelectCoinsMinConf1k(benchmark::State& state) { SelectCoinsMinConf(state, 1000); }
+static void SelectCoinsMinConf10k(benchmark::State& state) { SelectCoinsMinConf(state, 10000); }
+static void SelectCoinsMinConf100k(benchmark::State& state) { SelectCoinsMinConf(state, 100000); }
+static void CoinSelectionBnB10k(benchmark::State& state) { CoinSelectionBnB(state, 10000); }
+static void CoinSelectionBnB1M(benchmark::State& state) { CoinSelectionBnB(state, 1000000); }
+static void CoinSelectionKnapsack10k(benchmark::State& state) { CoinSelectionKnapsack(state, 10000); }
+static void CoinSelectionKnapsack1M(benchmark::State& state) { CoinSelectionKnapsack(state, 1000000); }
+
+BENCHMARK(AvailableCoins1k);
+BENCHMARK(AvailableCoins10k);
+BENCHMARK(SelectCoinsMinConf1k);
+BENCHMARK(SelectCoinsMinConf10k);
+BENCHMARK(SelectCoinsMinConf100k);
+BENCHMARK(CoinSelectionBnB10k);
+BENCHMARK(CoinSelectionBnB1M);
+BENCHMARK(CoinSelectionKnapsack10k);
+BENCHMARK(CoinSelectionKnapsack1M);
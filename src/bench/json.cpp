@@ -0,0 +1,65 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include "curecoinrpc.h"
+#include "util.h"
+
+using namespace json_spirit;
+
+// Shaped like a verbose getblock reply with 600 transactions
+static Object SyntheticBlockObject()
+{
+    Object result;
+    int nHeight = 1200000;
+    result.push_back(Pair("hash", Hash(BEGIN(nHeight), END(nHeight)).GetHex()));
+    result.push_back(Pair("size", 250000));
+    result.push_back(Pair("height", nHeight));
+    result.push_back(Pair("version", 4));
+    result.push_back(Pair("time", DateTimeStrFormat(1400000000)));
+    result.push_back(Pair("difficulty", 1234.5678));
+    result.push_back(Pair("flags", "proof-of-stake"));
+
+    Array txs;
+    for (int n = 0; n < 600; n++)
+    {
+        Object entry;
+        entry.push_back(Pair("txid", Hash(BEGIN(n), END(n)).GetHex()));
+        entry.push_back(Pair("time", (boost::int64_t)1400000000 + n));
+        entry.push_back(Pair("locktime", 0));
+        Array vout;
+        for (int i = 0; i < 2; i++)
+        {
+            Object out;
+            out.push_back(Pair("value", ValueFromAmount((n + 1) * COIN + i)));
+            out.push_back(Pair("n", i));
+            out.push_back(Pair("type", "pubkeyhash"));
+            vout.push_back(out);
+        }
+        entry.push_back(Pair("vout", vout));
+        txs.push_back(entry);
+    }
+    result.push_back(Pair("tx", txs));
+    return result;
+}
+
+static void JsonWrite(benchmark::State& state)
+{
+    Value value(SyntheticBlockObject());
+    while (state.KeepRunning())
+        write_string(value, false);
+}
+
+static void JsonRead(benchmark::State& state)
+{
+    std::string strJson = write_string(Value(SyntheticBlockObject()), false);
+    while (state.KeepRunning())
+    {
+        Value value;
+        read_string(strJson, value);
+    }
+}
+
+BENCHMARK(JsonWrite);
+BENCHMARK(JsonRead);
@@ -0,0 +1,172 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include "main.h"
+
+// A block of roughly 250 kB made of pay-to-pubkey-hash style transactions.
+// All fields are derived from a counter so every run sees identical data.
+static CBlock SyntheticBlock(int nTransactions)
+{
+    CBlock block;
+    block.nTime = 1400000000;
+    block.nBits = 0x1d00ffff;
+    block.hashPrevBlock = Hash(BEGIN(block.nTime), END(block.nTime));
+
+    for (int n = 0; n < nTransactions; n++)
+    {
+        CTransaction tx;
+        tx.nTime = block.nTime;
+        for (int i = 0; i < 2; i++)
+        {
+            int nSeed = n * 2 + i;
+            CScript scriptSig;
+            scriptSig << std::vector<unsigned char>(72, (unsigned char)nSeed) << std::vector<unsigned char>(33, (unsigned char)(nSeed >> 8));
+            tx.vin.push_back(CTxIn(Hash(BEGIN(nSeed), END(nSeed)), i, scriptSig));
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            CScript scriptPubKey;
+            scriptPubKey << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, (unsigned char)(n + i)) << OP_EQUALVERIFY << OP_CHECKSIG;
+            tx.vout.push_back(CTxOut((n + 1) * COIN + i, scriptPubKey));
+        }
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+// Append nBlocks synthetic blocks to the scratch data directory's block files
+static std::vector<std::pair<unsigned int, unsigned int> > WriteSyntheticBlocks(int nBlocks)
+{
+    std::vector<std::pair<unsigned int, unsigned int> > vPos;
+    CBlock block = SyntheticBlock(600);
+    for (int n = 0; n < nBlocks; n++)
+    {
+        block.nNonce = n;
+        unsigned int nFile, nBlockPos;
+        if (block.WriteToDisk(nFile, nBlockPos))
+            vPos.push_back(std::make_pair(nFile, nBlockPos));
+    }
+    return vPos;
+}
+
+static void ReadBlockFromDisk(benchmark::State& state, bool fMmap)
+{
+    std::vector<std::pair<unsigned int, unsigned int> > vPos = WriteSyntheticBlocks(20);
+    bool fMmapPrev = fBlockFileMmap;
+    fBlockFileMmap = fMmap;
+    unsigned int n = 0;
+    while (state.KeepRunning())
+    {
+        CBlock block;
+        block.ReadFromDisk(vPos[n % vPos.size()].first, vPos[n % vPos.size()].second);
+        n++;
+    }
+    fBlockFileMmap = fMmapPrev;
+}
+
+static void ReadBlockFromDiskStdio(benchmark::State& state) { ReadBlockFromDisk(state, false); }
+static void ReadBlockFromDiskMmap(benchmark::State& state) { ReadBlockFromDisk(state, true); }
+
+static void SerializeBlock(benchmark::State& state)
+{
+    CBlock block = SyntheticBlock(600);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << SyntheticBlock(600);
+    while (state.KeepRunning())
+    {
+        CDataStream ss(ssBlock.begin(), ssBlock.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        ss >> block;
+    }
+}
+
+// ProcessMessages copies each received message into its own stream
+template<typename Stream>
+static void CopyMessage(benchmark::State& state)
+{
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << SyntheticBlock(600);
+    while (state.KeepRunning())
+    {
+        Stream vMsg(ssBlock.begin(), ssBlock.end(), SER_NETWORK, PROTOCOL_VERSION);
+    }
+}
+
+static void CopyMessageDataStream(benchmark::State& state) { CopyMessage<CDataStream>(state); }
+static void CopyMessageNetDataStream(benchmark::State& state) { CopyMessage<CNetDataStream>(state); }
+
+static void SerializeTransaction(benchmark::State& state)
+{
+    CBlock block = SyntheticBlock(1);
+    const CTransaction& tx = block.vtx[0];
+    while (state.KeepRunning())
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << tx;
+    }
+}
+
+static void DeserializeTransaction(benchmark::State& state)
+{
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << SyntheticBlock(1).vtx[0];
+    while (state.KeepRunning())
+    {
+        CDataStream ss(ssTx.begin(), ssTx.end(), SER_NETWORK, PROTOCOL_VERSION);
+        CTransaction tx;
+        ss >> tx;
+    }
+}
+
+static void HashBlockHeader(benchmark::State& state)
+{
+    CBlock block = SyntheticBlock(1);
+    while (state.KeepRunning())
+        block.nNonce = block.GetHash().Get64();
+}
+
+static void HashTransaction(benchmark::State& state)
+{
+    CTransaction tx = SyntheticBlock(1).vtx[0];
+    while (state.KeepRunning())
+        tx.nLockTime = SerializeHash(tx).Get64() & 0xff;
+}
+
+static void Hash1MB(benchmark::State& state)
+{
+    std::vector<unsigned char> vch(1000000, 0x5a);
+    while (state.KeepRunning())
+        vch[0] = Hash(vch.begin(), vch.end()).Get64() & 0xff;
+}
+
+static void BuildMerkleTree(benchmark::State& state)
+{
+    CBlock block = SyntheticBlock(600);
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
+BENCHMARK(SerializeTransaction);
+BENCHMARK(DeserializeTransaction);
+BENCHMARK(HashBlockHeader);
+BENCHMARK(HashTransaction);
+BENCHMARK(Hash1MB);
+BENCHMARK(BuildMerkleTree);
+BENCHMARK(CopyMessageDataStream);
+BENCHMARK(CopyMessageNetDataStream);
+BENCHMARK(ReadBlockFromDiskStdio);
+BENCHMARK(ReadBlockFromDiskMmap);
@@ -0,0 +1,75 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include "kernel.h"
+#include "main.h"
+
+// A synthetic chain of block index entries spaced 10 minutes apart with a
+// stake modifier generated every 36 blocks (the 6 hour modifier interval),
+// registered in mapBlockIndex as the main chain for as long as the object lives.
+class CSyntheticChain
+{
+public:
+    std::vector<CBlock> vBlocks;
+    std::vector<CBlockIndex*> vIndex;
+
+    explicit CSyntheticChain(int nBlocks)
+    {
+        CBlockIndex* pindexPrev = NULL;
+        for (int n = 0; n < nBlocks; n++)
+        {
+            CBlock block;
+            block.nTime = 1400000000 + n * 600;
+            block.nBits = 0x1e0fffff;
+            block.nNonce = n;
+            block.hashPrevBlock = pindexPrev ? pindexPrev->GetBlockHash() : 0;
+            vBlocks.push_back(block);
+
+            CBlockIndex* pindex = new CBlockIndex(0, 0, block);
+            CBlockIndexMap::iterator mi = mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first;
+            pindex->phashBlock = &((*mi).first);
+            pindex->pprev = pindexPrev;
+            pindex->nHeight = n;
+            pindex->SetStakeModifier(Hash(BEGIN(n), END(n)).Get64(), n % 36 == 0);
+            if (pindexPrev)
+                pindexPrev->pnext = pindex;
+            vIndex.push_back(pindex);
+            pindexPrev = pindex;
+        }
+        pindexGenesisBlock = vIndex[0];
+    }
+
+    ~CSyntheticChain()
+    {
+        TruncateStakeModifierCache(NULL);
+        pindexGenesisBlock = NULL;
+        BOOST_FOREACH(CBlockIndex* pindex, vIndex)
+        {
+            mapBlockIndex.erase(pindex->GetBlockHash());
+            delete pindex;
+        }
+    }
+};
+
+// One kernel attempt as done by the staker for each candidate output and
+// timestamp, and by CheckProofOfStake for every incoming PoS block
+static void StakeKernelHash(benchmark::State& state)
+{
+    CSyntheticChain chain(3000);
+    const CBlock& blockFrom = chain.vBlocks[10];
+
+    CTransaction txPrev;
+    txPrev.nTime = blockFrom.nTime;
+    txPrev.vout.resize(1);
+    txPrev.vout[0].nValue = 1000 * COIN;
+    COutPoint prevout(txPrev.GetHash(), 0);
+
+    unsigned int nTimeTx = blockFrom.nTime + nStakeMinAge + 24 * 60 * 60;
+    uint256 hashProofOfStake;
+    while (state.KeepRunning())
+        CheckStakeKernelHash(0x1e0fffff, blockFrom, 81, txPrev, prevout, nTimeTx++, hashProofOfStake);
+}
+
+BENCHMARK(StakeKernelHash);
@@ -0,0 +1,92 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include "bench.h"
+
+#include "keystore.h"
+#include "main.h"
+#include "script.h"
+
+// A funding transaction paying to a pay-to-pubkey-hash output, and a
+// transaction spending it with a valid signature.
+struct CSignedSpend
+{
+    CBasicKeyStore keystore;
+    CTransaction txFrom;
+    CTransaction txTo;
+
+    CSignedSpend()
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+
+        txFrom.vout.resize(1);
+        txFrom.vout[0].nValue = 10 * COIN;
+        txFrom.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+        txTo.vin.resize(1);
+        txTo.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+        txTo.vout.resize(1);
+        txTo.vout[0].nValue = 9 * COIN;
+        txTo.vout[0].scriptPubKey = txFrom.vout[0].scriptPubKey;
+        SignSignature(keystore, txFrom, txTo, 0);
+    }
+};
+
+// Full ECDSA verification; the signature cache is disabled for the duration
+static void VerifySignatureUncached(benchmark::State& state)
+{
+    // SignSignature verifies its own result, which would fill the cache
+    std::map<std::string, std::string> mapOldArgs = mapArgs;
+    mapArgs["-maxsigcachesize"] = "0";
+    CSignedSpend spend;
+    while (state.KeepRunning())
+        VerifySignature(spend.txFrom, spend.txTo, 0, true, 0);
+    mapArgs = mapOldArgs;
+}
+
+// Verification of a signature already present in the signature cache, as
+// happens when a block contains transactions we accepted into the mempool
+static void VerifySignatureCached(benchmark::State& state)
+{
+    CSignedSpend spend;
+    VerifySignature(spend.txFrom, spend.txTo, 0, true, 0); // prime the cache
+    while (state.KeepRunning())
+        VerifySignature(spend.txFrom, spend.txTo, 0, true, 0);
+}
+
+// Script interpreter only: hashing and stack manipulation, no signatures
+static void EvalScriptHashing(benchmark::State& state)
+{
+    CTransaction txTo;
+    txTo.vin.resize(1);
+    CScript script;
+    script << std::vector<unsigned char>(32, 0x01);
+    // 30 rounds of 6 opcodes stays below the 201 opcode limit
+    for (int i = 0; i < 30; i++)
+        script << OP_DUP << OP_SHA256 << OP_SWAP << OP_HASH160 << OP_DROP << OP_HASH256;
+    while (state.KeepRunning())
+    {
+        std::vector<std::vector<unsigned char> > stack;
+        EvalScript(stack, script, txTo, 0, 0);
+    }
+}
+
+static void EvalScriptPayToPubKeyHash(benchmark::State& state)
+{
+    CSignedSpend spend;
+    const CScript& scriptSig = spend.txTo.vin[0].scriptSig;
+    const CScript& scriptPubKey = spend.txFrom.vout[0].scriptPubKey;
+    while (state.KeepRunning())
+    {
+        std::vector<std::vector<unsigned char> > stack;
+        EvalScript(stack, scriptSig, spend.txTo, 0, 0);
+        EvalScript(stack, scriptPubKey, spend.txTo, 0, 0);
+    }
+}
+
+BENCHMARK(VerifySignatureUncached);
+BENCHMARK(VerifySignatureCached);
+BENCHMARK(EvalScriptHashing);
+BENCHMARK(EvalScriptPayToPubKeyHash);
@@ -0,0 +1,194 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+#include "main.h"
+#include "util.h"
+
+#include <limits>
+#include <new>
+
+CBlockIndexMap::CBlockIndexMap() : nEntries(0), nShift(64), nSize(0), nSalt(0), nIndexes(0)
+{
+}
+
+CBlockIndexMap::~CBlockIndexMap()
+{
+    clear();
+}
+
+void CBlockIndexMap::PlaceEntry(unsigned int n)
+{
+    uint64 nMixed = Mix(Entry(n).value.first);
+    size_t nMask = vSlots.size() - 1;
+    size_t i = Home(nMixed);
+    while (vSlots[i].nEntry != 0)
+        i = (i + 1) & nMask;
+    vSlots[i].nEntry = n + 1;
+    vSlots[i].nTag = (unsigned int)nMixed;
+}
+
+void CBlockIndexMap::Rehash(size_t nSlots)
+{
+    // The salt keeps peers from choosing hashes that pile up in one run of
+    // slots. It is drawn on first use, not during static initialization.
+    if (vSlots.empty())
+        nSalt = GetRand(std::numeric_limits<uint64>::max());
+
+    int nBits = 4;
+    while (((size_t)1 << nBits) < nSlots)
+        nBits++;
+    std::vector<CSlot> vEmpty((size_t)1 << nBits);
+    vSlots.swap(vEmpty);
+    for (size_t i = 0; i < vSlots.size(); i++)
+        vSlots[i].nEntry = 0;
+    nShift = 64 - nBits;
+    for (unsigned int n = 0; n < nEntries; n++)
+        if (Entry(n).fUsed)
+            PlaceEntry(n);
+}
+
+void CBlockIndexMap::reserve(size_t nCount)
+{
+    // At most 70% full
+    size_t nSlots = nCount + nCount * 3 / 7 + 1;
+    if (nSlots > vSlots.size())
+        Rehash(nSlots);
+}
+
+unsigned int CBlockIndexMap::NewEntry(const value_type& value)
+{
+    unsigned int n;
+    if (!vFreeEntries.empty())
+    {
+        n = vFreeEntries.back();
+        vFreeEntries.pop_back();
+    }
+    else
+    {
+        n = nEntries;
+        if (n % ENTRY_CHUNK == 0)
+            vEntryChunks.push_back((CEntry*)::operator new(sizeof(CEntry) * ENTRY_CHUNK));
+        nEntries++;
+    }
+    new (&Entry(n)) CEntry(value);
+    return n;
+}
+
+std::pair<CBlockIndexMap::iterator, bool> CBlockIndexMap::insert(const value_type& value)
+{
+    unsigned int n = FindEntry(value.first);
+    if (n != NO_ENTRY)
+        return std::make_pair(iterator(this, n), false);
+
+    reserve(nSize + 1);
+    n = NewEntry(value);
+    PlaceEntry(n);
+    nSize++;
+    return std::make_pair(iterator(this, n), true);
+}
+
+CBlockIndex*& CBlockIndexMap::operator[](const uint256& hash)
+{
+    return insert(std::make_pair(hash, (CBlockIndex*)NULL)).first->second;
+}
+
+size_t CBlockIndexMap::erase(const uint256& hashIn)
+{
+    uint256 hash = hashIn;
+    unsigned int n = FindEntry(hash);
+    if (n == NO_ENTRY)
+        return 0;
+
+    // Backward shift deletion: pull later slots of the run into the hole
+    // unless that would move them in front of their home slot
+    size_t nMask = vSlots.size() - 1;
+    size_t i = Home(Mix(hash));
+    while (vSlots[i].nEntry != n + 1)
+        i = (i + 1) & nMask;
+    size_t j = i;
+    while (true)
+    {
+        j = (j + 1) & nMask;
+        if (vSlots[j].nEntry == 0)
+            break;
+        size_t k = Home(Mix(Entry(vSlots[j].nEntry - 1).value.first));
+        if ((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j))
+        {
+            vSlots[i] = vSlots[j];
+            i = j;
+        }
+    }
+    vSlots[i].nEntry = 0;
+
+    // Entries are trivially destructible; the slot is just marked free
+    Entry(n).fUsed = false;
+    vFreeEntries.push_back(n);
+    nSize--;
+    return 1;
+}
+
+void CBlockIndexMap::clear()
+{
+    BOOST_FOREACH(CEntry* pchunk, vEntryChunks)
+        ::operator delete(pchunk);
+    vEntryChunks.clear();
+    vFreeEntries.clear();
+    nEntries = 0;
+    std::vector<CSlot>().swap(vSlots);
+    nShift = 64;
+    nSize = 0;
+
+    for (unsigned int n = 0; n < nIndexes; n++)
+        vIndexChunks[n / INDEX_CHUNK][n % INDEX_CHUNK].~CBlockIndex();
+    BOOST_FOREACH(CBlockIndex* pchunk, vIndexChunks)
+        ::operator delete(pchunk);
+    vIndexChunks.clear();
+    nIndexes = 0;
+}
+
+void CBlockIndexMap::swap(CBlockIndexMap& other)
+{
+    vEntryChunks.swap(other.vEntryChunks);
+    std::swap(nEntries, other.nEntries);
+    vFreeEntries.swap(other.vFreeEntries);
+    vSlots.swap(other.vSlots);
+    std::swap(nShift, other.nShift);
+    std::swap(nSize, other.nSize);
+    std::swap(nSalt, other.nSalt);
+    vIndexChunks.swap(other.vIndexChunks);
+    std::swap(nIndexes, other.nIndexes);
+}
+
+void* CBlockIndexMap::AllocateIndex()
+{
+    if (nIndexes % INDEX_CHUNK == 0)
+        vIndexChunks.push_back((CBlockIndex*)::operator new(sizeof(CBlockIndex) * INDEX_CHUNK));
+    void* p = &vIndexChunks[nIndexes / INDEX_CHUNK][nIndexes % INDEX_CHUNK];
+    nIndexes++;
+    return p;
+}
+
+CBlockIndex* CBlockIndexMap::NewIndex()
+{
+    return new (AllocateIndex()) CBlockIndex();
+}
+
+CBlockIndex* CBlockIndexMap::NewIndex(const CBlockIndex& index)
+{
+    return new (AllocateIndex()) CBlockIndex(index);
+}
+
+CBlockIndex* CBlockIndexMap::NewIndex(unsigned int nFile, unsigned int nBlockPos, CBlock& block)
+{
+    return new (AllocateIndex()) CBlockIndex(nFile, nBlockPos, block);
+}
+
+size_t CBlockIndexMap::DynamicMemoryUsage() const
+{
+    return vSlots.capacity() * sizeof(CSlot) +
+           vEntryChunks.size() * ENTRY_CHUNK * sizeof(CEntry) +
+           vFreeEntries.capacity() * sizeof(unsigned int) +
+           vIndexChunks.size() * INDEX_CHUNK * sizeof(CBlockIndex);
+}
@@ -0,0 +1,187 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_BLOCKINDEXMAP_H
+#define curecoin_BLOCKINDEXMAP_H
+
+#include "uint256.h"
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+
+/** Block hash to CBlockIndex* map with the parts of the std::map interface
+ * the block index code uses.
+ *
+ * Entries live in fixed size chunks that are never moved or given back
+ * before clear(), so a phashBlock pointing at a key stays valid for as long
+ * as the entry is in the map. Lookups go through an open addressing table
+ * (linear probing) of entry numbers, keyed on the salted low 64 bits of the
+ * hash, with a 32-bit tag so a miss almost never touches an entry.
+ *
+ * The map can also allocate the CBlockIndex objects themselves from an
+ * arena with NewIndex(). Those are destroyed by clear() and the destructor;
+ * pointers inserted from anywhere else remain owned by the caller.
+ *
+ * Iteration order is insertion order (with erased entries reused), not hash
+ * order.
+ */
+class CBlockIndexMap
+{
+public:
+    typedef uint256 key_type;
+    typedef CBlockIndex* mapped_type;
+    typedef std::pair<const uint256, CBlockIndex*> value_type;
+    typedef size_t size_type;
+
+private:
+    enum { ENTRY_CHUNK = 4096, INDEX_CHUNK = 4096 };
+    static const unsigned int NO_ENTRY = (unsigned int)-1;
+
+    struct CEntry
+    {
+        value_type value;
+        bool fUsed;
+
+        explicit CEntry(const value_type& valueIn) : value(valueIn), fUsed(true) {}
+    };
+
+    // Table slot: entry number + 1 (0 is empty) and the low bits of the mixed hash
+    struct CSlot
+    {
+        unsigned int nEntry;
+        unsigned int nTag;
+    };
+
+    std::vector<CEntry*> vEntryChunks;
+    unsigned int nEntries;          // entries ever constructed, used or not
+    std::vector<unsigned int> vFreeEntries;
+    std::vector<CSlot> vSlots;      // power of two size
+    int nShift;                     // 64 - log2(vSlots.size())
+    size_t nSize;
+    uint64 nSalt;
+
+    std::vector<CBlockIndex*> vIndexChunks;
+    unsigned int nIndexes;
+
+    CEntry& Entry(unsigned int n) const { return vEntryChunks[n / ENTRY_CHUNK][n % ENTRY_CHUNK]; }
+
+    uint64 Mix(const uint256& hash) const { return (hash.Get64(0) ^ nSalt) * 0x9e3779b97f4a7c15ULL; }
+    size_t Home(uint64 nMixed) const { return (size_t)(nMixed >> nShift); }
+
+    unsigned int FindEntry(const uint256& hash) const
+    {
+        if (nSize == 0)
+            return NO_ENTRY;
+        uint64 nMixed = Mix(hash);
+        unsigned int nTag = (unsigned int)nMixed;
+        size_t nMask = vSlots.size() - 1;
+        for (size_t i = Home(nMixed); ; i = (i + 1) & nMask)
+        {
+            const CSlot& slot = vSlots[i];
+            if (slot.nEntry == 0)
+                return NO_ENTRY;
+            if (slot.nTag == nTag && Entry(slot.nEntry - 1).value.first == hash)
+                return slot.nEntry - 1;
+        }
+    }
+
+    unsigned int NextUsed(unsigned int n) const
+    {
+        while (n < nEntries && !Entry(n).fUsed)
+            n++;
+        return n;
+    }
+
+    void Rehash(size_t nSlots);
+    void PlaceEntry(unsigned int n);
+    unsigned int NewEntry(const value_type& value);
+    void* AllocateIndex();
+
+    CBlockIndexMap(const CBlockIndexMap&);
+    CBlockIndexMap& operator=(const CBlockIndexMap&);
+
+public:
+    template<typename MapT, typename ValueT>
+    class iterator_base
+    {
+    private:
+        MapT* pmap;
+        unsigned int n;
+        friend class CBlockIndexMap;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef ValueT value_type;
+        typedef ptrdiff_t difference_type;
+        typedef ValueT* pointer;
+        typedef ValueT& reference;
+
+        iterator_base() : pmap(NULL), n(0) {}
+        iterator_base(MapT* pmapIn, unsigned int nIn) : pmap(pmapIn), n(nIn) {}
+        template<typename OtherMapT, typename OtherValueT>
+        iterator_base(const iterator_base<OtherMapT, OtherValueT>& it) : pmap(it.pmap), n(it.n) {}
+
+        ValueT& operator*() const { return pmap->Entry(n).value; }
+        ValueT* operator->() const { return &pmap->Entry(n).value; }
+        iterator_base& operator++() { n = pmap->NextUsed(n + 1); return *this; }
+        iterator_base operator++(int) { iterator_base it = *this; ++*this; return it; }
+        bool operator==(const iterator_base& it) const { return n == it.n; }
+        bool operator!=(const iterator_base& it) const { return n != it.n; }
+
+        template<typename, typename> friend class iterator_base;
+    };
+
+    typedef iterator_base<CBlockIndexMap, value_type> iterator;
+    typedef iterator_base<const CBlockIndexMap, const value_type> const_iterator;
+
+    CBlockIndexMap();
+    ~CBlockIndexMap();
+
+    iterator begin() { return iterator(this, NextUsed(0)); }
+    iterator end() { return iterator(this, nEntries); }
+    const_iterator begin() const { return const_iterator(this, NextUsed(0)); }
+    const_iterator end() const { return const_iterator(this, nEntries); }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const uint256& hash)
+    {
+        unsigned int n = FindEntry(hash);
+        return iterator(this, n == NO_ENTRY ? nEntries : n);
+    }
+
+    const_iterator find(const uint256& hash) const
+    {
+        unsigned int n = FindEntry(hash);
+        return const_iterator(this, n == NO_ENTRY ? nEntries : n);
+    }
+
+    size_t count(const uint256& hash) const { return FindEntry(hash) == NO_ENTRY ? 0 : 1; }
+
+    std::pair<iterator, bool> insert(const value_type& value);
+    CBlockIndex*& operator[](const uint256& hash);
+    size_t erase(const uint256& hash);
+    void erase(iterator it) { erase(it->first); }
+
+    /** Destroys every entry and every CBlockIndex from NewIndex() */
+    void clear();
+    void swap(CBlockIndexMap& other);
+    /** Size the table for nCount entries without rehashing on the way */
+    void reserve(size_t nCount);
+
+    /** A CBlockIndex from the arena, to be inserted into this map */
+    CBlockIndex* NewIndex();
+    CBlockIndex* NewIndex(const CBlockIndex& index);
+    CBlockIndex* NewIndex(unsigned int nFile, unsigned int nBlockPos, CBlock& block);
+
+    /** Bytes held by the table, the entries and the arena */
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif
@@ -0,0 +1,468 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstore.h"
+#include "protocol.h"
+#include "sync.h"
+#include "util.h"
+
+#include <map>
+
+#include <boost/filesystem/operations.hpp>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+bool fBlockFileMmap = false;
+
+static boost::filesystem::path DataFilePath(const char* pszPrefix, unsigned int nFile)
+{
+    std::string strFn = strprintf("%s%04u.dat", pszPrefix, nFile);
+    return GetDataDir() / strFn;
+}
+
+boost::filesystem::path BlockFilePath(unsigned int nFile)
+{
+    return DataFilePath("blk", nFile);
+}
+
+boost::filesystem::path UndoFilePath(unsigned int nFile)
+{
+    return DataFilePath("rev", nFile);
+}
+
+static FILE* OpenDataFile(const boost::filesystem::path& path, unsigned int nFile, unsigned int nBlockPos, const char* pszMode)
+{
+    if ((nFile < 1) || (nFile == (unsigned int) -1))
+        return NULL;
+    FILE* file = fopen(path.string().c_str(), pszMode);
+    if (!file)
+        return NULL;
+    if (nBlockPos != 0 && !strchr(pszMode, 'a') && !strchr(pszMode, 'w'))
+    {
+        if (fseek(file, nBlockPos, SEEK_SET) != 0)
+        {
+            fclose(file);
+            return NULL;
+        }
+    }
+    return file;
+}
+
+FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode)
+{
+    return OpenDataFile(BlockFilePath(nFile), nFile, nBlockPos, pszMode);
+}
+
+//
+// Block and undo file writers
+//
+// The file being appended to stays open, and is grown a chunk at a time so
+// the filesystem can keep it contiguous. The unused tail is cut off again
+// when the file is finished or closed; after a crash it is found by walking
+// the records that follow the last one the index knows of.
+//
+
+// FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
+static const unsigned int MAX_BLOCKFILE_SIZE = 0x7F000000;
+
+static void CloseBlockFileView(unsigned int nFile);
+
+// Offset just past the last complete record in file, walking from nPos
+static unsigned int FindDataFileEnd(const boost::filesystem::path& path, FILE* file, unsigned int nFileSize, unsigned int nPos)
+{
+    const unsigned int nPrefix = sizeof(pchMessageStart) + sizeof(unsigned int);
+    std::shared_ptr<const CBlockFileView> pview = fBlockFileMmap ? MapFile(path) : std::shared_ptr<const CBlockFileView>();
+    if (pview)
+        nFileSize = std::min(nFileSize, (unsigned int)pview->nSize);
+
+    while (nPos <= nFileSize && nFileSize - nPos >= nPrefix)
+    {
+        char pchPrefix[nPrefix];
+        if (pview)
+            memcpy(pchPrefix, pview->pbegin + nPos, nPrefix);
+        else if (fseek(file, nPos, SEEK_SET) != 0 || fread(pchPrefix, 1, nPrefix, file) != nPrefix)
+            break;
+        unsigned int nSize;
+        memcpy(&nSize, pchPrefix + sizeof(pchMessageStart), sizeof(nSize));
+        if (memcmp(pchPrefix, pchMessageStart, sizeof(pchMessageStart)) != 0 || nSize == 0 || nSize > nFileSize - nPos - nPrefix)
+            break;
+        nPos += nPrefix + nSize;
+    }
+    return nPos;
+}
+
+/** Appends records, each behind the message start and its size, to the
+ * numbered files prefix0001.dat, prefix0002.dat, ... */
+class CDataFileWriter
+{
+private:
+    CCriticalSection cs;
+    const char* pszPrefix;
+    unsigned int nChunkSize;
+    bool fBlockFiles;       // mappings of the files are cached by GetBlockFileView
+    FILE* file;
+    unsigned int nFile;
+    unsigned int nEnd;      // end of the last record written
+    unsigned int nAlloc;    // end of the allocated space
+    std::map<unsigned int, unsigned int> mapLastIndexed;   // file -> position of its last indexed record
+
+    unsigned int GetIndexedEnd(FILE* fileIn);
+    bool Open();
+    void Finish();
+
+public:
+    CDataFileWriter(const char* pszPrefixIn, unsigned int nChunkSizeIn, bool fBlockFilesIn)
+        : pszPrefix(pszPrefixIn), nChunkSize(nChunkSizeIn), fBlockFiles(fBlockFilesIn),
+          file(NULL), nFile(1), nEnd(0), nAlloc(0) {}
+
+    bool Write(const char* pbegin, unsigned int nSize, unsigned int& nFileRet, unsigned int& nPosRet);
+    void SetLastIndexed(unsigned int nFileIn, unsigned int nPos);
+    void Sync();
+    void Close();
+};
+
+// End of the last record of nFile the index knows of, 0 if none. Requires cs.
+unsigned int CDataFileWriter::GetIndexedEnd(FILE* fileIn)
+{
+    const unsigned int nPrefix = sizeof(pchMessageStart) + sizeof(unsigned int);
+    std::map<unsigned int, unsigned int>::const_iterator mi = mapLastIndexed.find(nFile);
+    if (mi == mapLastIndexed.end() || mi->second < nPrefix)
+        return 0;
+    unsigned int nPos = mi->second;
+    char pchPrefix[nPrefix];
+    if (fseek(fileIn, nPos - nPrefix, SEEK_SET) != 0 || fread(pchPrefix, 1, nPrefix, fileIn) != nPrefix ||
+        memcmp(pchPrefix, pchMessageStart, sizeof(pchMessageStart)) != 0)
+    {
+        // Unreadable, but still not to be written over
+        printf("CDataFileWriter::GetIndexedEnd() : no record at %s:%u\n", DataFilePath(pszPrefix, nFile).string().c_str(), nPos);
+        return nPos;
+    }
+    unsigned int nSize;
+    memcpy(&nSize, pchPrefix + sizeof(pchMessageStart), sizeof(nSize));
+    return nPos + std::min(nSize, MAX_SIZE);
+}
+
+// Open nFile for writing at the end of its records. Requires cs.
+bool CDataFileWriter::Open()
+{
+    while (true)
+    {
+        boost::filesystem::path path = DataFilePath(pszPrefix, nFile);
+        bool fExists = boost::filesystem::exists(path);
+        FILE* fileIn = OpenDataFile(path, nFile, 0, fExists ? "rb+" : "wb+");
+        if (!fileIn)
+            return error("CDataFileWriter::Open() : can't open %s", path.string().c_str());
+
+        int nFileSize = GetFilesize(fileIn);
+        if (nFileSize < 0)
+        {
+            fclose(fileIn);
+            return error("CDataFileWriter::Open() : can't get the size of %s", path.string().c_str());
+        }
+        // Records past the last indexed one were written before a crash
+        // and may be torn; the walk from there finds where they end
+        unsigned int nEndIndexed = GetIndexedEnd(fileIn);
+        unsigned int nEndIn = nEndIndexed;
+        if (nEndIndexed < (unsigned int)nFileSize)
+            nEndIn = FindDataFileEnd(path, fileIn, nFileSize, nEndIndexed);
+        if (nEndIn < (unsigned int)nFileSize)
+            printf("CDataFileWriter::Open() : %s has %u bytes past its last record\n", path.string().c_str(), nFileSize - nEndIn);
+
+        if (nEndIn < MAX_BLOCKFILE_SIZE - MAX_SIZE)
+        {
+            file = fileIn;
+            nEnd = nEndIn;
+            nAlloc = nFileSize;
+            return true;
+        }
+
+        if (nEndIn < (unsigned int)nFileSize)
+        {
+            if (fBlockFiles)
+                CloseBlockFileView(nFile);
+            TruncateFile(fileIn, nEndIn);
+        }
+        fclose(fileIn);
+        nFile++;
+    }
+}
+
+// Requires cs
+void CDataFileWriter::Finish()
+{
+    if (!file)
+        return;
+    if (nAlloc > nEnd)
+    {
+        if (fBlockFiles)
+            CloseBlockFileView(nFile);
+        TruncateFile(file, nEnd);
+        nAlloc = nEnd;
+    }
+    FileCommit(file);
+    fclose(file);
+    file = NULL;
+}
+
+bool CDataFileWriter::Write(const char* pbegin, unsigned int nSize, unsigned int& nFileRet, unsigned int& nPosRet)
+{
+    const unsigned int nPrefix = sizeof(pchMessageStart) + sizeof(nSize);
+    if (nSize == 0 || nSize > MAX_SIZE)
+        return error("CDataFileWriter::Write() : bad record size %u", nSize);
+
+    LOCK(cs);
+    if (file && nEnd >= MAX_BLOCKFILE_SIZE - MAX_SIZE)
+    {
+        Finish();
+        nFile++;
+    }
+    if (!file && !Open())
+        return false;
+
+    unsigned int nEndNew = nEnd + nPrefix + nSize;
+    if (nEndNew > nAlloc)
+    {
+        unsigned int nAllocNew = std::min((nEndNew + nChunkSize - 1) / nChunkSize * nChunkSize, MAX_BLOCKFILE_SIZE);
+        AllocateFileRange(file, nAlloc, nAllocNew - nAlloc);
+        nAlloc = nAllocNew;
+    }
+
+    if (fseek(file, nEnd, SEEK_SET) != 0)
+        return error("CDataFileWriter::Write() : fseek failed");
+    if (fwrite(pchMessageStart, 1, sizeof(pchMessageStart), file) != sizeof(pchMessageStart) ||
+        fwrite(&nSize, 1, sizeof(nSize), file) != sizeof(nSize) ||
+        fwrite(pbegin, 1, nSize, file) != nSize ||
+        fflush(file) != 0)
+    {
+        // Start again from a fresh look at the file next time
+        fclose(file);
+        file = NULL;
+        return error("CDataFileWriter::Write() : write to %s failed", DataFilePath(pszPrefix, nFile).string().c_str());
+    }
+
+    nFileRet = nFile;
+    nPosRet = nEnd + nPrefix;
+    nEnd = nEndNew;
+    return true;
+}
+
+void CDataFileWriter::SetLastIndexed(unsigned int nFileIn, unsigned int nPos)
+{
+    LOCK(cs);
+    unsigned int& nLast = mapLastIndexed[nFileIn];
+    nLast = std::max(nLast, nPos);
+}
+
+void CDataFileWriter::Sync()
+{
+    LOCK(cs);
+    if (file)
+        FileCommit(file);
+}
+
+void CDataFileWriter::Close()
+{
+    LOCK(cs);
+    Finish();
+}
+
+static CDataFileWriter writerBlock("blk", BLOCKFILE_CHUNK_SIZE, true);
+static CDataFileWriter writerUndo("rev", UNDOFILE_CHUNK_SIZE, false);
+
+bool WriteBlockToFile(const char* pbegin, unsigned int nSize, unsigned int& nFileRet, unsigned int& nBlockPosRet)
+{
+    return writerBlock.Write(pbegin, nSize, nFileRet, nBlockPosRet);
+}
+
+void SetLastIndexedBlock(unsigned int nFile, unsigned int nBlockPos)
+{
+    writerBlock.SetLastIndexed(nFile, nBlockPos);
+}
+
+bool WriteUndoToFile(const char* pbegin, unsigned int nSize, unsigned int& nFileRet, unsigned int& nPosRet)
+{
+    // Followed by a checksum, a torn record must not pass for undo data
+    std::vector<char> vch(pbegin, pbegin + nSize);
+    uint256 hash = Hash(pbegin, pbegin + nSize);
+    vch.insert(vch.end(), (const char*)hash.begin(), (const char*)hash.end());
+    return writerUndo.Write(&vch[0], vch.size(), nFileRet, nPosRet);
+}
+
+void SetLastIndexedUndo(unsigned int nFile, unsigned int nPos)
+{
+    writerUndo.SetLastIndexed(nFile, nPos);
+}
+
+bool ReadUndoFile(unsigned int nFile, unsigned int nPos, std::vector<char>& vchRet)
+{
+    const unsigned int nPrefix = sizeof(pchMessageStart) + sizeof(unsigned int);
+    vchRet.clear();
+    if (nPos < nPrefix)
+        return false;
+    FILE* file = OpenDataFile(UndoFilePath(nFile), nFile, nPos - nPrefix, "rb");
+    if (!file)
+        return false;
+    char pchPrefix[nPrefix];
+    unsigned int nSize = 0;
+    bool fOk = fread(pchPrefix, 1, nPrefix, file) == nPrefix;
+    if (fOk)
+    {
+        memcpy(&nSize, pchPrefix + sizeof(pchMessageStart), sizeof(nSize));
+        fOk = memcmp(pchPrefix, pchMessageStart, sizeof(pchMessageStart)) == 0 && nSize > sizeof(uint256) && nSize <= MAX_SIZE;
+    }
+    if (fOk)
+    {
+        vchRet.resize(nSize);
+        fOk = fread(&vchRet[0], 1, nSize, file) == nSize;
+    }
+    fclose(file);
+    if (!fOk)
+        return false;
+
+    uint256 hash;
+    memcpy(hash.begin(), &vchRet[nSize - sizeof(hash)], sizeof(hash));
+    vchRet.resize(nSize - sizeof(hash));
+    if (Hash(vchRet.begin(), vchRet.end()) != hash)
+    {
+        vchRet.clear();
+        return error("ReadUndoFile() : checksum mismatch in %s at %u", UndoFilePath(nFile).string().c_str(), nPos);
+    }
+    return true;
+}
+
+void SyncBlockFile()
+{
+    writerBlock.Sync();
+    writerUndo.Sync();
+}
+
+void CloseBlockFile()
+{
+    writerBlock.Close();
+    writerUndo.Close();
+}
+
+
+//
+// Memory mapped block files
+//
+
+static CCriticalSection cs_mapBlockFileViews;
+static std::map<unsigned int, std::shared_ptr<const CBlockFileView> > mapBlockFileViews;
+
+CBlockFileView::~CBlockFileView()
+{
+#ifndef WIN32
+    munmap((void*)pbegin, nSize);
+#endif
+}
+
+std::shared_ptr<const CBlockFileView> MapFile(const boost::filesystem::path& path)
+{
+#ifdef WIN32
+    return std::shared_ptr<const CBlockFileView>();
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return std::shared_ptr<const CBlockFileView>();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return std::shared_ptr<const CBlockFileView>();
+    }
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        printf("MapFile() : mmap of %s failed, errno %d\n", path.string().c_str(), errno);
+        return std::shared_ptr<const CBlockFileView>();
+    }
+    return std::make_shared<const CBlockFileView>((const char*)p, (size_t)st.st_size);
+#endif
+}
+
+std::shared_ptr<const CBlockFileView> GetBlockFileView(unsigned int nFile, unsigned int nPos)
+{
+    if (!fBlockFileMmap || (nFile < 1) || (nFile == (unsigned int) -1))
+        return std::shared_ptr<const CBlockFileView>();
+
+    LOCK(cs_mapBlockFileViews);
+    std::shared_ptr<const CBlockFileView>& pview = mapBlockFileViews[nFile];
+    // The file being appended to outgrows its mapping; map it again
+    if (!pview || pview->nSize <= nPos)
+        pview = MapFile(BlockFilePath(nFile));
+    if (!pview || pview->nSize <= nPos)
+        return std::shared_ptr<const CBlockFileView>();
+    return pview;
+}
+
+// Mappings may run past the end of a file that is about to be truncated
+static void CloseBlockFileView(unsigned int nFile)
+{
+    LOCK(cs_mapBlockFileViews);
+    mapBlockFileViews.erase(nFile);
+}
+
+void CloseBlockFileViews()
+{
+    LOCK(cs_mapBlockFileViews);
+    mapBlockFileViews.clear();
+}
+
+bool CRawBlock::Read(unsigned int nFile, unsigned int nBlockPos, unsigned int nMaxSize)
+{
+    // Each block is preceded by the message start and its size
+    const unsigned int nPrefix = sizeof(pchMessageStart) + sizeof(nSize);
+    if (nBlockPos < nPrefix)
+        return false;
+    pbegin = NULL;
+    nSize = 0;
+
+    pview = GetBlockFileView(nFile, nBlockPos);
+    if (pview)
+    {
+        const char* pprefix = pview->pbegin + nBlockPos - nPrefix;
+        unsigned int nSizeIn;
+        memcpy(&nSizeIn, pprefix + sizeof(pchMessageStart), sizeof(nSizeIn));
+        if (memcmp(pprefix, pchMessageStart, sizeof(pchMessageStart)) != 0 || nSizeIn > nMaxSize)
+            return false;
+        if (nBlockPos + nSizeIn <= pview->nSize)
+        {
+            pbegin = pview->pbegin + nBlockPos;
+            nSize = nSizeIn;
+            return true;
+        }
+        // Appended after the file was mapped
+        pview.reset();
+    }
+
+    FILE* file = OpenBlockFile(nFile, nBlockPos - nPrefix, "rb");
+    if (!file)
+        return false;
+    char pchPrefix[nPrefix];
+    unsigned int nSizeIn = 0;
+    bool fOk = fread(pchPrefix, 1, nPrefix, file) == nPrefix;
+    if (fOk)
+    {
+        memcpy(&nSizeIn, pchPrefix + sizeof(pchMessageStart), sizeof(nSizeIn));
+        fOk = memcmp(pchPrefix, pchMessageStart, sizeof(pchMessageStart)) == 0 && nSizeIn <= nMaxSize;
+    }
+    if (fOk)
+    {
+        vch.resize(nSizeIn);
+        fOk = nSizeIn == 0 || fread(&vch[0], 1, nSizeIn, file) == nSizeIn;
+    }
+    fclose(file);
+    if (!fOk)
+        return false;
+    pbegin = vch.empty() ? NULL : &vch[0];
+    nSize = nSizeIn;
+    return true;
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_BLOCKSTORE_H
+#define curecoin_BLOCKSTORE_H
+
+#include "serialize.h"
+
+#include <memory>
+
+#include <boost/filesystem/path.hpp>
+
+boost::filesystem::path BlockFilePath(unsigned int nFile);
+boost::filesystem::path UndoFilePath(unsigned int nFile);
+FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode="rb");
+
+/** Block files grow in steps of this many bytes, allocated ahead of the writes */
+static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
+/** During initial block download the block file is synced every this many blocks */
+static const int BLOCKFILE_SYNC_INTERVAL = 500;
+
+/** Append a block (with the message start and size in front of it) to the
+ * block file being written, which is kept open between calls. The data is
+ * flushed to the OS but only committed to disk by SyncBlockFile.
+ */
+bool WriteBlockToFile(const char* pbegin, unsigned int nSize, unsigned int& nFileRet, unsigned int& nBlockPosRet);
+/** The block index has a block at nBlockPos of nFile. When the writer opens
+ * that file it appends after the last such block, whatever is in between.
+ */
+void SetLastIndexedBlock(unsigned int nFile, unsigned int nBlockPos);
+
+/** Undo files (rev000N.dat) grow in steps of this many bytes */
+static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+
+/** Append the undo data of a block to the undo file being written, the
+ * same way WriteBlockToFile does, with a checksum after it */
+bool WriteUndoToFile(const char* pbegin, unsigned int nSize, unsigned int& nFileRet, unsigned int& nPosRet);
+/** The undo data at nPos of nFile is indexed; as SetLastIndexedBlock */
+void SetLastIndexedUndo(unsigned int nFile, unsigned int nPos);
+/** Read back what WriteUndoToFile put at nPos of nFile. Fails if the
+ * framing or the checksum don't check out. */
+bool ReadUndoFile(unsigned int nFile, unsigned int nPos, std::vector<char>& vchRet);
+
+/** Commit what has been written to the block and undo files so far to disk */
+void SyncBlockFile();
+/** Sync, give back the space allocated past the last records and close */
+void CloseBlockFile();
+
+/** Read-only memory map of a whole blk000N.dat (or other data directory) file.
+ * Views are shared; a reader keeps its view alive while it deserializes,
+ * even if the file has since grown and been mapped again.
+ */
+class CBlockFileView
+{
+public:
+    const char* pbegin;
+    size_t nSize;
+
+    CBlockFileView(const char* pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) {}
+    ~CBlockFileView();
+
+private:
+    CBlockFileView(const CBlockFileView&);
+    CBlockFileView& operator=(const CBlockFileView&);
+};
+
+extern bool fBlockFileMmap;
+
+/** Map all of path, or NULL if it is empty or can't be mapped (always on Windows) */
+std::shared_ptr<const CBlockFileView> MapFile(const boost::filesystem::path& path);
+
+/** A view of nFile that extends past nPos, or NULL if it can't be mapped */
+std::shared_ptr<const CBlockFileView> GetBlockFileView(unsigned int nFile, unsigned int nPos);
+void CloseBlockFileViews();
+
+/** Deserialize obj from offset nPos of block file nFile.
+ * Reads straight from the mapped file when -blockmmap is on, otherwise (or
+ * when the object runs past the end of the mapping) through stdio.
+ * Returns false if the file can't be opened, throws on deserialize errors.
+ */
+template<typename T>
+bool ReadBlockFile(unsigned int nFile, unsigned int nPos, T& obj, int nType, int nVersion)
+{
+    std::shared_ptr<const CBlockFileView> pview = GetBlockFileView(nFile, nPos);
+    if (pview)
+    {
+        try {
+            CBufferReader reader(pview->pbegin + nPos, pview->pbegin + pview->nSize, nType, nVersion);
+            reader >> obj;
+            return true;
+        }
+        catch (std::ios_base::failure &e) {
+            // Appended after the file was mapped, or truncated: let stdio decide
+        }
+    }
+
+    CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nPos, "rb"), nType, nVersion);
+    if (!filein)
+        return false;
+    filein >> obj;
+    return true;
+}
+
+/** The serialized bytes of a stored block, for sending it on unchanged.
+ * Points into the mapped block file when it can, otherwise holds a copy
+ * read through stdio. Either way it stays valid while this object lives.
+ */
+class CRawBlock
+{
+public:
+    const char* pbegin;
+    unsigned int nSize;
+
+    CRawBlock() : pbegin(NULL), nSize(0) {}
+
+    /** Read the block CBlock::WriteToDisk put at nBlockPos of nFile. Fails if
+     * the message start and size written before it don't check out. */
+    bool Read(unsigned int nFile, unsigned int nBlockPos, unsigned int nMaxSize);
+
+private:
+    std::shared_ptr<const CBlockFileView> pview;
+    std::vector<char> vch;
+};
+
+#endif
@@ -0,0 +1,89 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bloom.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements, double fpRate)
+{
+    double logFpRate = log(fpRate);
+    // The optimal number of hash functions is log(fpRate) / log(0.5)
+    nHashFuncs = std::max(1, std::min((int)(logFpRate / log(0.5) + 0.5), 50));
+    nEntriesPerGeneration = (nElements + 1) / 2;
+    // Up to three generations are live at once
+    unsigned int nMaxElements = nEntriesPerGeneration * 3;
+    // fpRate = (1 - exp(-nHashFuncs * nMaxElements / nFilterBits)) ^ nHashFuncs
+    unsigned int nFilterBits = (unsigned int)ceil(-1.0 * nHashFuncs * nMaxElements / log(1.0 - exp(logFpRate / nHashFuncs)));
+    data.resize(((nFilterBits + 63) / 64) << 1);
+    reset();
+}
+
+// Position and bit of the n-th hash function, from two halves of one SipHash
+static inline void RollingBloomPosition(uint64 nHash, int n, size_t nSize, unsigned int& nPos, int& nBit)
+{
+    unsigned int h = (unsigned int)nHash + n * (unsigned int)(nHash >> 32);
+    nBit = h & 0x3f;
+    // Scale the hash into range without a division
+    nPos = (unsigned int)(((uint64)h * nSize) >> 32);
+}
+
+void CRollingBloomFilter::insert(const uint256& hash)
+{
+    if (nEntriesThisGeneration == nEntriesPerGeneration)
+    {
+        nEntriesThisGeneration = 0;
+        nGeneration++;
+        if (nGeneration == 4)
+            nGeneration = 1;
+        // Wipe the entries of the generation being reused
+        uint64 nMask1 = 0 - (uint64)(nGeneration & 1);
+        uint64 nMask2 = 0 - (uint64)(nGeneration >> 1);
+        for (unsigned int p = 0; p < data.size(); p += 2)
+        {
+            uint64 p1 = data[p], p2 = data[p + 1];
+            uint64 mask = (p1 ^ nMask1) | (p2 ^ nMask2);
+            data[p] = p1 & mask;
+            data[p + 1] = p2 & mask;
+        }
+    }
+    nEntriesThisGeneration++;
+
+    uint64 nHash = SipHashUint256(nKey0, nKey1, hash);
+    for (int n = 0; n < nHashFuncs; n++)
+    {
+        unsigned int nPos;
+        int nBit;
+        RollingBloomPosition(nHash, n, data.size(), nPos, nBit);
+        // The low bit of the position picks the plane, so it is ignored here
+        data[nPos & ~1U] = (data[nPos & ~1U] & ~((uint64)1 << nBit)) | ((uint64)(nGeneration & 1) << nBit);
+        data[nPos | 1] = (data[nPos | 1] & ~((uint64)1 << nBit)) | ((uint64)(nGeneration >> 1) << nBit);
+    }
+}
+
+bool CRollingBloomFilter::contains(const uint256& hash) const
+{
+    uint64 nHash = SipHashUint256(nKey0, nKey1, hash);
+    for (int n = 0; n < nHashFuncs; n++)
+    {
+        unsigned int nPos;
+        int nBit;
+        RollingBloomPosition(nHash, n, data.size(), nPos, nBit);
+        if (!(((data[nPos & ~1U] | data[nPos | 1]) >> nBit) & 1))
+            return false;
+    }
+    return true;
+}
+
+void CRollingBloomFilter::reset()
+{
+    nKey0 = GetRand(std::numeric_limits<uint64>::max());
+    nKey1 = GetRand(std::numeric_limits<uint64>::max());
+    nEntriesThisGeneration = 0;
+    nGeneration = 1;
+    std::fill(data.begin(), data.end(), 0);
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_BLOOM_H
+#define curecoin_BLOOM_H
+
+#include "uint256.h"
+
+#include <vector>
+
+/** Probabilistic set of the most recently inserted hashes.
+ *
+ * Remembers at least the last nElements inserted (and at most one and a half
+ * times as many), answering contains() with false positives at about
+ * fpRate and no false negatives for those. Entries are tagged with one of
+ * three generations in two bit planes; when the current generation is full
+ * the oldest one is wiped, so the filter never needs rebuilding. Memory is
+ * fixed at construction. Not thread safe.
+ */
+class CRollingBloomFilter
+{
+private:
+    int nEntriesPerGeneration;
+    int nEntriesThisGeneration;
+    int nGeneration;
+    int nHashFuncs;
+    uint64 nKey0;
+    uint64 nKey1;
+    // Bit plane pairs: data[2i] holds the low bit of each entry's
+    // generation, data[2i+1] the high bit; 0 in both means unset
+    std::vector<uint64> data;
+
+public:
+    CRollingBloomFilter(unsigned int nElements, double fpRate);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+    /** Forget everything and pick new hash keys */
+    void reset();
+
+    size_t GetMemoryUsage() const { return data.size() * sizeof(uint64); }
+};
+
+#endif
@@ -0,0 +1,145 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinselection.h"
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/foreach.hpp>
+
+bool SelectCoinsBnB(const std::vector<int64>& vValue, int64 nTarget, int64 nWindow, std::vector<char>& vfSelected, int64& nBest)
+{
+    size_t nCoins = vValue.size();
+
+    // vRemaining[i] is the most the coins from i on can add
+    std::vector<int64> vRemaining(nCoins + 1, 0);
+    for (size_t i = nCoins; i > 0; i--)
+        vRemaining[i - 1] = vRemaining[i] + vValue[i - 1];
+    if (vRemaining[0] < nTarget)
+        return false;
+
+    std::vector<size_t> vIncluded, vBest;
+    int64 nCurrent = 0;
+    size_t nBestCoins = std::numeric_limits<size_t>::max();
+    nBest = 0;
+
+    // Each coin in turn is first included, then, once everything with it
+    // has been tried, left out. Every input adds to the fee, so the subset
+    // with the fewest coins wins, then the one closest to the target.
+    size_t i = 0;
+    for (unsigned int nTries = 0; nTries < MAX_BNB_TRIES; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nCurrent + vRemaining[i] < nTarget)
+            fBacktrack = true;  // can't reach the target any more
+        else if (nCurrent > nTarget + nWindow)
+            fBacktrack = true;  // overshot
+        else if (nCurrent >= nTarget)
+        {
+            if (vIncluded.size() < nBestCoins || nCurrent < nBest)
+            {
+                nBest = nCurrent;
+                nBestCoins = vIncluded.size();
+                vBest = vIncluded;
+            }
+            fBacktrack = true;
+        }
+        else if (vIncluded.size() >= nBestCoins)
+            fBacktrack = true;  // one more coin is more than the best has
+
+        if (!fBacktrack)
+        {
+            nCurrent += vValue[i];
+            vIncluded.push_back(i);
+            i++;
+            continue;
+        }
+
+        // Leave out the last coin included and go on without it. Coins of
+        // the same value right after it would only repeat the subsets
+        // already tried with it, so they are skipped too.
+        if (vIncluded.empty())
+            break;
+        size_t nLast = vIncluded.back();
+        vIncluded.pop_back();
+        nCurrent -= vValue[nLast];
+        for (i = nLast + 1; i < nCoins && vValue[i] == vValue[nLast]; i++)
+            ;
+    }
+
+    if (vBest.empty())
+        return false;
+    vfSelected.assign(nCoins, false);
+    BOOST_FOREACH(size_t n, vBest)
+        vfSelected[n] = true;
+    return true;
+}
+
+void ApproximateBestSubset(const std::vector<int64>& vValue, int64 nTarget, std::vector<char>& vfSelected, int64& nBest, int nIterations)
+{
+    // The largest coins reach the target with the fewest inputs; a subset
+    // needing more than MAX_KNAPSACK_COINS of them would not fit in a
+    // transaction anyway, so the search stays within those
+    size_t nCoins = 0;
+    int64 nTotal = 0;
+    while (nCoins < vValue.size() && (nCoins < MAX_KNAPSACK_COINS || nTotal < nTarget))
+        nTotal += vValue[nCoins++];
+
+    vfSelected.assign(vValue.size(), false);
+    std::fill(vfSelected.begin(), vfSelected.begin() + nCoins, true);
+    nBest = nTotal;
+    if (nCoins == 0)
+        return;
+    nIterations = std::min(nIterations, std::max(1, (int)(MAX_KNAPSACK_OPS / nCoins)));
+
+    // rand() is too slow to draw a bit per coin per round
+    uint64 nRand = GetRand(std::numeric_limits<uint64>::max()) | 1;
+    int nRandBits = 0;
+
+    std::vector<char> vfIncluded;
+    for (int nRep = 0; nRep < nIterations && nBest != nTarget; nRep++)
+    {
+        vfIncluded.assign(nCoins, false);
+        int64 nSum = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
+        {
+            for (size_t i = 0; i < nCoins; i++)
+            {
+                bool fInclude;
+                if (nPass == 0)
+                {
+                    if (nRandBits == 0)
+                    {
+                        // xorshift64
+                        nRand ^= nRand << 13;
+                        nRand ^= nRand >> 7;
+                        nRand ^= nRand << 17;
+                        nRandBits = 64;
+                    }
+                    fInclude = (nRand >> --nRandBits) & 1;
+                }
+                else
+                    fInclude = !vfIncluded[i];
+                if (!fInclude)
+                    continue;
+
+                nSum += vValue[i];
+                vfIncluded[i] = true;
+                if (nSum >= nTarget)
+                {
+                    fReachedTarget = true;
+                    if (nSum < nBest)
+                    {
+                        nBest = nSum;
+                        std::copy(vfIncluded.begin(), vfIncluded.end(), vfSelected.begin());
+                    }
+                    nSum -= vValue[i];
+                    vfIncluded[i] = false;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_COINSELECTION_H
+#define curecoin_COINSELECTION_H
+
+#include "util.h"
+
+#include <vector>
+
+/** Most combinations the branch and bound search tries */
+static const unsigned int MAX_BNB_TRIES = 100000;
+/** Most coins the stochastic search works on */
+static const unsigned int MAX_KNAPSACK_COINS = 1000;
+/** Rough budget of coin visits for one stochastic search */
+static const unsigned int MAX_KNAPSACK_OPS = 2000000;
+/** Size of a signed pay-to-pubkey-hash input, used to tell which coins
+ * are worth less than the fee of spending them */
+static const unsigned int COIN_INPUT_SIZE = 148;
+
+// Coin selection over coin values sorted largest first. Both searches mark
+// the coins they pick in vfSelected, by index into vValue, and return the
+// total picked in nBest.
+
+/** Depth first search for a subset adding up to between nTarget and
+ * nTarget + nWindow, so no change output is needed. Of the subsets seen
+ * in up to MAX_BNB_TRIES steps it picks the one with the fewest coins, then
+ * the one closest to nTarget; returns whether there was any. */
+bool SelectCoinsBnB(const std::vector<int64>& vValue, int64 nTarget, int64 nWindow, std::vector<char>& vfSelected, int64& nBest);
+
+/** Randomized search for the subset of the largest MAX_KNAPSACK_COINS coins
+ * (or as many as it takes to reach nTarget) adding up to the least
+ * amount of at least nTarget, in up to nIterations rounds and about
+ * MAX_KNAPSACK_OPS coin visits. Coins beyond those are left unselected.
+ * If nothing reaches nTarget, all considered coins are selected. */
+void ApproximateBestSubset(const std::vector<int64>& vValue, int64 nTarget, std::vector<char>& vfSelected, int64& nBest, int nIterations = 1000);
+
+#endif
@@ -0,0 +1,135 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "compactblock.h"
+#include "util.h"
+
+#include <limits>
+
+CCompactBlock::CCompactBlock(const CBlock& block) : fKeySet(false), nNonce(GetRand(std::numeric_limits<uint64>::max())), vchBlockSig(block.vchBlockSig)
+{
+    header.nVersion = block.nVersion;
+    header.hashPrevBlock = block.hashPrevBlock;
+    header.hashMerkleRoot = block.hashMerkleRoot;
+    header.nTime = block.nTime;
+    header.nBits = block.nBits;
+    header.nNonce = block.nNonce;
+
+    // The receiver can't have the coinbase or the coinstake in its mempool
+    vPrefilled.push_back(CPrefilledTransaction(0, block.vtx[0]));
+    if (block.IsProofOfStake())
+        vPrefilled.push_back(CPrefilledTransaction(1, block.vtx[1]));
+
+    vShortTxIds.reserve(block.vtx.size() - vPrefilled.size());
+    for (unsigned int i = vPrefilled.size(); i < block.vtx.size(); i++)
+        vShortTxIds.push_back(CShortTxId(GetShortTxId(block.vtx[i].GetHash())));
+}
+
+void CCompactBlock::SetKey() const
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << header << nNonce;
+    uint256 hashKey = ss.GetHash();
+    nKey0 = hashKey.Get64(0);
+    nKey1 = hashKey.Get64(1);
+    fKeySet = true;
+}
+
+uint64 CCompactBlock::GetShortTxId(const uint256& hashTx) const
+{
+    if (!fKeySet)
+        SetKey();
+    return SipHashUint256(nKey0, nKey1, hashTx) & 0xffffffffffffULL;
+}
+
+bool CCompactBlock::FillBlock(CBlock& block, std::vector<unsigned short>& vMissing, int& nDoS) const
+{
+    nDoS = 0;
+    vMissing.clear();
+
+    size_t nTx = vShortTxIds.size() + vPrefilled.size();
+    if (vPrefilled.empty() || nTx > MAX_COMPACT_BLOCK_TX || nTx > MAX_BLOCK_SIZE / ::GetSerializeSize(CTransaction(), SER_NETWORK, PROTOCOL_VERSION))
+    {
+        nDoS = 100;
+        return error("CCompactBlock::FillBlock() : bad transaction count");
+    }
+
+    block.SetNull();
+    block.nVersion = header.nVersion;
+    block.hashPrevBlock = header.hashPrevBlock;
+    block.hashMerkleRoot = header.hashMerkleRoot;
+    block.nTime = header.nTime;
+    block.nBits = header.nBits;
+    block.nNonce = header.nNonce;
+    block.vchBlockSig = vchBlockSig;
+    block.vtx.resize(nTx);
+
+    // 0 missing, 1 filled, 2 more than one mempool transaction matched
+    std::vector<unsigned char> vState(nTx, 0);
+    int nLastIndex = -1;
+    BOOST_FOREACH(const CPrefilledTransaction& prefilled, vPrefilled)
+    {
+        if ((int)prefilled.nIndex <= nLastIndex || prefilled.nIndex >= nTx)
+        {
+            nDoS = 100;
+            return error("CCompactBlock::FillBlock() : bad prefilled transaction index %u", prefilled.nIndex);
+        }
+        nLastIndex = prefilled.nIndex;
+        block.vtx[prefilled.nIndex] = prefilled.tx;
+        vState[prefilled.nIndex] = 1;
+    }
+
+    // Short ids fill the remaining slots in order
+    std::map<uint64, unsigned short> mapShortTxId;
+    unsigned short nIndex = 0;
+    BOOST_FOREACH(const CShortTxId& shortid, vShortTxIds)
+    {
+        while (vState[nIndex])
+            nIndex++;
+        if (!mapShortTxId.insert(std::make_pair(shortid.nId, nIndex)).second)
+            return error("CCompactBlock::FillBlock() : short id collision in block %s", GetHash().ToString().substr(0,20).c_str());
+        nIndex++;
+    }
+
+    {
+        LOCK(mempool.cs);
+        for (std::map<uint256, CTransaction>::const_iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        {
+            std::map<uint64, unsigned short>::const_iterator it = mapShortTxId.find(GetShortTxId((*mi).first));
+            if (it == mapShortTxId.end())
+                continue;
+            unsigned short n = (*it).second;
+            if (vState[n] == 0)
+            {
+                block.vtx[n] = (*mi).second;
+                vState[n] = 1;
+            }
+            else if (vState[n] == 1)
+            {
+                // Can't tell which one it is, so ask for it
+                block.vtx[n] = CTransaction();
+                vState[n] = 2;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < nTx; i++)
+        if (vState[i] != 1)
+            vMissing.push_back(i);
+    return true;
+}
+
+bool FillMissingTransactions(CBlock& block, const std::vector<unsigned short>& vMissing, const std::vector<CTransaction>& vtx)
+{
+    if (vtx.size() != vMissing.size())
+        return error("FillMissingTransactions() : got %" PRIszu " transactions, asked for %" PRIszu, vtx.size(), vMissing.size());
+    for (unsigned int i = 0; i < vMissing.size(); i++)
+    {
+        if (vMissing[i] >= block.vtx.size())
+            return error("FillMissingTransactions() : index %u out of range", vMissing[i]);
+        block.vtx[vMissing[i]] = vtx[i];
+    }
+    block.vMerkleTree.clear();
+    return true;
+}
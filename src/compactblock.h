@@ -0,0 +1,137 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_COMPACTBLOCK_H
+#define curecoin_COMPACTBLOCK_H
+
+#include "main.h"
+
+/** Transaction indexes in compact blocks are 16 bits; bigger blocks go whole */
+static const unsigned int MAX_COMPACT_BLOCK_TX = 0xffff;
+/** getblocktxn is only answered for blocks this close to our best block,
+ * older ones are sent whole */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+
+/** A transaction sent whole in a compact block, at its index in the block */
+class CPrefilledTransaction
+{
+public:
+    unsigned short nIndex;
+    CTransaction tx;
+
+    CPrefilledTransaction() : nIndex(0) {}
+    CPrefilledTransaction(unsigned short nIndexIn, const CTransaction& txIn) : nIndex(nIndexIn), tx(txIn) {}
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(nIndex);
+        READWRITE(tx);
+    )
+};
+
+/** 48-bit short transaction id, 6 bytes on the wire */
+class CShortTxId
+{
+public:
+    uint64 nId;
+
+    CShortTxId() : nId(0) {}
+    explicit CShortTxId(uint64 nIdIn) : nId(nIdIn) {}
+
+    IMPLEMENT_SERIALIZE
+    (
+        unsigned int nLow = (unsigned int)nId;
+        unsigned short nHigh = (unsigned short)(nId >> 32);
+        READWRITE(nLow);
+        READWRITE(nHigh);
+        if (fRead)
+            const_cast<CShortTxId*>(this)->nId = ((uint64)nHigh << 32) | nLow;
+    )
+};
+
+/** A new block as its header and signature, the transactions the receiver
+ * can't have (the coinbase, and the coinstake of a proof-of-stake block),
+ * and a short id for each of the others. Short ids are SipHash keyed by
+ * the header and a random nonce, so they differ per block and per sender.
+ *
+ * The receiver fills the block in from its mempool, asks for whatever is
+ * missing with "getblocktxn" and gets it back in "blocktxn". When it can't
+ * tell transactions apart, or the result doesn't match the merkle root, it
+ * falls back to asking for the full block.
+ */
+class CCompactBlock
+{
+private:
+    mutable uint64 nKey0, nKey1;
+    mutable bool fKeySet;
+
+    void SetKey() const;
+
+public:
+    CBlock header;          // no transactions or signature
+    uint64 nNonce;
+    std::vector<CShortTxId> vShortTxIds;
+    std::vector<CPrefilledTransaction> vPrefilled;
+    std::vector<unsigned char> vchBlockSig;
+
+    CCompactBlock() : fKeySet(false), nNonce(0) {}
+    explicit CCompactBlock(const CBlock& block);
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(header.nVersion);
+        READWRITE(header.hashPrevBlock);
+        READWRITE(header.hashMerkleRoot);
+        READWRITE(header.nTime);
+        READWRITE(header.nBits);
+        READWRITE(header.nNonce);
+        READWRITE(nNonce);
+        READWRITE(vShortTxIds);
+        READWRITE(vPrefilled);
+        READWRITE(vchBlockSig);
+        if (fRead)
+            fKeySet = false;
+    )
+
+    uint256 GetHash() const { return header.GetHash(); }
+    uint64 GetShortTxId(const uint256& hashTx) const;
+
+    /** Rebuild the block from the prefilled transactions and the mempool.
+     * The indexes of transactions still missing go to vMissing. Returns
+     * false with nDoS set if the compact block is malformed, and false
+     * with nDoS 0 if two transactions share a short id. */
+    bool FillBlock(CBlock& block, std::vector<unsigned short>& vMissing, int& nDoS) const;
+};
+
+/** "getblocktxn": transactions of a block by index */
+class CBlockTransactionsRequest
+{
+public:
+    uint256 hashBlock;
+    std::vector<unsigned short> vIndexes;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(vIndexes);
+    )
+};
+
+/** "blocktxn": the answer to a getblocktxn, in the order asked for */
+class CBlockTransactions
+{
+public:
+    uint256 hashBlock;
+    std::vector<CTransaction> vtx;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(vtx);
+    )
+};
+
+/** Put the transactions from a blocktxn into the gaps FillBlock left */
+bool FillMissingTransactions(CBlock& block, const std::vector<unsigned short>& vMissing, const std::vector<CTransaction>& vtx);
+
+#endif
@@ -10,6 +10,7 @@
 #include "base58.h"
 #include "curecoinrpc.h"
 #include "db.h"
+#include "perf.h"
 
 #undef printf
 #include <boost/asio.hpp>
@@ -56,6 +57,43 @@ json_spirit::Object JSONRPCError(int code, const std::string& message)
     return error;
 }
 
+static CCriticalSection cs_rpcWarmup;
+static bool fRPCInWarmup = true;
+static std::string strRPCWarmupStatus("RPC server started");
+
+void SetRPCWarmupStatus(const std::string& strStatus)
+{
+    // Init messages are formatted for the splash screen
+    std::string strPlain;
+    bool fInTag = false;
+    BOOST_FOREACH(char c, strStatus)
+    {
+        if (c == '<')
+            fInTag = true;
+        else if (c == '>')
+            fInTag = false;
+        else if (!fInTag)
+            strPlain += c;
+    }
+
+    LOCK(cs_rpcWarmup);
+    strRPCWarmupStatus = strPlain;
+}
+
+void SetRPCWarmupFinished()
+{
+    LOCK(cs_rpcWarmup);
+    fRPCInWarmup = false;
+}
+
+bool RPCIsInWarmup(std::string* pstrStatus)
+{
+    LOCK(cs_rpcWarmup);
+    if (pstrStatus)
+        *pstrStatus = strRPCWarmupStatus;
+    return fRPCInWarmup;
+}
+
 void RPCTypeCheck(const json_spirit::Array& params,
                   const std::list<json_spirit::Value_type>& typesExpected,
                   bool fAllowNull)
@@ -208,6 +246,9 @@ static const CRPCCommand vRPCCommands[] =
     { "getblockcount",          &getblockcount,          true,   false },
     { "getconnectioncount",     &getconnectioncount,     true,   false },
     { "getpeerinfo",            &getpeerinfo,            true,   false },
+    { "getnettotals",           &getnettotals,           true,   false },
+    { "getperfstats",           &getperfstats,           true,   true },
+    { "getlockprofile",         &getlockprofile,         true,   true },
     { "getdifficulty",          &getdifficulty,          true,   false },
     { "getgenerate",            &getgenerate,            true,   false },
     { "setgenerate",            &setgenerate,            true,   false },
@@ -270,6 +311,7 @@ static const CRPCCommand vRPCCommands[] =
     { "checkwallet",            &checkwallet,            false,  true},
     { "repairwallet",           &repairwallet,           false,  true},
     { "resendtx",               &resendtx,               false,  true},
+    { "consolidatecoins",       &consolidatecoins,       false,  false},
     { "makekeypair",            &makekeypair,            false,  true},
     { "sendalert",              &sendalert,              false,  false},
 };
@@ -331,7 +373,7 @@ std::string rfc1123Time()
     return std::string(buffer);
 }
 
-static std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive)
+static std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepalive, const char* pszContentType = "application/json")
 {
     if (nStatus == HTTP_UNAUTHORIZED)
         return strprintf("HTTP/1.0 401 Authorization Required\r\n"
@@ -362,7 +404,7 @@ static std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepal
             "Date: %s\r\n"
             "Connection: %s\r\n"
             "Content-Length: %" PRIszu "\r\n"
-            "Content-Type: application/json\r\n"
+            "Content-Type: %s\r\n"
             "Server: curecoin-json-rpc/%s\r\n"
             "\r\n"
             "%s",
@@ -371,6 +413,7 @@ static std::string HTTPReply(int nStatus, const std::string& strMsg, bool keepal
         rfc1123Time().c_str(),
         keepalive ? "keep-alive" : "close",
         strMsg.size(),
+        pszContentType,
         FormatFullVersion().c_str(),
         strMsg.c_str());
 }
@@ -390,6 +433,22 @@ int ReadHTTPStatus(std::basic_istream<char>& stream, int &proto)
     return atoi(vWords[1].c_str());
 }
 
+// Server side counterpart of ReadHTTPStatus: "GET /metrics HTTP/1.1"
+static void ReadHTTPRequestLine(std::basic_istream<char>& stream, std::string& strMethodRet, std::string& strURIRet, int &proto)
+{
+    std::string str;
+    getline(stream, str);
+    boost::trim(str);
+    std::vector<std::string> vWords;
+    boost::split(vWords, str, boost::is_any_of(" "));
+    strMethodRet = vWords.size() > 0 ? vWords[0] : "";
+    strURIRet = vWords.size() > 1 ? vWords[1] : "";
+    proto = 0;
+    const char *ver = strstr(str.c_str(), "HTTP/1.");
+    if (ver != NULL)
+        proto = atoi(ver+7);
+}
+
 int ReadHTTPHeader(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet)
 {
     int nLen = 0;
@@ -415,19 +474,16 @@ int ReadHTTPHeader(std::basic_istream<char>& stream, std::map<std::string, std::
     return nLen;
 }
 
-int ReadHTTP(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet, std::string& strMessageRet)
+// Read the headers and body that follow the first line of a request or reply
+static bool ReadHTTPMessage(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet, std::string& strMessageRet, int nProto)
 {
     mapHeadersRet.clear();
     strMessageRet = "";
 
-    // Read status
-    int nProto = 0;
-    int nStatus = ReadHTTPStatus(stream, nProto);
-
     // Read header
     int nLen = ReadHTTPHeader(stream, mapHeadersRet);
     if (nLen < 0 || nLen > (int)MAX_SIZE)
-        return HTTP_INTERNAL_SERVER_ERROR;
+        return false;
 
     // Read message
     if (nLen > 0)
@@ -447,6 +503,17 @@ int ReadHTTP(std::basic_istream<char>& stream, std::map<std::string, std::string
             mapHeadersRet["connection"] = "close";
     }
 
+    return true;
+}
+
+int ReadHTTP(std::basic_istream<char>& stream, std::map<std::string, std::string>& mapHeadersRet, std::string& strMessageRet)
+{
+    // Read status
+    int nProto = 0;
+    int nStatus = ReadHTTPStatus(stream, nProto);
+
+    if (!ReadHTTPMessage(stream, mapHeadersRet, strMessageRet, nProto))
+        return HTTP_INTERNAL_SERVER_ERROR;
     return nStatus;
 }
 
@@ -958,9 +1025,11 @@ void ThreadRPCServer3(void* parg)
             return;
         }
         std::map<std::string, std::string> mapHeaders;
-        std::string strRequest;
+        std::string strRequest, strMethod, strURI;
+        int nProto = 0;
 
-        ReadHTTP(conn->stream(), mapHeaders, strRequest);
+        ReadHTTPRequestLine(conn->stream(), strMethod, strURI, nProto);
+        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto);
 
         // Check authorization
         if (mapHeaders.count("authorization") == 0)
@@ -983,6 +1052,16 @@ void ThreadRPCServer3(void* parg)
         if (mapHeaders["connection"] == "close")
             fRun = false;
 
+        // Prometheus scrape of the performance counters
+        if (strMethod == "GET")
+        {
+            if (strURI == "/metrics" && GetBoolArg("-rpcmetrics"))
+                conn->stream() << HTTPReply(HTTP_OK, FormatPerfStatsPrometheus(), fRun, "text/plain; version=0.0.4") << std::flush;
+            else
+                conn->stream() << HTTPReply(HTTP_NOT_FOUND, "", fRun) << std::flush;
+            continue;
+        }
+
         JSONRequest jreq;
         try
         {
@@ -1036,6 +1115,11 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
     if (!pcmd)
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
 
+    // Nothing is loaded yet
+    std::string strWarmupStatus;
+    if (RPCIsInWarmup(&strWarmupStatus))
+        throw JSONRPCError(RPC_IN_WARMUP, strWarmupStatus);
+
     // Observe safe mode
     std::string strWarning = GetWarnings("rpc");
     if (strWarning != "" && !GetBoolArg("-disablesafemode") &&
@@ -1164,6 +1248,8 @@ json_spirit::Array RPCConvertValues(const std::string &strMethod, const std::vec
     if (strMethod == "listreceivedbyaccount"  && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "getbalance"             && n > 1) ConvertTo<boost::int64_t>(params[1]);
     if (strMethod == "getblock"               && n > 1) ConvertTo<bool>(params[1]);
+    if (strMethod == "getperfstats"           && n > 0) ConvertTo<bool>(params[0]);
+    if (strMethod == "getlockprofile"         && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "getblockbynumber"       && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "getblockbynumber"       && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "getblockhash"           && n > 0) ConvertTo<boost::int64_t>(params[0]);
@@ -1182,6 +1268,10 @@ json_spirit::Array RPCConvertValues(const std::string &strMethod, const std::vec
     if (strMethod == "sendmany"               && n > 2) ConvertTo<boost::int64_t>(params[2]);
     if (strMethod == "reservebalance"          && n > 0) ConvertTo<bool>(params[0]);
     if (strMethod == "reservebalance"          && n > 1) ConvertTo<double>(params[1]);
+    if (strMethod == "consolidatecoins"       && n > 0) ConvertTo<bool>(params[0]);
+    if (strMethod == "consolidatecoins"       && n > 1) ConvertTo<double>(params[1]);
+    if (strMethod == "consolidatecoins"       && n > 2) ConvertTo<double>(params[2]);
+    if (strMethod == "consolidatecoins"       && n > 3) ConvertTo<double>(params[3]);
     if (strMethod == "addmultisigaddress"     && n > 0) ConvertTo<boost::int64_t>(params[0]);
     if (strMethod == "addmultisigaddress"     && n > 1) ConvertTo<json_spirit::Array>(params[1]);
     if (strMethod == "listunspent"            && n > 0) ConvertTo<boost::int64_t>(params[0]);
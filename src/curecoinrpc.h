@@ -69,6 +69,7 @@ enum RPCErrorCode
     RPC_INVALID_PARAMETER           = -8,  // Invalid, missing or duplicate parameter
     RPC_DATABASE_ERROR              = -20, // Database error
     RPC_DESERIALIZATION_ERROR       = -22, // Error parsing or validating structure in raw format
+    RPC_IN_WARMUP                   = -28, // Client still warming up
 
     // P2P client errors
     RPC_CLIENT_NOT_CONNECTED        = -9,  // curecoin is not connected
@@ -89,6 +90,12 @@ enum RPCErrorCode
 json_spirit::Object JSONRPCError(int code, const std::string& message);
 
 void ThreadRPCServer(void* parg);
+
+/** Until SetRPCWarmupFinished(), every call fails with RPC_IN_WARMUP and the
+ * last status set here (init messages, with their markup removed) */
+void SetRPCWarmupStatus(const std::string& strStatus);
+void SetRPCWarmupFinished();
+bool RPCIsInWarmup(std::string* pstrStatus);
 int CommandLineRPC(int argc, char *argv[]);
 
 /** Convert parameter values for RPC call from strings to command-specific JSON objects. */
@@ -155,6 +162,9 @@ extern double GetPoSKernelPS();
 
 extern json_spirit::Value getconnectioncount(const json_spirit::Array& params, bool fHelp); // in rpcnet.cpp
 extern json_spirit::Value getpeerinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getnettotals(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getperfstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getlockprofile(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value dumpprivkey(const json_spirit::Array& params, bool fHelp); // in rpcdump.cpp
 extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value importaddress(const json_spirit::Array& params, bool fHelp);
@@ -205,6 +215,7 @@ extern json_spirit::Value reservebalance(const json_spirit::Array& params, bool
 extern json_spirit::Value checkwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value repairwallet(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value resendtx(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value consolidatecoins(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value makekeypair(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value validatepubkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnewpubkey(const json_spirit::Array& params, bool fHelp);
@@ -9,14 +9,20 @@
 #include "util.h"
 #include "main.h"
 #include "kernel.h"
+#include "perf.h"
+#include "blockstore.h"
+#include "ui_interface.h"
 #include <boost/version.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 
+#include <condition_variable>
 #include <map>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -494,6 +500,7 @@ void CDBEnv::Flush(bool fShutdown)
 
 bool CTxDB::ReadTxIndex(uint256 hash, CTxIndex& txindex)
 {
+    PERF_TIMER(PERF_TXDB_READTXINDEX);
     assert(!fClient);
     txindex.SetNull();
     return Read(std::make_pair(std::string("tx"), hash), txindex);
@@ -531,6 +538,7 @@ bool CTxDB::ContainsTx(uint256 hash)
 
 bool CTxDB::ReadDiskTx(uint256 hash, CTransaction& tx, CTxIndex& txindex)
 {
+    PERF_TIMER(PERF_TXDB_READDISKTX);
     assert(!fClient);
     tx.SetNull();
     if (!ReadTxIndex(hash, txindex))
@@ -560,6 +568,73 @@ bool CTxDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
     return Write(std::make_pair(std::string("blockindex"), blockindex.GetBlockHash()), blockindex);
 }
 
+// Where in the undo files the CBlockUndo of a connected block is
+bool CTxDB::ReadBlockUndoPos(uint256 hashBlock, unsigned int& nFile, unsigned int& nPos)
+{
+    std::pair<unsigned int, unsigned int> pos;
+    if (!Read(std::make_pair(std::string("blockundo"), hashBlock), pos))
+        return false;
+    nFile = pos.first;
+    nPos = pos.second;
+    return true;
+}
+
+bool CTxDB::WriteBlockUndoPos(uint256 hashBlock, unsigned int nFile, unsigned int nPos)
+{
+    // Records are appended, so the latest of a file is its last indexed one
+    return Write(std::make_pair(std::string("blockundo"), hashBlock), std::make_pair(nFile, nPos)) &&
+           Write(std::make_pair(std::string("undoend"), nFile), nPos);
+}
+
+// Position of the last indexed undo record of each undo file
+bool CTxDB::ReadLastUndoPos(std::map<unsigned int, unsigned int>& mapLastPosRet)
+{
+    mapLastPosRet.clear();
+    Dbc* pcursor = GetCursor();
+    if (!pcursor)
+        return false;
+
+    unsigned int fFlags = DB_SET_RANGE;
+    while (true)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        if (fFlags == DB_SET_RANGE)
+            ssKey << std::make_pair(std::string("undoend"), (unsigned int)0);
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        int ret = ReadAtCursor(pcursor, ssKey, ssValue, fFlags);
+        fFlags = DB_NEXT;
+        if (ret == DB_NOTFOUND)
+            break;
+        else if (ret != 0)
+        {
+            pcursor->close();
+            return false;
+        }
+
+        try {
+        std::string strType;
+        ssKey >> strType;
+        if (strType != "undoend")
+            break;
+        unsigned int nFile, nPos;
+        ssKey >> nFile;
+        ssValue >> nPos;
+        mapLastPosRet[nFile] = nPos;
+        }
+        catch (std::exception &e) {
+            pcursor->close();
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+    }
+    pcursor->close();
+    return true;
+}
+
+bool CTxDB::EraseBlockUndoPos(uint256 hashBlock)
+{
+    return Erase(std::make_pair(std::string("blockundo"), hashBlock));
+}
+
 bool CTxDB::ReadHashBestChain(uint256& hashBestChain)
 {
     return Read(std::string("hashBestChain"), hashBestChain);
@@ -570,14 +645,19 @@ bool CTxDB::WriteHashBestChain(uint256 hashBestChain)
     return Write(std::string("hashBestChain"), hashBestChain);
 }
 
-bool CTxDB::ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust)
+// Kept in the CBigNum serialization it has always been written in
+bool CTxDB::ReadBestInvalidTrust(arith_uint256& bnBestInvalidTrust)
 {
-    return Read(std::string("bnBestInvalidTrust"), bnBestInvalidTrust);
+    CBigNum bn;
+    if (!Read(std::string("bnBestInvalidTrust"), bn))
+        return false;
+    bnBestInvalidTrust = UintToArith256(bn.getuint256());
+    return true;
 }
 
-bool CTxDB::WriteBestInvalidTrust(CBigNum bnBestInvalidTrust)
+bool CTxDB::WriteBestInvalidTrust(const arith_uint256& bnBestInvalidTrust)
 {
-    return Write(std::string("bnBestInvalidTrust"), bnBestInvalidTrust);
+    return Write(std::string("bnBestInvalidTrust"), CBigNum(ArithToUint256(bnBestInvalidTrust)));
 }
 
 bool CTxDB::ReadSyncCheckpoint(uint256& hashCheckpoint)
@@ -606,46 +686,165 @@ CBlockIndex static * InsertBlockIndex(uint256 hash)
         return NULL;
 
     // Return existing
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    CBlockIndexMap::iterator mi = mapBlockIndex.find(hash);
     if (mi != mapBlockIndex.end())
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = mapBlockIndex.NewIndex();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
-bool CTxDB::LoadBlockIndex()
+static const int MAX_CHECK_THREADS = 16;
+
+// The block reads and context free CheckBlock() calls of the -checkblocks
+// verification, done ahead of the sequential checks on worker threads.
+// Blocks are handed out in order, and workers stay at most a window of
+// blocks ahead of the consumer.
+class CBlockVerifyQueue
 {
-    if (!LoadBlockIndexGuts())
-        return false;
+private:
+    struct CResult
+    {
+        CBlock block;
+        bool fRead;
+        bool fValid;
+    };
+
+    const std::vector<CBlockIndex*>& vIndex;
+    bool fCheckBlock;
+    size_t nWindow;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t nNext;        // next block a worker takes
+    size_t nConsumed;    // blocks handed out by Get
+    bool fStop;
+    std::map<size_t, CResult> mapDone;
+    std::vector<std::thread> vThreads;
+
+    void Work()
+    {
+        RenameThread("curecoin-verify");
+        while (true)
+        {
+            size_t n;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!fStop && nNext < vIndex.size() && nNext >= nConsumed + nWindow)
+                    cond.wait(lock);
+                if (fStop || nNext >= vIndex.size())
+                    return;
+                n = nNext++;
+            }
 
-    if (fRequestShutdown)
-        return true;
+            CResult result;
+            result.fRead = result.block.ReadFromDisk(vIndex[n]);
+            result.fValid = result.fRead && (!fCheckBlock || result.block.CheckBlock());
 
-    // Calculate bnChainTrust
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                mapDone[n] = std::move(result);
+            }
+            cond.notify_all();
+        }
+    }
+
+public:
+    CBlockVerifyQueue(const std::vector<CBlockIndex*>& vIndexIn, bool fCheckBlockIn, int nThreads) :
+        vIndex(vIndexIn), fCheckBlock(fCheckBlockIn), nWindow(nThreads * 16), nNext(0), nConsumed(0), fStop(false)
     {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        for (int i = 0; i < nThreads; i++)
+            vThreads.push_back(std::thread(&CBlockVerifyQueue::Work, this));
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
+
+    ~CBlockVerifyQueue()
     {
-        CBlockIndex* pindex = item.second;
-        pindex->bnChainTrust = (pindex->pprev ? pindex->pprev->bnChainTrust : 0) + pindex->GetBlockTrust();
-        // ppcoin: calculate stake modifier checksum
-        pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
-        if (!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
-            return error("CTxDB::LoadBlockIndex() : Failed stake modifier checkpoint height=%d, modifier=0x%016" PRI64x, pindex->nHeight, pindex->nStakeModifier);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+        BOOST_FOREACH(std::thread& thread, vThreads)
+            thread.join();
+    }
+
+    // Block n of vIndex, and whether it passed CheckBlock (if asked to check).
+    // Returns false if it couldn't be read.
+    bool Get(size_t n, CBlock& block, bool& fValid)
+    {
+        CResult result;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!mapDone.count(n))
+                cond.wait(lock);
+            result = std::move(mapDone[n]);
+            mapDone.erase(n);
+            nConsumed = n + 1;
+        }
+        cond.notify_all();
+        block = std::move(result.block);
+        fValid = result.fValid;
+        return result.fRead;
+    }
+};
+
+bool CTxDB::LoadBlockIndex()
+{
+    // The snapshot of the last clean shutdown has the trust and modifier
+    // checksums computed already, but is only good if this database still
+    // ends at the same best chain
+    uint256 hashBestChainDisk;
+    CBlockIndexSnapshot snapshot;
+    bool fSnapshot = GetBoolArg("-blockindexsnapshot", true) && ReadHashBestChain(hashBestChainDisk) && snapshot.Read(hashBestChainDisk);
+    snapshot.Remove();
+
+    if (!fSnapshot)
+    {
+        if (!LoadBlockIndexGuts())
+            return false;
+
+        if (fRequestShutdown)
+            return true;
+
+        // Calculate bnChainTrust
+        std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+        BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
+        {
+            CBlockIndex* pindex = item.second;
+            pindex->bnChainTrust = (pindex->pprev ? pindex->pprev->bnChainTrust : 0) + pindex->GetBlockTrust();
+            // ppcoin: calculate stake modifier checksum
+            pindex->nStakeModifierChecksum = GetStakeModifierChecksum(pindex);
+            if (!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
+                return error("CTxDB::LoadBlockIndex() : Failed stake modifier checkpoint height=%d, modifier=0x%016" PRI64x, pindex->nHeight, pindex->nStakeModifier);
+        }
+    }
+
+    // The block file writer must not append over a block we have indexed
+    std::map<unsigned int, unsigned int> mapLastBlockPos;
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+    {
+        unsigned int& nLastPos = mapLastBlockPos[item.second->nFile];
+        nLastPos = std::max(nLastPos, item.second->nBlockPos);
     }
+    BOOST_FOREACH(const PAIRTYPE(unsigned int, unsigned int)& item, mapLastBlockPos)
+        SetLastIndexedBlock(item.first, item.second);
+    // Nor the undo file writer over undo data
+    std::map<unsigned int, unsigned int> mapLastUndoPos;
+    if (!ReadLastUndoPos(mapLastUndoPos))
+        return error("CTxDB::LoadBlockIndex() : ReadLastUndoPos failed");
+    BOOST_FOREACH(const PAIRTYPE(unsigned int, unsigned int)& item, mapLastUndoPos)
+        SetLastIndexedUndo(item.first, item.second);
 
     // Load hashBestChain pointer to end of best chain
     if (!ReadHashBestChain(hashBestChain))
@@ -678,18 +877,34 @@ bool CTxDB::LoadBlockIndex()
         nCheckDepth = 1000000000; // suffices until the year 19000
     if (nCheckDepth > nBestHeight)
         nCheckDepth = nBestHeight;
-    printf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+    int nCheckThreads = std::max(1, std::min((int)GetArg("-checkthreads", std::thread::hardware_concurrency()), MAX_CHECK_THREADS));
+    printf("Verifying last %i blocks at level %i on %d threads\n", nCheckDepth, nCheckLevel, nCheckThreads);
+    std::vector<CBlockIndex*> vVerify;
+    for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev && pindex->nHeight >= nBestHeight-nCheckDepth; pindex = pindex->pprev)
+        vVerify.push_back(pindex);
+    CBlockVerifyQueue queue(vVerify, nCheckLevel>0, nCheckThreads);
+
     CBlockIndex* pindexFork = NULL;
     std::map<std::pair<unsigned int, unsigned int>, CBlockIndex*> mapBlockPos;
-    for (CBlockIndex* pindex = pindexBest; pindex && pindex->pprev; pindex = pindex->pprev)
+    int nLastProgress = -1;
+    for (unsigned int i = 0; i < vVerify.size(); i++)
     {
-        if (fRequestShutdown || pindex->nHeight < nBestHeight-nCheckDepth)
+        if (fRequestShutdown)
             break;
+        int nProgress = (int)(i * 100 / vVerify.size());
+        if (nProgress != nLastProgress)
+        {
+            uiInterface.InitMessage(strprintf(_("Verifying blocks... %d%%"), nProgress));
+            nLastProgress = nProgress;
+        }
+
+        CBlockIndex* pindex = vVerify[i];
         CBlock block;
-        if (!block.ReadFromDisk(pindex))
+        bool fValid;
+        if (!queue.Get(i, block, fValid))
             return error("LoadBlockIndex() : block.ReadFromDisk failed");
         // check level 1: verify block validity
-        if (nCheckLevel>0 && !block.CheckBlock())
+        if (!fValid)
         {
             printf("LoadBlockIndex() : *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString().c_str());
             pindexFork = pindex->pprev;
@@ -883,30 +1098,331 @@ bool CTxDB::LoadBlockIndexGuts()
 
 
 
+//
+// CBlockIndexSnapshot
+//
+
+static const int BLOCKINDEX_SNAPSHOT_VERSION = 1;
+static const unsigned int BLOCKINDEX_SNAPSHOT_NONE = (unsigned int)-1;
+
+// One entry of blkindex.snapshot: the block hash, the fields of
+// CDiskBlockIndex, the computed chain trust and modifier checksum, and pprev
+// and pnext as positions in the snapshot instead of hashes
+class CBlockIndexSnapshotEntry
+{
+public:
+    uint256 hashBlock;
+    unsigned int nPrev;
+    unsigned int nNext;
+    CBlockIndex* pindex;
+
+    explicit CBlockIndexSnapshotEntry(CBlockIndex* pindexIn) : nPrev(BLOCKINDEX_SNAPSHOT_NONE), nNext(BLOCKINDEX_SNAPSHOT_NONE), pindex(pindexIn) {}
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(nPrev);
+        READWRITE(nNext);
+        READWRITE(pindex->nFile);
+        READWRITE(pindex->nBlockPos);
+        READWRITE(pindex->nHeight);
+        READWRITE(pindex->nMint);
+        READWRITE(pindex->nMoneySupply);
+        READWRITE(pindex->nFlags);
+        READWRITE(pindex->nStakeModifier);
+        if (pindex->IsProofOfStake())
+        {
+            READWRITE(pindex->prevoutStake);
+            READWRITE(pindex->nStakeTime);
+            READWRITE(pindex->hashProofOfStake);
+        }
+        READWRITE(pindex->nVersion);
+        READWRITE(pindex->hashMerkleRoot);
+        READWRITE(pindex->nTime);
+        READWRITE(pindex->nBits);
+        READWRITE(pindex->nNonce);
+        uint256 hashChainTrust = ArithToUint256(pindex->bnChainTrust);
+        READWRITE(hashChainTrust);
+        if (fRead)
+            pindex->bnChainTrust = UintToArith256(hashChainTrust);
+        READWRITE(pindex->nStakeModifierChecksum);
+    )
+};
+
+typedef std::vector<std::pair<const CBlockIndex*, unsigned int> > SnapshotPositions;
+
+static unsigned int GetSnapshotPosition(const SnapshotPositions& vPos, const CBlockIndex* pindex)
+{
+    if (pindex == NULL)
+        return BLOCKINDEX_SNAPSHOT_NONE;
+    SnapshotPositions::const_iterator it = lower_bound(vPos.begin(), vPos.end(), std::make_pair(pindex, 0u));
+    if (it == vPos.end() || it->first != pindex)
+        throw std::runtime_error("GetSnapshotPosition() : block index entry not in mapBlockIndex");
+    return it->second;
+}
+
+CBlockIndexSnapshot::CBlockIndexSnapshot()
+{
+    pathSnapshot = GetDataDir() / "blkindex.snapshot";
+}
+
+bool CBlockIndexSnapshot::Write()
+{
+    LOCK(cs_main);
+    if (pindexBest == NULL)
+        return false;
+    int64 nStart = GetTimeMillis();
+
+    // Entries are written in mapBlockIndex order; pprev and pnext become
+    // positions in that order
+    SnapshotPositions vPos;
+    vPos.reserve(mapBlockIndex.size());
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        vPos.push_back(std::make_pair((const CBlockIndex*)item.second, (unsigned int)vPos.size()));
+    sort(vPos.begin(), vPos.end());
+
+    boost::filesystem::path pathTmp = GetDataDir() / "blkindex.snapshot.new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("CBlockIndexSnapshot::Write() : open failed");
+
+    // Serialize a chunk at a time, checksum everything and append the checksum
+    try {
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(pchMessageStart) << BLOCKINDEX_SNAPSHOT_VERSION << hashBestChain << (unsigned int)mapBlockIndex.size();
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        {
+            CBlockIndexSnapshotEntry entry(item.second);
+            entry.hashBlock = item.first;
+            entry.nPrev = GetSnapshotPosition(vPos, item.second->pprev);
+            entry.nNext = GetSnapshotPosition(vPos, item.second->pnext);
+            ss << entry;
+            if (ss.size() >= 0x100000)
+            {
+                hasher.write(&ss[0], ss.size());
+                fileout.write(&ss[0], ss.size());
+                ss.clear();
+            }
+        }
+        if (!ss.empty())
+        {
+            hasher.write(&ss[0], ss.size());
+            fileout.write(&ss[0], ss.size());
+        }
+        fileout << hasher.GetHash();
+    }
+    catch (std::exception &e) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
+        return error("CBlockIndexSnapshot::Write() : %s", e.what());
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, pathSnapshot))
+        return error("CBlockIndexSnapshot::Write() : Rename-into-place failed");
+
+    printf("Wrote block index snapshot of %" PRIszu " entries  %" PRI64d "ms\n", mapBlockIndex.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+static bool ReadBlockIndexSnapshot(const char* pbegin, const char* pend, const uint256& hashBestChainExpected)
+{
+    if (pend - pbegin < (ptrdiff_t)sizeof(uint256))
+        return error("ReadBlockIndexSnapshot() : file too short");
+    uint256 hashChecksum;
+    pend -= sizeof(uint256);
+    memcpy(&hashChecksum, pend, sizeof(uint256));
+    if (hashChecksum != Hash(pbegin, pend))
+        return error("ReadBlockIndexSnapshot() : checksum mismatch, data corrupted");
+
+    CBufferReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+    unsigned char pchMsgTmp[4];
+    int nSnapshotVersion;
+    uint256 hashBest;
+    unsigned int nEntries;
+    reader >> FLATDATA(pchMsgTmp) >> nSnapshotVersion >> hashBest >> nEntries;
+    if (memcmp(pchMsgTmp, pchMessageStart, sizeof(pchMsgTmp)))
+        return error("ReadBlockIndexSnapshot() : invalid network magic number");
+    if (nSnapshotVersion != BLOCKINDEX_SNAPSHOT_VERSION)
+        return error("ReadBlockIndexSnapshot() : unknown version %d", nSnapshotVersion);
+    if (hashBest != hashBestChainExpected)
+        return error("ReadBlockIndexSnapshot() : snapshot ends at %s, not at the best chain %s",
+            hashBest.ToString().substr(0,20).c_str(), hashBestChainExpected.ToString().substr(0,20).c_str());
+    if (nEntries > reader.size())
+        return error("ReadBlockIndexSnapshot() : bad entry count %u", nEntries);
+
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<std::pair<unsigned int, unsigned int> > vLinks;
+    vIndex.reserve(nEntries);
+    vLinks.reserve(nEntries);
+    mapBlockIndex.reserve(nEntries);
+    for (unsigned int i = 0; i < nEntries; i++)
+    {
+        CBlockIndex index;
+        CBlockIndexSnapshotEntry entry(&index);
+        reader >> entry;
+
+        CBlockIndex* pindexNew = mapBlockIndex.NewIndex(index);
+        std::pair<CBlockIndexMap::iterator, bool> ret = mapBlockIndex.insert(std::make_pair(entry.hashBlock, pindexNew));
+        if (!ret.second)
+            return error("ReadBlockIndexSnapshot() : duplicate entry %s", entry.hashBlock.ToString().substr(0,20).c_str());
+        pindexNew->phashBlock = &((*ret.first).first);
+        vIndex.push_back(pindexNew);
+        vLinks.push_back(std::make_pair(entry.nPrev, entry.nNext));
+    }
+    if (!reader.empty())
+        return error("ReadBlockIndexSnapshot() : trailing data");
+
+    for (unsigned int i = 0; i < nEntries; i++)
+    {
+        CBlockIndex* pindex = vIndex[i];
+        if ((vLinks[i].first != BLOCKINDEX_SNAPSHOT_NONE && vLinks[i].first >= nEntries) ||
+            (vLinks[i].second != BLOCKINDEX_SNAPSHOT_NONE && vLinks[i].second >= nEntries))
+            return error("ReadBlockIndexSnapshot() : bad link at %u", i);
+        pindex->pprev = vLinks[i].first == BLOCKINDEX_SNAPSHOT_NONE ? NULL : vIndex[vLinks[i].first];
+        pindex->pnext = vLinks[i].second == BLOCKINDEX_SNAPSHOT_NONE ? NULL : vIndex[vLinks[i].second];
+
+        // Watch for genesis block
+        if (pindexGenesisBlock == NULL && pindex->GetBlockHash() == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet))
+            pindexGenesisBlock = pindex;
+
+        if (!pindex->CheckIndex())
+            return error("ReadBlockIndexSnapshot() : CheckIndex failed at %d", pindex->nHeight);
+        if (!CheckStakeModifierCheckpoints(pindex->nHeight, pindex->nStakeModifierChecksum))
+            return error("ReadBlockIndexSnapshot() : Failed stake modifier checkpoint height=%d, modifier=0x%016" PRI64x, pindex->nHeight, pindex->nStakeModifier);
+
+        // ppcoin: build setStakeSeen
+        if (pindex->IsProofOfStake())
+            setStakeSeen.insert(std::make_pair(pindex->prevoutStake, pindex->nStakeTime));
+    }
+    return true;
+}
+
+bool CBlockIndexSnapshot::Read(const uint256& hashBestChainExpected)
+{
+    if (!mapBlockIndex.empty() || !boost::filesystem::exists(pathSnapshot))
+        return false;
+    int64 nStart = GetTimeMillis();
+
+    // Map the file, or read it whole where it can't be mapped
+    std::shared_ptr<const CBlockFileView> pview = MapFile(pathSnapshot);
+    std::vector<char> vchData;
+    if (!pview)
+    {
+        try {
+            vchData.resize(boost::filesystem::file_size(pathSnapshot));
+            boost::filesystem::ifstream filein(pathSnapshot, std::ios_base::in | std::ios_base::binary);
+            if (vchData.empty() || !filein.read(&vchData[0], vchData.size()))
+                return error("CBlockIndexSnapshot::Read() : read failed");
+        }
+        catch (std::exception &e) {
+            return error("CBlockIndexSnapshot::Read() : %s", e.what());
+        }
+    }
+    const char* pbegin = pview ? pview->pbegin : &vchData[0];
+    const char* pend = pview ? pview->pbegin + pview->nSize : &vchData[0] + vchData.size();
+
+    bool fRet = false;
+    try {
+        fRet = ReadBlockIndexSnapshot(pbegin, pend, hashBestChainExpected);
+    }
+    catch (std::exception &e) {
+        error("CBlockIndexSnapshot::Read() : deserialize error");
+    }
+    if (!fRet)
+    {
+        // Leave nothing behind for the blkindex.dat path
+        mapBlockIndex.clear();
+        setStakeSeen.clear();
+        pindexGenesisBlock = NULL;
+        return false;
+    }
+
+    printf("Loaded block index snapshot of %" PRIszu " entries  %" PRI64d "ms\n", mapBlockIndex.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+void CBlockIndexSnapshot::Remove()
+{
+    try {
+        boost::filesystem::remove(pathSnapshot);
+    }
+    catch (std::exception &e) {
+        printf("CBlockIndexSnapshot::Remove() : %s\n", e.what());
+    }
+}
+
+
+
+
+
 //
 // CAddrDB
 //
 
+/** File stream that hashes everything written to or read from it, so
+ * peers.dat is checksummed as it streams instead of through a copy in memory */
+class CHashedAutoFile
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    int nType;
+    int nVersion;
+
+    CHashedAutoFile(CAutoFile& fileIn) : file(fileIn), hasher(fileIn.nType, fileIn.nVersion), nType(fileIn.nType), nVersion(fileIn.nVersion) {}
+
+    CHashedAutoFile& write(const char* pch, size_t nSize)
+    {
+        file.write(pch, nSize);
+        hasher.write(pch, nSize);
+        return (*this);
+    }
+
+    CHashedAutoFile& read(char* pch, size_t nSize)
+    {
+        file.read(pch, nSize);
+        hasher.write(pch, nSize);
+        return (*this);
+    }
+
+    // invalidates the object
+    uint256 GetHash() { return hasher.GetHash(); }
+
+    template<typename T>
+    CHashedAutoFile& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    template<typename T>
+    CHashedAutoFile& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 
 CAddrDB::CAddrDB()
 {
     pathAddr = GetDataDir() / "peers.dat";
+    pathJournal = GetDataDir() / "peers.log";
 }
 
-bool CAddrDB::Write(const CAddrMan& addr)
+bool CAddrDB::Write(const CAddrMan& addr, uint256* phashRet)
 {
     // Generate random temporary filename
     unsigned short randv = 0;
     RAND_bytes((unsigned char *)&randv, sizeof(randv));
     std::string tmpfn = strprintf("peers.dat.%04x", randv);
 
-    // serialize addresses, checksum data up to that point, then append csum
-    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
-    ssPeers << FLATDATA(pchMessageStart);
-    ssPeers << addr;
-    uint256 hash = Hash(ssPeers.begin(), ssPeers.end());
-    ssPeers << hash;
-
     // open temp output file, and associate with CAutoFile
     boost::filesystem::path pathTmp = GetDataDir() / tmpfn;
     FILE *file = fopen(pathTmp.string().c_str(), "wb");
@@ -914,11 +1430,19 @@ bool CAddrDB::Write(const CAddrMan& addr)
     if (!fileout)
         return error("CAddrman::Write() : open failed");
 
-    // Write and commit header, data
+    // serialize addresses straight to the file, checksumming as they go, then append csum
     try {
-        fileout << ssPeers;
+        CHashedAutoFile hashout(fileout);
+        hashout << FLATDATA(pchMessageStart);
+        hashout << addr;
+        uint256 hash = hashout.GetHash();
+        fileout << hash;
+        if (phashRet)
+            *phashRet = hash;
     }
     catch (std::exception &e) {
+        fileout.fclose();
+        boost::filesystem::remove(pathTmp);
         return error("CAddrman::Write() : I/O error");
     }
     FileCommit(fileout);
@@ -931,7 +1455,7 @@ bool CAddrDB::Write(const CAddrMan& addr)
     return true;
 }
 
-bool CAddrDB::Read(CAddrMan& addr)
+bool CAddrDB::Read(CAddrMan& addr, uint256* phashRet)
 {
     // open input file, and associate with CAutoFile
     FILE *file = fopen(pathAddr.string().c_str(), "rb");
@@ -939,46 +1463,169 @@ bool CAddrDB::Read(CAddrMan& addr)
     if (!filein)
         return error("CAddrman::Read() : open failed");
 
-    // use file size to size memory buffer
-    int fileSize = GetFilesize(filein);
-    int dataSize = fileSize - sizeof(uint256);
-    std::vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
+    // de-serialize straight from the file, checksumming as we go; the
+    // addresses are only kept if the checksum at the end matches
+    CAddrMan addrRead;
+    unsigned char pchMsgTmp[4];
     try {
-        filein.read((char *)&vchData[0], dataSize);
+        CHashedAutoFile hashin(filein);
+
+        // de-serialize file header (pchMessageStart magic number) and
+        hashin >> FLATDATA(pchMsgTmp);
+
+        // verify the network matches ours
+        if (memcmp(pchMsgTmp, pchMessageStart, sizeof(pchMsgTmp)))
+            return error("CAddrman::Read() : invalid network magic number");
+
+        // de-serialize address data
+        hashin >> addrRead;
+
+        // verify stored checksum matches input data
+        uint256 hashIn;
         filein >> hashIn;
+        if (hashIn != hashin.GetHash())
+            return error("CAddrman::Read() : checksum mismatch; data corrupted");
+        if (phashRet)
+            *phashRet = hashIn;
     }
     catch (std::exception &e) {
-        return error("CAddrman::Read() 2 : I/O error or stream data corrupted");
+        return error("CAddrman::Read() : I/O error or stream data corrupted");
     }
-    filein.fclose();
 
-    CDataStream ssPeers(vchData, SER_DISK, CLIENT_VERSION);
+    addr.Swap(addrRead);
+    return true;
+}
 
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssPeers.begin(), ssPeers.end());
-    if (hashIn != hashTmp)
-        return error("CAddrman::Read() : checksum mismatch; data corrupted");
+bool CAddrDB::StartJournal(const uint256& hashBase)
+{
+    boost::filesystem::path pathTmp = pathJournal;
+    pathTmp += ".new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("CAddrDB::StartJournal() : open failed");
 
-    unsigned char pchMsgTmp[4];
     try {
-        // de-serialize file header (pchMessageStart magic number) and
-        ssPeers >> FLATDATA(pchMsgTmp);
+        fileout << FLATDATA(pchMessageStart) << hashBase;
+    }
+    catch (std::exception &e) {
+        return error("CAddrDB::StartJournal() : I/O error");
+    }
+    FileCommit(fileout);
+    fileout.fclose();
 
-        // verify the network matches ours
-        if (memcmp(pchMsgTmp, pchMessageStart, sizeof(pchMsgTmp)))
-            return error("CAddrman::Read() : invalid network magic number");
+    if (!RenameOver(pathTmp, pathJournal))
+        return error("CAddrDB::StartJournal() : Rename-into-place failed");
+    return true;
+}
 
-        // de-serialize address data into one CAddrMan object
-        ssPeers >> addr;
+bool CAddrDB::AppendJournal(const std::vector<CAddrChange>& vChanges)
+{
+    if (!boost::filesystem::exists(pathJournal))
+        return false;
+
+    // each batch: size, the changes, and the hash of the changes
+    CDataStream ssBatch(SER_DISK, CLIENT_VERSION);
+    ssBatch << vChanges;
+    unsigned int nSize = ssBatch.size();
+    uint256 hash = Hash(ssBatch.begin(), ssBatch.end());
+
+    FILE *file = fopen(pathJournal.string().c_str(), "ab");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("CAddrDB::AppendJournal() : open failed");
+
+    try {
+        fileout << nSize;
+        fileout.write(&ssBatch[0], nSize);
+        fileout << hash;
     }
     catch (std::exception &e) {
-        return error("CAddrman::Read() : I/O error or stream data corrupted");
+        return error("CAddrDB::AppendJournal() : I/O error");
     }
-
+    FileCommit(fileout);
     return true;
 }
 
+int CAddrDB::ReadJournal(CAddrMan& addr, const uint256& hashBase)
+{
+    FILE *file = fopen(pathJournal.string().c_str(), "rb");
+    CAutoFile filein = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return -1;
+
+    unsigned char pchMsgTmp[4];
+    uint256 hashIn;
+    try {
+        filein >> FLATDATA(pchMsgTmp) >> hashIn;
+    }
+    catch (std::exception &e) {
+        return -1;
+    }
+    if (memcmp(pchMsgTmp, pchMessageStart, sizeof(pchMsgTmp)) || hashIn != hashBase)
+    {
+        printf("CAddrDB::ReadJournal() : peers.log is not for this peers.dat, ignoring it\n");
+        return -1;
+    }
+
+    int nChanges = 0;
+    long nGood = ftell(filein);
+    while (true)
+    {
+        std::vector<CAddrChange> vChanges;
+        try {
+            unsigned int nSize;
+            filein >> nSize;
+            if (nSize > ADDRDB_JOURNAL_MAX_BATCH)
+                break;
+            std::vector<char> vchBatch(nSize);
+            if (nSize > 0)
+                filein.read(&vchBatch[0], nSize);
+            filein >> hashIn;
+            if (hashIn != Hash(vchBatch.begin(), vchBatch.end()))
+                break;
+            CDataStream ssBatch(vchBatch.begin(), vchBatch.end(), SER_DISK, CLIENT_VERSION);
+            ssBatch >> vChanges;
+        }
+        catch (std::exception &e) {
+            break;
+        }
+        addr.ApplyChanges(vChanges);
+        nChanges += vChanges.size();
+        nGood = ftell(filein);
+    }
+
+    // cut off a batch torn by a crash, so later batches are appended after good data
+    if (GetFilesize(filein) > nGood)
+    {
+        filein.fclose();
+        printf("CAddrDB::ReadJournal() : dropping %d bytes at the end of peers.log\n", (int)(boost::filesystem::file_size(pathJournal) - nGood));
+        try {
+            boost::filesystem::resize_file(pathJournal, nGood);
+        }
+        catch (boost::filesystem::filesystem_error &e) {
+            printf("CAddrDB::ReadJournal() : %s\n", e.what());
+            return -1;
+        }
+    }
+    return nChanges;
+}
+
+void CAddrDB::EraseJournal()
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove(pathJournal, ec);
+}
+
+bool CAddrDB::JournalNeedsCompaction()
+{
+    boost::system::error_code ec;
+    boost::uintmax_t nJournal = boost::filesystem::file_size(pathJournal, ec);
+    if (ec)
+        return false;
+    boost::uintmax_t nSnapshot = boost::filesystem::file_size(pathAddr, ec);
+    if (ec)
+        nSnapshot = 0;
+    return nJournal > ADDRDB_JOURNAL_MIN_COMPACT && nJournal > nSnapshot;
+}
+
@@ -16,6 +16,7 @@
 #include <db_cxx.h>
 
 class CAddress;
+class CAddrChange;
 class CAddrMan;
 class CBlockLocator;
 class CDiskBlockIndex;
@@ -338,10 +339,14 @@ public:
     bool ReadDiskTx(COutPoint outpoint, CTransaction& tx, CTxIndex& txindex);
     bool ReadDiskTx(COutPoint outpoint, CTransaction& tx);
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+    bool ReadBlockUndoPos(uint256 hashBlock, unsigned int& nFile, unsigned int& nPos);
+    bool WriteBlockUndoPos(uint256 hashBlock, unsigned int nFile, unsigned int nPos);
+    bool EraseBlockUndoPos(uint256 hashBlock);
+    bool ReadLastUndoPos(std::map<unsigned int, unsigned int>& mapLastPosRet);
     bool ReadHashBestChain(uint256& hashBestChain);
     bool WriteHashBestChain(uint256 hashBestChain);
-    bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust);
-    bool WriteBestInvalidTrust(CBigNum bnBestInvalidTrust);
+    bool ReadBestInvalidTrust(arith_uint256& bnBestInvalidTrust);
+    bool WriteBestInvalidTrust(const arith_uint256& bnBestInvalidTrust);
     bool ReadSyncCheckpoint(uint256& hashCheckpoint);
     bool WriteSyncCheckpoint(uint256 hashCheckpoint);
     bool ReadCheckpointPubKey(std::string& strPubKey);
@@ -354,15 +359,59 @@ private:
 
 
 
-/** Access to the (IP) address database (peers.dat) */
+/** peers.log is folded back into peers.dat once it is larger than both
+ * peers.dat and this many bytes */
+static const unsigned int ADDRDB_JOURNAL_MIN_COMPACT = 256 * 1024;
+/** peers.log is folded back into peers.dat at least this often (seconds) */
+static const int64 ADDRDB_COMPACT_INTERVAL = 24 * 60 * 60;
+/** Largest batch of address changes read back from peers.log */
+static const unsigned int ADDRDB_JOURNAL_MAX_BATCH = 32 * 1024 * 1024;
+
+/** Access to the (IP) address database (peers.dat).
+ *
+ * peers.dat holds a full snapshot of the address manager. Changes made
+ * since are appended in checksummed batches to a journal, peers.log, whose
+ * header names the checksum of the peers.dat it applies to. Reading replays
+ * the batches that are intact; a torn batch at the end is cut off.
+ */
 class CAddrDB
 {
 private:
     boost::filesystem::path pathAddr;
+    boost::filesystem::path pathJournal;
 public:
     CAddrDB();
-    bool Write(const CAddrMan& addr);
-    bool Read(CAddrMan& addr);
+    bool Write(const CAddrMan& addr, uint256* phashRet = NULL);
+    bool Read(CAddrMan& addr, uint256* phashRet = NULL);
+
+    /** Replace peers.log with an empty journal on top of the peers.dat with checksum hashBase */
+    bool StartJournal(const uint256& hashBase);
+    /** Append a batch of changes; fails if there is no journal to append to */
+    bool AppendJournal(const std::vector<CAddrChange>& vChanges);
+    /** Replay peers.log onto addr. Returns the number of changes replayed,
+     * or -1 if there is no journal for the peers.dat with checksum hashBase. */
+    int ReadJournal(CAddrMan& addr, const uint256& hashBase);
+    void EraseJournal();
+    /** Whether peers.log has grown enough to be folded into peers.dat */
+    bool JournalNeedsCompaction();
+};
+
+
+/** Flat snapshot of the block index (blkindex.snapshot).
+ * Written at shutdown with the computed chain trust and stake modifier
+ * checksums, so the next startup can map it instead of walking every
+ * blockindex record in blkindex.dat. Read consumes the file: it is only good
+ * for the very next start after a clean shutdown.
+ */
+class CBlockIndexSnapshot
+{
+private:
+    boost::filesystem::path pathSnapshot;
+public:
+    CBlockIndexSnapshot();
+    bool Write();
+    bool Read(const uint256& hashBestChainExpected);
+    void Remove();
 };
 
 #endif // curecoin_DB_H
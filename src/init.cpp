@@ -9,6 +9,7 @@
 #include "init.h"
 #include "main.h"
 #include "util.h"
+#include "perf.h"
 #include "ui_interface.h"
 #include "checkpoints.h"
 #include "uint256.h"
@@ -76,6 +77,9 @@ void Shutdown(void* parg)
         nTransactionsUpdated++;
         bitdb.Flush(false);
         StopNode();
+        CloseBlockFile();
+        if (GetBoolArg("-blockindexsnapshot", true))
+            CBlockIndexSnapshot().Write();
         bitdb.Flush(true);
         boost::filesystem::remove(GetPidFile());
         UnregisterWallet(pwalletMain);
@@ -245,12 +249,22 @@ std::string HelpMessage()
         "  -listen                " + _("Accept connections from outside (default: 1 if no -proxy or -connect)") + "\n" +
         "  -bind=<addr>           " + _("Bind to given address. Use [host]:port notation for IPv6") + "\n" +
         "  -dnsseed               " + _("Find peers using DNS lookup (default: 1)") + "\n" +
+        "  -compactblocks         " + _("Relay new blocks to peers as short transaction ids they fill in from their memory pool (default: 1)") + "\n" +
+        "  -headersfirst          " + _("Fetch block headers first, then blocks from several peers at once (default: 1)") + "\n" +
         "  -staking               " + _("Stake your coins to support the network and gain rewards (default: 1)") + "\n" +
+        "  -stakethreads=<n>      " + _("Number of threads searching for stake kernels (1-16, default: 1)") + "\n" +
+        "  -consolidate           " + _("Combine small outputs in the background while the wallet is idle (default: 0)") + "\n" +
+        "  -consolidatethreshold=<amt> " + _("Outputs smaller than this are combined (default: 1)") + "\n" +
+        "  -consolidatetarget=<amt> " + _("Size of the outputs they are combined into (default: 10)") + "\n" +
+        "  -consolidatemaxfee=<amt> " + _("Most fee spent in one consolidation run (default: 0.1)") + "\n" +
         "  -nosynccheckpoints     " + _("Disable sync checkpoints (default: 0)") + "\n" +
         "  -banscore=<n>          " + _("Threshold for disconnecting misbehaving peers (default: 100)") + "\n" +
         "  -bantime=<n>           " + _("Number of seconds to keep misbehaving peers from reconnecting (default: 86400)") + "\n" +
         "  -maxreceivebuffer=<n>  " + _("Maximum per-connection receive buffer, <n>*1000 bytes (default: 5000)") + "\n" +
         "  -maxsendbuffer=<n>     " + _("Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)") + "\n" +
+        "  -maxuploadrate=<n>     " + _("Limit total upload rate to <n> kilobytes per second (default: 0 = unlimited)") + "\n" +
+        "  -maxpeeruploadrate=<n> " + _("Limit upload rate to each peer to <n> kilobytes per second (default: 0 = unlimited)") + "\n" +
+        "  -maxuploadtarget=<n>   " + _("Stop serving old blocks after uploading <n> MiB in 24 hours (default: 0 = no limit)") + "\n" +
 #if USE_UPNP
 #if USE_UPNP
         "  -upnp                  " + _("Use UPnP to map the listening port (default: 1 when listening)") + "\n" +
@@ -270,6 +284,8 @@ std::string HelpMessage()
         "  -debug                 " + _("Output extra debugging information. Implies all other -debug* options") + "\n" +
         "  -debugnet              " + _("Output extra network debugging information") + "\n" +
         "  -logtimestamps         " + _("Prepend debug output with timestamp") + "\n" +
+        "  -perfstats             " + _("Collect timings of hot code paths and lock contention for getperfstats (default: 1)") + "\n" +
+        "  -lockprofile           " + _("Record wait and hold times of every LOCK() site for getlockprofile (default: 0)") + "\n" +
         "  -shrinkdebugfile       " + _("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n" +
         "  -printtoconsole        " + _("Send trace/debug info to console instead of debug.log file") + "\n" +
 #ifdef WIN32
@@ -279,6 +295,7 @@ std::string HelpMessage()
         "  -rpcpassword=<pw>      " + _("Password for JSON-RPC connections") + "\n" +
         "  -rpcport=<port>        " + _("Listen for JSON-RPC connections on <port> (default: 18512 or testnet: 18519)") + "\n" +
         "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified IP address") + "\n" +
+        "  -rpcmetrics            " + _("Serve performance counters to authenticated GET /metrics requests in Prometheus format (default: 0)") + "\n" +
         "  -rpcconnect=<ip>       " + _("Send commands to node running on <ip> (default: 127.0.0.1)") + "\n" +
         "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n" +
 		"  -walletnotify=<cmd>    " + _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)") + "\n" +
@@ -289,8 +306,13 @@ std::string HelpMessage()
         "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + "\n" +
         "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n" +
         "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n" +
+        "  -checkthreads=<n>      " + _("Number of threads reading and checking blocks at startup (1-16, default: number of cores)") + "\n" +
         "  -assumevalid=<hex>     " + _("If this block hash is in the chain, skip script verification for blocks before it (default: mainnet checkpoint, empty for testnet)") + "\n" +
         "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n" +
+        "  -blockindexsnapshot    " + _("Save the block index at shutdown and load it from there at the next start (default: 1)") + "\n" +
+#ifndef WIN32
+        "  -blockmmap             " + _("Read blocks from memory mapped block files (default: 1 on 64-bit systems)") + "\n" +
+#endif
 
         "\n" + _("Block creation options:") + "\n" +
         "  -blockminsize=<n>      "   + _("Set minimum block size in bytes (default: 0)") + "\n" +
@@ -433,6 +455,14 @@ bool AppInit2()
     fPrintToConsole = GetBoolArg("-printtoconsole");
     fPrintToDebugger = GetBoolArg("-printtodebugger");
     fLogTimestamps = GetBoolArg("-logtimestamps");
+#ifndef WIN32
+    fBlockFileMmap = GetBoolArg("-blockmmap", sizeof(void*) >= 8);
+#endif
+    fPerfStats = GetBoolArg("-perfstats", true);
+    fLockProfile = GetBoolArg("-lockprofile");
+    fHeadersFirst = GetBoolArg("-headersfirst", true);
+    if (GetBoolArg("-compactblocks", true))
+        nLocalServices |= NODE_COMPACT_BLOCKS;
 
     if (mapArgs.count("-timeout"))
     {
@@ -441,6 +471,15 @@ bool AppInit2()
             nConnectTimeout = nNewTimeout;
     }
 
+    if (GetArg("-maxuploadrate", 0) < 0 || GetArg("-maxpeeruploadrate", 0) < 0 || GetArg("-maxuploadtarget", 0) < 0)
+        return InitError(_("Upload limits can't be negative"));
+    {
+        LOCK(cs_bandwidth);
+        bucketUpload.SetRate(GetArg("-maxuploadrate", 0) * 1000, GetArg("-maxuploadrate", 0) * 1000);
+        uploadTarget.SetTarget(GetArg("-maxuploadtarget", 0) * 1024 * 1024);
+    }
+    nMaxPeerUploadRate = GetArg("-maxpeeruploadrate", 0) * 1000;
+
     // Continue to put "/P2SH/" in the coinbase to monitor
     // BIP16 support.
     // This can be removed eventually...
@@ -512,6 +551,14 @@ bool AppInit2()
 
     int64 nStart;
 
+    // RPC is served from here on, but every call fails with the latest init
+    // message until loading is done
+    if (fServer)
+    {
+        uiInterface.InitMessage.connect(SetRPCWarmupStatus);
+        NewThread(ThreadRPCServer, NULL);
+    }
+
     // ********************************************************* Step 5: verify database integrity
 
     uiInterface.InitMessage(_("<font style='color: black'>Verifying database integrity...</font>"));
@@ -659,6 +706,12 @@ bool AppInit2()
         }
     }
 
+    {
+        int64 nThreshold, nTarget, nMaxFee;
+        if (!GetConsolidationSettings(nThreshold, nTarget, nMaxFee))
+            return InitError(_("Invalid amount for -consolidatethreshold, -consolidatetarget or -consolidatemaxfee"));
+    }
+
     if (mapArgs.count("-checkpointkey")) // ppcoin: checkpoint master priv key
     {
         if (!Checkpoints::SetCheckpointPrivKey(GetArg("-checkpointkey", "")))
@@ -733,7 +786,7 @@ bool AppInit2()
     {
         std::string strMatch = mapArgs["-printblock"];
         int nFound = 0;
-        for (std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+        for (CBlockIndexMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
         {
             uint256 hash = (*mi).first;
             if (strncmp(hash.ToString().c_str(), strMatch.c_str(), strMatch.size()) == 0)
@@ -880,8 +933,20 @@ bool AppInit2()
 
     {
         CAddrDB adb;
-        if (!adb.Read(addrman))
+        uint256 hashPeers;
+        if (!adb.Read(addrman, &hashPeers))
+        {
             printf("Invalid or missing peers.dat; recreating\n");
+            adb.EraseJournal();
+        }
+        else
+        {
+            int nChanges = adb.ReadJournal(addrman, hashPeers);
+            if (nChanges < 0)
+                adb.StartJournal(hashPeers);
+            else
+                printf("Replayed %d address changes from peers.log\n", nChanges);
+        }
     }
 
     if (GetBoolArg("-pruneaddrman", false))
@@ -918,13 +983,11 @@ bool AppInit2()
     if (!NewThread(StartNode, NULL))
         InitError(_("Error: could not start node"));
 
-    if (fServer)
-        NewThread(ThreadRPCServer, NULL);
-
     // ********************************************************* Step 12: finished
 
     uiInterface.InitMessage(_("<font style='color: black'>Done loading</font>"));
     printf("Done loading\n");
+    SetRPCWarmupFinished();
 
     if (!strErrors.str().empty())
         return InitError(strErrors.str());
@@ -932,6 +995,9 @@ bool AppInit2()
      // Add wallet transactions that aren't already in a block to mapTransactions
     pwalletMain->ReacceptWalletTransactions();
 
+    if (GetBoolArg("-consolidate", false))
+        NewThread(ThreadConsolidateCoins, pwalletMain);
+
 #if !defined(QT_GUI)
     // Loop until process is exit()ed from shutdown() function,
     // called from ThreadRPCServer thread when a "stop" command is received.
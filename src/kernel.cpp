@@ -69,7 +69,7 @@ static int64 GetStakeModifierSelectionIntervalSection(int nSection)
 }
 
 // Get stake modifier selection interval (in seconds)
-static int64 GetStakeModifierSelectionInterval()
+int64 GetStakeModifierSelectionInterval()
 {
     int64 nSelectionInterval = 0;
     for (int nSection=0; nSection<64; nSection++)
@@ -229,7 +229,7 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64& nStakeModif
 
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
-static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64& nStakeModifier, int& nStakeModifierHeight, int64& nStakeModifierTime, bool fPrintProofOfStake)
+static bool GetKernelStakeModifierWalk(uint256 hashBlockFrom, uint64& nStakeModifier, int& nStakeModifierHeight, int64& nStakeModifierTime, bool fPrintProofOfStake)
 {
     nStakeModifier = 0;
     if (!mapBlockIndex.count(hashBlockFrom))
@@ -261,6 +261,133 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64& nStakeModifier
     return true;
 }
 
+// Stake modifier cache
+//
+// The walk above is repeated for every kernel check, once per candidate
+// output and timestamp when staking, always with the same answer for a given
+// coin origin block as long as the main chain stays the same. So the main
+// chain's modifier generation points are kept in height order with a running
+// maximum of their timestamps, which finds the first one at least a
+// selection interval after the origin block with a binary search, and the
+// answer is remembered per origin block. Generation points are appended
+// lazily by following pnext, and Reorganize drops everything above the fork.
+//
+namespace {
+class CStakeModifierEntry
+{
+public:
+    uint64 nStakeModifier;
+    int nHeight;
+    int64 nTime;
+};
+}
+
+static const unsigned int MAX_STAKE_MODIFIER_ENTRIES = 200000;
+
+static CCriticalSection cs_stakemodifiers;
+static std::vector<const CBlockIndex*> vStakeModifierPoints;
+static std::vector<int64> vStakeModifierMaxTime;         // running maximum of the points' times
+static const CBlockIndex* pindexStakeModifierScanned = NULL;
+static std::map<uint256, CStakeModifierEntry> mapStakeModifierEntries;
+
+static void ScanStakeModifierPoints()
+{
+    if (!pindexStakeModifierScanned)
+    {
+        if (!pindexGenesisBlock)
+            return;
+        pindexStakeModifierScanned = pindexGenesisBlock;
+    }
+    else if (!pindexStakeModifierScanned->pnext)
+        return;
+    else
+        pindexStakeModifierScanned = pindexStakeModifierScanned->pnext;
+
+    for (const CBlockIndex* pindex = pindexStakeModifierScanned; pindex; pindex = pindex->pnext)
+    {
+        if (pindex->GeneratedStakeModifier())
+        {
+            int64 nMaxTime = vStakeModifierMaxTime.empty() ? pindex->GetBlockTime() : std::max(vStakeModifierMaxTime.back(), pindex->GetBlockTime());
+            vStakeModifierPoints.push_back(pindex);
+            vStakeModifierMaxTime.push_back(nMaxTime);
+        }
+        pindexStakeModifierScanned = pindex;
+    }
+}
+
+static bool CompareStakeModifierHeight(const CBlockIndex* pindex, int nHeight)
+{
+    return pindex->nHeight < nHeight;
+}
+
+void TruncateStakeModifierCache(const CBlockIndex* pindexFork)
+{
+    LOCK(cs_stakemodifiers);
+    int nForkHeight = pindexFork ? pindexFork->nHeight : -1;
+    while (!vStakeModifierPoints.empty() && vStakeModifierPoints.back()->nHeight > nForkHeight)
+    {
+        vStakeModifierPoints.pop_back();
+        vStakeModifierMaxTime.pop_back();
+    }
+    if (pindexStakeModifierScanned && pindexStakeModifierScanned->nHeight > nForkHeight)
+        pindexStakeModifierScanned = pindexFork;
+
+    // An origin on the disconnected branch is above the fork too
+    std::map<uint256, CStakeModifierEntry>::iterator it = mapStakeModifierEntries.begin();
+    while (it != mapStakeModifierEntries.end())
+    {
+        if (it->second.nHeight > nForkHeight)
+            mapStakeModifierEntries.erase(it++);
+        else
+            it++;
+    }
+}
+
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64& nStakeModifier, int& nStakeModifierHeight, int64& nStakeModifierTime, bool fPrintProofOfStake)
+{
+    {
+        LOCK(cs_stakemodifiers);
+        std::map<uint256, CStakeModifierEntry>::const_iterator it = mapStakeModifierEntries.find(hashBlockFrom);
+        if (it != mapStakeModifierEntries.end())
+        {
+            nStakeModifier = it->second.nStakeModifier;
+            nStakeModifierHeight = it->second.nHeight;
+            nStakeModifierTime = it->second.nTime;
+            return true;
+        }
+
+        CBlockIndexMap::const_iterator mi = mapBlockIndex.find(hashBlockFrom);
+        if (mi != mapBlockIndex.end() && mi->second->pnext)
+        {
+            const CBlockIndex* pindexFrom = mi->second;
+            int64 nTimeTarget = pindexFrom->GetBlockTime() + GetStakeModifierSelectionInterval();
+            ScanStakeModifierPoints();
+
+            // First point above the origin whose time reaches the target
+            size_t nFirst = std::lower_bound(vStakeModifierPoints.begin(), vStakeModifierPoints.end(), pindexFrom->nHeight + 1, CompareStakeModifierHeight) - vStakeModifierPoints.begin();
+            size_t nReached = std::lower_bound(vStakeModifierMaxTime.begin(), vStakeModifierMaxTime.end(), nTimeTarget) - vStakeModifierMaxTime.begin();
+            size_t n = std::max(nFirst, nReached);
+            while (n < vStakeModifierPoints.size() && vStakeModifierPoints[n]->GetBlockTime() < nTimeTarget)
+                n++;
+
+            if (n < vStakeModifierPoints.size())
+            {
+                const CBlockIndex* pindex = vStakeModifierPoints[n];
+                if (mapStakeModifierEntries.size() >= MAX_STAKE_MODIFIER_ENTRIES)
+                    mapStakeModifierEntries.clear();
+                CStakeModifierEntry& entry = mapStakeModifierEntries[hashBlockFrom];
+                entry.nStakeModifier = nStakeModifier = pindex->nStakeModifier;
+                entry.nHeight = nStakeModifierHeight = pindex->nHeight;
+                entry.nTime = nStakeModifierTime = pindex->GetBlockTime();
+                return true;
+            }
+        }
+    }
+
+    // Not indexed, off the main chain or too recent: the walk reports why
+    return GetKernelStakeModifierWalk(hashBlockFrom, nStakeModifier, nStakeModifierHeight, nStakeModifierTime, fPrintProofOfStake);
+}
+
 // ppcoin kernel protocol
 // coinstake must meet hash target according to the protocol:
 // kernel (input 0) must meet the formula
@@ -293,15 +420,12 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
     if (nTimeBlockFrom + nStakeMinAge > nTimeTx) // Min age requirement
         return error("CheckStakeKernelHash() : min age violation");
 
-    CBigNum bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
     int64 nValueIn = txPrev.vout[prevout.n].nValue;
 
     // v0.3 protocol kernel hash weight starts from 0 at the 30-day min age
     // this change increases active coins participating the hash and helps
     // to secure the network when proof-of-stake difficulty is low
     int64 nTimeWeight = std::min((int64)nTimeTx - txPrev.nTime, (int64)nStakeMaxAge) - nStakeMinAge;
-    CBigNum bnCoinDayWeight = CBigNum(nValueIn) * nTimeWeight / COIN / (24 * 60 * 60);
 
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
@@ -330,7 +454,7 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
     }
 
     // Now check if proof-of-stake hash meets target protocol
-    if (CBigNum(hashProofOfStake) > bnCoinDayWeight * bnTargetPerCoinDay)
+    if (!CheckStakeKernelTarget(hashProofOfStake, nBits, nValueIn, nTimeWeight))
         return false;
     if (fDebug && !fPrintProofOfStake)
     {
@@ -348,6 +472,35 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned
     return true;
 }
 
+// The kernel target is bnCoinDayWeight * bnTargetPerCoinDay, which was
+// computed with signed, unbounded CBigNums. This gives the same answer for
+// every input, including the negative and overflowing nBits and time weights
+// a peer can put in a block before its nBits have been checked, using sign
+// and magnitude in 320 bits instead.
+bool CheckStakeKernelTarget(const uint256& hashProofOfStake, unsigned int nBits, int64 nValueIn, int64 nTimeWeight)
+{
+    bool fTargetNegative, fTargetOverflow;
+    arith_uint320 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits, &fTargetNegative, &fTargetOverflow);
+
+    // Divisions round toward zero like BN_div, so work on the magnitude
+    bool fWeightNegative = (nValueIn < 0) != (nTimeWeight < 0);
+    arith_uint320 bnCoinDayWeight = nValueIn < 0 ? -(uint64)nValueIn : (uint64)nValueIn;
+    bnCoinDayWeight *= arith_uint320(nTimeWeight < 0 ? -(uint64)nTimeWeight : (uint64)nTimeWeight);
+    bnCoinDayWeight /= arith_uint320(COIN * 24 * 60 * 60);
+
+    arith_uint320 bnHash(UintToArith256(hashProofOfStake));
+    if (bnCoinDayWeight == 0 || (bnTargetPerCoinDay == 0 && !fTargetOverflow))
+        return bnHash == 0;
+    if (fTargetNegative != fWeightNegative)
+        return false;
+
+    // Anything over 256 bits is above every hash
+    if (fTargetOverflow || bnCoinDayWeight.bits() + bnTargetPerCoinDay.bits() > 257)
+        return true;
+    return bnHash <= bnCoinDayWeight * bnTargetPerCoinDay;
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake)
 {
@@ -14,13 +14,26 @@ extern unsigned int nModifierInterval;
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
 
+// Get stake modifier selection interval (in seconds)
+int64 GetStakeModifierSelectionInterval();
+
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64& nStakeModifier, bool& fGeneratedStakeModifier);
 
+// Get the stake modifier a kernel from hashBlockFrom hashes with, and the block that generated it
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64& nStakeModifier, int& nStakeModifierHeight, int64& nStakeModifierTime, bool fPrintProofOfStake);
+
+// Forget the cached stake modifiers of blocks above pindexFork, which are
+// leaving the main chain, or all of them for NULL
+void TruncateStakeModifierCache(const CBlockIndex* pindexFork);
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock& blockFrom, unsigned int nTxPrevOffset, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, uint256& hashProofOfStake, bool fPrintProofOfStake=false);
 
+// Check whether hashProofOfStake <= nValueIn * nTimeWeight / COIN / (24 * 60 * 60) * target(nBits)
+bool CheckStakeKernelTarget(const uint256& hashProofOfStake, unsigned int nBits, int64 nValueIn, int64 nTimeWeight);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CTransaction& tx, unsigned int nBits, uint256& hashProofOfStake);
@@ -5,11 +5,14 @@
 
 #include "alert.h"
 #include "checkpoints.h"
+#include "compactblock.h"
 #include "db.h"
 #include "net.h"
 #include "init.h"
+#include "orphantx.h"
 #include "ui_interface.h"
 #include "kernel.h"
+#include "perf.h"
 #include "wallet.h"
 #include "util.h"
 #include <boost/algorithm/string/replace.hpp>
@@ -40,17 +43,17 @@ CCriticalSection cs_main;
 CTxMemPool mempool;
 unsigned int nTransactionsUpdated = 0;
 
-std::map<uint256, CBlockIndex*> mapBlockIndex;
+CBlockIndexMap mapBlockIndex;
 std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 uint256 hashGenesisBlock = hashGenesisBlockOfficial;
 uint256 hashAssumeValid = 0;  // Set in init; default mainnet checkpoint, empty for testnet
-static CBigNum bnProofOfWorkLimit(~uint256(0) >> 20);
-static CBigNum bnProofOfStakeLimit(~uint256(0) >> 24);
-static CBigNum bnProofOfStakeHardLimit(~uint256(0) >> 30);
+static arith_uint256 bnProofOfWorkLimit(~arith_uint256(0) >> 20);
+static arith_uint256 bnProofOfStakeLimit(~arith_uint256(0) >> 24);
+static arith_uint256 bnProofOfStakeHardLimit(~arith_uint256(0) >> 30);
 
 
-static CBigNum bnProofOfWorkLimitTestNet(~uint256(0) >> 16);
-static CBigNum bnProofOfStakeLimitTestNet(~uint256(0) >> 20);
+static arith_uint256 bnProofOfWorkLimitTestNet(~arith_uint256(0) >> 16);
+static arith_uint256 bnProofOfStakeLimitTestNet(~arith_uint256(0) >> 20);
 
 unsigned int nStakeMinAge = 60 * 60 * 24 * 30; // minimum age for coin age
 unsigned int nStakeMaxAge = 60 * 60 * 24 * 90; // stake age of full weight
@@ -60,8 +63,8 @@ const int64 nTestNetStartTime = nChainStartTime;
 int nCoinbaseMaturity = 10; // mining need 30 confirm
 CBlockIndex* pindexGenesisBlock = NULL;
 int nBestHeight = -1;
-CBigNum bnBestChainTrust = 0;
-CBigNum bnBestInvalidTrust = 0;
+arith_uint256 bnBestChainTrust = 0;
+arith_uint256 bnBestInvalidTrust = 0;
 uint256 hashBestChain = 0;
 CBlockIndex* pindexBest = NULL;
 int64 nTimeBestReceived = 0;
@@ -73,8 +76,34 @@ std::multimap<uint256, CBlock*> mapOrphanBlocksByPrev;
 std::set<std::pair<COutPoint, unsigned int> > setStakeSeenOrphan;
 std::map<uint256, uint256> mapProofOfStake;
 
-std::map<uint256, CDataStream*> mapOrphanTransactions;
-std::map<uint256, std::map<uint256, CDataStream*> > mapOrphanTransactionsByPrev;
+// Headers-first sync, all guarded by cs_main
+bool fHeadersFirst = true;
+CHeaderChain headerChain;
+static int nHeadersSyncPeer = -1;       // node id of the peer we take headers from
+static int64 nHeadersSyncTime = 0;      // last getheaders sent or headers received
+static bool fHeadersRequested = false;
+struct CBlockInFlight
+{
+    int nNodeId;
+    int64 nTime;
+};
+static std::map<uint256, CBlockInFlight> mapBlocksInFlight;
+static uint256 hashBlockStalled = 0;    // first missing block, while peers stall on it
+static std::set<int> setBlockStalledPeers;
+
+// Compact blocks waiting for a blocktxn, guarded by cs_main
+struct CPartialBlock
+{
+    int nNodeId;
+    int64 nTime;
+    CBlock block;
+    std::vector<unsigned short> vMissing;
+};
+static std::map<uint256, CPartialBlock> mapPartialBlocks;
+static const unsigned int MAX_PARTIAL_BLOCKS = 16;
+static const unsigned int MAX_PARTIAL_BLOCKS_PER_PEER = 2;
+static const int64 PARTIAL_BLOCK_TIMEOUT = 10;
+
 
 // Constant stuff for coinbase transactions we create:
 CScript COINBASE_FLAGS;
@@ -200,83 +229,6 @@ void ResendWalletTransactions()
 
 
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// mapOrphanTransactions
-//
-
-bool AddOrphanTx(const CDataStream& vMsg)
-{
-    CTransaction tx;
-    CDataStream(vMsg) >> tx;
-    uint256 hash = tx.GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    CDataStream* pvMsg = new CDataStream(vMsg);
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
-    if (pvMsg->size() > 5000)
-    {
-        printf("ignoring large orphan tx (size: %" PRIszu ", hash: %s)\n", pvMsg->size(), hash.ToString().substr(0,10).c_str());
-        delete pvMsg;
-        return false;
-    }
-
-    mapOrphanTransactions[hash] = pvMsg;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            mapOrphanTransactionsByPrev[txin.prevout.hash].insert(std::make_pair(hash, pvMsg));
-
-    printf("stored orphan tx %s (mapsz %" PRIszu ")\n", hash.ToString().substr(0,10).c_str(),
-           mapOrphanTransactions.size());
-    return true;
-}
-
-void static EraseOrphanTx(uint256 hash)
-{
-    if (!mapOrphanTransactions.count(hash))
-        return;
-    const CDataStream* pvMsg = mapOrphanTransactions[hash];
-    CTransaction tx;
-    CDataStream(*pvMsg) >> tx;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-    {
-        mapOrphanTransactionsByPrev[txin.prevout.hash].erase(hash);
-        if (mapOrphanTransactionsByPrev[txin.prevout.hash].empty())
-            mapOrphanTransactionsByPrev.erase(txin.prevout.hash);
-    }
-    delete pvMsg;
-    mapOrphanTransactions.erase(hash);
-}
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
-{
-    unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        std::map<uint256, CDataStream*>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
-}
-
-
-
-
-
-
-
 //////////////////////////////////////////////////////////////////////////////
 //
 // CTransaction and CTxIndex
@@ -459,7 +411,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
     }
 
     // Is the tx in a block that's in the main chain
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    CBlockIndexMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -775,7 +727,7 @@ int CMerkleTx::GetDepthInMainChain(CBlockIndex* &pindexRet) const
         return 0;
 
     // Find the block it claims to be in
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    CBlockIndexMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -858,7 +810,7 @@ int CTxIndex::GetDepthInMainChain() const
     if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos, false))
         return 0;
     // Find the block in the index
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+    CBlockIndexMap::iterator mi = mapBlockIndex.find(block.GetHash());
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -1050,8 +1002,8 @@ int64 GetProofOfStakeReward(int64 nCoinAge, unsigned int nBits, unsigned int nTi
     if (nBestHeight > (int)HF_BLOCK) bnRewardCoinYearLimit = (int64)(0.04 * MAX_MINT_PROOF_OF_WORK); // 4% hardfork
     CBigNum bnTarget;
     bnTarget.SetCompact(nBits);
-    CBigNum bnTargetLimit = bnProofOfStakeLimit;
-    bnTargetLimit.SetCompact(bnTargetLimit.GetCompact());
+    CBigNum bnTargetLimit;
+    bnTargetLimit.SetCompact(bnProofOfStakeLimit.GetCompact());
 
     // curecoin: reward for coin-year is cut in half every 64x multiply of PoS difficulty
     // A reasonably continuous curve is used to avoid shock to market
@@ -1097,7 +1049,7 @@ static const int64 nTargetSpacingWorkMax = 12 * nStakeTargetSpacing; // 2-hour /
 //
 unsigned int ComputeMinWork(unsigned int nBase, int64 nTime)
 {
-    CBigNum bnTargetLimit = bnProofOfWorkLimit;
+    CBigNum bnTargetLimit(ArithToUint256(bnProofOfWorkLimit));
 
     CBigNum bnResult;
     bnResult.SetCompact(nBase);
@@ -1121,23 +1073,43 @@ const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfSta
     return pindex;
 }
 
-unsigned int static GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake)
+// ppcoin: retarget with exponential moving toward target spacing
+unsigned int static GetNextTarget(unsigned int nPrevBits, int64 nActualSpacing, int64 nTargetSpacing, const arith_uint256& bnTargetLimit)
 {
-    CBigNum bnTargetLimit = bnProofOfWorkLimit;
+    // The previous target times a spacing of up to 2**33 seconds can pass
+    // 256 bits, so scale it in 320. The spacing can be negative, in which case
+    // the CBigNum this replaced carried the sign into the compact result.
+    bool fNegative;
+    arith_uint320 bnNew;
+    bnNew.SetCompact(nPrevBits, &fNegative);
+    int64 nInterval = nTargetTimespan / nTargetSpacing;
+    int64 nNumerator = (nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing;
+    if (nNumerator < 0)
+        fNegative = !fNegative;
+    bnNew *= arith_uint320(nNumerator < 0 ? -(uint64)nNumerator : (uint64)nNumerator);
+    bnNew /= arith_uint320((nInterval + 1) * nTargetSpacing);
 
-    if(fProofOfStake)
-    {
-        // Proof-of-Stake blocks has own target limit since nVersion=3 supermajority on mainNet and always on testNet
-        if(fTestNet)
-            bnTargetLimit = bnProofOfStakeLimit;
-        else
-        {
-            if(pindexLast->nHeight + 1 > 15000)
-                bnTargetLimit = bnProofOfStakeLimit;
-            else if(pindexLast->nHeight + 1 > 14060)
-                bnTargetLimit = bnProofOfStakeHardLimit;
-        }
-    }
+    if (!fNegative && bnNew > arith_uint320(bnTargetLimit))
+        return bnTargetLimit.GetCompact();
+
+    return bnNew.GetCompact(fNegative);
+}
+
+// Proof-of-Stake blocks has own target limit since nVersion=3 supermajority on mainNet and always on testNet
+static arith_uint256 GetProofOfStakeLimit(int nHeight)
+{
+    if(fTestNet)
+        return bnProofOfStakeLimit;
+    if(nHeight > 15000)
+        return bnProofOfStakeLimit;
+    else if(nHeight > 14060)
+        return bnProofOfStakeHardLimit;
+    return bnProofOfWorkLimit;
+}
+
+unsigned int static GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake)
+{
+    arith_uint256 bnTargetLimit = fProofOfStake ? GetProofOfStakeLimit(pindexLast->nHeight + 1) : bnProofOfWorkLimit;
 
     if (pindexLast == NULL)
         return bnTargetLimit.GetCompact(); // genesis block
@@ -1174,19 +1146,9 @@ unsigned int static GetNextTargetRequired(const CBlockIndex* pindexLast, bool fP
     }*/
 
     // ppcoin: target change every block
-    // ppcoin: retarget with exponential moving toward target spacing
-    CBigNum bnNew;
-    bnNew.SetCompact(pindexPrev->nBits);
     if (pindexLast->nHeight > (int)HF_BLOCK) nStakeTargetSpacing = 4 * 60; // 4 minute target enforced
     int64 nTargetSpacing = fProofOfStake? nStakeTargetSpacing : std::min(nTargetSpacingWorkMax, (int64) nStakeTargetSpacing * (1 + pindexLast->nHeight - pindexPrev->nHeight));
-    int64 nInterval = nTargetTimespan / nTargetSpacing;
-    bnNew *= ((nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing);
-    bnNew /= ((nInterval + 1) * nTargetSpacing);
-
-    if (bnNew > bnTargetLimit)
-        bnNew = bnTargetLimit;
-
-    return bnNew.GetCompact();
+    return GetNextTarget(pindexPrev->nBits, nActualSpacing, nTargetSpacing, bnTargetLimit);
 }
 
 bool CheckProofOfWork(uint256 hash, unsigned int nBits)
@@ -1194,18 +1156,19 @@ bool CheckProofOfWork(uint256 hash, unsigned int nBits)
     //printf("block.nBits in CheckProofWork Func is:%d\n", nBits);
 
 
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    bool fNegative, fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
     //printf("uint256 hash in CheckProofWork Func is:%s\n", hash.ToString().c_str());
-    //printf("bnTarget.getuint256() in CheckProofWork Func is:%d\n", bnTarget.getuint256().ToString().c_str());
+    //printf("bnTarget in CheckProofWork Func is:%s\n", bnTarget.ToString().c_str());
 
     // Check range
-    if (bnTarget <= 0 || bnTarget > bnProofOfWorkLimit)
+    if (fNegative || fOverflow || bnTarget == 0 || bnTarget > bnProofOfWorkLimit)
         return error("CheckProofOfWork() : nBits below minimum work");
 
     // Check proof of work matches claimed amount
-    if (hash > bnTarget.getuint256())
+    if (UintToArith256(hash) > bnTarget)
         return error("CheckProofOfWork() : hash doesn't match nBits");
 
     return true;
@@ -1584,10 +1547,30 @@ bool CTransaction::ClientConnectInputs()
 
 bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 {
-    // Disconnect in reverse order
-    for (int i = vtx.size()-1; i >= 0; i--)
-        if (!vtx[i].DisconnectInputs(txdb))
-            return false;
+    uint256 hashBlock = pindex->GetBlockHash();
+    unsigned int nUndoFile, nUndoPos;
+    CBlockUndo undo;
+    if (txdb.ReadBlockUndoPos(hashBlock, nUndoFile, nUndoPos) && undo.ReadFromDisk(nUndoFile, nUndoPos, hashBlock))
+    {
+        // Put back the entries of the transactions it spends, one write each
+        for (unsigned int i = 0; i < undo.vPrevTxIndex.size(); i++)
+            if (!txdb.UpdateTxIndex(undo.vPrevTxIndex[i].first, undo.vPrevTxIndex[i].second))
+                return error("DisconnectBlock() : UpdateTxIndex failed");
+
+        // See DisconnectInputs about why this may fail
+        for (int i = vtx.size()-1; i >= 0; i--)
+            txdb.EraseTxIndex(vtx[i]);
+        txdb.EraseBlockUndoPos(hashBlock);
+    }
+    else
+    {
+        // Connected before undo data was kept, or it was lost: look up and
+        // unspend the inputs one at a time. Disconnect in reverse order
+        for (int i = vtx.size()-1; i >= 0; i--)
+            if (!vtx[i].DisconnectInputs(txdb))
+                return false;
+        txdb.EraseBlockUndoPos(hashBlock);
+    }
 
     // Update block index on disk without changing it in memory.
     // The memory index structure will be changed after the db commits.
@@ -1608,6 +1591,8 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
 
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 {
+    PERF_TIMER(PERF_CONNECTBLOCK);
+
     // Check it again in case a previous version let a bad block in
     if (!CheckBlock(!fJustCheck, !fJustCheck))
         return false;
@@ -1651,6 +1636,8 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         nTxPos = pindex->nBlockPos + ::GetSerializeSize(CBlock(), SER_DISK, CLIENT_VERSION) - (2 * GetSizeOfCompactSize(0)) + GetSizeOfCompactSize(vtx.size());
 
     std::map<uint256, CTxIndex> mapQueuedChanges;
+    CBlockUndo undo;
+    std::set<uint256> setUndo;
     int64 nFees = 0;
     int64 nValueIn = 0;
     int64 nValueOut = 0;
@@ -1685,6 +1672,17 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
             if (!tx.FetchInputs(txdb, mapQueuedChanges, true, false, mapInputs, fInvalid))
                 return false;
 
+            // The first spend of an earlier transaction in this block finds
+            // its entry as it was before the block
+            if (!fJustCheck)
+            {
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                {
+                    if (!mapQueuedChanges.count(txin.prevout.hash) && setUndo.insert(txin.prevout.hash).second)
+                        undo.vPrevTxIndex.push_back(std::make_pair(txin.prevout.hash, mapInputs[txin.prevout.hash].first));
+                }
+            }
+
             if (fStrictPayToScriptHash)
             {
                 // Add in sigops done by pay-to-script-hash inputs;
@@ -1723,6 +1721,17 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     if (fJustCheck)
         return true;
 
+    // Undo data only saves work when disconnecting, which can do without
+    undo.hashBlock = pindex->GetBlockHash();
+    unsigned int nUndoFile, nUndoPos;
+    if (undo.WriteToDisk(nUndoFile, nUndoPos))
+    {
+        if (!txdb.WriteBlockUndoPos(undo.hashBlock, nUndoFile, nUndoPos))
+            return error("ConnectBlock() : WriteBlockUndoPos failed");
+    }
+    else
+        printf("ConnectBlock() : no undo data for %s\n", undo.hashBlock.ToString().substr(0,20).c_str());
+
     // Write queued txindex changes
     for (std::map<uint256, CTxIndex>::iterator mi = mapQueuedChanges.begin(); mi != mapQueuedChanges.end(); ++mi)
     {
@@ -1840,6 +1849,7 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     BOOST_FOREACH(CBlockIndex* pindex, vConnect)
             if (pindex->pprev)
             pindex->pprev->pnext = pindex;
+    TruncateStakeModifierCache(pfork);
 
     // Resurrect memory transactions that were in the disconnected branch
     BOOST_FOREACH(CTransaction& tx, vResurrect)
@@ -1882,6 +1892,8 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
 
 bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
 {
+    PERF_TIMER(PERF_SETBESTCHAIN);
+
     uint256 hash = GetHash();
 
     if (!txdb.TxnBegin())
@@ -2072,11 +2084,9 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos)
         return error("AddToBlockIndex() : %s already exists", hash.ToString().substr(0,20).c_str());
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(nFile, nBlockPos, *this);
-    if (!pindexNew)
-        return error("AddToBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = mapBlockIndex.NewIndex(nFile, nBlockPos, *this);
     pindexNew->phashBlock = &hash;
-    std::map<uint256, CBlockIndex*>::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
+    CBlockIndexMap::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
@@ -2109,7 +2119,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos)
         return error("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=0x%016" PRI64x, pindexNew->nHeight, nStakeModifier);
 
     // Add to mapBlockIndex
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
+    CBlockIndexMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     if (pindexNew->IsProofOfStake())
         setStakeSeen.insert(std::make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
@@ -2246,7 +2256,7 @@ bool CBlock::AcceptBlock()
         return error("AcceptBlock() : block already in mapBlockIndex");
 
     // Get prev block index
-    std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+    CBlockIndexMap::iterator mi = mapBlockIndex.find(hashPrevBlock);
     if (mi == mapBlockIndex.end())
         return DoS(10, error("AcceptBlock() : prev block not found"));
     CBlockIndex* pindexPrev = (*mi).second;
@@ -2308,10 +2318,33 @@ bool CBlock::AcceptBlock()
     int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
     if (hashBestChain == hash)
     {
+        // Peers that take compact blocks get the block itself straight away,
+        // everyone else an inv
+        CInv inv(MSG_BLOCK, hash);
+        std::unique_ptr<CCompactBlock> pcmpctblock;
         LOCK(cs_vNodes);
         BOOST_FOREACH(CNode* pnode, vNodes)
-                if (nBestHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                pnode->PushInventory(CInv(MSG_BLOCK, hash));
+        {
+            if (nBestHeight <= (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+                continue;
+            if ((nLocalServices & NODE_COMPACT_BLOCKS) && (pnode->nServices & NODE_COMPACT_BLOCKS) && vtx.size() <= MAX_COMPACT_BLOCK_TX)
+            {
+                bool fNew;
+                {
+                    LOCK(pnode->cs_inventory);
+                    fNew = !pnode->filterInventoryKnown.contains(hash);
+                    if (fNew)
+                        pnode->filterInventoryKnown.insert(hash);
+                }
+                if (!fNew)
+                    continue;
+                if (!pcmpctblock)
+                    pcmpctblock.reset(new CCompactBlock(*this));
+                pnode->PushMessage("cmpctblock", *pcmpctblock);
+            }
+            else
+                pnode->PushInventory(inv);
+        }
     }
 
     // ppcoin: check pending sync-checkpoint
@@ -2332,6 +2365,401 @@ bool CBlockIndex::IsSuperMajority(int minVersion, const CBlockIndex* pstart, uns
     return (nFound >= nRequired);
 }
 
+void CHeaderChain::Clear()
+{
+    hashBase = 0;
+    nBaseHeight = -1;
+    vHash.clear();
+    vTime.clear();
+    vBits.clear();
+    vNodeId.clear();
+    mapHeight.clear();
+}
+
+void CHeaderChain::Reset(const CBlockIndex* pindexBase)
+{
+    Clear();
+    hashBase = pindexBase->GetBlockHash();
+    nBaseHeight = pindexBase->nHeight;
+}
+
+void CHeaderChain::Truncate(int nHeight)
+{
+    while (Height() > nHeight)
+    {
+        mapHeight.erase(vHash.back());
+        vHash.pop_back();
+        vTime.pop_back();
+        vBits.pop_back();
+        vNodeId.pop_back();
+    }
+}
+
+int64 CHeaderChain::GetBlockTime(int nHeight) const
+{
+    if (nHeight > nBaseHeight)
+        return vTime[nHeight - nBaseHeight - 1];
+    CBlockIndexMap::const_iterator mi = mapBlockIndex.find(hashBase);
+    return mi == mapBlockIndex.end() ? 0 : (*mi).second->GetBlockTime();
+}
+
+bool CHeaderChain::GetTimeAndBits(int nHeight, int64& nTimeRet, unsigned int& nBitsRet) const
+{
+    if (nHeight > nBaseHeight)
+    {
+        nTimeRet = vTime[nHeight - nBaseHeight - 1];
+        nBitsRet = vBits[nHeight - nBaseHeight - 1];
+        return true;
+    }
+    CBlockIndexMap::const_iterator mi = mapBlockIndex.find(hashBase);
+    const CBlockIndex* pindex = mi == mapBlockIndex.end() ? NULL : (*mi).second;
+    while (pindex && pindex->nHeight > nHeight)
+        pindex = pindex->pprev;
+    if (!pindex)
+        return false;
+    nTimeRet = pindex->GetBlockTime();
+    nBitsRet = pindex->nBits;
+    return true;
+}
+
+int64 CHeaderChain::GetMedianTimePast(int nHeight) const
+{
+    // Same as CBlockIndex::GetMedianTimePast, continuing into mapBlockIndex
+    // below the base
+    std::vector<int64> vTimes;
+    for (int h = nHeight; h > nBaseHeight && vTimes.size() < (size_t)CBlockIndex::nMedianTimeSpan; h--)
+        vTimes.push_back(GetBlockTime(h));
+    CBlockIndexMap::const_iterator mi = mapBlockIndex.find(hashBase);
+    for (const CBlockIndex* pindex = mi == mapBlockIndex.end() ? NULL : (*mi).second;
+         pindex && vTimes.size() < (size_t)CBlockIndex::nMedianTimeSpan; pindex = pindex->pprev)
+        vTimes.push_back(pindex->GetBlockTime());
+    if (vTimes.empty())
+        return 0;
+    std::sort(vTimes.begin(), vTimes.end());
+    return vTimes[vTimes.size() / 2];
+}
+
+CBlockLocator CHeaderChain::GetLocator() const
+{
+    CBlockIndexMap::const_iterator mi = mapBlockIndex.find(hashBase);
+    if (mi == mapBlockIndex.end())
+        return CBlockLocator(pindexBest);
+
+    std::vector<uint256> vHave;
+    int nStep = 1;
+    for (int nHeight = Height(); nHeight > nBaseHeight; nHeight -= nStep)
+    {
+        vHave.push_back(GetHash(nHeight));
+        if (vHave.size() > 10)
+            nStep *= 2;
+    }
+    // and on down from the base as CBlockLocator::Set does
+    for (const CBlockIndex* pindex = (*mi).second; pindex; )
+    {
+        vHave.push_back(pindex->GetBlockHash());
+        for (int i = 0; pindex && i < nStep; i++)
+            pindex = pindex->pprev;
+        if (vHave.size() > 10)
+            nStep *= 2;
+    }
+    vHave.push_back((!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet));
+    return CBlockLocator(vHave);
+}
+
+bool CHeaderChain::Connect(const std::vector<CBlock>& vHeaders, int nNodeId, int& nDoS)
+{
+    nDoS = 0;
+    if (vHeaders.empty())
+        return true;
+
+    // Attach the first header, dropping whatever it replaces
+    const uint256& hashPrev = vHeaders[0].hashPrevBlock;
+    std::map<uint256, int>::const_iterator mi = mapHeight.find(hashPrev);
+    if (mi != mapHeight.end())
+        Truncate((*mi).second);
+    else if (hashBase != 0 && hashPrev == hashBase)
+        Truncate(nBaseHeight);
+    else
+    {
+        CBlockIndexMap::iterator mb = mapBlockIndex.find(hashPrev);
+        if (mb == mapBlockIndex.end())
+            return error("CHeaderChain::Connect() : headers do not connect, prev=%s", hashPrev.ToString().substr(0,20).c_str());
+
+        // A branch off below the last hardened checkpoint can't lead past it
+        CBlockIndex* pindexFork = (*mb).second;
+        if (pindexFork->nHeight < Checkpoints::GetTotalBlocksEstimate() && !pindexFork->IsInMainChain())
+        {
+            nDoS = 100;
+            return error("CHeaderChain::Connect() : headers fork off below the last checkpoint at height %d", pindexFork->nHeight);
+        }
+        Reset(pindexFork);
+    }
+
+    BOOST_FOREACH(const CBlock& header, vHeaders)
+    {
+        uint256 hash = header.GetHash();
+        int nHeight = Height() + 1;
+        const uint256& hashTip = vHash.empty() ? hashBase : vHash.back();
+        if (header.hashPrevBlock != hashTip)
+        {
+            nDoS = 20;
+            return error("CHeaderChain::Connect() : non-continuous headers at height %d", nHeight);
+        }
+
+        if (!Checkpoints::CheckHardened(nHeight, hash))
+        {
+            nDoS = 100;
+            return error("CHeaderChain::Connect() : rejected by hardened checkpoint at height %d", nHeight);
+        }
+
+        if (header.GetBlockTime() <= GetMedianTimePast(nHeight - 1) || header.GetBlockTime() + nMaxClockDrift < GetBlockTime(nHeight - 1))
+        {
+            nDoS = 100;
+            return error("CHeaderChain::Connect() : block's timestamp is too early at height %d", nHeight);
+        }
+        if (header.GetBlockTime() > GetAdjustedTime() + nMaxClockDrift)
+            return error("CHeaderChain::Connect() : block timestamp too far in the future at height %d", nHeight);
+
+        // The larger of the proof-of-work and proof-of-stake limits, since
+        // the header does not say which it is
+        bool fNegative, fOverflow;
+        arith_uint256 bnTarget;
+        bnTarget.SetCompact(header.nBits, &fNegative, &fOverflow);
+        if (fNegative || fOverflow || bnTarget == 0 || bnTarget > std::max(bnProofOfWorkLimit, bnProofOfStakeLimit))
+        {
+            nDoS = 100;
+            return error("CHeaderChain::Connect() : nBits out of range at height %d", nHeight);
+        }
+
+        if (nHeight > (int)HF_BLOCK + 2)
+        {
+            // Only proof-of-stake from here on, retargeting on the two
+            // blocks before as GetNextTargetRequired does
+            int64 nPrevTime, nPrevPrevTime;
+            unsigned int nPrevBits, nPrevPrevBits;
+            if (!GetTimeAndBits(nHeight - 1, nPrevTime, nPrevBits) || !GetTimeAndBits(nHeight - 2, nPrevPrevTime, nPrevPrevBits))
+                return error("CHeaderChain::Connect() : no headers before height %d", nHeight);
+            // 4 minute target enforced past HF_BLOCK; the global spacing is
+            // left alone as blocks below the headers still retarget on it
+            const int64 nSpacing = 4 * 60;
+            if (header.nBits != GetNextTarget(nPrevBits, nPrevTime - nPrevPrevTime, nSpacing, GetProofOfStakeLimit(nHeight)))
+            {
+                nDoS = 100;
+                return error("CHeaderChain::Connect() : incorrect proof-of-stake target at height %d", nHeight);
+            }
+        }
+        else if ((bnTarget > bnProofOfWorkLimit || UintToArith256(hash) > bnTarget) && bnTarget > GetProofOfStakeLimit(nHeight))
+        {
+            // Neither meets its proof-of-work nor has a stake target
+            nDoS = 100;
+            return error("CHeaderChain::Connect() : header without proof-of-work at height %d", nHeight);
+        }
+
+        vHash.push_back(hash);
+        vTime.push_back(header.nTime);
+        vBits.push_back(header.nBits);
+        vNodeId.push_back(nNodeId);
+        mapHeight[hash] = nHeight;
+    }
+    return true;
+}
+
+void CHeaderChain::Prune()
+{
+    while (!vHash.empty() && mapBlockIndex.count(vHash.front()))
+    {
+        hashBase = vHash.front();
+        nBaseHeight++;
+        mapHeight.erase(hashBase);
+        vHash.pop_front();
+        vTime.pop_front();
+        vBits.pop_front();
+        vNodeId.pop_front();
+    }
+}
+
+// Whether the header chain is ahead of us and blocks come from the scheduler
+static bool IsHeadersFirstSyncing()
+{
+    return fHeadersFirst && headerChain.Height() > nBestHeight;
+}
+
+static bool ProcessBlockHeaders(CNode* pfrom, const std::vector<CBlock>& vHeaders)
+{
+    // Only the peer we asked; anything else may be stale or unsolicited
+    if (!fHeadersFirst || pfrom->nNodeId != nHeadersSyncPeer)
+        return true;
+    fHeadersRequested = false;
+    nHeadersSyncTime = GetTime();
+
+    int nDoS = 0;
+    if (!headerChain.Connect(vHeaders, pfrom->nNodeId, nDoS))
+    {
+        nHeadersSyncPeer = -1;
+        if (nDoS)
+            pfrom->Misbehaving(nDoS);
+        return false;
+    }
+    printf("received %" PRIszu " headers from %s, header chain at %d\n", vHeaders.size(), pfrom->addr.ToString().c_str(), headerChain.Height());
+
+    // A short answer means the peer has nothing more
+    if (vHeaders.size() < MAX_HEADERS_RESULTS)
+        nHeadersSyncPeer = -1;
+    return true;
+}
+
+static void BlockInFlightReceived(const uint256& hash)
+{
+    mapBlocksInFlight.erase(hash);
+    if (hash == hashBlockStalled)
+    {
+        hashBlockStalled = 0;
+        setBlockStalledPeers.clear();
+    }
+}
+
+// The header chain led to a block that can't be had or can't be right:
+// drop it, and blame the peer that sent the header
+static void HeaderChainBlockFailed(const uint256& hash, int nDoS)
+{
+    int nHeight = headerChain.GetHeight(hash);
+    if (nHeight < 0)
+        return;
+    int nNodeId = headerChain.GetNodeId(nHeight);
+    printf("header chain block %s at height %d failed, dropping the headers of peer %d\n", hash.ToString().substr(0,20).c_str(), nHeight, nNodeId);
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+            if (pnode->nNodeId == nNodeId)
+                pnode->Misbehaving(nDoS);
+    }
+    headerChain.Clear();
+    nHeadersSyncPeer = -1;
+    mapBlocksInFlight.clear();
+    hashBlockStalled = 0;
+    setBlockStalledPeers.clear();
+}
+
+// Forget every request to a peer we are dropping so others pick them up
+static void BlocksInFlightCancel(int nNodeId)
+{
+    for (std::map<uint256, CBlockInFlight>::iterator mi = mapBlocksInFlight.begin(); mi != mapBlocksInFlight.end(); )
+    {
+        if ((*mi).second.nNodeId == nNodeId)
+            mapBlocksInFlight.erase(mi++);
+        else
+            ++mi;
+    }
+}
+
+void FinalizeNode(int nNodeId)
+{
+    BlocksInFlightCancel(nNodeId);
+    // Its orphans are unlikely to find their parents, and its budget goes with it
+    orphanpool.EraseForPeer(nNodeId);
+    if (nHeadersSyncPeer == nNodeId)
+    {
+        nHeadersSyncPeer = -1;
+        fHeadersRequested = false;
+    }
+}
+
+// Headers-first sync: keep one peer feeding the header chain, and request
+// the blocks of the window above our best block from every peer that
+// should have them
+static void SendHeadersFirstRequests(CNode* pto, std::vector<CInv>& vGetData)
+{
+    int64 nNow = GetTime();
+
+    //
+    // Headers
+    //
+    if (nHeadersSyncPeer != -1 && nNow - nHeadersSyncTime > HEADERS_DOWNLOAD_TIMEOUT)
+    {
+        printf("headers sync peer %d timed out\n", nHeadersSyncPeer);
+        nHeadersSyncPeer = -1;
+    }
+    if (nHeadersSyncPeer == -1 && !pto->fClient && !pto->fOneShot && !pto->fDisconnect &&
+        pto->nStartingHeight > std::max(nBestHeight, headerChain.Height()))
+    {
+        nHeadersSyncPeer = pto->nNodeId;
+        fHeadersRequested = false;
+        nHeadersSyncTime = nNow;
+    }
+    if (nHeadersSyncPeer == pto->nNodeId && !fHeadersRequested && headerChain.Height() < nBestHeight + MAX_HEADERS_AHEAD)
+    {
+        if (headerChain.Height() <= nBestHeight)
+            headerChain.Clear();
+        pto->PushMessage("getheaders", headerChain.GetLocator(), uint256(0));
+        fHeadersRequested = true;
+        nHeadersSyncTime = nNow;
+    }
+
+    //
+    // Blocks
+    //
+    headerChain.Prune();
+    if (!IsHeadersFirstSyncing() || pto->fClient || pto->fDisconnect)
+        return;
+
+    int nInFlight = 0;
+    for (std::map<uint256, CBlockInFlight>::const_iterator mi = mapBlocksInFlight.begin(); mi != mapBlocksInFlight.end(); ++mi)
+        if ((*mi).second.nNodeId == pto->nNodeId)
+            nInFlight++;
+
+    bool fFirstMissing = true;
+    int nEnd = std::min(headerChain.Height(), nBestHeight + BLOCK_DOWNLOAD_WINDOW);
+    for (int nHeight = std::max(nBestHeight, headerChain.BaseHeight()) + 1; nHeight <= nEnd; nHeight++)
+    {
+        const uint256& hash = headerChain.GetHash(nHeight);
+        if (mapBlockIndex.count(hash) || mapOrphanBlocks.count(hash))
+            continue;
+        bool fFirst = fFirstMissing;
+        fFirstMissing = false;
+
+        std::map<uint256, CBlockInFlight>::iterator mi = mapBlocksInFlight.find(hash);
+        if (mi != mapBlocksInFlight.end())
+        {
+            const CBlockInFlight& request = (*mi).second;
+            if (request.nNodeId == pto->nNodeId)
+            {
+                // Everything else waits on the first block we are missing.
+                // Hand it to another peer; this one may only be slow, or
+                // the header may be for a block nobody has
+                if (fFirst && nNow - request.nTime > BLOCK_STALLING_TIMEOUT && vNodes.size() > 1)
+                {
+                    printf("peer %s is stalling block download at height %d\n", pto->addr.ToString().c_str(), nHeight);
+                    BlocksInFlightCancel(pto->nNodeId);
+                    if (hash != hashBlockStalled)
+                    {
+                        hashBlockStalled = hash;
+                        setBlockStalledPeers.clear();
+                    }
+                    setBlockStalledPeers.insert(pto->nNodeId);
+                    if (setBlockStalledPeers.size() >= std::min((size_t)3, vNodes.size()))
+                        HeaderChainBlockFailed(hash, 20);
+                    return;
+                }
+                continue;
+            }
+            if (nNow - request.nTime < BLOCK_DOWNLOAD_TIMEOUT)
+                continue;
+        }
+
+        // Only ask peers that said they are past this height
+        if (pto->nStartingHeight < nHeight || nInFlight >= MAX_BLOCKS_IN_FLIGHT_PER_PEER)
+            break;
+        if (hash == hashBlockStalled && setBlockStalledPeers.count(pto->nNodeId))
+            continue;
+
+        CBlockInFlight& request = mapBlocksInFlight[hash];
+        request.nNodeId = pto->nNodeId;
+        request.nTime = nNow;
+        vGetData.push_back(CInv(MSG_BLOCK, hash));
+        nInFlight++;
+    }
+}
+
 bool ProcessBlock(CNode* pfrom, CBlock* pblock)
 {
     // Check for duplicate
@@ -2359,8 +2787,13 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
         {
             printf("WARNING: ProcessBlock(): check proof-of-stake failed for block %s\n", hash.ToString().c_str());
 
+            // On top of our best block its kernel is known, so the header
+            // that brought it here was a forgery
+            if (pblock->hashPrevBlock == hashBestChain)
+                HeaderChainBlockFailed(hash, 100);
+
             // peershares: ask for missing blocks
-            if (pfrom)
+            if (pfrom && !IsHeadersFirstSyncing())
                 pfrom->PushGetBlocks(pindexBest, pblock->GetHash());
 
             return false; // do not error here as we expect this during initial block download
@@ -2408,8 +2841,9 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
         mapOrphanBlocks.insert(std::make_pair(hash, pblock2));
         mapOrphanBlocksByPrev.insert(std::make_pair(pblock2->hashPrevBlock, pblock2));
 
-        // Ask this guy to fill in what we're missing
-        if (pfrom)
+        // Ask this guy to fill in what we're missing, unless the headers
+        // first scheduler is already fetching it
+        if (pfrom && !IsHeadersFirstSyncing())
         {
             pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(pblock2));
             // ppcoin: getblocks may not obtain the ancestor block rejected
@@ -2583,53 +3017,6 @@ bool CheckDiskSpace(uint64 nAdditionalBytes)
     return true;
 }
 
-static boost::filesystem::path BlockFilePath(unsigned int nFile)
-{
-    std::string strBlockFn = strprintf("blk%04u.dat", nFile);
-    return GetDataDir() / strBlockFn;
-}
-
-FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode)
-{
-    if ((nFile < 1) || (nFile == (unsigned int) -1))
-        return NULL;
-    FILE* file = fopen(BlockFilePath(nFile).string().c_str(), pszMode);
-    if (!file)
-        return NULL;
-    if (nBlockPos != 0 && !strchr(pszMode, 'a') && !strchr(pszMode, 'w'))
-    {
-        if (fseek(file, nBlockPos, SEEK_SET) != 0)
-        {
-            fclose(file);
-            return NULL;
-        }
-    }
-    return file;
-}
-
-static unsigned int nCurrentBlockFile = 1;
-
-FILE* AppendBlockFile(unsigned int& nFileRet)
-{
-    nFileRet = 0;
-    while (true)
-    {
-        FILE* file = OpenBlockFile(nCurrentBlockFile, 0, "ab");
-        if (!file)
-            return NULL;
-        if (fseek(file, 0, SEEK_END) != 0)
-            return NULL;
-        // FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
-        if (ftell(file) < (long)(0x7F000000 - MAX_SIZE))
-        {
-            nFileRet = nCurrentBlockFile;
-            return file;
-        }
-        fclose(file);
-        nCurrentBlockFile++;
-    }
-}
-
 bool LoadBlockIndex(bool fAllowNew)
 {
     if (fTestNet)
@@ -2769,7 +3156,7 @@ void PrintBlockTree()
 {
     // pre-compute tree structure
     std::map<CBlockIndex*, std::vector<CBlockIndex*> > mapNext;
-    for (std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+    for (CBlockIndexMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
     {
         CBlockIndex* pindex = (*mi).second;
         mapNext[pindex->pprev].push_back(pindex);
@@ -3005,7 +3392,7 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
             txInMap = (mempool.exists(inv.hash));
         }
         return txInMap ||
-                mapOrphanTransactions.count(inv.hash) ||
+                orphanpool.Exists(inv.hash) ||
                 txdb.ContainsTx(inv.hash);
     }
 
@@ -3020,13 +3407,205 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
 
 
 
+// Accept the orphans that were waiting for hashParent, then theirs, and
+// so on, in one pass
+static void ProcessOrphanTransactions(CTxDB& txdb, const uint256& hashParent)
+{
+    std::vector<uint256> vWorkQueue(1, hashParent);
+    std::set<uint256> setDone;
+    for (unsigned int i = 0; i < vWorkQueue.size(); i++)
+    {
+        std::vector<uint256> vChildren;
+        orphanpool.GetChildren(vWorkQueue[i], vChildren);
+        BOOST_FOREACH(const uint256& hash, vChildren)
+        {
+            // A child of several parents in this pass may show up again
+            if (setDone.count(hash))
+                continue;
+
+            CTransaction tx = orphanpool.Get(hash)->tx;
+            CInv inv(MSG_TX, hash);
+            bool fMissingInputs = false;
+            if (tx.AcceptToMemoryPool(txdb, true, &fMissingInputs))
+            {
+                printf("   accepted orphan tx %s\n", hash.ToString().substr(0,10).c_str());
+                SyncWithWallets(tx, NULL, true);
+                RelayMessage(inv, tx);
+                mapAlreadyAskedFor.erase(inv);
+                vWorkQueue.push_back(hash);
+                setDone.insert(hash);
+            }
+            else if (!fMissingInputs)
+            {
+                printf("   removed invalid orphan tx %s\n", hash.ToString().substr(0,10).c_str());
+                setDone.insert(hash);
+            }
+        }
+    }
+
+    BOOST_FOREACH(const uint256& hash, setDone)
+        orphanpool.Erase(hash);
+}
+
+// A rebuilt compact block that doesn't match its merkle root most likely
+// picked the wrong transaction for a short id, so fetch it whole rather
+// than blame the peer
+static void ProcessCompactBlock(CNode* pfrom, CBlock& block)
+{
+    CInv inv(MSG_BLOCK, block.GetHash());
+    if (block.BuildMerkleTree() != block.hashMerkleRoot)
+    {
+        printf("compact block %s did not rebuild, asking for all of it\n", inv.hash.ToString().substr(0,20).c_str());
+        pfrom->PushMessage("getdata", std::vector<CInv>(1, inv));
+        return;
+    }
+
+    // Rebuilt, so no longer owed by whichever peer it was requested from
+    BlockInFlightReceived(inv.hash);
+    if (ProcessBlock(pfrom, &block))
+        mapAlreadyAskedFor.erase(inv);
+    if (block.nDoS) pfrom->Misbehaving(block.nDoS);
+}
+
+// What can be checked of a compact block before rebuilding it: its header
+// against the block it builds on, and its signature and proof from the
+// prefilled coinbase and coinstake. Fails with nDoS set for a block that
+// can't be genuine.
+static bool CheckCompactBlockHeader(const CCompactBlock& cmpctblock, CBlockIndex* pindexPrev, int& nDoS)
+{
+    nDoS = 0;
+    const std::vector<CPrefilledTransaction>& vPrefilled = cmpctblock.vPrefilled;
+    if (vPrefilled.empty() || vPrefilled[0].nIndex != 0 || !vPrefilled[0].tx.IsCoinBase())
+    {
+        nDoS = 100;
+        return error("CheckCompactBlockHeader() : no coinbase");
+    }
+    CBlock block(cmpctblock.header);
+    block.vtx.push_back(vPrefilled[0].tx);
+    if (vPrefilled.size() > 1 && vPrefilled[1].nIndex == 1 && vPrefilled[1].tx.IsCoinStake())
+        block.vtx.push_back(vPrefilled[1].tx);
+    block.vchBlockSig = cmpctblock.vchBlockSig;
+    uint256 hash = block.GetHash();
+    int nHeight = pindexPrev->nHeight + 1;
+
+    if (block.GetBlockTime() > GetAdjustedTime() + nMaxClockDrift)
+        return error("CheckCompactBlockHeader() : block timestamp too far in the future");
+    if (block.IsProofOfWork() && nHeight > (int)HF_BLOCK)
+    {
+        nDoS = 100;
+        return error("CheckCompactBlockHeader() : proof-of-work block at height %d", nHeight);
+    }
+    if (block.nBits != GetNextTargetRequired(pindexPrev, block.IsProofOfStake()))
+    {
+        nDoS = 100;
+        return error("CheckCompactBlockHeader() : incorrect %s", block.IsProofOfWork() ? "proof-of-work" : "proof-of-stake");
+    }
+    if (block.GetBlockTime() <= pindexPrev->GetMedianTimePast() || block.GetBlockTime() + nMaxClockDrift < pindexPrev->GetBlockTime())
+    {
+        nDoS = 100;
+        return error("CheckCompactBlockHeader() : block's timestamp is too early");
+    }
+    if (block.IsProofOfWork() && !CheckProofOfWork(hash, block.nBits))
+    {
+        nDoS = 50;
+        return error("CheckCompactBlockHeader() : proof of work failed");
+    }
+    if (!block.CheckBlockSignature())
+    {
+        nDoS = 100;
+        return error("CheckCompactBlockHeader() : bad block signature");
+    }
+    if (block.IsProofOfStake())
+    {
+        // On top of our best block the kernel is known, so a failure is a
+        // forgery rather than a gap in our chain
+        uint256 hashProofOfStake = 0;
+        if (!CheckProofOfStake(block.vtx[1], block.nBits, hashProofOfStake))
+        {
+            if (block.hashPrevBlock == hashBestChain)
+                nDoS = 100;
+            return error("CheckCompactBlockHeader() : check proof-of-stake failed");
+        }
+    }
+    return true;
+}
+
+static void AddPartialBlock(const uint256& hash, const CPartialBlock& partial)
+{
+    int64 nNow = GetTime();
+    for (std::map<uint256, CPartialBlock>::iterator mi = mapPartialBlocks.begin(); mi != mapPartialBlocks.end(); )
+    {
+        if (nNow - (*mi).second.nTime > PARTIAL_BLOCK_TIMEOUT)
+            mapPartialBlocks.erase(mi++);
+        else
+            ++mi;
+    }
+
+    // Make room by dropping the oldest of the peer's own, or if it has few
+    // the oldest of all, so one peer can't push out the others' blocks
+    std::map<uint256, CPartialBlock>::iterator miOldest = mapPartialBlocks.end(), miOldestPeer = mapPartialBlocks.end();
+    unsigned int nPeerBlocks = 0;
+    for (std::map<uint256, CPartialBlock>::iterator mi = mapPartialBlocks.begin(); mi != mapPartialBlocks.end(); ++mi)
+    {
+        if (miOldest == mapPartialBlocks.end() || (*mi).second.nTime < (*miOldest).second.nTime)
+            miOldest = mi;
+        if ((*mi).second.nNodeId == partial.nNodeId)
+        {
+            nPeerBlocks++;
+            if (miOldestPeer == mapPartialBlocks.end() || (*mi).second.nTime < (*miOldestPeer).second.nTime)
+                miOldestPeer = mi;
+        }
+    }
+    if (nPeerBlocks >= MAX_PARTIAL_BLOCKS_PER_PEER)
+        mapPartialBlocks.erase(miOldestPeer);
+    else if (mapPartialBlocks.size() >= MAX_PARTIAL_BLOCKS)
+        mapPartialBlocks.erase(miOldest);
+    mapPartialBlocks[hash] = partial;
+}
+
+
+
+
+// Send a block we have to a peer, unless it is an old one and the upload
+// target is reached, in which case the peer is dropped and false returned
+static bool PushBlockFromDisk(CNode* pfrom, CBlockIndex* pindex)
+{
+    if (pindex->GetBlockTime() < GetAdjustedTime() - UPLOAD_TARGET_HISTORICAL_AGE && IsUploadTargetReached())
+    {
+        printf("upload target reached, disconnecting peer %s asking for old block\n", pfrom->addrName.c_str());
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    // Blocks for a peer catching up yield to relay traffic
+    int nPriority = pindex->nHeight < nBestHeight - BULK_BLOCK_DEPTH ? SEND_PRIORITY_BULK : SEND_PRIORITY_HIGH;
+
+    // Send the bytes on disk as they are; the header hash shows they are
+    // the block the index says
+    CRawBlock rawblock;
+    if (rawblock.Read(pindex->nFile, pindex->nBlockPos, MAX_BLOCK_SIZE) && rawblock.nSize >= BLOCK_HEADER_SIZE &&
+        Hash(rawblock.pbegin, rawblock.pbegin + BLOCK_HEADER_SIZE) == pindex->GetBlockHash())
+        pfrom->PushRawMessage("block", rawblock.pbegin, rawblock.nSize, nPriority);
+    else
+    {
+        CBlock block;
+        block.ReadFromDisk(pindex);
+        if (nPriority == SEND_PRIORITY_BULK)
+            pfrom->PushBulkMessage("block", block);
+        else
+            pfrom->PushMessage("block", block);
+    }
+    return true;
+}
+
 // The message start string is designed to be unlikely to occur in normal data.
 // The characters are rarely used upper ASCII, not valid as UTF-8, and produce
 // a large 4-byte int at any alignment.
 unsigned char pchMessageStart[4] = { 0xe4, 0xe8, 0xe9, 0xe5 };
 
-bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv)
+bool static ProcessMessage(CNode* pfrom, std::string strCommand, CNetDataStream& vRecv)
 {
+    PERF_TIMER(PERF_PROCESSMESSAGE);
     static std::map<CService, CPubKey> mapReuseKey;
     RandAddSeedPerfmon();
     if (fDebug)
@@ -3134,7 +3713,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 (pfrom->nStartingHeight > (nBestHeight - 144)) &&
                 (pfrom->nVersion < NOBLKS_VERSION_START ||
                  pfrom->nVersion >= NOBLKS_VERSION_END) &&
-                (nAskedForBlocks < 1 || vNodes.size() <= 1))
+                (nAskedForBlocks < 1 || vNodes.size() <= 1) &&
+                !(fHeadersFirst && pfrom->nStartingHeight > nBestHeight))
         {
             nAskedForBlocks++;
             pfrom->PushGetBlocks(pindexBest, uint256(0));
@@ -3278,7 +3858,9 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             if (fDebug)
                 printf("  got inventory: %s  %s\n", inv.ToString().c_str(), fAlreadyHave ? "have" : "new");
 
-            if (!fAlreadyHave)
+            if (inv.type == MSG_BLOCK && IsHeadersFirstSyncing()) {
+                // Blocks come from the download window until we are synced
+            } else if (!fAlreadyHave)
                 pfrom->AskFor(inv, IsInitialBlockDownload()); // peershares: immediate retry during initial download
             else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
                 pfrom->PushGetBlocks(pindexBest, GetOrphanRoot(mapOrphanBlocks[inv.hash]));
@@ -3320,12 +3902,12 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             if (inv.type == MSG_BLOCK)
             {
                 // Send block from disk
-                std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
+                CBlockIndexMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
-                    CBlock block;
-                    block.ReadFromDisk((*mi).second);
-                    pfrom->PushMessage("block", block);
+                    CBlockIndex* pindex = (*mi).second;
+                    if (!PushBlockFromDisk(pfrom, pindex))
+                        break;
 
                     // Trigger them to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
@@ -3433,7 +4015,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         if (locator.IsNull())
         {
             // If locator is null, return the hashStop block
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashStop);
+            CBlockIndexMap::iterator mi = mapBlockIndex.find(hashStop);
             if (mi == mapBlockIndex.end())
                 return true;
             pindex = (*mi).second;
@@ -3459,11 +4041,22 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
+    else if (strCommand == "headers")
+    {
+        std::vector<CBlock> vHeaders;
+        vRecv >> vHeaders;
+        if (vHeaders.size() > MAX_HEADERS_RESULTS)
+        {
+            pfrom->Misbehaving(20);
+            return error("message headers size() = %" PRIszu "", vHeaders.size());
+        }
+        ProcessBlockHeaders(pfrom, vHeaders);
+    }
+
+
     else if (strCommand == "tx")
     {
-        std::vector<uint256> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
-        CDataStream vMsg(vRecv);
+        CDataStream vMsg(vRecv.begin(), vRecv.end(), vRecv.nType, vRecv.nVersion);
         CTxDB txdb("r");
         CTransaction tx;
         vRecv >> tx;
@@ -3477,52 +4070,17 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             SyncWithWallets(tx, NULL, true);
             RelayMessage(inv, vMsg);
             mapAlreadyAskedFor.erase(inv);
-            vWorkQueue.push_back(inv.hash);
-            vEraseQueue.push_back(inv.hash);
-
-            // Recursively process any orphan transactions that depended on this one
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                uint256 hashPrev = vWorkQueue[i];
-                for (std::map<uint256, CDataStream*>::iterator mi = mapOrphanTransactionsByPrev[hashPrev].begin();
-                     mi != mapOrphanTransactionsByPrev[hashPrev].end();
-                     ++mi)
-                {
-                    const CDataStream& vMsg = *((*mi).second);
-                    CTransaction tx;
-                    CDataStream(vMsg) >> tx;
-                    CInv inv(MSG_TX, tx.GetHash());
-                    bool fMissingInputs2 = false;
-
-                    if (tx.AcceptToMemoryPool(txdb, true, &fMissingInputs2))
-                    {
-                        printf("   accepted orphan tx %s\n", inv.hash.ToString().substr(0,10).c_str());
-                        SyncWithWallets(tx, NULL, true);
-                        RelayMessage(inv, vMsg);
-                        mapAlreadyAskedFor.erase(inv);
-                        vWorkQueue.push_back(inv.hash);
-                        vEraseQueue.push_back(inv.hash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        // invalid orphan
-                        vEraseQueue.push_back(inv.hash);
-                        printf("   removed invalid orphan tx %s\n", inv.hash.ToString().substr(0,10).c_str());
-                    }
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                    EraseOrphanTx(hash);
+            orphanpool.Erase(inv.hash);
+            ProcessOrphanTransactions(txdb, inv.hash);
         }
         else if (fMissingInputs)
         {
-            AddOrphanTx(vMsg);
+            orphanpool.Add(tx, inv.hash, pfrom->nNodeId);
 
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
+            // DoS prevention: do not allow the orphan pool to grow unbounded
+            unsigned int nEvicted = orphanpool.Limit();
             if (nEvicted > 0)
-                printf("mapOrphan overflow, removed %u tx\n", nEvicted);
+                printf("orphan pool overflow, removed %u tx\n", nEvicted);
         }
         if (tx.nDoS) pfrom->Misbehaving(tx.nDoS);
     }
@@ -3541,6 +4099,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         CInv inv(MSG_BLOCK, block.GetHash());
         pfrom->AddInventoryKnown(inv);
+        BlockInFlightReceived(inv.hash);
 
         if (ProcessBlock(pfrom, &block))
             mapAlreadyAskedFor.erase(inv);
@@ -3548,6 +4107,139 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
+    else if (strCommand == "cmpctblock" && (nLocalServices & NODE_COMPACT_BLOCKS))
+    {
+        CCompactBlock cmpctblock;
+        vRecv >> cmpctblock;
+
+        uint256 hash = cmpctblock.GetHash();
+        CInv inv(MSG_BLOCK, hash);
+        pfrom->AddInventoryKnown(inv);
+        if (mapBlockIndex.count(hash) || mapOrphanBlocks.count(hash))
+            return true;
+        std::map<uint256, CPartialBlock>::const_iterator mi = mapPartialBlocks.find(hash);
+        if (mi != mapPartialBlocks.end() && GetTime() - (*mi).second.nTime <= PARTIAL_BLOCK_TIMEOUT)
+            return true;
+        printf("received compact block %s\n", hash.ToString().substr(0,20).c_str());
+
+        // Only a block on top of one we have can be rebuilt; anything else
+        // goes the usual way
+        if (!mapBlockIndex.count(cmpctblock.header.hashPrevBlock))
+        {
+            if (!IsHeadersFirstSyncing())
+                pfrom->AskFor(inv, IsInitialBlockDownload());
+            return true;
+        }
+
+        // Worth rebuilding and keeping only if it could be a real block
+        int nDoS = 0;
+        if (!CheckCompactBlockHeader(cmpctblock, mapBlockIndex[cmpctblock.header.hashPrevBlock], nDoS))
+        {
+            if (nDoS)
+            {
+                pfrom->Misbehaving(nDoS);
+                return false;
+            }
+            return true;
+        }
+
+        CPartialBlock partial;
+        partial.nNodeId = pfrom->nNodeId;
+        partial.nTime = GetTime();
+        if (!cmpctblock.FillBlock(partial.block, partial.vMissing, nDoS))
+        {
+            if (nDoS)
+            {
+                pfrom->Misbehaving(nDoS);
+                return false;
+            }
+            pfrom->PushMessage("getdata", std::vector<CInv>(1, inv));
+            return true;
+        }
+
+        if (partial.vMissing.empty())
+            ProcessCompactBlock(pfrom, partial.block);
+        else
+        {
+            if (fDebugNet)
+                printf("compact block %s missing %" PRIszu " of %" PRIszu " transactions\n", hash.ToString().substr(0,20).c_str(), partial.vMissing.size(), partial.block.vtx.size());
+            CBlockTransactionsRequest req;
+            req.hashBlock = hash;
+            req.vIndexes = partial.vMissing;
+            pfrom->PushMessage("getblocktxn", req);
+            AddPartialBlock(hash, partial);
+        }
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        CBlockTransactionsRequest req;
+        vRecv >> req;
+
+        CBlockIndexMap::iterator mi = mapBlockIndex.find(req.hashBlock);
+        if (mi == mapBlockIndex.end())
+            return error("getblocktxn for unknown block %s", req.hashBlock.ToString().substr(0,20).c_str());
+        CBlockIndex* pindex = (*mi).second;
+
+        // Only recent blocks are relayed compact; for anything older the
+        // whole block is no more than the transactions asked for, and is
+        // sent as getdata would
+        if (!pindex->IsInMainChain() || pindex->nHeight < nBestHeight - MAX_BLOCKTXN_DEPTH)
+        {
+            PushBlockFromDisk(pfrom, pindex);
+            return true;
+        }
+
+        CBlock block;
+        if (!block.ReadFromDisk(pindex))
+            return error("getblocktxn : ReadFromDisk failed for %s", req.hashBlock.ToString().substr(0,20).c_str());
+
+        // Each index once, in order, as FillBlock lists the gaps
+        if (req.vIndexes.size() > block.vtx.size())
+        {
+            pfrom->Misbehaving(100);
+            return error("getblocktxn asks for %" PRIszu " of %" PRIszu " transactions", req.vIndexes.size(), block.vtx.size());
+        }
+        CBlockTransactions resp;
+        resp.hashBlock = req.hashBlock;
+        resp.vtx.reserve(req.vIndexes.size());
+        for (unsigned int i = 0; i < req.vIndexes.size(); i++)
+        {
+            unsigned short n = req.vIndexes[i];
+            if (n >= block.vtx.size() || (i > 0 && n <= req.vIndexes[i-1]))
+            {
+                pfrom->Misbehaving(100);
+                return error("getblocktxn index %u out of range or out of order", n);
+            }
+            resp.vtx.push_back(block.vtx[n]);
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn")
+    {
+        CBlockTransactions resp;
+        vRecv >> resp;
+
+        // Unasked for or given up on
+        std::map<uint256, CPartialBlock>::iterator mi = mapPartialBlocks.find(resp.hashBlock);
+        if (mi == mapPartialBlocks.end() || (*mi).second.nNodeId != pfrom->nNodeId)
+            return true;
+
+        CBlock block((*mi).second.block);
+        bool fFilled = FillMissingTransactions(block, (*mi).second.vMissing, resp.vtx);
+        mapPartialBlocks.erase(mi);
+        if (!fFilled)
+        {
+            pfrom->Misbehaving(100);
+            return false;
+        }
+        ProcessCompactBlock(pfrom, block);
+    }
+
+
     else if (strCommand == "getaddr")
     {
         pfrom->vAddrToSend.clear();
@@ -3690,7 +4382,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
 bool ProcessMessages(CNode* pfrom)
 {
-    CDataStream& vRecv = pfrom->vRecv;
+    CNetDataStream& vRecv = pfrom->vRecv;
     if (vRecv.empty())
         return true;
     //if (fDebug)
@@ -3708,11 +4400,11 @@ bool ProcessMessages(CNode* pfrom)
     while (true)
     {
         // Don't bother if send buffer is too full to respond anyway
-        if (pfrom->vSend.size() >= SendBufferSize())
+        if (pfrom->GetSendQueued() >= SendBufferSize())
             break;
 
         // Scan for message start
-        CDataStream::iterator pstart = search(vRecv.begin(), vRecv.end(), BEGIN(pchMessageStart), END(pchMessageStart));
+        CNetDataStream::iterator pstart = search(vRecv.begin(), vRecv.end(), BEGIN(pchMessageStart), END(pchMessageStart));
         int nHeaderSize = vRecv.GetSerializeSize(CMessageHeader());
         if (vRecv.end() - pstart < nHeaderSize)
         {
@@ -3764,7 +4456,7 @@ bool ProcessMessages(CNode* pfrom)
         }
 
         // Copy message to its own buffer
-        CDataStream vMsg(vRecv.begin(), vRecv.begin() + nMessageSize, vRecv.nType, vRecv.nVersion);
+        CNetDataStream vMsg(vRecv.begin(), vRecv.begin() + nMessageSize, vRecv.nType, vRecv.nVersion);
         vRecv.ignore(nMessageSize);
 
         // Process message
@@ -3806,11 +4498,14 @@ bool ProcessMessages(CNode* pfrom)
     }
 
     vRecv.Compact();
+    // Don't keep the buffer of a large message around once it is processed
+    if (vRecv.empty() && vRecv.capacity() > MAX_IDLE_BUFFER_SIZE)
+        vRecv.release();
     return true;
 }
 
 
-bool SendMessages(CNode* pto, bool fSendTrickle)
+bool SendMessages(CNode* pto)
 {
     TRY_LOCK(cs_main, lockMain);
     if (lockMain) {
@@ -3820,7 +4515,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
 
         // Keep-alive ping. We send a nonce of zero because we don't use it anywhere
         // right now.
-        if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->vSend.empty()) {
+        if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->GetSendQueued() == 0) {
             uint64 nonce = 0;
             if (pto->nVersion > BIP0031_VERSION)
                 pto->PushMessage("ping", nonce);
@@ -3858,8 +4553,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         // Message: addr
         //
-        if (fSendTrickle)
+        int64 nNow = GetTime() * 1000000;
+        if (pto->nNextAddrSend < nNow)
         {
+            pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
@@ -3885,56 +4582,40 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         //
         // Message: inventory
         //
+        // Blocks go out straight away. Transactions are held until the
+        // peer's next flush, at random times a few seconds apart, which
+        // batches them into fewer inv messages and makes it harder to tell
+        // which node a transaction came from.
         std::vector<CInv> vInv;
-        std::vector<CInv> vInvWait;
         {
             LOCK(pto->cs_inventory);
+            bool fSendTrickle = false;
+            if (pto->nNextInvSend < nNow)
+            {
+                fSendTrickle = true;
+                pto->nNextInvSend = PoissonNextSend(nNow, INVENTORY_BROADCAST_INTERVAL >> !pto->fInbound);
+            }
+
+            std::vector<CInv> vInvWait;
             vInv.reserve(pto->vInventoryToSend.size());
-            vInvWait.reserve(pto->vInventoryToSend.size());
             BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
             {
-                if (pto->setInventoryKnown.count(inv))
-                    continue;
-
-                // trickle out tx inv to protect privacy
                 if (inv.type == MSG_TX && !fSendTrickle)
                 {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
-                    uint256 hashRand = inv.hash ^ hashSalt;
-                    hashRand = Hash(BEGIN(hashRand), END(hashRand));
-                    bool fTrickleWait = ((hashRand & 3) != 0);
-
-                    // always trickle our own transactions
-                    if (!fTrickleWait)
-                    {
-                        CWalletTx wtx;
-                        if (GetTransaction(inv.hash, wtx))
-                            if (wtx.fFromMe)
-                                fTrickleWait = true;
-                    }
-
-                    if (fTrickleWait)
-                    {
-                        vInvWait.push_back(inv);
-                        continue;
-                    }
+                    vInvWait.push_back(inv);
+                    continue;
                 }
-
-                // returns true if wasn't already contained in the set
-                if (pto->setInventoryKnown.insert(inv).second)
+                if (pto->filterInventoryKnown.contains(inv.hash))
+                    continue;
+                pto->filterInventoryKnown.insert(inv.hash);
+                vInv.push_back(inv);
+                if (vInv.size() >= MAX_INV_SZ)
                 {
-                    vInv.push_back(inv);
-                    if (vInv.size() >= 1000)
-                    {
-                        pto->PushMessage("inv", vInv);
-                        vInv.clear();
-                    }
+                    pto->PushMessage("inv", vInv);
+                    vInv.clear();
                 }
             }
-            pto->vInventoryToSend = vInvWait;
+            pto->vInventoryToSend.swap(vInvWait);
         }
         if (!vInv.empty())
             pto->PushMessage("inv", vInv);
@@ -3944,7 +4625,6 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Message: getdata
         //
         std::vector<CInv> vGetData;
-        int64 nNow = GetTime() * 1000000;
         CTxDB txdb("r");
         while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
         {
@@ -3963,6 +4643,8 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             }
             pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
+        if (fHeadersFirst)
+            SendHeadersFirstRequests(pto, vGetData);
         if (!vGetData.empty())
             pto->PushMessage("getdata", vGetData);
 
@@ -4114,6 +4796,8 @@ public:
 //   fProofOfStake: try (best effort) to make a proof-of-stake block
 CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake)
 {
+    PERF_TIMER(PERF_CREATENEWBLOCK);
+
     CReserveKey reservekey(pwallet);
 
     // Create new block
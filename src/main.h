@@ -5,12 +5,16 @@
 #ifndef curecoin_MAIN_H
 #define curecoin_MAIN_H
 
+#include "arith_uint256.h"
 #include "bignum.h"
 #include "sync.h"
 #include "net.h"
 #include "script.h"
+#include "blockstore.h"
+#include "blockindexmap.h"
 
 #include <list>
+#include <deque>
 
 class CWallet;
 class CBlock;
@@ -25,6 +29,8 @@ class CRequestTracker;
 class CNode;
 
 static const unsigned int MAX_BLOCK_SIZE = 1000000;
+/** Serialized size of a block header, which is all the block hash covers */
+static const unsigned int BLOCK_HEADER_SIZE = 80;
 static const unsigned int MAX_BLOCK_SIZE_GEN = MAX_BLOCK_SIZE/2;
 static const unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
 static const unsigned int MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/100;
@@ -53,11 +59,30 @@ static const uint256 hashGenesisBlockTestNet("0x0000a25934ca63ddc77adf8fe033cfb5
 
 static const int64 nMaxClockDrift = 2 * 60 * 60;        // two hours
 
+/** Headers-first sync: most headers in one "headers" message */
+static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Headers-first sync: how far the header chain may run ahead of our best block */
+static const int MAX_HEADERS_AHEAD = 50000;
+/** Headers-first sync: blocks above our best block that may be requested */
+static const int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Headers-first sync: blocks requested from one peer at a time */
+static const int MAX_BLOCKS_IN_FLIGHT_PER_PEER = 16;
+/** Seconds before a block request is handed to another peer */
+static const int64 BLOCK_DOWNLOAD_TIMEOUT = 120;
+/** Seconds the peer holding the next block we need may take before it is disconnected */
+static const int64 BLOCK_STALLING_TIMEOUT = 30;
+/** Seconds before the headers sync peer is given up on */
+static const int64 HEADERS_DOWNLOAD_TIMEOUT = 120;
+/** Average seconds between transaction inv flushes to an inbound peer; outbound peers get half */
+static const int INVENTORY_BROADCAST_INTERVAL = 5;
+/** Average seconds between addr flushes to a peer */
+static const int AVG_ADDRESS_BROADCAST_INTERVAL = 30;
+
 extern CScript COINBASE_FLAGS;
 
 
 extern CCriticalSection cs_main;
-extern std::map<uint256, CBlockIndex*> mapBlockIndex;
+extern CBlockIndexMap mapBlockIndex;
 extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 extern uint256 hashGenesisBlock;
 extern uint256 hashAssumeValid;  // If set, skip script/sig verification for blocks before this (IBD speedup)
@@ -65,8 +90,8 @@ extern CBlockIndex* pindexGenesisBlock;
 extern unsigned int nStakeMinAge;
 extern int nCoinbaseMaturity;
 extern int nBestHeight;
-extern CBigNum bnBestChainTrust;
-extern CBigNum bnBestInvalidTrust;
+extern arith_uint256 bnBestChainTrust;
+extern arith_uint256 bnBestInvalidTrust;
 extern uint256 hashBestChain;
 extern CBlockIndex* pindexBest;
 extern unsigned int nTransactionsUpdated;
@@ -81,6 +106,7 @@ extern CCriticalSection cs_setpwalletRegistered;
 extern std::set<CWallet*> setpwalletRegistered;
 extern unsigned char pchMessageStart[4];
 extern std::map<uint256, CBlock*> mapOrphanBlocks;
+extern bool fHeadersFirst;
 
 // Settings
 //extern int64 nTransactionFee;
@@ -101,13 +127,13 @@ void UnregisterWallet(CWallet* pwalletIn);
 void SyncWithWallets(const CTransaction& tx, const CBlock* pblock = NULL, bool fUpdate = false, bool fConnect = true);
 bool ProcessBlock(CNode* pfrom, CBlock* pblock);
 bool CheckDiskSpace(uint64 nAdditionalBytes=0);
-FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode="rb");
-FILE* AppendBlockFile(unsigned int& nFileRet);
 bool LoadBlockIndex(bool fAllowNew=true);
 void PrintBlockTree();
 CBlockIndex* FindBlockByHeight(int nHeight);
 bool ProcessMessages(CNode* pfrom);
-bool SendMessages(CNode* pto, bool fSendTrickle);
+/** Forget what is kept about a peer that is gone. Requires cs_main. */
+void FinalizeNode(int nNodeId);
+bool SendMessages(CNode* pto);
 bool LoadExternalBlockFile(FILE* fileIn);
 void Generatecurecoins(bool fGenerate, CWallet* pwallet);
 CBlock* CreateNewBlock(CWallet* pwallet, bool fProofOfStake=false);
@@ -600,6 +626,18 @@ public:
 
     bool ReadFromDisk(CDiskTxPos pos, FILE** pfileRet=NULL)
     {
+        if (!pfileRet)
+        {
+            try {
+                if (!ReadBlockFile(pos.nFile, pos.nTxPos, *this, SER_DISK, CLIENT_VERSION))
+                    return error("CTransaction::ReadFromDisk() : OpenBlockFile failed");
+            }
+            catch (std::exception &e) {
+                return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+            }
+            return true;
+        }
+
         CAutoFile filein = CAutoFile(OpenBlockFile(pos.nFile, 0, pfileRet ? "rb+" : "rb"), SER_DISK, CLIENT_VERSION);
         if (!filein)
             return error("CTransaction::ReadFromDisk() : OpenBlockFile failed");
@@ -827,6 +865,55 @@ public:
 
 
 
+/** What DisconnectBlock needs to take a block off the chain: the txdb
+ * entries, as they were before the block was connected, of the earlier
+ * transactions it spends. Written to the undo files (rev000N.dat) by
+ * ConnectBlock, and found through the txdb by block hash.
+ */
+class CBlockUndo
+{
+public:
+    uint256 hashBlock;
+    std::vector<std::pair<uint256, CTxIndex> > vPrevTxIndex;
+
+    CBlockUndo()
+    {
+        hashBlock = 0;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(vPrevTxIndex);
+    )
+
+    bool WriteToDisk(unsigned int& nFileRet, unsigned int& nPosRet) const
+    {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << *this;
+        return WriteUndoToFile(&ss[0], ss.size(), nFileRet, nPosRet);
+    }
+
+    bool ReadFromDisk(unsigned int nFile, unsigned int nPos, const uint256& hashBlockIn)
+    {
+        std::vector<char> vch;
+        if (!ReadUndoFile(nFile, nPos, vch))
+            return false;
+        try {
+            CDataStream ss(vch.begin(), vch.end(), SER_DISK, CLIENT_VERSION);
+            ss >> *this;
+        }
+        catch (std::exception &e) {
+            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+        }
+        if (hashBlock != hashBlockIn)
+            return error("CBlockUndo::ReadFromDisk() : undo data is for block %s", hashBlock.ToString().substr(0,20).c_str());
+        return true;
+    }
+};
+
+
+
 
 
 /** Nodes collect new transactions into a block, hash them into a hash tree,
@@ -1023,26 +1110,15 @@ public:
 
     bool WriteToDisk(unsigned int& nFileRet, unsigned int& nBlockPosRet)
     {
-        // Open history file to append
-        CAutoFile fileout = CAutoFile(AppendBlockFile(nFileRet), SER_DISK, CLIENT_VERSION);
-        if (!fileout)
-            return error("CBlock::WriteToDisk() : AppendBlockFile failed");
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << *this;
+        if (!WriteBlockToFile(&ss[0], ss.size(), nFileRet, nBlockPosRet))
+            return error("CBlock::WriteToDisk() : WriteBlockToFile failed");
 
-        // Write index header
-        unsigned int nSize = fileout.GetSerializeSize(*this);
-        fileout << FLATDATA(pchMessageStart) << nSize;
-
-        // Write block
-        long fileOutPos = ftell(fileout);
-        if (fileOutPos < 0)
-            return error("CBlock::WriteToDisk() : ftell failed");
-        nBlockPosRet = fileOutPos;
-        fileout << *this;
-
-        // Flush stdio buffers and commit to disk before returning
-        fflush(fileout);
-        if (!IsInitialBlockDownload() || (nBestHeight+1) % 500 == 0)
-            FileCommit(fileout);
+        // Written blocks are only flushed to the OS; commit them to disk
+        // in batches while catching up
+        if (!IsInitialBlockDownload() || (nBestHeight+1) % BLOCKFILE_SYNC_INTERVAL == 0)
+            SyncBlockFile();
 
         return true;
     }
@@ -1051,16 +1127,10 @@ public:
     {
         SetNull();
 
-        // Open history file to read
-        CAutoFile filein = CAutoFile(OpenBlockFile(nFile, nBlockPos, "rb"), SER_DISK, CLIENT_VERSION);
-        if (!filein)
-            return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
-        if (!fReadTransactions)
-            filein.nType |= SER_BLOCKHEADERONLY;
-
         // Read block
         try {
-            filein >> *this;
+            if (!ReadBlockFile(nFile, nBlockPos, *this, fReadTransactions ? SER_DISK : SER_DISK | SER_BLOCKHEADERONLY, CLIENT_VERSION))
+                return error("CBlock::ReadFromDisk() : OpenBlockFile failed");
         }
         catch (std::exception &e) {
             return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
@@ -1132,7 +1202,7 @@ public:
     CBlockIndex* pnext;
     unsigned int nFile;
     unsigned int nBlockPos;
-    CBigNum bnChainTrust; // ppcoin: trust score of block chain
+    arith_uint256 bnChainTrust; // ppcoin: trust score of block chain
     int nHeight;
 
     int64 nMint;
@@ -1243,13 +1313,20 @@ public:
         return (int64)nTime;
     }
 
-    CBigNum GetBlockTrust() const
+    arith_uint256 GetBlockTrust() const
     {
-        CBigNum bnTarget;
-        bnTarget.SetCompact(nBits);
-        if (bnTarget <= 0)
+        bool fNegative, fOverflow;
+        arith_uint256 bnTarget;
+        bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
+        if (fNegative || (bnTarget == 0 && !fOverflow))
+            return 0;
+        if (!IsProofOfStake())
+            return 1;
+        if (fOverflow)
             return 0;
-        return (IsProofOfStake()? (CBigNum(1)<<256) / (bnTarget+1) : 1);
+        // 2**256 / (bnTarget+1), which doesn't fit in 256 bits, is
+        // ~bnTarget / (bnTarget+1) + 1
+        return (~bnTarget / (bnTarget + 1)) + 1;
     }
 
     bool IsInMainChain() const
@@ -1471,7 +1548,7 @@ public:
 
     explicit CBlockLocator(uint256 hashBlock)
     {
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        CBlockIndexMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end())
             Set((*mi).second);
     }
@@ -1522,7 +1599,7 @@ public:
         int nStep = 1;
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            CBlockIndexMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1541,7 +1618,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            CBlockIndexMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1557,7 +1634,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            CBlockIndexMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1579,6 +1656,68 @@ public:
 
 
 
+/** Header chain ahead of our best block, for headers-first sync.
+ *
+ * It starts at a block in mapBlockIndex and holds only the hash, time and
+ * target of each header and the peer that sent it, which is all the
+ * download scheduler needs. Headers are checked as far as a header allows:
+ * linkage, hardened checkpoints, the timestamp rules of AcceptBlock and
+ * that nBits is in range. Past HF_BLOCK every block is proof-of-stake, so
+ * nBits must be the stake target that follows from the headers before it;
+ * before that, a header that meets its proof-of-work target is one. The
+ * kernel and stake modifier need the coinstake, so they are left to
+ * ProcessBlock, which blames the peer that sent the header if they fail.
+ */
+class CHeaderChain
+{
+private:
+    uint256 hashBase;           // block in mapBlockIndex the chain starts from, 0 when empty
+    int nBaseHeight;
+    std::deque<uint256> vHash;  // vHash[i] is at height nBaseHeight + 1 + i
+    std::deque<unsigned int> vTime;
+    std::deque<unsigned int> vBits;
+    std::deque<int> vNodeId;    // peer each header came from
+    std::map<uint256, int> mapHeight;
+
+    void Reset(const CBlockIndex* pindexBase);
+    void Truncate(int nHeight);
+    int64 GetMedianTimePast(int nHeight) const;
+    int64 GetBlockTime(int nHeight) const;
+    bool GetTimeAndBits(int nHeight, int64& nTimeRet, unsigned int& nBitsRet) const;
+
+public:
+    CHeaderChain() { Clear(); }
+
+    void Clear();
+
+    /** Height of the last header, -1 when empty */
+    int Height() const { return nBaseHeight + (int)vHash.size(); }
+    int BaseHeight() const { return nBaseHeight; }
+    bool IsEmpty() const { return vHash.empty(); }
+    bool Contains(const uint256& hash) const { return mapHeight.count(hash) != 0; }
+    /** Hash at nHeight, which must be above the base and at most Height() */
+    const uint256& GetHash(int nHeight) const { return vHash[nHeight - nBaseHeight - 1]; }
+    /** Peer that sent the header at nHeight */
+    int GetNodeId(int nHeight) const { return vNodeId[nHeight - nBaseHeight - 1]; }
+    /** Height of hash in the chain, -1 if it isn't there */
+    int GetHeight(const uint256& hash) const
+    {
+        std::map<uint256, int>::const_iterator mi = mapHeight.find(hash);
+        return mi == mapHeight.end() ? -1 : (*mi).second;
+    }
+
+    /** Locator for the next "getheaders", from the last header down */
+    CBlockLocator GetLocator() const;
+
+    /** Append headers received in one "headers" message. The first one may
+     * attach anywhere on this chain or to any block in mapBlockIndex. */
+    bool Connect(const std::vector<CBlock>& vHeaders, int nNodeId, int& nDoS);
+
+    /** Move the base past headers whose blocks are now in mapBlockIndex */
+    void Prune();
+};
+
+extern CHeaderChain headerChain;
 
 
 
@@ -12,11 +12,13 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <deque>
 #include <list>
 #include <map>
 #include <set>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -33,6 +35,8 @@
 
 
 static const int MAX_OUTBOUND_CONNECTIONS = 24;
+// Outbound connection attempts in progress at once
+static const unsigned int MAX_CONNECTING = 8;
 
 void ThreadMessageHandler2(void* parg);
 void ThreadSocketHandler2(void* parg);
@@ -43,6 +47,7 @@ void ThreadMapPort2(void* parg);
 #endif
 void ThreadDNSAddressSeed2(void* parg);
 bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOutbound = NULL, const char *strDest = NULL, bool fOneShot = false);
+static bool ConnectOutbound(const CAddress& addrConnect, CSemaphoreGrant *grantOutbound = NULL, const char *strDest = NULL, bool fOneShot = false);
 
 
 struct LocalServiceInfo {
@@ -83,6 +88,13 @@ CCriticalSection cs_setservAddNodeAddresses;
 
 static CSemaphore *semOutbound = NULL;
 
+// Addresses being connected to in the background by ThreadConnectAttempt,
+// the threads doing it and those of them that have finished
+static std::set<CNetAddr> setConnecting;
+static std::map<std::thread::id, std::thread> mapConnectThreads;
+static std::vector<std::thread::id> vConnectThreadsDone;
+static CCriticalSection cs_setConnecting;
+
 // Total bytes received/sent over the network (for traffic graph)
 static std::atomic<uint64> nTotalBytesRecv(0);
 static std::atomic<uint64> nTotalBytesSent(0);
@@ -90,6 +102,25 @@ static std::atomic<uint64> nTotalBytesSent(0);
 uint64 GetTotalBytesRecv() { return nTotalBytesRecv.load(); }
 uint64 GetTotalBytesSent() { return nTotalBytesSent.load(); }
 
+CTokenBucket bucketUpload;
+CUploadTarget uploadTarget;
+CCriticalSection cs_bandwidth;
+int64 nMaxPeerUploadRate = 0;
+
+bool IsUploadTargetReached()
+{
+    LOCK(cs_bandwidth);
+    return uploadTarget.IsReached(GetTime());
+}
+
+int64 PoissonNextSend(int64 nNow, int nAverageInterval)
+{
+    // Exponentially distributed gaps, so the send times of a series look
+    // like those of independent events and don't give away when an
+    // announcement reached us
+    return nNow + (int64)(log1p(GetRand(1ULL << 48) * -0.0000000000000035527136788 /* -1/2^48 */) * nAverageInterval * -1000000.0 + 0.5);
+}
+
 void AddOneShot(std::string strDest)
 {
     LOCK(cs_vOneShots);
@@ -559,6 +590,64 @@ void CNode::Cleanup()
 {
 }
 
+int CNode::SocketSendData(int64 nMaxHigh, int64 nMaxBulk, bool& fBulkRet)
+{
+    // A bulk message that has started going out has to be finished first
+    CNetDataStream* pSend;
+    int64 nMax;
+    if (nSendBulkLeft == 0 && !vSend.empty())
+    {
+        pSend = &vSend;
+        nMax = std::min((int64)vSend.size(), nMaxHigh);
+        fBulkRet = false;
+    }
+    else if (!vSendBulk.empty())
+    {
+        if (nSendBulkLeft == 0)
+        {
+            unsigned int nSize;
+            memcpy(&nSize, &vSendBulk[CMessageHeader::MESSAGE_SIZE_OFFSET], sizeof(nSize));
+            nSendBulkLeft = CMessageHeader::HEADER_SIZE + nSize;
+        }
+        pSend = &vSendBulk;
+        nMax = std::min((int64)nSendBulkLeft, nMaxBulk);
+        fBulkRet = true;
+    }
+    else
+        return 0;
+
+    nMax = std::min(nMax, bucketSend.Available(GetTimeMicros()));
+    if (nMax <= 0)
+        return 0;
+
+    CNetDataStream& vSendData = *pSend;
+    int nBytes = send(hSocket, &vSendData[0], nMax, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        vSendData.erase(vSendData.begin(), vSendData.begin() + nBytes);
+        if (vSendData.empty() && vSendData.capacity() > MAX_IDLE_BUFFER_SIZE)
+            vSendData.release();
+        if (fBulkRet)
+            nSendBulkLeft -= nBytes;
+        bucketSend.Consume(nBytes);
+        nLastSend = GetTime();
+        nSendBytes += nBytes;
+        nTotalBytesSent += nBytes;
+        return nBytes;
+    }
+    if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            printf("socket send error %d\n", nErr);
+            CloseSocketDisconnect();
+        }
+    }
+    return 0;
+}
+
 
 void CNode::PushVersion()
 {
@@ -578,6 +667,8 @@ void CNode::PushVersion()
 
 std::map<CNetAddr, int64> CNode::setBanned;
 CCriticalSection CNode::cs_setBanned;
+int CNode::nLastNodeId = 0;
+CCriticalSection CNode::cs_nLastNodeId;
 
 void CNode::ClearBanned()
 {
@@ -640,6 +731,26 @@ void CNode::copyStats(CNodeStats &stats)
     X(nReleaseTime);
     X(nStartingHeight);
     X(nMisbehavior);
+
+    // The handler threads may hold the buffer locks for a while, and
+    // cs_vRecv is taken before cs_vNodes, so never wait here
+    {
+        TRY_LOCK(cs_vSend, lockSend);
+        TRY_LOCK(cs_vRecv, lockRecv);
+        if (lockSend && lockRecv)
+        {
+            nSendQueued = GetSendQueued();
+            nSendBulkQueued = vSendBulk.size();
+            nRecvQueued = vRecv.size();
+            nBufferMemory = vSend.capacity() + vSendBulk.capacity() + vRecv.capacity();
+        }
+    }
+    X(nSendQueued);
+    X(nRecvQueued);
+    X(nBufferMemory);
+    X(nSendBulkQueued);
+    X(nSendBytes);
+    X(nRecvBytes);
 }
 #undef X
 
@@ -677,6 +788,7 @@ void ThreadSocketHandler2(void* parg)
 {
     printf("ThreadSocketHandler started\n");
     std::list<CNode*> vNodesDisconnected;
+    std::vector<int> vNodesFinalize;
     unsigned int nPrevNodeCount = 0;
 
     while (true)
@@ -691,7 +803,7 @@ void ThreadSocketHandler2(void* parg)
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
             {
                 if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecv.empty() && pnode->vSend.empty()))
+                    (pnode->GetRefCount() <= 0 && pnode->vRecv.empty() && pnode->GetSendQueued() == 0))
                 {
                     // remove from vNodes
                     vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
@@ -708,6 +820,7 @@ void ThreadSocketHandler2(void* parg)
                     if (pnode->fNetworkNode || pnode->fInbound)
                         pnode->Release();
                     vNodesDisconnected.push_back(pnode);
+                    vNodesFinalize.push_back(pnode->nNodeId);
                 }
             }
 
@@ -744,6 +857,20 @@ void ThreadSocketHandler2(void* parg)
                 }
             }
         }
+
+        // Requests and other state kept for nodes that are gone, outside
+        // cs_vNodes as cs_main is taken before it everywhere else
+        if (!vNodesFinalize.empty())
+        {
+            TRY_LOCK(cs_main, lockMain);
+            if (lockMain)
+            {
+                BOOST_FOREACH(int nNodeId, vNodesFinalize)
+                    FinalizeNode(nNodeId);
+                vNodesFinalize.clear();
+            }
+        }
+
         if (vNodes.size() != nPrevNodeCount)
         {
             nPrevNodeCount = vNodes.size();
@@ -772,6 +899,17 @@ void ThreadSocketHandler2(void* parg)
             hSocketMax = std::max(hSocketMax, hListenSocket);
             have_fds = true;
         }
+
+        // Upload bandwidth for this round. Bulk data only gets what the
+        // high priority traffic that can go out now leaves over.
+        int64 nUploadAllowance;
+        int64 nNow = GetTimeMicros();
+        {
+            LOCK(cs_bandwidth);
+            nUploadAllowance = bucketUpload.Available(nNow);
+        }
+        int64 nHighQueued = 0;
+        std::vector<SOCKET> vhBulkSocket;
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH(CNode* pnode, vNodes)
@@ -783,12 +921,33 @@ void ThreadSocketHandler2(void* parg)
                 hSocketMax = std::max(hSocketMax, pnode->hSocket);
                 have_fds = true;
                 {
+                    // Throttled sockets are left out, or select would return at once
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSend.empty())
+                    if (!lockSend || pnode->GetSendQueued() == 0 || nUploadAllowance <= 0 ||
+                        pnode->bucketSend.Available(nNow) <= 0)
+                        continue;
+                    // A peer that stopped reading isn't counted on to take its share
+                    int64 nHigh = pnode->GetSendableHigh(nNow);
+                    if (nHigh > 0)
+                    {
                         FD_SET(pnode->hSocket, &fdsetSend);
+                        if (!pnode->fSendStalled)
+                            nHighQueued += nHigh;
+                    }
+                    else
+                        vhBulkSocket.push_back(pnode->hSocket);
                 }
             }
         }
+        // Sockets with only bulk data to send wait while there's no allowance for it
+        if (nUploadAllowance > nHighQueued)
+        {
+            BOOST_FOREACH(SOCKET hSocket, vhBulkSocket)
+            {
+                FD_SET(hSocket, &fdsetSend);
+            }
+        }
+        fd_set fdsetSendWanted = fdsetSend;
 
         vnThreadsRunning[THREAD_SOCKETHANDLER]--;
         int nSelect = select(have_fds ? hSocketMax + 1 : 0,
@@ -806,6 +965,7 @@ void ThreadSocketHandler2(void* parg)
                     FD_SET(i, &fdsetRecv);
             }
             FD_ZERO(&fdsetSend);
+            FD_ZERO(&fdsetSendWanted);
             FD_ZERO(&fdsetError);
             Sleep(timeout.tv_usec/1000);
         }
@@ -880,6 +1040,24 @@ void ThreadSocketHandler2(void* parg)
             BOOST_FOREACH(CNode* pnode, vNodesCopy)
                 pnode->AddRef();
         }
+
+        // Peers that can't take data right now don't hold back the bulk traffic
+        nNow = GetTimeMicros();
+        nHighQueued = 0;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            if (FD_ISSET(pnode->hSocket, &fdsetSendWanted))
+                pnode->fSendStalled = !FD_ISSET(pnode->hSocket, &fdsetSend);
+            if (!FD_ISSET(pnode->hSocket, &fdsetSend))
+                continue;
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend)
+                nHighQueued += pnode->GetSendableHigh(nNow);
+        }
+        int64 nBulkAllowance = std::max(nUploadAllowance - nHighQueued, (int64)0);
+
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             if (fShutdown)
@@ -895,7 +1073,7 @@ void ThreadSocketHandler2(void* parg)
                 TRY_LOCK(pnode->cs_vRecv, lockRecv);
                 if (lockRecv)
                 {
-                    CDataStream& vRecv = pnode->vRecv;
+                    CNetDataStream& vRecv = pnode->vRecv;
                     unsigned int nPos = vRecv.size();
 
                     if (nPos > ReceiveBufferSize()) {
@@ -912,6 +1090,7 @@ void ThreadSocketHandler2(void* parg)
                             vRecv.resize(nPos + nBytes);
                             memcpy(&vRecv[nPos], pchBuf, nBytes);
                             pnode->nLastRecv = GetTime();
+                            pnode->nRecvBytes += nBytes;
                             nTotalBytesRecv += nBytes;
                         }
                         else if (nBytes == 0)
@@ -946,26 +1125,15 @@ void ThreadSocketHandler2(void* parg)
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
                 {
-                    CDataStream& vSend = pnode->vSend;
-                    if (!vSend.empty())
+                    bool fBulk = false;
+                    int nBytes = pnode->SocketSendData(nUploadAllowance, nBulkAllowance, fBulk);
+                    if (nBytes > 0)
                     {
-                        int nBytes = send(pnode->hSocket, &vSend[0], vSend.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            vSend.erase(vSend.begin(), vSend.begin() + nBytes);
-                            pnode->nLastSend = GetTime();
-                            nTotalBytesSent += nBytes;
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                printf("socket send error %d\n", nErr);
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
+                        nUploadAllowance -= nBytes;
+                        nBulkAllowance = std::min(fBulk ? nBulkAllowance - nBytes : nBulkAllowance, nUploadAllowance);
+                        LOCK(cs_bandwidth);
+                        bucketUpload.Consume(nBytes);
+                        uploadTarget.Add(nBytes, GetTime());
                     }
                 }
             }
@@ -973,7 +1141,7 @@ void ThreadSocketHandler2(void* parg)
             //
             // Inactivity checking
             //
-            if (pnode->vSend.empty())
+            if (pnode->GetSendQueued() == 0)
                 pnode->nLastSendEmpty = GetTime();
             if (GetTime() - pnode->nTimeConnected > 60)
             {
@@ -1199,38 +1367,54 @@ void ThreadDNSAddressSeed(void* parg)
     printf("ThreadDNSAddressSeed exited\n");
 }
 
+static void LookupDNSSeed(unsigned int seed_idx, std::atomic<int>* pnFound)
+{
+    try
+    {
+        std::vector<CNetAddr> vaddr;
+        std::vector<CAddress> vAdd;
+        if (LookupHost(strDNSSeed[seed_idx][1], vaddr))
+        {
+            BOOST_FOREACH(CNetAddr& ip, vaddr)
+            {
+                int nOneDay = 24*3600;
+                CAddress addr = CAddress(CService(ip, GetDefaultPort()));
+                addr.nTime = GetTime() - nOneDay/2 - GetRand(nOneDay); // use a random age between 12 and 36 hours old
+                vAdd.push_back(addr);
+            }
+        }
+        addrman.Add(vAdd, CNetAddr(strDNSSeed[seed_idx][0], true));
+        *pnFound += vAdd.size();
+    }
+    catch (std::exception& e) {
+        PrintExceptionContinue(&e, "LookupDNSSeed()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "LookupDNSSeed()");
+    }
+}
+
 void ThreadDNSAddressSeed2(void* parg)
 {
     printf("ThreadDNSAddressSeed started\n");
-    int found = 0;
+    std::atomic<int> found(0);
 
     if (!fTestNet)
     {
         printf("Loading addresses from DNS seeds (could take a while)\n");
 
+        // Resolve all the seeds at once, so one slow name server doesn't hold up the rest
+        std::vector<std::thread> vThreads;
         for (unsigned int seed_idx = 0; seed_idx < ARRAYLEN(strDNSSeed); seed_idx++) {
-            if (HaveNameProxy()) {
+            if (HaveNameProxy())
                 AddOneShot(strDNSSeed[seed_idx][1]);
-            } else {
-                std::vector<CNetAddr> vaddr;
-                std::vector<CAddress> vAdd;
-                if (LookupHost(strDNSSeed[seed_idx][1], vaddr))
-                {
-                    BOOST_FOREACH(CNetAddr& ip, vaddr)
-                    {
-                        int nOneDay = 24*3600;
-                        CAddress addr = CAddress(CService(ip, GetDefaultPort()));
-                        addr.nTime = GetTime() - nOneDay/2 - GetRand(nOneDay); // use a random age between 12 and 36 hours old
-                        vAdd.push_back(addr);
-                        found++;
-                    }
-                }
-                addrman.Add(vAdd, CNetAddr(strDNSSeed[seed_idx][0], true));
-            }
+            else
+                vThreads.push_back(std::thread(LookupDNSSeed, seed_idx, &found));
         }
+        BOOST_FOREACH(std::thread& thread, vThreads)
+            thread.join();
     }
 
-    printf("%d addresses found from DNS seeds\n", found);
+    printf("%d addresses found from DNS seeds\n", found.load());
 }
 
 
@@ -1249,29 +1433,59 @@ unsigned int pnSeed[] =
     0x8AC5D324   // 138.197.211.36 - always-running seed node
 };
 
+static CCriticalSection cs_addrdb;
+static int64 nLastAddrCompact = 0;
+
+// Rewrite peers.dat in full and start an empty journal on top of it
 void DumpAddresses()
 {
+    LOCK(cs_addrdb);
     int64 nStart = GetTimeMillis();
 
     int nPruned = addrman.PruneTerrible();
     if (nPruned > 0)
         printf("Pruned %d bad addresses from addrman\n", nPruned);
 
+    // Serialize a copy so addrman isn't locked while writing
+    CAddrMan addrSnapshot;
+    addrman.TakeSnapshot(addrSnapshot);
+
     CAddrDB adb;
-    adb.Write(addrman);
+    uint256 hash;
+    if (adb.Write(addrSnapshot, &hash))
+        adb.StartJournal(hash);
+    else
+        adb.EraseJournal();
+    nLastAddrCompact = GetTime();
 
     printf("Flushed %d addresses to peers.dat  %" PRI64d "ms\n",
-           addrman.size(), GetTimeMillis() - nStart);
+           addrSnapshot.size(), GetTimeMillis() - nStart);
+}
+
+// Append what changed since the last flush to peers.log, compacting when it gets large or old
+void FlushAddresses()
+{
+    LOCK(cs_addrdb);
+    CAddrDB adb;
+    if (GetTime() - nLastAddrCompact < ADDRDB_COMPACT_INTERVAL && !adb.JournalNeedsCompaction())
+    {
+        std::vector<CAddrChange> vChanges;
+        addrman.GetChanges(vChanges);
+        if (vChanges.empty() || adb.AppendJournal(vChanges))
+            return;
+    }
+    DumpAddresses();
 }
 
 void ThreadDumpAddress2(void* parg)
 {
     vnThreadsRunning[THREAD_DUMPADDRESS]++;
+    nLastAddrCompact = GetTime();
     while (!fShutdown)
     {
-        DumpAddresses();
+        FlushAddresses();
         vnThreadsRunning[THREAD_DUMPADDRESS]--;
-        Sleep(60000); // Dump peers.dat every 60 seconds
+        Sleep(60000); // Journal address changes every 60 seconds
         vnThreadsRunning[THREAD_DUMPADDRESS]++;
     }
     vnThreadsRunning[THREAD_DUMPADDRESS]--;
@@ -1331,6 +1545,79 @@ void static ProcessOneShot()
     }
 }
 
+// Connects to addrConnect off the ThreadOpenConnections thread, so several
+// attempts (including proxy handshakes) can be waiting on the network at once
+static void ThreadConnectAttempt(CAddress addrConnect, CSemaphoreGrant* pgrant)
+{
+    RenameThread("curecoin-connect");
+
+    try
+    {
+        ConnectOutbound(addrConnect, pgrant);
+    }
+    catch (std::exception& e) {
+        PrintExceptionContinue(&e, "ThreadConnectAttempt()");
+    } catch (...) {
+        PrintExceptionContinue(NULL, "ThreadConnectAttempt()");
+    }
+    delete pgrant;
+
+    LOCK(cs_setConnecting);
+    setConnecting.erase(addrConnect);
+    vConnectThreadsDone.push_back(std::this_thread::get_id());
+}
+
+// Join the connection attempt threads that have finished, or all of them
+static void JoinConnectThreads(bool fAll)
+{
+    std::vector<std::thread> vJoin;
+    {
+        LOCK(cs_setConnecting);
+        if (fAll)
+        {
+            for (std::map<std::thread::id, std::thread>::iterator it = mapConnectThreads.begin(); it != mapConnectThreads.end(); ++it)
+                vJoin.push_back(std::move(it->second));
+            mapConnectThreads.clear();
+        }
+        else
+        {
+            BOOST_FOREACH(const std::thread::id& id, vConnectThreadsDone)
+            {
+                std::map<std::thread::id, std::thread>::iterator it = mapConnectThreads.find(id);
+                if (it == mapConnectThreads.end())
+                    continue;
+                vJoin.push_back(std::move(it->second));
+                mapConnectThreads.erase(it);
+            }
+        }
+        vConnectThreadsDone.clear();
+    }
+    for (unsigned int i = 0; i < vJoin.size(); i++)
+        vJoin[i].join();
+}
+
+bool StartConnectAttempt(const CAddress& addrConnect, CSemaphoreGrant& grantOutbound)
+{
+    JoinConnectThreads(false);
+
+    // Once shutting down StopNode may already have joined the attempts
+    LOCK(cs_setConnecting);
+    if (fShutdown || setConnecting.count(addrConnect))
+        return false;
+    CSemaphoreGrant* pgrant = new CSemaphoreGrant();
+    grantOutbound.MoveTo(*pgrant);
+    setConnecting.insert(addrConnect);
+    std::thread thread(ThreadConnectAttempt, addrConnect, pgrant);
+    std::thread::id id = thread.get_id();
+    mapConnectThreads[id] = std::move(thread);
+    return true;
+}
+
+void JoinConnectAttempts()
+{
+    JoinConnectThreads(true);
+}
+
 // ppcoin: stake minter thread
 void static ThreadStakeMinter(void* parg)
 {
@@ -1397,6 +1684,12 @@ void ThreadOpenConnections2(void* parg)
         if (fShutdown)
             return;
 
+        {
+            LOCK(cs_setConnecting);
+            if (setConnecting.size() >= MAX_CONNECTING)
+                continue;
+        }
+
 
         vnThreadsRunning[THREAD_OPENCONNECTIONS]--;
         CSemaphoreGrant grant(*semOutbound);
@@ -1442,6 +1735,11 @@ void ThreadOpenConnections2(void* parg)
                 }
             }
         }
+        {
+            LOCK(cs_setConnecting);
+            BOOST_FOREACH(const CNetAddr& addr, setConnecting)
+                setConnected.insert(addr.GetGroup());
+        }
 
         int64 nANow = GetAdjustedTime();
 
@@ -1477,8 +1775,11 @@ void ThreadOpenConnections2(void* parg)
             break;
         }
 
-        if (addrConnect.IsValid())
-            OpenNetworkConnection(addrConnect, &grant);
+        if (addrConnect.IsValid() && !IsLocal(addrConnect) && !FindNode((CNetAddr)addrConnect) && !CNode::IsBanned(addrConnect))
+        {
+            // The attempt holds the outbound slot until it connects or fails
+            StartConnectAttempt(addrConnect, grant);
+        }
     }
 }
 
@@ -1575,7 +1876,7 @@ void ThreadOpenAddedConnections2(void* parg)
 }
 
 // if successful, this moves the passed grant to the constructed node
-bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOutbound, const char *strDest, bool fOneShot)
+static bool ConnectOutbound(const CAddress& addrConnect, CSemaphoreGrant *grantOutbound, const char *strDest, bool fOneShot)
 {
     //
     // Initiate outbound network connection
@@ -1590,9 +1891,7 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
     if (strDest && FindNode(strDest))
         return false;
 
-    vnThreadsRunning[THREAD_OPENCONNECTIONS]--;
     CNode* pnode = ConnectNode(addrConnect, strDest);
-    vnThreadsRunning[THREAD_OPENCONNECTIONS]++;
     if (fShutdown)
         return false;
     if (!pnode)
@@ -1606,6 +1905,14 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
     return true;
 }
 
+bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOutbound, const char *strDest, bool fOneShot)
+{
+    vnThreadsRunning[THREAD_OPENCONNECTIONS]--;
+    bool fConnected = ConnectOutbound(addrConnect, grantOutbound, strDest, fOneShot);
+    vnThreadsRunning[THREAD_OPENCONNECTIONS]++;
+    return fConnected;
+}
+
 
 
 
@@ -1649,9 +1956,6 @@ void ThreadMessageHandler2(void* parg)
         }
 
         // Poll the connected nodes for messages
-        CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
-            pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             // Receive messages
@@ -1667,7 +1971,7 @@ void ThreadMessageHandler2(void* parg)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
-                    SendMessages(pnode, pnode == pnodeTrickle);
+                    SendMessages(pnode);
             }
             if (fShutdown)
                 return;
@@ -1979,8 +2283,10 @@ bool StopNode()
     if (vnThreadsRunning[THREAD_MINTER] > 0) printf("ThreadStakeMinter still running\n");
     while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0)
         Sleep(20);
+    // Connection attempts still in progress end within their connect timeout
+    JoinConnectAttempts();
     Sleep(50);
-    DumpAddresses();
+    FlushAddresses();
     return true;
 }
 
@@ -14,7 +14,8 @@
 #include <arpa/inet.h>
 #endif
 
-#include "mruset.h"
+#include "bandwidth.h"
+#include "bloom.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "addrman.h"
@@ -29,11 +30,31 @@ extern int nBestHeight;
 inline unsigned int ReceiveBufferSize() { return 1000*GetArg("-maxreceivebuffer", 5*1000); }
 inline unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
 
+/** A drained send or receive buffer bigger than this is given back to the pool */
+static const unsigned int MAX_IDLE_BUFFER_SIZE = 64 * 1024;
+/** Recent inventory remembered per peer, so it isn't announced to them twice */
+static const unsigned int INVENTORY_KNOWN_SIZE = 5000;
+/** Blocks more than this far below the best block are served at bulk priority */
+static const int BULK_BLOCK_DEPTH = 10;
+
+/** Send queues of a peer. Bulk messages go out only when no other data
+ * waits, and only with upload bandwidth that other traffic doesn't need. */
+enum
+{
+    SEND_PRIORITY_HIGH,
+    SEND_PRIORITY_BULK,
+};
+
 void AddOneShot(std::string strDest);
 bool RecvLine(SOCKET hSocket, std::string& strLine);
 uint64 GetTotalBytesRecv();
 uint64 GetTotalBytesSent();
+/** Whether -maxuploadtarget has been reached for this cycle */
+bool IsUploadTargetReached();
 bool GetMyExternalIP(CNetAddr& ipRet);
+/** Time in microseconds of the next of a series of sends at random,
+ * nAverageInterval seconds apart on average */
+int64 PoissonNextSend(int64 nNow, int nAverageInterval);
 void AddressCurrentlyConnected(const CService& addr);
 CNode* FindNode(const CNetAddr& ip);
 CNode* FindNode(const CService& ip);
@@ -43,6 +64,12 @@ unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError=REF(std::string()));
 void StartNode(void* parg);
 bool StopNode();
+/** Connect to addrConnect on a thread of its own, which takes over
+ * grantOutbound until it connects or fails. False if shutting down or
+ * already connecting to that address. */
+bool StartConnectAttempt(const CAddress& addrConnect, CSemaphoreGrant& grantOutbound);
+/** Wait for every connection attempt to end. Called by StopNode. */
+void JoinConnectAttempts();
 
 enum
 {
@@ -79,10 +106,10 @@ enum
 class CRequestTracker
 {
 public:
-    void (*fn)(void*, CDataStream&);
+    void (*fn)(void*, CNetDataStream&);
     void* param1;
 
-    explicit CRequestTracker(void (*fnIn)(void*, CDataStream&)=NULL, void* param1In=NULL)
+    explicit CRequestTracker(void (*fnIn)(void*, CNetDataStream&)=NULL, void* param1In=NULL)
     {
         fn = fnIn;
         param1 = param1In;
@@ -129,6 +156,12 @@ extern std::deque<std::pair<int64, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern std::map<CInv, int64> mapAlreadyAskedFor;
 
+// Upload limits (-maxuploadrate, -maxpeeruploadrate, -maxuploadtarget)
+extern CTokenBucket bucketUpload;
+extern CUploadTarget uploadTarget;
+extern CCriticalSection cs_bandwidth;
+extern int64 nMaxPeerUploadRate;
+
 
 
 
@@ -146,6 +179,12 @@ public:
     int64 nReleaseTime;
     int nStartingHeight;
     int nMisbehavior;
+    uint64 nSendQueued;
+    uint64 nRecvQueued;
+    uint64 nBufferMemory;
+    uint64 nSendBulkQueued;
+    uint64 nSendBytes;
+    uint64 nRecvBytes;
 };
 
 
@@ -159,16 +198,23 @@ public:
     // socket
     uint64 nServices;
     SOCKET hSocket;
-    CDataStream vSend;
-    CDataStream vRecv;
+    CNetDataStream vSend;
+    CNetDataStream vSendBulk;
+    CNetDataStream vRecv;
     CCriticalSection cs_vSend;
     CCriticalSection cs_vRecv;
+    unsigned int nSendBulkLeft; // bytes of the bulk message being sent
+    CTokenBucket bucketSend;    // -maxpeeruploadrate, guarded by cs_vSend
+    bool fSendStalled;          // socket wasn't writable last round, socket handler only
+    uint64 nSendBytes;
+    uint64 nRecvBytes;
     int64 nLastSend;
     int64 nLastRecv;
     int64 nLastSendEmpty;
     int64 nTimeConnected;
     int nHeaderStart;
     unsigned int nMessageStart;
+    int nMessagePriority;
     CAddress addr;
     std::string addrName;
     CService addrLocal;
@@ -180,7 +226,13 @@ public:
     bool fNetworkNode;
     bool fSuccessfullyConnected;
     bool fDisconnect;
+    int nNodeId;
     CSemaphoreGrant grantOutbound;
+    // Last seen buffer sizes, for copyStats
+    uint64 nSendQueued;
+    uint64 nRecvQueued;
+    uint64 nBufferMemory;
+    uint64 nSendBulkQueued;
 protected:
     int nRefCount;
 
@@ -190,6 +242,11 @@ protected:
     static CCriticalSection cs_setBanned;
     int nMisbehavior;
 
+    // Node ids are never reused, so state kept elsewhere by id does not
+    // get mixed up with a later connection
+    static int nLastNodeId;
+    static CCriticalSection cs_nLastNodeId;
+
 public:
     int64 nReleaseTime;
     std::map<uint256, CRequestTracker> mapRequests;
@@ -206,22 +263,31 @@ public:
     std::set<uint256> setKnown;
     uint256 hashCheckpointKnown; // ppcoin: known sent sync-checkpoint
 
+    int64 nNextAddrSend;
+
     // inventory based relay
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
     std::multimap<int64, CInv> mapAskFor;
+    int64 nNextInvSend;
 
-    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK, MIN_PROTO_VERSION), vRecv(SER_NETWORK, MIN_PROTO_VERSION)
+    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : vSend(SER_NETWORK, MIN_PROTO_VERSION), vSendBulk(SER_NETWORK, MIN_PROTO_VERSION), vRecv(SER_NETWORK, MIN_PROTO_VERSION), filterInventoryKnown(INVENTORY_KNOWN_SIZE, 0.000001)
     {
         nServices = 0;
         hSocket = hSocketIn;
+        nSendBulkLeft = 0;
+        fSendStalled = false;
+        bucketSend.SetRate(nMaxPeerUploadRate, nMaxPeerUploadRate);
+        nSendBytes = 0;
+        nRecvBytes = 0;
         nLastSend = 0;
         nLastRecv = 0;
         nLastSendEmpty = GetTime();
         nTimeConnected = GetTime();
         nHeaderStart = -1;
         nMessageStart = -1;
+        nMessagePriority = SEND_PRIORITY_HIGH;
         addr = addrIn;
         addrName = addrNameIn == "" ? addr.ToStringIPPort() : addrNameIn;
         nVersion = 0;
@@ -232,6 +298,14 @@ public:
         fNetworkNode = false;
         fSuccessfullyConnected = false;
         fDisconnect = false;
+        {
+            LOCK(cs_nLastNodeId);
+            nNodeId = nLastNodeId++;
+        }
+        nSendQueued = 0;
+        nRecvQueued = 0;
+        nBufferMemory = 0;
+        nSendBulkQueued = 0;
         nRefCount = 0;
         nReleaseTime = 0;
         hashContinue = 0;
@@ -241,7 +315,8 @@ public:
         fGetAddr = false;
         nMisbehavior = 0;
         hashCheckpointKnown = 0;
-        setInventoryKnown.max_size(SendBufferSize() / 1000);
+        nNextAddrSend = 0;
+        nNextInvSend = 0;
 
         // Be shy and don't send version until we hear
         if (!fInbound)
@@ -303,7 +378,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.hash);
         }
     }
 
@@ -311,7 +386,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
+            if (!filterInventoryKnown.contains(inv.hash))
                 vInventoryToSend.push_back(inv);
         }
     }
@@ -341,11 +416,31 @@ public:
 
 
 
-    void BeginMessage(const char* pszCommand)
+    /** Bytes waiting to be sent, in both queues */
+    size_t GetSendQueued() const
+    {
+        return vSend.size() + vSendBulk.size();
+    }
+
+    /** Bytes of high priority traffic SocketSendData could send now, which
+     * is none while a bulk message is half sent. Requires cs_vSend. */
+    int64 GetSendableHigh(int64 nTimeMicros)
+    {
+        if (nSendBulkLeft != 0 || vSend.empty())
+            return 0;
+        return std::min((int64)vSend.size(), std::max(bucketSend.Available(nTimeMicros), (int64)0));
+    }
+
+    /** Send queued data with at most nMaxHigh bytes of high priority
+     * traffic or nMaxBulk bytes of bulk. Returns the bytes sent. */
+    int SocketSendData(int64 nMaxHigh, int64 nMaxBulk, bool& fBulkRet);
+
+    void BeginMessage(const char* pszCommand, int nPriority = SEND_PRIORITY_HIGH)
     {
         ENTER_CRITICAL_SECTION(cs_vSend);
         if (nHeaderStart != -1)
             AbortMessage();
+        nMessagePriority = nPriority;
         nHeaderStart = vSend.size();
         vSend << CMessageHeader(pszCommand, 0);
         nMessageStart = vSend.size();
@@ -393,6 +488,13 @@ public:
             printf("(%d bytes)\n", nSize);
         }
 
+        // Messages are built in vSend; bulk ones then wait in their own queue
+        if (nMessagePriority == SEND_PRIORITY_BULK)
+        {
+            vSendBulk.insert(vSendBulk.end(), vSend.begin() + nHeaderStart, vSend.end());
+            vSend.resize(nHeaderStart);
+        }
+
         nHeaderStart = -1;
         nMessageStart = -1;
         LEAVE_CRITICAL_SECTION(cs_vSend);
@@ -444,6 +546,39 @@ public:
         }
     }
 
+    /** Push a message whose payload is already serialized */
+    void PushRawMessage(const char* pszCommand, const char* pbegin, unsigned int nSize, int nPriority = SEND_PRIORITY_HIGH)
+    {
+        try
+        {
+            BeginMessage(pszCommand, nPriority);
+            vSend.write(pbegin, nSize);
+            EndMessage();
+        }
+        catch (...)
+        {
+            AbortMessage();
+            throw;
+        }
+    }
+
+    /** Queue a message behind all other traffic to this peer */
+    template<typename T1>
+    void PushBulkMessage(const char* pszCommand, const T1& a1)
+    {
+        try
+        {
+            BeginMessage(pszCommand, SEND_PRIORITY_BULK);
+            vSend << a1;
+            EndMessage();
+        }
+        catch (...)
+        {
+            AbortMessage();
+            throw;
+        }
+    }
+
     template<typename T1, typename T2>
     void PushMessage(const char* pszCommand, const T1& a1, const T2& a2)
     {
@@ -574,7 +709,7 @@ public:
 
 
     void PushRequest(const char* pszCommand,
-                     void (*fn)(void*, CDataStream&), void* param1)
+                     void (*fn)(void*, CNetDataStream&), void* param1)
     {
         uint256 hashReply;
         RAND_bytes((unsigned char*)&hashReply, sizeof(hashReply));
@@ -589,7 +724,7 @@ public:
 
     template<typename T1>
     void PushRequest(const char* pszCommand, const T1& a1,
-                     void (*fn)(void*, CDataStream&), void* param1)
+                     void (*fn)(void*, CNetDataStream&), void* param1)
     {
         uint256 hashReply;
         RAND_bytes((unsigned char*)&hashReply, sizeof(hashReply));
@@ -604,7 +739,7 @@ public:
 
     template<typename T1, typename T2>
     void PushRequest(const char* pszCommand, const T1& a1, const T2& a2,
-                     void (*fn)(void*, CDataStream&), void* param1)
+                     void (*fn)(void*, CNetDataStream&), void* param1)
     {
         uint256 hashReply;
         RAND_bytes((unsigned char*)&hashReply, sizeof(hashReply));
@@ -175,7 +175,38 @@ bool LookupNumeric(const char *pszName, CService& addr, int portDefault)
     return Lookup(pszName, addr, portDefault, false);
 }
 
-bool static Socks4(const CService &addrDest, SOCKET& hSocket)
+// Receive exactly len bytes, failing if the peer is silent for nTimeout milliseconds in total,
+// so a dead proxy can't hold up a connection attempt forever
+bool static RecvWithTimeout(char* data, size_t len, int nTimeout, SOCKET hSocket)
+{
+    int64 nEnd = GetTimeMillis() + nTimeout;
+    while (len > 0)
+    {
+        int64 nLeft = nEnd - GetTimeMillis();
+        if (nLeft <= 0)
+            return false;
+        struct timeval timeout;
+        timeout.tv_sec  = nLeft / 1000;
+        timeout.tv_usec = (nLeft % 1000) * 1000;
+
+        fd_set fdset;
+        FD_ZERO(&fdset);
+        FD_SET(hSocket, &fdset);
+        int nRet = select(hSocket + 1, &fdset, NULL, NULL, &timeout);
+        if (nRet == SOCKET_ERROR && WSAGetLastError() == WSAEINTR)
+            continue;
+        if (nRet <= 0)
+            return false;
+        int nRecv = recv(hSocket, data, len, 0);
+        if (nRecv <= 0)
+            return false;
+        data += nRecv;
+        len -= nRecv;
+    }
+    return true;
+}
+
+bool static Socks4(const CService &addrDest, SOCKET& hSocket, int nTimeout)
 {
     printf("SOCKS4 connecting %s\n", addrDest.ToString().c_str());
     if (!addrDest.IsIPv4())
@@ -203,7 +234,7 @@ bool static Socks4(const CService &addrDest, SOCKET& hSocket)
         return error("Error sending to proxy");
     }
     char pchRet[8];
-    if (recv(hSocket, pchRet, 8, 0) != 8)
+    if (!RecvWithTimeout(pchRet, 8, nTimeout, hSocket))
     {
         closesocket(hSocket);
         return error("Error reading proxy response");
@@ -219,7 +250,7 @@ bool static Socks4(const CService &addrDest, SOCKET& hSocket)
     return true;
 }
 
-bool static Socks5(std::string strDest, int port, SOCKET& hSocket)
+bool static Socks5(std::string strDest, int port, SOCKET& hSocket, int nTimeout)
 {
     printf("SOCKS5 connecting %s\n", strDest.c_str());
     if (strDest.size() > 255)
@@ -238,7 +269,7 @@ bool static Socks5(std::string strDest, int port, SOCKET& hSocket)
         return error("Error sending to proxy");
     }
     char pchRet1[2];
-    if (recv(hSocket, pchRet1, 2, 0) != 2)
+    if (!RecvWithTimeout(pchRet1, 2, nTimeout, hSocket))
     {
         closesocket(hSocket);
         return error("Error reading proxy response");
@@ -261,7 +292,7 @@ bool static Socks5(std::string strDest, int port, SOCKET& hSocket)
         return error("Error sending to proxy");
     }
     char pchRet2[4];
-    if (recv(hSocket, pchRet2, 4, 0) != 4)
+    if (!RecvWithTimeout(pchRet2, 4, nTimeout, hSocket))
     {
         closesocket(hSocket);
         return error("Error reading proxy response");
@@ -295,15 +326,15 @@ bool static Socks5(std::string strDest, int port, SOCKET& hSocket)
     char pchRet3[256];
     switch (pchRet2[3])
     {
-        case 0x01: ret = recv(hSocket, pchRet3, 4, 0) != 4; break;
-        case 0x04: ret = recv(hSocket, pchRet3, 16, 0) != 16; break;
+        case 0x01: ret = !RecvWithTimeout(pchRet3, 4, nTimeout, hSocket); break;
+        case 0x04: ret = !RecvWithTimeout(pchRet3, 16, nTimeout, hSocket); break;
         case 0x03:
         {
-            ret = recv(hSocket, pchRet3, 1, 0) != 1;
+            ret = !RecvWithTimeout(pchRet3, 1, nTimeout, hSocket);
             if (ret)
-                return error("Error reading from proxy");
-            int nRecv = pchRet3[0];
-            ret = recv(hSocket, pchRet3, nRecv, 0) != nRecv;
+                break;
+            int nRecv = (unsigned char)pchRet3[0];
+            ret = !RecvWithTimeout(pchRet3, nRecv, nTimeout, hSocket);
             break;
         }
         default: closesocket(hSocket); return error("Error: malformed proxy response");
@@ -313,7 +344,7 @@ bool static Socks5(std::string strDest, int port, SOCKET& hSocket)
         closesocket(hSocket);
         return error("Error reading from proxy");
     }
-    if (recv(hSocket, pchRet3, 2, 0) != 2)
+    if (!RecvWithTimeout(pchRet3, 2, nTimeout, hSocket))
     {
         closesocket(hSocket);
         return error("Error reading from proxy");
@@ -420,7 +451,7 @@ bool static ConnectSocketDirectly(const CService &addrConnect, SOCKET& hSocketRe
     if (ioctlsocket(hSocket, FIONBIO, &fNonblock) == SOCKET_ERROR)
 #else
     fFlags = fcntl(hSocket, F_GETFL, 0);
-    if (fcntl(hSocket, F_SETFL, fFlags & !O_NONBLOCK) == SOCKET_ERROR)
+    if (fcntl(hSocket, F_SETFL, fFlags & ~O_NONBLOCK) == SOCKET_ERROR)
 #endif
     {
         closesocket(hSocket);
@@ -500,11 +531,11 @@ bool ConnectSocket(const CService &addrDest, SOCKET& hSocketRet, int nTimeout)
     // do socks negotiation
     switch (proxy.second) {
     case 4:
-        if (!Socks4(addrDest, hSocket))
+        if (!Socks4(addrDest, hSocket, nTimeout))
             return false;
         break;
     case 5:
-        if (!Socks5(addrDest.ToStringIP(), addrDest.GetPort(), hSocket))
+        if (!Socks5(addrDest.ToStringIP(), addrDest.GetPort(), hSocket, nTimeout))
             return false;
         break;
     default:
@@ -541,7 +572,7 @@ bool ConnectSocketByName(CService &addr, SOCKET& hSocketRet, const char *pszDest
         default:
         case 4: return false;
         case 5:
-            if (!Socks5(strDest, port, hSocket))
+            if (!Socks5(strDest, port, hSocket, nTimeout))
                 return false;
             break;
     }
@@ -926,6 +957,13 @@ uint64 CNetAddr::GetHash() const
     return nRet;
 }
 
+uint64 CNetAddr::GetSipHash(uint64 k0, uint64 k1) const
+{
+    uint256 n = 0;
+    std::memcpy(n.begin(), ip, 16);
+    return SipHashUint256(k0, k1, n);
+}
+
 void CNetAddr::print() const
 {
     printf("CNetAddr(%s)\n", ToString().c_str());
@@ -68,6 +68,8 @@ class CNetAddr
         std::string ToStringIP() const;
         unsigned int GetByte(int n) const;
         uint64 GetHash() const;
+        /** Keyed SipHash of the address, for tables an attacker shouldn't be able to aim at */
+        uint64 GetSipHash(uint64 k0, uint64 k1) const;
         bool GetInAddr(struct in_addr* pipv4Addr) const;
         std::vector<unsigned char> GetGroup() const;
         int GetReachabilityFrom(const CNetAddr *paddrPartner = NULL) const;
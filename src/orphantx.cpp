@@ -0,0 +1,146 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "orphantx.h"
+#include "util.h"
+
+COrphanTxPool orphanpool;
+
+bool COrphanTxPool::Add(const CTransaction& tx, const uint256& hash, int nNodeId)
+{
+    if (mapOrphans.count(hash))
+        return false;
+
+    // Ignore big transactions, to avoid a send-big-orphans memory
+    // exhaustion attack. If a peer has a legitimate large transaction with
+    // a missing parent then we assume it will rebroadcast it later, after
+    // the parent transaction(s) have been mined or received.
+    unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    if (nSize > MAX_ORPHAN_TX_SIZE)
+    {
+        printf("ignoring large orphan tx (size: %u, hash: %s)\n", nSize, hash.ToString().substr(0,10).c_str());
+        return false;
+    }
+
+    // One peer can't push everyone else's orphans out
+    unsigned int& nPeerBytes = mapPeerBytes[nNodeId];
+    if (nPeerBytes + nSize > MAX_ORPHAN_PEER_BYTES)
+    {
+        printf("ignoring orphan tx %s, peer %d has %u bytes of orphans\n", hash.ToString().substr(0,10).c_str(), nNodeId, nPeerBytes);
+        return false;
+    }
+
+    COrphanTx& orphan = mapOrphans[hash];
+    orphan.tx = tx;
+    orphan.nNodeId = nNodeId;
+    orphan.nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    orphan.nSize = nSize;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        mapOrphansByPrev[txin.prevout].insert(hash);
+    nPeerBytes += nSize;
+    nTotalBytes += nSize;
+
+    printf("stored orphan tx %s (mapsz %" PRIszu ")\n", hash.ToString().substr(0,10).c_str(), mapOrphans.size());
+    return true;
+}
+
+void COrphanTxPool::Erase(std::map<uint256, COrphanTx>::iterator it)
+{
+    const COrphanTx& orphan = (*it).second;
+    BOOST_FOREACH(const CTxIn& txin, orphan.tx.vin)
+    {
+        std::map<COutPoint, std::set<uint256> >::iterator mi = mapOrphansByPrev.find(txin.prevout);
+        if (mi == mapOrphansByPrev.end())
+            continue;
+        (*mi).second.erase((*it).first);
+        if ((*mi).second.empty())
+            mapOrphansByPrev.erase(mi);
+    }
+
+    std::map<int, unsigned int>::iterator mp = mapPeerBytes.find(orphan.nNodeId);
+    if (mp != mapPeerBytes.end())
+    {
+        (*mp).second -= orphan.nSize;
+        if ((*mp).second == 0)
+            mapPeerBytes.erase(mp);
+    }
+    nTotalBytes -= orphan.nSize;
+    mapOrphans.erase(it);
+}
+
+bool COrphanTxPool::Erase(const uint256& hash)
+{
+    std::map<uint256, COrphanTx>::iterator it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+        return false;
+    Erase(it);
+    return true;
+}
+
+void COrphanTxPool::EraseForPeer(int nNodeId)
+{
+    for (std::map<uint256, COrphanTx>::iterator it = mapOrphans.begin(); it != mapOrphans.end(); )
+    {
+        if ((*it).second.nNodeId == nNodeId)
+            Erase(it++);
+        else
+            ++it;
+    }
+}
+
+void COrphanTxPool::Clear()
+{
+    mapOrphans.clear();
+    mapOrphansByPrev.clear();
+    mapPeerBytes.clear();
+    nTotalBytes = 0;
+}
+
+const COrphanTxPool::COrphanTx* COrphanTxPool::Get(const uint256& hash) const
+{
+    std::map<uint256, COrphanTx>::const_iterator it = mapOrphans.find(hash);
+    return it == mapOrphans.end() ? NULL : &(*it).second;
+}
+
+void COrphanTxPool::GetChildren(const uint256& hashParent, std::vector<uint256>& vChildren) const
+{
+    // Outpoints sort by hash first, so all outputs of the parent are adjacent
+    for (std::map<COutPoint, std::set<uint256> >::const_iterator mi = mapOrphansByPrev.lower_bound(COutPoint(hashParent, 0));
+         mi != mapOrphansByPrev.end() && (*mi).first.hash == hashParent; ++mi)
+        vChildren.insert(vChildren.end(), (*mi).second.begin(), (*mi).second.end());
+}
+
+unsigned int COrphanTxPool::Limit()
+{
+    int64 nNow = GetTime();
+    if (nNextSweep <= nNow)
+    {
+        unsigned int nExpired = 0;
+        for (std::map<uint256, COrphanTx>::iterator it = mapOrphans.begin(); it != mapOrphans.end(); )
+        {
+            if ((*it).second.nTimeExpire <= nNow)
+            {
+                Erase(it++);
+                nExpired++;
+            }
+            else
+                ++it;
+        }
+        nNextSweep = nNow + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nExpired > 0)
+            printf("expired %u orphan tx\n", nExpired);
+    }
+
+    unsigned int nEvicted = 0;
+    while (mapOrphans.size() > MAX_ORPHAN_TRANSACTIONS || nTotalBytes > MAX_ORPHAN_POOL_BYTES)
+    {
+        // Evict a random orphan
+        std::map<uint256, COrphanTx>::iterator it = mapOrphans.lower_bound(GetRandHash());
+        if (it == mapOrphans.end())
+            it = mapOrphans.begin();
+        Erase(it);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_ORPHANTX_H
+#define curecoin_ORPHANTX_H
+
+#include "main.h"
+
+/** Largest orphan transaction we keep */
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+/** Most orphan bytes kept in all */
+static const unsigned int MAX_ORPHAN_POOL_BYTES = 5 * MAX_BLOCK_SIZE;
+/** Most orphan bytes kept from one peer */
+static const unsigned int MAX_ORPHAN_PEER_BYTES = MAX_BLOCK_SIZE;
+/** Seconds an orphan is kept waiting for its parents */
+static const int64 ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Seconds between sweeps for expired orphans */
+static const int64 ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/** Transactions whose inputs we haven't seen yet.
+ *
+ * Orphans are kept deserialized with their hash, indexed by each outpoint
+ * they spend, so when a transaction arrives its waiting children are found
+ * from its hash alone. The pool is capped by count (MAX_ORPHAN_TRANSACTIONS)
+ * and by bytes, in all and per peer, and orphans expire after
+ * ORPHAN_TX_EXPIRE_TIME. Guarded by cs_main.
+ */
+class COrphanTxPool
+{
+public:
+    struct COrphanTx
+    {
+        CTransaction tx;
+        int nNodeId;
+        int64 nTimeExpire;
+        unsigned int nSize;
+    };
+
+private:
+    std::map<uint256, COrphanTx> mapOrphans;
+    std::map<COutPoint, std::set<uint256> > mapOrphansByPrev;
+    std::map<int, unsigned int> mapPeerBytes;
+    size_t nTotalBytes;
+    int64 nNextSweep;
+
+    void Erase(std::map<uint256, COrphanTx>::iterator it);
+
+public:
+    COrphanTxPool() : nTotalBytes(0), nNextSweep(0) {}
+
+    /** Keep tx until its parents arrive, unless it is too large or the
+     * peer already has MAX_ORPHAN_PEER_BYTES waiting */
+    bool Add(const CTransaction& tx, const uint256& hash, int nNodeId);
+    bool Erase(const uint256& hash);
+    void EraseForPeer(int nNodeId);
+    void Clear();
+
+    bool Exists(const uint256& hash) const { return mapOrphans.count(hash) != 0; }
+    const COrphanTx* Get(const uint256& hash) const;
+    /** Orphans spending any output of hashParent */
+    void GetChildren(const uint256& hashParent, std::vector<uint256>& vChildren) const;
+
+    /** Drop expired orphans, then random ones until within the caps.
+     * Returns how many were dropped to fit. */
+    unsigned int Limit();
+
+    size_t Size() const { return mapOrphans.size(); }
+    size_t Bytes() const { return nTotalBytes; }
+};
+
+extern COrphanTxPool orphanpool;
+
+#endif
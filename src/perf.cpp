@@ -0,0 +1,328 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "perf.h"
+#include "sync.h"
+
+#include <boost/foreach.hpp>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <tuple>
+
+bool fPerfStats = true;
+bool fLockProfile = false;
+
+static const char* const pszPerfTimerNames[PERF_MAX] =
+{
+    "processmessage",
+    "connectblock",
+    "setbestchain",
+    "txdb_readtxindex",
+    "txdb_readdisktx",
+    "createnewblock",
+    "createcoinstake",
+};
+
+const char* GetPerfTimerName(perfTimerId id)
+{
+    return pszPerfTimerNames[id];
+}
+
+namespace {
+
+// Counters owned by one thread. Only the owning thread writes the timer
+// counters, so updates are plain relaxed stores; other threads only read
+// them when taking a snapshot.
+class CThreadPerfData
+{
+public:
+    std::atomic<uint64> vCount[PERF_MAX];
+    std::atomic<uint64> vTotalMicros[PERF_MAX];
+    std::atomic<uint64> vMaxMicros[PERF_MAX];
+
+    // Contention is rare next to timed calls, and this mutex is only ever
+    // contended by a reader taking a snapshot.
+    std::mutex cs;
+    std::map<const char*, CLockContentionStats> mapLocks; // keyed by the LOCK() name literal
+    std::map<std::tuple<const char*, int, const char*>, CLockSiteStats> mapLockSites; // file, line, name
+
+    CThreadPerfData();
+    ~CThreadPerfData();
+
+    void Reset()
+    {
+        for (int i = 0; i < PERF_MAX; i++)
+        {
+            vCount[i].store(0, std::memory_order_relaxed);
+            vTotalMicros[i].store(0, std::memory_order_relaxed);
+            vMaxMicros[i].store(0, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(cs);
+        mapLocks.clear();
+        mapLockSites.clear();
+    }
+};
+
+class CPerfRegistry
+{
+public:
+    std::mutex cs;
+    std::set<CThreadPerfData*> setThreads;
+
+    // Totals of threads that have exited
+    CPerfTimerStats vRetired[PERF_MAX];
+    std::map<std::string, CLockContentionStats> mapRetiredLocks;
+    std::map<std::pair<std::string, std::string>, CLockSiteStats> mapRetiredLockSites;
+};
+
+}
+
+// Never destroyed, threads may still exit while static destructors run
+static CPerfRegistry& GetPerfRegistry()
+{
+    static CPerfRegistry* pregistry = new CPerfRegistry();
+    return *pregistry;
+}
+
+// LOCK(pwalletMain->cs_wallet) and LOCK(cs_wallet) are the same lock
+static std::string NormalizeLockName(const char* pszName)
+{
+    std::string strName(pszName);
+    std::string::size_type nPos = strName.find_last_of(".>");
+    if (nPos != std::string::npos)
+        strName = strName.substr(nPos + 1);
+    return strName;
+}
+
+// Key lock sites by name and file:line, without the build's source directory
+static std::pair<std::string, std::string> LockSiteKey(const std::tuple<const char*, int, const char*>& key)
+{
+    std::string strFile(std::get<0>(key));
+    std::string::size_type nPos = strFile.find_last_of("/\\");
+    if (nPos != std::string::npos)
+        strFile = strFile.substr(nPos + 1);
+    return std::make_pair(NormalizeLockName(std::get<2>(key)), strprintf("%s:%d", strFile.c_str(), std::get<1>(key)));
+}
+
+static void MergeLockSiteStats(CLockSiteStats& to, const CLockSiteStats& from)
+{
+    to.nCount += from.nCount;
+    to.nContended += from.nContended;
+    to.nWaitNanos += from.nWaitNanos;
+    to.nMaxWaitNanos = std::max(to.nMaxWaitNanos, from.nMaxWaitNanos);
+    to.nHoldNanos += from.nHoldNanos;
+    to.nMaxHoldNanos = std::max(to.nMaxHoldNanos, from.nMaxHoldNanos);
+}
+
+static void MergeLockStats(CLockContentionStats& to, const CLockContentionStats& from)
+{
+    to.nContended += from.nContended;
+    to.nTryFailed += from.nTryFailed;
+    to.nWaitMicros += from.nWaitMicros;
+    to.nMaxWaitMicros = std::max(to.nMaxWaitMicros, from.nMaxWaitMicros);
+}
+
+CThreadPerfData::CThreadPerfData()
+{
+    Reset();
+    CPerfRegistry& registry = GetPerfRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs);
+    registry.setThreads.insert(this);
+}
+
+CThreadPerfData::~CThreadPerfData()
+{
+    CPerfRegistry& registry = GetPerfRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs);
+    for (int i = 0; i < PERF_MAX; i++)
+    {
+        registry.vRetired[i].nCount += vCount[i].load(std::memory_order_relaxed);
+        registry.vRetired[i].nTotalMicros += vTotalMicros[i].load(std::memory_order_relaxed);
+        registry.vRetired[i].nMaxMicros = std::max(registry.vRetired[i].nMaxMicros, (uint64)vMaxMicros[i].load(std::memory_order_relaxed));
+    }
+    {
+        std::lock_guard<std::mutex> lockThread(cs);
+        for (std::map<const char*, CLockContentionStats>::iterator it = mapLocks.begin(); it != mapLocks.end(); ++it)
+            MergeLockStats(registry.mapRetiredLocks[NormalizeLockName(it->first)], it->second);
+        for (std::map<std::tuple<const char*, int, const char*>, CLockSiteStats>::iterator it = mapLockSites.begin(); it != mapLockSites.end(); ++it)
+            MergeLockSiteStats(registry.mapRetiredLockSites[LockSiteKey(it->first)], it->second);
+    }
+    registry.setThreads.erase(this);
+}
+
+// Set once the thread's data is destroyed, so that locks taken by other
+// thread_local destructors afterwards are not recorded into freed memory
+static thread_local bool fThreadPerfDataGone = false;
+
+static CThreadPerfData* GetThreadPerfData()
+{
+    if (fThreadPerfDataGone)
+        return NULL;
+    static thread_local struct CThreadPerfDataHolder
+    {
+        CThreadPerfData data;
+        ~CThreadPerfDataHolder() { fThreadPerfDataGone = true; }
+    } holder;
+    return &holder.data;
+}
+
+void PerfRecord(perfTimerId id, int64 nMicros)
+{
+    CThreadPerfData* pdata = GetThreadPerfData();
+    if (!pdata || nMicros < 0)
+        return;
+    pdata->vCount[id].store(pdata->vCount[id].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    pdata->vTotalMicros[id].store(pdata->vTotalMicros[id].load(std::memory_order_relaxed) + nMicros, std::memory_order_relaxed);
+    if ((uint64)nMicros > pdata->vMaxMicros[id].load(std::memory_order_relaxed))
+        pdata->vMaxMicros[id].store(nMicros, std::memory_order_relaxed);
+}
+
+void LockContended(const char* pszName, long long nWaitMicros, bool fTry)
+{
+    CThreadPerfData* pdata = GetThreadPerfData();
+    if (!pdata)
+        return;
+    std::lock_guard<std::mutex> lock(pdata->cs);
+    CLockContentionStats& stats = pdata->mapLocks[pszName];
+    if (fTry)
+    {
+        stats.nTryFailed++;
+        return;
+    }
+    stats.nContended++;
+    stats.nWaitMicros += nWaitMicros;
+    stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, (uint64)nWaitMicros);
+}
+
+void LockProfileRecord(const char* pszName, const char* pszFile, int nLine, bool fContended, long long nWaitNanos, long long nHoldNanos)
+{
+    CThreadPerfData* pdata = GetThreadPerfData();
+    if (!pdata)
+        return;
+    std::lock_guard<std::mutex> lock(pdata->cs);
+    CLockSiteStats& stats = pdata->mapLockSites[std::make_tuple(pszFile, nLine, pszName)];
+    stats.nCount++;
+    if (fContended)
+        stats.nContended++;
+    stats.nWaitNanos += nWaitNanos;
+    stats.nMaxWaitNanos = std::max(stats.nMaxWaitNanos, (uint64)nWaitNanos);
+    stats.nHoldNanos += nHoldNanos;
+    stats.nMaxHoldNanos = std::max(stats.nMaxHoldNanos, (uint64)nHoldNanos);
+}
+
+void GetPerfTimerStats(std::vector<CPerfTimerStats>& vStats)
+{
+    CPerfRegistry& registry = GetPerfRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs);
+    vStats.assign(registry.vRetired, registry.vRetired + PERF_MAX);
+    for (int i = 0; i < PERF_MAX; i++)
+    {
+        vStats[i].strName = GetPerfTimerName((perfTimerId)i);
+        BOOST_FOREACH(CThreadPerfData* pdata, registry.setThreads)
+        {
+            vStats[i].nCount += pdata->vCount[i].load(std::memory_order_relaxed);
+            vStats[i].nTotalMicros += pdata->vTotalMicros[i].load(std::memory_order_relaxed);
+            vStats[i].nMaxMicros = std::max(vStats[i].nMaxMicros, (uint64)pdata->vMaxMicros[i].load(std::memory_order_relaxed));
+        }
+    }
+}
+
+void GetLockContentionStats(std::vector<CLockContentionStats>& vStats)
+{
+    std::map<std::string, CLockContentionStats> mapStats;
+    {
+        CPerfRegistry& registry = GetPerfRegistry();
+        std::lock_guard<std::mutex> lock(registry.cs);
+        mapStats = registry.mapRetiredLocks;
+        BOOST_FOREACH(CThreadPerfData* pdata, registry.setThreads)
+        {
+            std::lock_guard<std::mutex> lockThread(pdata->cs);
+            for (std::map<const char*, CLockContentionStats>::iterator it = pdata->mapLocks.begin(); it != pdata->mapLocks.end(); ++it)
+                MergeLockStats(mapStats[NormalizeLockName(it->first)], it->second);
+        }
+    }
+
+    vStats.clear();
+    for (std::map<std::string, CLockContentionStats>::iterator it = mapStats.begin(); it != mapStats.end(); ++it)
+    {
+        vStats.push_back(it->second);
+        vStats.back().strName = it->first;
+    }
+}
+
+void GetLockSiteStats(std::vector<CLockSiteStats>& vStats)
+{
+    std::map<std::pair<std::string, std::string>, CLockSiteStats> mapStats;
+    {
+        CPerfRegistry& registry = GetPerfRegistry();
+        std::lock_guard<std::mutex> lock(registry.cs);
+        mapStats = registry.mapRetiredLockSites;
+        BOOST_FOREACH(CThreadPerfData* pdata, registry.setThreads)
+        {
+            std::lock_guard<std::mutex> lockThread(pdata->cs);
+            for (std::map<std::tuple<const char*, int, const char*>, CLockSiteStats>::iterator it = pdata->mapLockSites.begin(); it != pdata->mapLockSites.end(); ++it)
+                MergeLockSiteStats(mapStats[LockSiteKey(it->first)], it->second);
+        }
+    }
+
+    vStats.clear();
+    for (std::map<std::pair<std::string, std::string>, CLockSiteStats>::iterator it = mapStats.begin(); it != mapStats.end(); ++it)
+    {
+        vStats.push_back(it->second);
+        vStats.back().strName = it->first.first;
+        vStats.back().strSite = it->first.second;
+    }
+}
+
+void ResetPerfStats()
+{
+    CPerfRegistry& registry = GetPerfRegistry();
+    std::lock_guard<std::mutex> lock(registry.cs);
+    for (int i = 0; i < PERF_MAX; i++)
+        registry.vRetired[i] = CPerfTimerStats();
+    registry.mapRetiredLocks.clear();
+    registry.mapRetiredLockSites.clear();
+    BOOST_FOREACH(CThreadPerfData* pdata, registry.setThreads)
+        pdata->Reset();
+}
+
+// Prometheus text exposition format, version 0.0.4
+std::string FormatPerfStatsPrometheus()
+{
+    std::vector<CPerfTimerStats> vTimers;
+    GetPerfTimerStats(vTimers);
+    std::vector<CLockContentionStats> vLocks;
+    GetLockContentionStats(vLocks);
+
+    std::string strRet;
+    strRet += "# HELP curecoin_perf_calls_total Number of calls of a timed code path.\n"
+              "# TYPE curecoin_perf_calls_total counter\n";
+    BOOST_FOREACH(const CPerfTimerStats& stats, vTimers)
+        strRet += strprintf("curecoin_perf_calls_total{path=\"%s\"} %" PRI64u "\n", stats.strName.c_str(), stats.nCount);
+    strRet += "# HELP curecoin_perf_seconds_total Time spent in a timed code path.\n"
+              "# TYPE curecoin_perf_seconds_total counter\n";
+    BOOST_FOREACH(const CPerfTimerStats& stats, vTimers)
+        strRet += strprintf("curecoin_perf_seconds_total{path=\"%s\"} %.6f\n", stats.strName.c_str(), stats.nTotalMicros / 1e6);
+    strRet += "# HELP curecoin_perf_max_seconds Longest single call of a timed code path.\n"
+              "# TYPE curecoin_perf_max_seconds gauge\n";
+    BOOST_FOREACH(const CPerfTimerStats& stats, vTimers)
+        strRet += strprintf("curecoin_perf_max_seconds{path=\"%s\"} %.6f\n", stats.strName.c_str(), stats.nMaxMicros / 1e6);
+
+    strRet += "# HELP curecoin_lock_contended_total Lock acquisitions that had to wait for another thread.\n"
+              "# TYPE curecoin_lock_contended_total counter\n";
+    BOOST_FOREACH(const CLockContentionStats& stats, vLocks)
+        strRet += strprintf("curecoin_lock_contended_total{lock=\"%s\"} %" PRI64u "\n", stats.strName.c_str(), stats.nContended);
+    strRet += "# HELP curecoin_lock_tryfailed_total TRY_LOCK attempts that found the lock taken.\n"
+              "# TYPE curecoin_lock_tryfailed_total counter\n";
+    BOOST_FOREACH(const CLockContentionStats& stats, vLocks)
+        strRet += strprintf("curecoin_lock_tryfailed_total{lock=\"%s\"} %" PRI64u "\n", stats.strName.c_str(), stats.nTryFailed);
+    strRet += "# HELP curecoin_lock_wait_seconds_total Time spent waiting for contended locks.\n"
+              "# TYPE curecoin_lock_wait_seconds_total counter\n";
+    BOOST_FOREACH(const CLockContentionStats& stats, vLocks)
+        strRet += strprintf("curecoin_lock_wait_seconds_total{lock=\"%s\"} %.6f\n", stats.strName.c_str(), stats.nWaitMicros / 1e6);
+    return strRet;
+}
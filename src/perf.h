@@ -0,0 +1,99 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_PERF_H
+#define curecoin_PERF_H
+
+#include "util.h"
+
+#include <string>
+#include <vector>
+
+/** Hot code paths timed with PERF_TIMER */
+enum perfTimerId
+{
+    PERF_PROCESSMESSAGE,
+    PERF_CONNECTBLOCK,
+    PERF_SETBESTCHAIN,
+    PERF_TXDB_READTXINDEX,
+    PERF_TXDB_READDISKTX,
+    PERF_CREATENEWBLOCK,
+    PERF_CREATECOINSTAKE,
+
+    PERF_MAX
+};
+
+/** Aggregated timings of one timer, times in microseconds */
+class CPerfTimerStats
+{
+public:
+    std::string strName;
+    uint64 nCount;
+    uint64 nTotalMicros;
+    uint64 nMaxMicros;
+
+    CPerfTimerStats() : nCount(0), nTotalMicros(0), nMaxMicros(0) {}
+};
+
+/** Aggregated contention of all LOCK()s of one critical section, times in microseconds */
+class CLockContentionStats
+{
+public:
+    std::string strName;
+    uint64 nContended;   // LOCK() found the lock held by another thread
+    uint64 nTryFailed;   // TRY_LOCK() found the lock held by another thread
+    uint64 nWaitMicros;
+    uint64 nMaxWaitMicros;
+
+    CLockContentionStats() : nContended(0), nTryFailed(0), nWaitMicros(0), nMaxWaitMicros(0) {}
+};
+
+/** Lock profiler totals of one LOCK() site, times in nanoseconds */
+class CLockSiteStats
+{
+public:
+    std::string strName;
+    std::string strSite;    // file:line of the LOCK()
+    uint64 nCount;
+    uint64 nContended;
+    uint64 nWaitNanos;
+    uint64 nMaxWaitNanos;
+    uint64 nHoldNanos;
+    uint64 nMaxHoldNanos;
+
+    CLockSiteStats() : nCount(0), nContended(0), nWaitNanos(0), nMaxWaitNanos(0), nHoldNanos(0), nMaxHoldNanos(0) {}
+};
+
+extern bool fPerfStats;
+
+const char* GetPerfTimerName(perfTimerId id);
+void PerfRecord(perfTimerId id, int64 nMicros);
+void GetPerfTimerStats(std::vector<CPerfTimerStats>& vStats);
+void GetLockContentionStats(std::vector<CLockContentionStats>& vStats);
+void GetLockSiteStats(std::vector<CLockSiteStats>& vStats);
+void ResetPerfStats();
+std::string FormatPerfStatsPrometheus();
+
+/** Adds the lifetime of the object to a perfTimerId.
+ * Counters are kept per thread so timing a path never takes a lock.
+ */
+class CPerfTimer
+{
+private:
+    perfTimerId id;
+    bool fActive;
+    int64 nStart;
+
+public:
+    explicit CPerfTimer(perfTimerId idIn) : id(idIn), fActive(fPerfStats), nStart(fActive ? GetTimeMicros() : 0) {}
+
+    ~CPerfTimer()
+    {
+        if (fActive)
+            PerfRecord(id, GetTimeMicros() - nStart);
+    }
+};
+
+#define PERF_TIMER(id) CPerfTimer perftimer(id)
+
+#endif
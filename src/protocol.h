@@ -61,7 +61,8 @@ class CMessageHeader
             CHECKSUM_SIZE=sizeof(int),
 
             MESSAGE_SIZE_OFFSET=MESSAGE_START_SIZE+COMMAND_SIZE,
-            CHECKSUM_OFFSET=MESSAGE_SIZE_OFFSET+MESSAGE_SIZE_SIZE
+            CHECKSUM_OFFSET=MESSAGE_SIZE_OFFSET+MESSAGE_SIZE_SIZE,
+            HEADER_SIZE=CHECKSUM_OFFSET+CHECKSUM_SIZE
         };
         char pchMessageStart[MESSAGE_START_SIZE];
         char pchCommand[COMMAND_SIZE];
@@ -73,6 +74,8 @@ class CMessageHeader
 enum
 {
     NODE_NETWORK = (1 << 0),
+    // Takes new blocks as "cmpctblock" and answers "getblocktxn"
+    NODE_COMPACT_BLOCKS = (1 << 1),
 };
 
 /** A CService with information about it as peer */
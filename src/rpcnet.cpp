@@ -8,7 +8,9 @@
 #include "wallet.h"
 #include "db.h"
 #include "walletdb.h"
+#include "perf.h"
 
+#include <algorithm>
 #include <map>
 #include <stdexcept>
 #include <vector>
@@ -64,6 +66,12 @@ json_spirit::Value getpeerinfo(const json_spirit::Array& params, bool fHelp)
         obj.push_back(json_spirit::Pair("releasetime", (boost::int64_t)stats.nReleaseTime));
         obj.push_back(json_spirit::Pair("startingheight", stats.nStartingHeight));
         obj.push_back(json_spirit::Pair("banscore", stats.nMisbehavior));
+        obj.push_back(json_spirit::Pair("sendqueue", (boost::int64_t)stats.nSendQueued));
+        obj.push_back(json_spirit::Pair("recvqueue", (boost::int64_t)stats.nRecvQueued));
+        obj.push_back(json_spirit::Pair("buffermemory", (boost::int64_t)stats.nBufferMemory));
+        obj.push_back(json_spirit::Pair("bulkqueue", (boost::int64_t)stats.nSendBulkQueued));
+        obj.push_back(json_spirit::Pair("bytessent", (boost::int64_t)stats.nSendBytes));
+        obj.push_back(json_spirit::Pair("bytesrecv", (boost::int64_t)stats.nRecvBytes));
 
         ret.push_back(obj);
     }
@@ -71,6 +79,159 @@ json_spirit::Value getpeerinfo(const json_spirit::Array& params, bool fHelp)
     return ret;
 }
 
+json_spirit::Value getnettotals(const json_spirit::Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getnettotals\n"
+            "Returns bytes sent and received, the upload rate limits in bytes\n"
+            "per second, and where the upload target stands.");
+
+    json_spirit::Object obj;
+    obj.push_back(json_spirit::Pair("totalbytesrecv", (boost::int64_t)GetTotalBytesRecv()));
+    obj.push_back(json_spirit::Pair("totalbytessent", (boost::int64_t)GetTotalBytesSent()));
+    obj.push_back(json_spirit::Pair("timemillis", (boost::int64_t)GetTimeMillis()));
+    obj.push_back(json_spirit::Pair("maxpeeruploadrate", (boost::int64_t)nMaxPeerUploadRate));
+
+    LOCK(cs_bandwidth);
+    int64 nNow = GetTime();
+    obj.push_back(json_spirit::Pair("maxuploadrate", (boost::int64_t)bucketUpload.GetRate()));
+    json_spirit::Object target;
+    target.push_back(json_spirit::Pair("timeframe", (boost::int64_t)UPLOAD_TARGET_TIMEFRAME));
+    target.push_back(json_spirit::Pair("target", (boost::int64_t)uploadTarget.GetTarget()));
+    target.push_back(json_spirit::Pair("target_reached", uploadTarget.IsReached(nNow)));
+    target.push_back(json_spirit::Pair("bytes_left_in_cycle", (boost::int64_t)uploadTarget.GetBytesLeft(nNow)));
+    target.push_back(json_spirit::Pair("time_left_in_cycle", (boost::int64_t)uploadTarget.GetTimeLeft(nNow)));
+    obj.push_back(json_spirit::Pair("uploadtarget", target));
+    return obj;
+}
+
+json_spirit::Value getperfstats(const json_spirit::Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error(
+            "getperfstats [reset=false]\n"
+            "Returns call counts and timings of hot code paths, and how often\n"
+            "each lock was contended, and the size of the block index. If [reset]\n"
+            "is true the counters are cleared after they are read.");
+
+    std::vector<CPerfTimerStats> vTimers;
+    GetPerfTimerStats(vTimers);
+    std::vector<CLockContentionStats> vLocks;
+    GetLockContentionStats(vLocks);
+    if (params.size() > 0 && params[0].get_bool())
+        ResetPerfStats();
+
+    json_spirit::Object timers;
+    BOOST_FOREACH(const CPerfTimerStats& stats, vTimers)
+    {
+        json_spirit::Object obj;
+        obj.push_back(json_spirit::Pair("count", (boost::int64_t)stats.nCount));
+        obj.push_back(json_spirit::Pair("total_us", (boost::int64_t)stats.nTotalMicros));
+        obj.push_back(json_spirit::Pair("avg_us", (boost::int64_t)(stats.nCount ? stats.nTotalMicros / stats.nCount : 0)));
+        obj.push_back(json_spirit::Pair("max_us", (boost::int64_t)stats.nMaxMicros));
+        timers.push_back(json_spirit::Pair(stats.strName, obj));
+    }
+
+    json_spirit::Object locks;
+    BOOST_FOREACH(const CLockContentionStats& stats, vLocks)
+    {
+        json_spirit::Object obj;
+        obj.push_back(json_spirit::Pair("contended", (boost::int64_t)stats.nContended));
+        obj.push_back(json_spirit::Pair("tryfailed", (boost::int64_t)stats.nTryFailed));
+        obj.push_back(json_spirit::Pair("wait_us", (boost::int64_t)stats.nWaitMicros));
+        obj.push_back(json_spirit::Pair("maxwait_us", (boost::int64_t)stats.nMaxWaitMicros));
+        locks.push_back(json_spirit::Pair(stats.strName, obj));
+    }
+
+    uint64 nInUse, nCached, nAllocs, nPoolHits;
+    GetNetBufferStats(nInUse, nCached, nAllocs, nPoolHits);
+    json_spirit::Object netbuffers;
+    netbuffers.push_back(json_spirit::Pair("inuse", (boost::int64_t)nInUse));
+    netbuffers.push_back(json_spirit::Pair("pooled", (boost::int64_t)nCached));
+    netbuffers.push_back(json_spirit::Pair("allocs", (boost::int64_t)nAllocs));
+    netbuffers.push_back(json_spirit::Pair("poolhits", (boost::int64_t)nPoolHits));
+
+    json_spirit::Object blockindex;
+    {
+        LOCK(cs_main);
+        blockindex.push_back(json_spirit::Pair("entries", (boost::int64_t)mapBlockIndex.size()));
+        blockindex.push_back(json_spirit::Pair("memory", (boost::int64_t)mapBlockIndex.DynamicMemoryUsage()));
+    }
+
+    json_spirit::Object result;
+    result.push_back(json_spirit::Pair("enabled", fPerfStats));
+    result.push_back(json_spirit::Pair("timers", timers));
+    result.push_back(json_spirit::Pair("locks", locks));
+    result.push_back(json_spirit::Pair("netbuffers", netbuffers));
+    result.push_back(json_spirit::Pair("blockindex", blockindex));
+    return result;
+}
+
+static bool SortLockSitesByWait(const CLockSiteStats& a, const CLockSiteStats& b)
+{
+    return a.nWaitNanos > b.nWaitNanos;
+}
+
+static bool SortLockSitesByHold(const CLockSiteStats& a, const CLockSiteStats& b)
+{
+    return a.nHoldNanos > b.nHoldNanos;
+}
+
+static bool SortLockSitesByCount(const CLockSiteStats& a, const CLockSiteStats& b)
+{
+    return a.nCount > b.nCount;
+}
+
+json_spirit::Value getlockprofile(const json_spirit::Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw std::runtime_error(
+            "getlockprofile [count=20] [sortby=wait]\n"
+            "Returns the [count] LOCK() sites with the most total wait time, or\n"
+            "hold time or acquisitions when [sortby] is \"hold\" or \"count\".\n"
+            "Requires -lockprofile. getperfstats true clears the profile.");
+
+    if (!fLockProfile)
+        throw JSONRPCError(RPC_MISC_ERROR, "Lock profiler is off, restart with -lockprofile");
+
+    int nCount = 20;
+    if (params.size() > 0)
+        nCount = params[0].get_int();
+    std::string strSortBy = "wait";
+    if (params.size() > 1)
+        strSortBy = params[1].get_str();
+
+    std::vector<CLockSiteStats> vSites;
+    GetLockSiteStats(vSites);
+    if (strSortBy == "wait")
+        std::sort(vSites.begin(), vSites.end(), SortLockSitesByWait);
+    else if (strSortBy == "hold")
+        std::sort(vSites.begin(), vSites.end(), SortLockSitesByHold);
+    else if (strSortBy == "count")
+        std::sort(vSites.begin(), vSites.end(), SortLockSitesByCount);
+    else
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sortby, expected wait, hold or count");
+
+    json_spirit::Array ret;
+    for (int i = 0; i < (int)vSites.size() && i < nCount; i++)
+    {
+        const CLockSiteStats& stats = vSites[i];
+        json_spirit::Object obj;
+        obj.push_back(json_spirit::Pair("lock", stats.strName));
+        obj.push_back(json_spirit::Pair("site", stats.strSite));
+        obj.push_back(json_spirit::Pair("count", (boost::int64_t)stats.nCount));
+        obj.push_back(json_spirit::Pair("contended", (boost::int64_t)stats.nContended));
+        obj.push_back(json_spirit::Pair("wait_us", (boost::int64_t)(stats.nWaitNanos / 1000)));
+        obj.push_back(json_spirit::Pair("maxwait_us", (boost::int64_t)(stats.nMaxWaitNanos / 1000)));
+        obj.push_back(json_spirit::Pair("hold_us", (boost::int64_t)(stats.nHoldNanos / 1000)));
+        obj.push_back(json_spirit::Pair("avghold_ns", (boost::int64_t)(stats.nCount ? stats.nHoldNanos / stats.nCount : 0)));
+        obj.push_back(json_spirit::Pair("maxhold_us", (boost::int64_t)(stats.nMaxHoldNanos / 1000)));
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 extern CCriticalSection cs_mapAlerts;
 extern std::map<uint256, CAlert> mapAlerts;
  
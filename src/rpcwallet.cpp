@@ -341,19 +341,19 @@ json_spirit::Value listaddressgroupings(const json_spirit::Array& params, bool f
 
     json_spirit::Array jsonGroupings;
     std::map<CTxDestination, int64> balances = pwalletMain->GetAddressBalances();
-    BOOST_FOREACH(std::set<CTxDestination> grouping, pwalletMain->GetAddressGroupings())
+    std::set< std::set<CTxDestination> > groupings = pwalletMain->GetAddressGroupings();
+    LOCK(pwalletMain->cs_wallet);
+    BOOST_FOREACH(const std::set<CTxDestination>& grouping, groupings)
     {
         json_spirit::Array jsonGrouping;
-        BOOST_FOREACH(CTxDestination address, grouping)
+        BOOST_FOREACH(const CTxDestination& address, grouping)
         {
             json_spirit::Array addressInfo;
             addressInfo.push_back(CcurecoinAddress(address).ToString());
             addressInfo.push_back(ValueFromAmount(balances[address]));
-            {
-                LOCK(pwalletMain->cs_wallet);
-                if (pwalletMain->mapAddressBook.find(CcurecoinAddress(address).Get()) != pwalletMain->mapAddressBook.end())
-                    addressInfo.push_back(pwalletMain->mapAddressBook.find(CcurecoinAddress(address).Get())->second);
-            }
+            std::map<CTxDestination, std::string>::const_iterator mi = pwalletMain->mapAddressBook.find(address);
+            if (mi != pwalletMain->mapAddressBook.end())
+                addressInfo.push_back((*mi).second);
             jsonGrouping.push_back(addressInfo);
         }
         jsonGroupings.push_back(jsonGrouping);
@@ -1303,7 +1303,7 @@ json_spirit::Value gettransaction(const json_spirit::Array& params, bool fHelp)
             else
             {
                 entry.push_back(json_spirit::Pair("blockhash", hashBlock.GetHex()));
-                std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+                CBlockIndexMap::iterator mi = mapBlockIndex.find(hashBlock);
                 if (mi != mapBlockIndex.end() && (*mi).second)
                 {
                     CBlockIndex* pindex = (*mi).second;
@@ -1758,6 +1758,66 @@ json_spirit::Value resendtx(const json_spirit::Array& params, bool fHelp)
     return json_spirit::Value::null;
 }
 
+// curecoin: combine small outputs into fewer, larger ones
+json_spirit::Value consolidatecoins(const json_spirit::Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 4)
+        throw std::runtime_error(
+            "consolidatecoins [run=false] [threshold] [target] [maxfee]\n"
+            "Combine outputs smaller than [threshold] into outputs of about [target],\n"
+            "each address separately, spending at most [maxfee] in fees.\n"
+            "Amounts default to -consolidatethreshold, -consolidatetarget and -consolidatemaxfee.\n"
+            "Without [run] only reports what would be sent.");
+
+    int64 nThreshold, nTarget, nMaxFee;
+    if (!GetConsolidationSettings(nThreshold, nTarget, nMaxFee))
+        throw JSONRPCError(RPC_WALLET_ERROR, "Invalid consolidation settings");
+    bool fRun = params.size() > 0 && params[0].get_bool();
+    if (params.size() > 1)
+        nThreshold = AmountFromValue(params[1]);
+    if (params.size() > 2)
+        nTarget = AmountFromValue(params[2]);
+    if (params.size() > 3)
+        nMaxFee = AmountFromValue(params[3]);
+    if (nThreshold <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid threshold");
+    if (nTarget < nThreshold)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Target must be at least the threshold");
+
+    // maxfee comes from the caller, so a wallet unlocked for minting only
+    // must not pay it
+    EnsureWalletIsUnlocked();
+
+    std::vector<CWalletTx> vwtx;
+    int64 nFee;
+    if (!pwalletMain->CreateConsolidation(nThreshold, nTarget, nMaxFee, vwtx, nFee))
+        throw JSONRPCError(RPC_WALLET_ERROR, "Error creating consolidation transactions");
+
+    unsigned int nInputs = 0, nOutputs = 0;
+    json_spirit::Array txids;
+    BOOST_FOREACH(CWalletTx& wtx, vwtx)
+    {
+        if (fRun)
+        {
+            CReserveKey reservekey(pwalletMain);
+            if (!pwalletMain->CommitTransaction(wtx, reservekey))
+                throw JSONRPCError(RPC_WALLET_ERROR, "Error: The transaction was rejected.");
+            txids.push_back(wtx.GetHash().GetHex());
+        }
+        nInputs += wtx.vin.size();
+        nOutputs += wtx.vout.size();
+    }
+
+    json_spirit::Object result;
+    result.push_back(json_spirit::Pair("transactions", (int)vwtx.size()));
+    result.push_back(json_spirit::Pair("inputs", (int)nInputs));
+    result.push_back(json_spirit::Pair("outputs", (int)nOutputs));
+    result.push_back(json_spirit::Pair("fee", ValueFromAmount(nFee)));
+    if (fRun)
+        result.push_back(json_spirit::Pair("txids", txids));
+    return result;
+}
+
 // ppcoin: make a public-private key pair
 json_spirit::Value makekeypair(const json_spirit::Array& params, bool fHelp)
 {
@@ -5,6 +5,7 @@
 #ifndef curecoin_SYNC_H
 #define curecoin_SYNC_H
 
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
 
@@ -25,6 +26,16 @@ void static inline EnterCritical(const char* pszName, const char* pszFile, int n
 void static inline LeaveCritical() {}
 #endif
 
+/** Count a LOCK() that had to wait, or a failed TRY_LOCK(), see perf.cpp.
+ * Only called while fPerfStats (-perfstats) is set. */
+extern bool fPerfStats;
+void LockContended(const char* pszName, long long nWaitMicros, bool fTry);
+
+/** Lock profiler: when set, every LOCK() records its wait and hold time
+ * against its file:line, see perf.cpp and getlockprofile */
+extern bool fLockProfile;
+void LockProfileRecord(const char* pszName, const char* pszFile, int nLine, bool fContended, long long nWaitNanos, long long nHoldNanos);
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
@@ -35,6 +46,36 @@ class CMutexLock
 {
 private:
     std::unique_lock<Mutex> lock;
+
+    // Lock profiler state of the current acquisition, see fLockProfile
+    bool fProfiling;
+    bool fProfileContended;
+    const char* pszProfileName;
+    const char* pszProfileFile;
+    int nProfileLine;
+    long long nProfileWaitNanos;
+    std::chrono::steady_clock::time_point profileAcquired;
+
+    void ProfileAcquired(const char* pszName, const char* pszFile, int nLine, bool fContended, long long nWaitNanos, std::chrono::steady_clock::time_point acquired)
+    {
+        fProfiling = true;
+        fProfileContended = fContended;
+        pszProfileName = pszName;
+        pszProfileFile = pszFile;
+        nProfileLine = nLine;
+        nProfileWaitNanos = nWaitNanos;
+        profileAcquired = acquired;
+    }
+
+    void ProfileReleased()
+    {
+        if (!fProfiling)
+            return;
+        fProfiling = false;
+        long long nHoldNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profileAcquired).count();
+        LockProfileRecord(pszProfileName, pszProfileFile, nProfileLine, fProfileContended, nProfileWaitNanos, nHoldNanos);
+    }
+
 public:
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
@@ -42,15 +83,30 @@ public:
         if (!lock.owns_lock())
         {
             EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
-            if (!lock.try_lock())
+            if (lock.try_lock())
+            {
+                if (fLockProfile)
+                    ProfileAcquired(pszName, pszFile, nLine, false, 0, std::chrono::steady_clock::now());
+            }
+            else
             {
+#ifdef DEBUG_LOCKCONTENTION
                 PrintLockContention(pszName, pszFile, nLine);
 #endif
-            lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+                if (!fPerfStats && !fLockProfile)
+                {
+                    lock.lock();
+                    return;
+                }
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                lock.lock();
+                std::chrono::steady_clock::time_point acquired = std::chrono::steady_clock::now();
+                long long nWaitNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(acquired - start).count();
+                if (fPerfStats)
+                    LockContended(pszName, nWaitNanos / 1000, false);
+                if (fLockProfile)
+                    ProfileAcquired(pszName, pszFile, nLine, true, nWaitNanos, acquired);
             }
-#endif
         }
     }
 
@@ -58,6 +114,7 @@ public:
     {
         if (lock.owns_lock())
         {
+            ProfileReleased();
             lock.unlock();
             LeaveCritical();
         }
@@ -69,12 +126,18 @@ public:
         {
             EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()), true);
             if (!lock.try_lock())
+            {
                 LeaveCritical();
+                if (fPerfStats)
+                    LockContended(pszName, 0, true);
+            }
+            else if (fLockProfile)
+                ProfileAcquired(pszName, pszFile, nLine, false, 0, std::chrono::steady_clock::now());
         }
         return lock.owns_lock();
     }
 
-    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) : lock(mutexIn, std::defer_lock)
+    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) : lock(mutexIn, std::defer_lock), fProfiling(false)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -85,7 +148,10 @@ public:
     ~CMutexLock()
     {
         if (lock.owns_lock())
+        {
+            ProfileReleased();
             LeaveCritical();
+        }
     }
 
     operator bool()
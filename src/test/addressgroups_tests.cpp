@@ -0,0 +1,60 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "addressgroups.h"
+
+BOOST_AUTO_TEST_SUITE(addressgroups_tests)
+
+static CTxDestination MakeAddress(unsigned int n)
+{
+    uint160 hash(n);
+    if (n % 2)
+        return CScriptID(hash);
+    return CKeyID(hash);
+}
+
+BOOST_AUTO_TEST_CASE(addressgroups_merge)
+{
+    CAddressGroups groups;
+    for (unsigned int n = 0; n < 10; n++)
+        groups.Add(MakeAddress(n));
+    BOOST_CHECK_EQUAL(groups.Add(MakeAddress(3)), 3U);
+    BOOST_CHECK_EQUAL(groups.Size(), 10U);
+
+    // {0, 1, 2} {3, 4} {5} ... {9}, with 10 and 11 new
+    groups.Merge(MakeAddress(0), MakeAddress(1));
+    groups.Merge(MakeAddress(2), MakeAddress(1));
+    groups.Merge(MakeAddress(3), MakeAddress(4));
+    groups.Merge(MakeAddress(10), MakeAddress(11));
+    groups.Merge(MakeAddress(0), MakeAddress(2));
+    BOOST_CHECK_EQUAL(groups.Size(), 12U);
+    BOOST_CHECK(groups.SameGroup(MakeAddress(0), MakeAddress(2)));
+    BOOST_CHECK(groups.SameGroup(MakeAddress(11), MakeAddress(10)));
+    BOOST_CHECK(!groups.SameGroup(MakeAddress(2), MakeAddress(3)));
+    BOOST_CHECK(!groups.SameGroup(MakeAddress(5), MakeAddress(12)));
+
+    std::set< std::set<CTxDestination> > setGroups;
+    groups.GetGroups(setGroups);
+    BOOST_CHECK_EQUAL(setGroups.size(), 8U);
+    std::set<CTxDestination> group;
+    group.insert(MakeAddress(0));
+    group.insert(MakeAddress(1));
+    group.insert(MakeAddress(2));
+    BOOST_CHECK(setGroups.count(group));
+
+    // A chain of merges ends up as one group
+    for (unsigned int n = 0; n < 11; n++)
+        groups.Merge(MakeAddress(n), MakeAddress(n + 1));
+    setGroups.clear();
+    groups.GetGroups(setGroups);
+    BOOST_CHECK_EQUAL(setGroups.size(), 1U);
+    BOOST_CHECK_EQUAL(setGroups.begin()->size(), 12U);
+
+    groups.Clear();
+    BOOST_CHECK_EQUAL(groups.Size(), 0U);
+    BOOST_CHECK(!groups.SameGroup(MakeAddress(0), MakeAddress(1)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
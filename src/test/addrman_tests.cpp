@@ -0,0 +1,248 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include "addrman.h"
+#include "db.h"
+
+BOOST_AUTO_TEST_SUITE(addrman_tests)
+
+static CAddress MakeAddress(int n, int64 nTime)
+{
+    CAddress addr(CService(strprintf("%d.%d.%d.%d", 1 + (n % 200), (n / 200) % 256, (n / 51200) % 256, 1 + n % 250), 8333));
+    addr.nTime = nTime;
+    return addr;
+}
+
+static CNetAddr MakeSource(int n)
+{
+    return CNetAddr(strprintf("250.%d.%d.1", (n % 16) + 1, (n / 16) % 256));
+}
+
+static bool IsOdd(const CNetAddr& addr)
+{
+    return addr.GetByte(3) % 2 == 1;
+}
+
+BOOST_AUTO_TEST_CASE(addrman_simple)
+{
+    CAddrMan addrman;
+    int64 nNow = GetAdjustedTime();
+
+    // Nothing to select from an empty table
+    BOOST_CHECK(!addrman.Select().IsValid());
+
+    CAddress addr1 = MakeAddress(1, nNow - 3600);
+    BOOST_CHECK(addrman.Add(addr1, MakeSource(1)));
+    BOOST_CHECK(!addrman.Add(addr1, MakeSource(1)));
+    BOOST_CHECK(!addrman.Add(CAddress(CService("127.0.0.1", 8333)), MakeSource(1)));
+    BOOST_CHECK_EQUAL(addrman.size(), 1);
+    BOOST_CHECK((CService)addrman.Select() == (CService)addr1);
+
+    // Once good it is in the tried table and selected from there
+    CAddress addr2 = MakeAddress(2, nNow - 3600);
+    addrman.Add(addr2, MakeSource(2));
+    addrman.Good(addr2, nNow);
+    BOOST_CHECK_EQUAL(addrman.size(), 2);
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK((CService)addrman.Select(0) == (CService)addr2);
+    for (int i = 0; i < 10; i++)
+        BOOST_CHECK((CService)addrman.Select(100) == (CService)addr1);
+
+    // 2.0.0.2 stays, 3.0.0.3 goes
+    BOOST_CHECK_EQUAL(addrman.CleanupUnsupported(IsOdd), 1);
+    BOOST_CHECK_EQUAL(addrman.size(), 1);
+    BOOST_CHECK((CService)addrman.Select() == (CService)addr1);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_many)
+{
+    CAddrMan addrman;
+    int64 nNow = GetAdjustedTime();
+
+    int nOdd = 0;
+    for (int n = 0; n < 30000; n++)
+    {
+        CAddress addr = MakeAddress(n, nNow - 3600);
+        addrman.Add(addr, MakeSource(n));
+        if (n % 10 == 0)
+            addrman.Good(addr, nNow);
+    }
+    BOOST_CHECK_EQUAL(addrman.CheckConsistency(), 0);
+
+    // The buckets bound the table
+    int nSize = addrman.size();
+    BOOST_CHECK(nSize > 1000);
+    BOOST_CHECK(nSize <= ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_NEW_BUCKET_SIZE + ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_TRIED_BUCKET_SIZE);
+
+    std::vector<CAddress> vAddr = addrman.GetAddr();
+    BOOST_CHECK_EQUAL((int)vAddr.size(), std::min(ADDRMAN_GETADDR_MAX, ADDRMAN_GETADDR_MAX_PCT * nSize / 100));
+    for (int i = 0; i < 100; i++)
+        BOOST_CHECK(addrman.Select().IsValid());
+
+    BOOST_FOREACH(const CAddress& addr, vAddr)
+        if (IsOdd(addr))
+            nOdd++;
+    BOOST_CHECK(nOdd > 0);
+    int nRemoved = addrman.CleanupUnsupported(IsOdd);
+    BOOST_CHECK(nRemoved >= nOdd);
+    BOOST_CHECK_EQUAL(addrman.size(), nSize - nRemoved);
+    BOOST_CHECK_EQUAL(addrman.CheckConsistency(), 0);
+    BOOST_FOREACH(const CAddress& addr, addrman.GetAddr())
+        BOOST_CHECK(!IsOdd(addr));
+
+    // Entries freed above are reused
+    for (int n = 0; n < 1000; n++)
+        addrman.Add(MakeAddress(n, nNow - 60), MakeSource(n + 7));
+    BOOST_CHECK_EQUAL(addrman.CheckConsistency(), 0);
+    BOOST_CHECK(addrman.size() > nSize - nRemoved);
+}
+
+BOOST_AUTO_TEST_CASE(addrman_serialize)
+{
+    CAddrMan addrman;
+    int64 nNow = GetAdjustedTime();
+    for (int n = 0; n < 5000; n++)
+    {
+        CAddress addr = MakeAddress(n, nNow - 3600);
+        addrman.Add(addr, MakeSource(n));
+        if (n % 7 == 0)
+            addrman.Good(addr, nNow);
+    }
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << addrman;
+    CDataStream ssCopy(ss);
+
+    CAddrMan addrman2;
+    ss >> addrman2;
+    BOOST_CHECK_EQUAL(addrman2.CheckConsistency(), 0);
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+
+    // Reading places every entry in the same slots, so it writes back the same
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    ss2 << addrman2;
+    BOOST_CHECK(ss2.str() == ssCopy.str());
+
+    // An old format file has its new buckets rebuilt
+    ssCopy[0] = 0;
+    CAddrMan addrman3;
+    ssCopy >> addrman3;
+    BOOST_CHECK_EQUAL(addrman3.CheckConsistency(), 0);
+    BOOST_CHECK(addrman3.size() > 0);
+    BOOST_CHECK(addrman3.size() <= addrman.size());
+
+    CAddrMan addrman4;
+    addrman4.Swap(addrman2);
+    BOOST_CHECK_EQUAL(addrman2.size(), 0);
+    BOOST_CHECK_EQUAL(addrman4.size(), addrman.size());
+    BOOST_CHECK(addrman4.Select().IsValid());
+}
+
+BOOST_AUTO_TEST_CASE(addrman_changes)
+{
+    CAddrMan addrman;
+    int64 nNow = GetAdjustedTime();
+    for (int n = 0; n < 2000; n++)
+        addrman.Add(MakeAddress(n, nNow - 3600), MakeSource(n));
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << addrman;
+    CAddrMan addrmanBase;
+    ss >> addrmanBase;
+
+    // Reading or snapshotting leaves nothing to journal
+    std::vector<CAddrChange> vChanges;
+    addrmanBase.GetChanges(vChanges);
+    BOOST_CHECK(vChanges.empty());
+    addrman.GetChanges(vChanges);
+    vChanges.clear();
+
+    // New, promoted, refreshed and removed entries
+    for (int n = 2000; n < 2500; n++)
+        addrman.Add(MakeAddress(n, nNow - 3600), MakeSource(n));
+    for (int n = 0; n < 2500; n += 9)
+        addrman.Good(MakeAddress(n, 0), nNow);
+    for (int n = 1; n < 2500; n += 13)
+        addrman.Attempt(MakeAddress(n, 0), nNow);
+    int nRemoved = addrman.CleanupUnsupported(IsOdd);
+    BOOST_CHECK(nRemoved > 0);
+
+    addrman.GetChanges(vChanges);
+    BOOST_CHECK(!vChanges.empty());
+    std::vector<CAddrChange> vAgain;
+    addrman.GetChanges(vAgain);
+    BOOST_CHECK(vAgain.empty());
+
+    // Through a stream, as peers.log would carry them
+    CDataStream ssChanges(SER_DISK, CLIENT_VERSION);
+    ssChanges << vChanges;
+    std::vector<CAddrChange> vRead;
+    ssChanges >> vRead;
+    addrmanBase.ApplyChanges(vRead);
+    BOOST_CHECK_EQUAL(addrmanBase.CheckConsistency(), 0);
+    BOOST_CHECK_EQUAL(addrmanBase.size(), addrman.size());
+
+    // Everything known here is already known there
+    BOOST_FOREACH(const CAddress& addr, addrman.GetAddr())
+        BOOST_CHECK(!addrmanBase.Add(addr, MakeSource(0)));
+    BOOST_FOREACH(const CAddress& addr, addrmanBase.GetAddr())
+        BOOST_CHECK(!IsOdd(addr));
+}
+
+BOOST_AUTO_TEST_CASE(addrman_journal)
+{
+    CAddrMan addrman;
+    int64 nNow = GetAdjustedTime();
+    for (int n = 0; n < 1000; n++)
+        addrman.Add(MakeAddress(n, nNow - 3600), MakeSource(n));
+
+    CAddrDB adb;
+    uint256 hashBase;
+    BOOST_CHECK(adb.Write(addrman, &hashBase));
+    BOOST_CHECK(adb.StartJournal(hashBase));
+    std::vector<CAddrChange> vChanges;
+    addrman.GetChanges(vChanges);
+    vChanges.clear();
+
+    for (int n = 1000; n < 1200; n++)
+        addrman.Add(MakeAddress(n, nNow - 3600), MakeSource(n));
+    addrman.GetChanges(vChanges);
+    BOOST_CHECK(adb.AppendJournal(vChanges));
+    vChanges.clear();
+    for (int n = 0; n < 1200; n += 5)
+        addrman.Good(MakeAddress(n, 0), nNow);
+    addrman.GetChanges(vChanges);
+    BOOST_CHECK(adb.AppendJournal(vChanges));
+
+    CAddrMan addrman2;
+    uint256 hashRead;
+    BOOST_CHECK(adb.Read(addrman2, &hashRead));
+    BOOST_CHECK(hashRead == hashBase);
+    BOOST_CHECK(adb.ReadJournal(addrman2, hashRead) > 200);
+    BOOST_CHECK_EQUAL(addrman2.CheckConsistency(), 0);
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+
+    // A journal for another peers.dat is ignored
+    CAddrMan addrman3;
+    BOOST_CHECK_EQUAL(adb.ReadJournal(addrman3, GetRandHash()), -1);
+    BOOST_CHECK_EQUAL(addrman3.size(), 0);
+
+    // A torn batch at the end is dropped and the rest still replays
+    boost::filesystem::path pathJournal = GetDataDir() / "peers.log";
+    boost::uintmax_t nSize = boost::filesystem::file_size(pathJournal);
+    boost::filesystem::resize_file(pathJournal, nSize - 10);
+    CAddrMan addrman4;
+    adb.Read(addrman4);
+    BOOST_CHECK(adb.ReadJournal(addrman4, hashBase) > 0);
+    BOOST_CHECK(boost::filesystem::file_size(pathJournal) < nSize - 10);
+    BOOST_CHECK_EQUAL(addrman4.CheckConsistency(), 0);
+    BOOST_CHECK(addrman4.size() > 1000);
+
+    adb.EraseJournal();
+    BOOST_CHECK(!adb.AppendJournal(vChanges));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,164 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "arith_uint256.h"
+#include "bignum.h"
+#include "kernel.h"
+#include "main.h"
+#include "test/insecurerand.h"
+
+// The consensus code used to do all of this with CBigNum, so every check
+// here compares against the CBigNum expression it replaced.
+
+BOOST_AUTO_TEST_SUITE(arith_uint256_tests)
+
+static CInsecureRand insecureRand(0x2545f4914f6cdd1dULL);
+
+// Random value with a random number of leading zero bits
+static arith_uint256 RandArith256()
+{
+    arith_uint256 a;
+    for (int i = 0; i < arith_uint256::WIDTH; i++)
+        a.pn[i] = (unsigned int)insecureRand.Rand64();
+    return a >> (insecureRand.Rand64() % 257);
+}
+
+static CBigNum ToBigNum(const arith_uint256& a)
+{
+    return CBigNum(ArithToUint256(a));
+}
+
+static const CBigNum bnTwo256 = CBigNum(1) << 256;
+
+// Magnitudes of every exponent with mantissas spread over the whole 24 bits,
+// sign included, plus the corner cases
+static std::vector<unsigned int> CompactSamples(int nMaxSize, unsigned int nStride)
+{
+    std::vector<unsigned int> vCompact;
+    static const unsigned int pEdges[] = { 0x000000, 0x000001, 0x00007f, 0x000080, 0x0000ff, 0x007fff, 0x008000,
+                                           0x7fffff, 0x800000, 0x800001, 0x80ffff, 0xffffff };
+    for (int nSize = 0; nSize <= nMaxSize; nSize++)
+    {
+        for (unsigned int nWord = 0; nWord <= 0xffffff; nWord += nStride)
+            vCompact.push_back((nSize << 24) | nWord);
+        for (unsigned int i = 0; i < sizeof(pEdges) / sizeof(pEdges[0]); i++)
+            vCompact.push_back((nSize << 24) | pEdges[i]);
+    }
+    return vCompact;
+}
+
+BOOST_AUTO_TEST_CASE(compact_matches_bignum)
+{
+    std::vector<unsigned int> vCompact = CompactSamples(255, 0x1001);
+    BOOST_FOREACH(unsigned int nCompact, vCompact)
+    {
+        CBigNum bn;
+        bn.SetCompact(nCompact);
+        bool fNegative, fOverflow;
+        arith_uint256 a;
+        a.SetCompact(nCompact, &fNegative, &fOverflow);
+
+        CBigNum bnAbs = bn < 0 ? -bn : bn;
+        BOOST_CHECK_EQUAL(fNegative, bn < 0);
+        BOOST_CHECK_EQUAL(fOverflow, bnAbs >= bnTwo256);
+        if (fOverflow)
+            continue;
+        BOOST_CHECK_MESSAGE(ToBigNum(a) == bnAbs, strprintf("SetCompact(0x%08x)", nCompact));
+        BOOST_CHECK_MESSAGE(a.GetCompact(fNegative) == bn.GetCompact(), strprintf("GetCompact(0x%08x)", nCompact));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(arithmetic_matches_bignum)
+{
+    for (int i = 0; i < 20000; i++)
+    {
+        arith_uint256 a = RandArith256();
+        arith_uint256 b = RandArith256();
+        unsigned int nShift = insecureRand.Rand64() % 300;
+        unsigned int n32 = (unsigned int)insecureRand.Rand64();
+        CBigNum bnA = ToBigNum(a), bnB = ToBigNum(b);
+
+        BOOST_CHECK(ToBigNum(a + b) == (bnA + bnB) % bnTwo256);
+        BOOST_CHECK(ToBigNum(a - b) == (bnA - bnB + bnTwo256) % bnTwo256);
+        BOOST_CHECK(ToBigNum(a * b) == (bnA * bnB) % bnTwo256);
+        BOOST_CHECK(ToBigNum(a * n32) == (bnA * CBigNum(n32)) % bnTwo256);
+        BOOST_CHECK(ToBigNum(a << nShift) == (bnA << nShift) % bnTwo256);
+        BOOST_CHECK(ToBigNum(a >> nShift) == bnA >> nShift);
+        BOOST_CHECK_EQUAL(a < b, bnA < bnB);
+        BOOST_CHECK_EQUAL(a == b, bnA == bnB);
+        if (b != 0)
+            BOOST_CHECK(ToBigNum(a / b) == bnA / bnB);
+    }
+    BOOST_CHECK_THROW(arith_uint256(1) / arith_uint256(0), arith_uint_error);
+}
+
+BOOST_AUTO_TEST_CASE(block_trust_matches_bignum)
+{
+    std::vector<unsigned int> vCompact = CompactSamples(40, 0x3fff);
+    for (int i = 0; i < 4096; i++)
+        vCompact.push_back((unsigned int)insecureRand.Rand64());
+
+    BOOST_FOREACH(unsigned int nCompact, vCompact)
+    {
+        for (int nProofOfStake = 0; nProofOfStake < 2; nProofOfStake++)
+        {
+            CBlockIndex index;
+            index.nBits = nCompact;
+            if (nProofOfStake)
+                index.SetProofOfStake();
+
+            CBigNum bnTarget;
+            bnTarget.SetCompact(nCompact);
+            CBigNum bnTrust = bnTarget <= 0 ? CBigNum(0) : (nProofOfStake ? (CBigNum(1)<<256) / (bnTarget+1) : CBigNum(1));
+            BOOST_CHECK_MESSAGE(ToBigNum(index.GetBlockTrust()) == bnTrust, strprintf("GetBlockTrust(0x%08x, %d)", nCompact, nProofOfStake));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_target_matches_bignum)
+{
+    for (int i = 0; i < 200000; i++)
+    {
+        // Mostly realistic proof-of-stake targets, amounts and ages, but also
+        // the garbage a peer can send before nBits is checked
+        unsigned int nBits = (unsigned int)insecureRand.Rand64();
+        if (i % 4 != 0)
+            nBits = ((0x1a + insecureRand.Rand64() % 6) << 24) | (nBits & 0x7fffff);
+        int64 nValueIn = insecureRand.Rand64() % MAX_MONEY;
+        if (i % 8 == 0)
+            nValueIn = (int64)(insecureRand.Rand64() >> 1) - (int64)(insecureRand.Rand64() >> 1);
+        int64 nTimeWeight = insecureRand.Rand64() % (90 * 24 * 60 * 60);
+        if (i % 5 == 0)
+            nTimeWeight = (int64)(insecureRand.Rand64() % (1ULL << 34)) - (1LL << 33);
+
+        CBigNum bnTargetPerCoinDay;
+        bnTargetPerCoinDay.SetCompact(nBits);
+        CBigNum bnCoinDayWeight = CBigNum(nValueIn) * nTimeWeight / COIN / (24 * 60 * 60);
+        CBigNum bnTarget = bnCoinDayWeight * bnTargetPerCoinDay;
+
+        // A random hash, and when the target fits in a hash, hashes on and
+        // around the boundary
+        std::vector<CBigNum> vHash;
+        vHash.push_back(ToBigNum(RandArith256()));
+        vHash.push_back(0);
+        if (bnTarget >= 0 && bnTarget < bnTwo256)
+        {
+            vHash.push_back(bnTarget);
+            if (bnTarget > 0)
+                vHash.push_back(bnTarget - 1);
+            if (bnTarget + 1 < bnTwo256)
+                vHash.push_back(bnTarget + 1);
+        }
+
+        BOOST_FOREACH(CBigNum& bnHash, vHash)
+        {
+            bool fExpected = !(bnHash > bnTarget);
+            BOOST_CHECK_MESSAGE(CheckStakeKernelTarget(bnHash.getuint256(), nBits, nValueIn, nTimeWeight) == fExpected,
+                strprintf("CheckStakeKernelTarget(%s, 0x%08x, %" PRI64d ", %" PRI64d ")", bnHash.GetHex().c_str(), nBits, nValueIn, nTimeWeight));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "bandwidth.h"
+#include "net.h"
+
+BOOST_AUTO_TEST_SUITE(bandwidth_tests)
+
+BOOST_AUTO_TEST_CASE(bandwidth_token_bucket)
+{
+    CTokenBucket bucket;
+    BOOST_CHECK(!bucket.IsLimited());
+    BOOST_CHECK(bucket.Available(1000000) > 1000000000);
+
+    // Starts full, then refills at the rate
+    bucket.SetRate(1000, 2000);
+    int64 nNow = 1000000;
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), 2000);
+    bucket.Consume(2000);
+    BOOST_CHECK_EQUAL(bucket.Available(nNow), 0);
+    BOOST_CHECK_EQUAL(bucket.Available(nNow + 500000), 500);
+
+    // Small steps add up
+    for (int i = 1; i <= 100; i++)
+        bucket.Available(nNow + 500000 + i * 999);
+    BOOST_CHECK_EQUAL(bucket.Available(nNow + 600000), 600);
+
+    // and it never holds more than the burst
+    BOOST_CHECK_EQUAL(bucket.Available(nNow + 60000000), 2000);
+
+    // Overspending is paid back before anything more can be sent
+    bucket.Consume(3000);
+    BOOST_CHECK_EQUAL(bucket.Available(nNow + 60000000), 0);
+    BOOST_CHECK_EQUAL(bucket.Available(nNow + 62000000), 1000);
+}
+
+BOOST_AUTO_TEST_CASE(bandwidth_upload_target)
+{
+    int64 nNow = 1000000;
+    CUploadTarget unlimited;
+    unlimited.Add(1 << 30, nNow);
+    BOOST_CHECK(!unlimited.IsReached(nNow));
+
+    CUploadTarget target;
+    target.SetTarget(1000);
+    target.Add(600, nNow);
+    BOOST_CHECK(!target.IsReached(nNow));
+    BOOST_CHECK_EQUAL(target.GetBytesLeft(nNow + 10), 400U);
+    BOOST_CHECK_EQUAL(target.GetTimeLeft(nNow + 10), UPLOAD_TARGET_TIMEFRAME - 10);
+    target.Add(600, nNow + 20);
+    BOOST_CHECK(target.IsReached(nNow + 20));
+    BOOST_CHECK_EQUAL(target.GetBytesLeft(nNow + 20), 0U);
+
+    // A new cycle starts from nothing
+    BOOST_CHECK(!target.IsReached(nNow + UPLOAD_TARGET_TIMEFRAME));
+    BOOST_CHECK_EQUAL(target.GetBytesLeft(nNow + UPLOAD_TARGET_TIMEFRAME), 1000U);
+}
+
+BOOST_AUTO_TEST_CASE(bandwidth_send_priority)
+{
+    CNode node(INVALID_SOCKET, CAddress(CService("1.2.3.4", 8333)), "", true);
+    std::vector<unsigned char> vchBlock(5000, 0x42);
+    node.PushBulkMessage("block", vchBlock);
+    node.PushMessage("ping", (uint64)1);
+
+    // Bulk messages wait in their own queue, whole
+    BOOST_CHECK_EQUAL(node.vSendBulk.size(), CMessageHeader::HEADER_SIZE + ::GetSerializeSize(vchBlock, SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK_EQUAL(node.vSend.size(), CMessageHeader::HEADER_SIZE + sizeof(uint64));
+    BOOST_CHECK_EQUAL(node.GetSendQueued(), node.vSend.size() + node.vSendBulk.size());
+    BOOST_CHECK(std::string(&node.vSendBulk[CMessageHeader::MESSAGE_START_SIZE]) == "block");
+
+    // Nothing is sent while there's no bandwidth for it
+    size_t nQueued = node.GetSendQueued();
+    bool fBulk;
+    BOOST_CHECK_EQUAL(node.SocketSendData(0, 0, fBulk), 0);
+    BOOST_CHECK_EQUAL(node.GetSendQueued(), nQueued);
+}
+
+#ifndef WIN32
+// Read what the node sent to the other end of its socket
+static std::string ReadSent(SOCKET hSocket, size_t nSize)
+{
+    std::string str(nSize, '\0');
+    size_t nRead = 0;
+    while (nRead < nSize)
+    {
+        int n = recv(hSocket, &str[nRead], nSize - nRead, 0);
+        if (n <= 0)
+            break;
+        nRead += n;
+    }
+    str.resize(nRead);
+    return str;
+}
+
+BOOST_AUTO_TEST_CASE(bandwidth_send_mixed)
+{
+    int hSocket[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, hSocket) == 0);
+    CNode node(hSocket[0], CAddress(CService("1.2.3.4", 8333)), "", true);
+    std::vector<unsigned char> vchBlock(5000, 0x42);
+    node.PushBulkMessage("block", vchBlock);
+    node.PushMessage("ping", (uint64)1);
+    const int64 nBlockSize = node.vSendBulk.size();
+    const int64 nPingSize = node.vSend.size();
+    int64 nNow = GetTimeMicros();
+
+    // High priority data goes ahead of the bulk queued before it, and
+    // only that counts against the bulk allowance
+    BOOST_CHECK_EQUAL(node.GetSendableHigh(nNow), nPingSize);
+    bool fBulk = true;
+    BOOST_CHECK_EQUAL(node.SocketSendData(1000, 1000, fBulk), nPingSize);
+    BOOST_CHECK(!fBulk);
+    std::string strSent = ReadSent(hSocket[1], nPingSize);
+    BOOST_CHECK(std::string(&strSent[CMessageHeader::MESSAGE_START_SIZE]) == "ping");
+    BOOST_CHECK(node.vSend.empty());
+
+    // Bulk data goes out no faster than its allowance
+    BOOST_CHECK_EQUAL(node.SocketSendData(1000, 100, fBulk), 100);
+    BOOST_CHECK(fBulk);
+    BOOST_CHECK_EQUAL(node.nSendBulkLeft, nBlockSize - 100);
+    strSent = ReadSent(hSocket[1], 100);
+    BOOST_CHECK(std::string(&strSent[CMessageHeader::MESSAGE_START_SIZE]) == "block");
+
+    // A bulk message that has started going out is finished first
+    node.PushMessage("ping", (uint64)2);
+    BOOST_CHECK_EQUAL(node.GetSendableHigh(nNow), 0);
+    int64 nBulkSent = 100;
+    while (node.nSendBulkLeft > 0)
+    {
+        int nBytes = node.SocketSendData(1000, 1000, fBulk);
+        BOOST_REQUIRE(nBytes > 0);
+        BOOST_CHECK(fBulk);
+        nBulkSent += nBytes;
+    }
+    BOOST_CHECK_EQUAL(nBulkSent, nBlockSize);
+    BOOST_CHECK(node.vSendBulk.empty());
+    BOOST_CHECK_EQUAL(ReadSent(hSocket[1], nBlockSize - 100).size(), (size_t)(nBlockSize - 100));
+
+    // No more than the peer's own rate lets through
+    node.bucketSend.SetRate(10, 10);
+    BOOST_CHECK_EQUAL(node.GetSendableHigh(nNow), 10);
+    BOOST_CHECK_EQUAL(node.SocketSendData(1000, 1000, fBulk), 10);
+    BOOST_CHECK(!fBulk);
+    BOOST_CHECK_EQUAL(node.SocketSendData(1000, 1000, fBulk), 0);
+    BOOST_CHECK_EQUAL((int64)node.vSend.size(), nPingSize - 10);
+    BOOST_CHECK_EQUAL(ReadSent(hSocket[1], 10).size(), 10U);
+
+    // Every byte written is counted
+    BOOST_CHECK_EQUAL(node.nSendBytes, (uint64)(2 * nPingSize + nBlockSize - (nPingSize - 10)));
+    close(hSocket[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
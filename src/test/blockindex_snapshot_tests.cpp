@@ -0,0 +1,158 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "db.h"
+#include "main.h"
+#include "test/insecurerand.h"
+
+#include <boost/filesystem/fstream.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockindex_snapshot_tests)
+
+static CInsecureRand insecureRand(0x6a09e667f3bcc908ULL);
+
+// A main chain with a side branch, every entry with the fields the snapshot
+// has to carry filled with something
+static void BuildChain(std::vector<CBlockIndex*>& vIndex)
+{
+    CBlockIndex* pindexPrev = NULL;
+    CBlockIndex* pindexFork = NULL;
+    for (int n = 0; n < 1200; n++)
+    {
+        if (n == 1000)
+            pindexPrev = pindexFork;
+
+        CBlock block;
+        block.nVersion = 1 + insecureRand.Rand64() % 4;
+        block.nTime = 1400000000 + n * 600;
+        block.nBits = (unsigned int)insecureRand.Rand64();
+        block.nNonce = (unsigned int)insecureRand.Rand64();
+        block.hashMerkleRoot = insecureRand.Rand64();
+        block.hashPrevBlock = pindexPrev ? pindexPrev->GetBlockHash() : 0;
+
+        CBlockIndex* pindex = mapBlockIndex.NewIndex(1 + n / 500, (unsigned int)insecureRand.Rand64(), block);
+        CBlockIndexMap::iterator mi = mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first;
+        pindex->phashBlock = &((*mi).first);
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = pindexPrev ? pindexPrev->nHeight + 1 : 0;
+        pindex->nMint = insecureRand.Rand64() % MAX_MONEY;
+        pindex->nMoneySupply = insecureRand.Rand64() % MAX_MONEY;
+        pindex->SetStakeModifier(insecureRand.Rand64(), insecureRand.Rand64() % 2);
+        if (n % 3 == 0)
+        {
+            pindex->SetProofOfStake();
+            pindex->prevoutStake = COutPoint(insecureRand.Rand64(), insecureRand.Rand64() % 10);
+            pindex->nStakeTime = block.nTime;
+            pindex->hashProofOfStake = insecureRand.Rand64();
+        }
+        pindex->bnChainTrust = (pindexPrev ? pindexPrev->bnChainTrust : 0) + pindex->GetBlockTrust();
+        pindex->nStakeModifierChecksum = (unsigned int)insecureRand.Rand64();
+        if (pindexPrev && n < 1000)
+            pindexPrev->pnext = pindex;
+        if (n == 900)
+            pindexFork = pindex;
+        vIndex.push_back(pindex);
+        pindexPrev = pindex;
+    }
+}
+
+static void CheckSameIndex(const CBlockIndexMap& mapExpected)
+{
+    BOOST_REQUIRE_EQUAL(mapBlockIndex.size(), mapExpected.size());
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapExpected)
+    {
+        CBlockIndexMap::const_iterator mi = mapBlockIndex.find(item.first);
+        BOOST_REQUIRE(mi != mapBlockIndex.end());
+        const CBlockIndex* a = (*mi).second;
+        const CBlockIndex* b = item.second;
+        BOOST_CHECK(a->GetBlockHash() == b->GetBlockHash());
+        BOOST_CHECK(a->phashBlock == &(*mi).first);
+        BOOST_CHECK((a->pprev ? a->pprev->GetBlockHash() : 0) == (b->pprev ? b->pprev->GetBlockHash() : 0));
+        BOOST_CHECK((a->pnext ? a->pnext->GetBlockHash() : 0) == (b->pnext ? b->pnext->GetBlockHash() : 0));
+        BOOST_CHECK_EQUAL(a->nFile, b->nFile);
+        BOOST_CHECK_EQUAL(a->nBlockPos, b->nBlockPos);
+        BOOST_CHECK_EQUAL(a->nHeight, b->nHeight);
+        BOOST_CHECK_EQUAL(a->nMint, b->nMint);
+        BOOST_CHECK_EQUAL(a->nMoneySupply, b->nMoneySupply);
+        BOOST_CHECK_EQUAL(a->nFlags, b->nFlags);
+        BOOST_CHECK_EQUAL(a->nStakeModifier, b->nStakeModifier);
+        BOOST_CHECK(a->prevoutStake == b->prevoutStake);
+        BOOST_CHECK_EQUAL(a->nStakeTime, b->nStakeTime);
+        BOOST_CHECK(a->hashProofOfStake == b->hashProofOfStake);
+        BOOST_CHECK_EQUAL(a->nVersion, b->nVersion);
+        BOOST_CHECK(a->hashMerkleRoot == b->hashMerkleRoot);
+        BOOST_CHECK_EQUAL(a->nTime, b->nTime);
+        BOOST_CHECK_EQUAL(a->nBits, b->nBits);
+        BOOST_CHECK_EQUAL(a->nNonce, b->nNonce);
+        BOOST_CHECK(a->bnChainTrust == b->bnChainTrust);
+        BOOST_CHECK_EQUAL(a->nStakeModifierChecksum, b->nStakeModifierChecksum);
+    }
+}
+
+static void ClearIndex()
+{
+    mapBlockIndex.clear();
+    setStakeSeen.clear();
+    pindexGenesisBlock = NULL;
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_round_trip)
+{
+    // No stake modifier checkpoints to match on testnet
+    fTestNet = true;
+
+    std::vector<CBlockIndex*> vIndex;
+    BuildChain(vIndex);
+    pindexBest = vIndex[999];
+    hashBestChain = pindexBest->GetBlockHash();
+
+    CBlockIndexSnapshot snapshot;
+    BOOST_REQUIRE(snapshot.Write());
+    boost::filesystem::path pathSnapshot = GetDataDir() / "blkindex.snapshot";
+    BOOST_REQUIRE(boost::filesystem::exists(pathSnapshot));
+
+    // Read refuses to add to an index that is already loaded
+    BOOST_CHECK(!snapshot.Read(hashBestChain));
+
+    CBlockIndexMap mapExpected;
+    mapExpected.swap(mapBlockIndex);
+
+    // A snapshot of another best chain is stale and loads nothing
+    BOOST_CHECK(!snapshot.Read(vIndex[998]->GetBlockHash()));
+    BOOST_CHECK(mapBlockIndex.empty());
+
+    BOOST_CHECK(snapshot.Read(hashBestChain));
+    CheckSameIndex(mapExpected);
+    unsigned int nStake = 0;
+    BOOST_FOREACH(CBlockIndex* pindex, vIndex)
+        nStake += pindex->IsProofOfStake();
+    BOOST_CHECK_EQUAL(setStakeSeen.size(), nStake);
+    ClearIndex();
+
+    // Any flipped byte fails the checksum
+    std::vector<char> vchFile(boost::filesystem::file_size(pathSnapshot));
+    {
+        boost::filesystem::ifstream filein(pathSnapshot, std::ios_base::in | std::ios_base::binary);
+        filein.read(&vchFile[0], vchFile.size());
+    }
+    vchFile[vchFile.size() / 2] ^= 0x20;
+    {
+        boost::filesystem::ofstream fileout(pathSnapshot, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        fileout.write(&vchFile[0], vchFile.size());
+    }
+    BOOST_CHECK(!snapshot.Read(hashBestChain));
+    BOOST_CHECK(mapBlockIndex.empty());
+
+    snapshot.Remove();
+    BOOST_CHECK(!boost::filesystem::exists(pathSnapshot));
+
+    mapExpected.swap(mapBlockIndex);
+    ClearIndex();
+    pindexBest = NULL;
+    hashBestChain = 0;
+    fTestNet = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "blockindexmap.h"
+#include "main.h"
+#include "test/insecurerand.h"
+
+BOOST_AUTO_TEST_SUITE(blockindexmap_tests)
+
+static CInsecureRand insecureRand(0xbb67ae8584caa73bULL);
+
+// Hashes from a small pool, so inserts collide with existing keys and erases
+// hit, and with shared low 64 bits, so the full key compare is exercised
+static uint256 RandKey()
+{
+    uint256 hash = insecureRand.Rand64() % 5000;
+    if (insecureRand.Rand64() % 4 == 0)
+        hash |= uint256(insecureRand.Rand64() % 3) << 192;
+    return hash;
+}
+
+BOOST_AUTO_TEST_CASE(matches_std_map)
+{
+    CBlockIndexMap map;
+    std::map<uint256, CBlockIndex*> mapRef;
+    std::map<uint256, const uint256*> mapKeyAddr;
+
+    for (int i = 0; i < 200000; i++)
+    {
+        uint256 hash = RandKey();
+        switch (insecureRand.Rand64() % 5)
+        {
+        case 0:
+        case 1:
+        {
+            CBlockIndex* pindex = (CBlockIndex*)(size_t)(insecureRand.Rand64() | 1);
+            std::pair<CBlockIndexMap::iterator, bool> ret = map.insert(std::make_pair(hash, pindex));
+            std::pair<std::map<uint256, CBlockIndex*>::iterator, bool> retRef = mapRef.insert(std::make_pair(hash, pindex));
+            BOOST_CHECK_EQUAL(ret.second, retRef.second);
+            BOOST_CHECK(ret.first->first == hash);
+            BOOST_CHECK(ret.first->second == retRef.first->second);
+            if (ret.second)
+                mapKeyAddr[hash] = &ret.first->first;
+            break;
+        }
+        case 2:
+            BOOST_CHECK_EQUAL(map.erase(hash), mapRef.erase(hash));
+            mapKeyAddr.erase(hash);
+            break;
+        case 3:
+            BOOST_CHECK(map[hash] == mapRef[hash]);
+            if (!mapKeyAddr.count(hash))
+                mapKeyAddr[hash] = &map.find(hash)->first;
+            break;
+        default:
+        {
+            BOOST_CHECK_EQUAL(map.count(hash), mapRef.count(hash));
+            CBlockIndexMap::iterator mi = map.find(hash);
+            BOOST_CHECK_EQUAL(mi != map.end(), mapRef.count(hash) != 0);
+            if (mi != map.end())
+            {
+                BOOST_CHECK(mi->second == mapRef[hash]);
+                // Keys never move while their entry is in the map
+                BOOST_CHECK(&mi->first == mapKeyAddr[hash]);
+            }
+        }
+        }
+    }
+
+    BOOST_CHECK_EQUAL(map.size(), mapRef.size());
+    size_t nIterated = 0;
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, map)
+    {
+        BOOST_CHECK(mapRef.count(item.first) && mapRef[item.first] == item.second);
+        nIterated++;
+    }
+    BOOST_CHECK_EQUAL(nIterated, mapRef.size());
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+    BOOST_CHECK(map.find(RandKey()) == map.end());
+}
+
+BOOST_AUTO_TEST_CASE(arena_entries)
+{
+    CBlockIndexMap map;
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < 10000; i++)
+    {
+        CBlock block;
+        block.nNonce = i;
+        CBlockIndex* pindex = map.NewIndex(1, i, block);
+        CBlockIndexMap::iterator mi = map.insert(std::make_pair(block.GetHash(), pindex)).first;
+        pindex->phashBlock = &mi->first;
+        vIndex.push_back(pindex);
+    }
+    // Entries and keys stay where they were while the table grows
+    for (int i = 0; i < 10000; i++)
+    {
+        BOOST_CHECK_EQUAL(vIndex[i]->nBlockPos, (unsigned int)i);
+        BOOST_CHECK(map[vIndex[i]->GetBlockHash()] == vIndex[i]);
+    }
+    BOOST_CHECK(map.DynamicMemoryUsage() >= 10000 * sizeof(CBlockIndex));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
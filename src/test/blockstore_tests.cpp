@@ -0,0 +1,268 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "db.h"
+#include "main.h"
+#include "test/txfactory.h"
+
+BOOST_AUTO_TEST_SUITE(blockstore_tests)
+
+BOOST_AUTO_TEST_CASE(blockstore_raw_block)
+{
+    bool fMmapSaved = fBlockFileMmap;
+    CBlock block1 = MakeTestBlock(3), block2 = MakeTestBlock(50);
+    unsigned int nFile1, nPos1, nFile2, nPos2;
+    BOOST_CHECK(block1.WriteToDisk(nFile1, nPos1));
+    BOOST_CHECK(block2.WriteToDisk(nFile2, nPos2));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block2;
+
+    // The same bytes the block serializes to for the network, mapped or not
+    for (int nMmap = 0; nMmap < 2; nMmap++)
+    {
+        fBlockFileMmap = nMmap;
+        CRawBlock rawblock;
+        BOOST_CHECK(rawblock.Read(nFile2, nPos2, MAX_BLOCK_SIZE));
+        BOOST_CHECK_EQUAL(rawblock.nSize, ss.size());
+        BOOST_CHECK(std::string(rawblock.pbegin, rawblock.nSize) == ss.str());
+        BOOST_CHECK(Hash(rawblock.pbegin, rawblock.pbegin + BLOCK_HEADER_SIZE) == block2.GetHash());
+
+        CRawBlock rawblock1;
+        BOOST_CHECK(rawblock1.Read(nFile1, nPos1, MAX_BLOCK_SIZE));
+        BOOST_CHECK(Hash(rawblock1.pbegin, rawblock1.pbegin + BLOCK_HEADER_SIZE) == block1.GetHash());
+
+        // Not a block position, or bigger than allowed
+        BOOST_CHECK(!rawblock.Read(nFile2, nPos2 + 1, MAX_BLOCK_SIZE));
+        BOOST_CHECK(!rawblock.Read(nFile2, nPos2, ss.size() - 1));
+        BOOST_CHECK(!rawblock.Read(nFile2, 0, MAX_BLOCK_SIZE));
+    }
+    CloseBlockFileViews();
+    fBlockFileMmap = fMmapSaved;
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_preallocate)
+{
+    CBlock block1 = MakeTestBlock(2), block2 = MakeTestBlock(4), block3 = MakeTestBlock(8);
+    unsigned int nFile1, nPos1, nFile2, nPos2, nFile3, nPos3;
+    BOOST_CHECK(block1.WriteToDisk(nFile1, nPos1));
+    unsigned int nSize1 = ::GetSerializeSize(block1, SER_DISK, CLIENT_VERSION);
+
+    // Closing gives back the space allocated past the last block
+    CloseBlockFile();
+    boost::filesystem::path path = BlockFilePath(nFile1);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nPos1 + nSize1);
+
+    // Picks up after the last block, not at the end of the file
+    BOOST_CHECK(block2.WriteToDisk(nFile2, nPos2));
+    BOOST_CHECK_EQUAL(nFile2, nFile1);
+    BOOST_CHECK_EQUAL(nPos2, nPos1 + nSize1 + 8);
+    BOOST_CHECK(boost::filesystem::file_size(path) >= nPos2 + ::GetSerializeSize(block2, SER_DISK, CLIENT_VERSION));
+
+    // A tail of zeros left behind by a crash is written over
+    CloseBlockFile();
+    unsigned int nEnd = boost::filesystem::file_size(path);
+    FILE* file = OpenBlockFile(nFile1, 0, "rb+");
+    BOOST_REQUIRE(file);
+    AllocateFileRange(file, nEnd, 100000);
+    fclose(file);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nEnd + 100000);
+    BOOST_CHECK(block3.WriteToDisk(nFile3, nPos3));
+    BOOST_CHECK_EQUAL(nFile3, nFile1);
+    BOOST_CHECK_EQUAL(nPos3, nEnd + 8);
+
+    CRawBlock rawblock2, rawblock3;
+    BOOST_CHECK(rawblock2.Read(nFile2, nPos2, MAX_BLOCK_SIZE));
+    BOOST_CHECK(Hash(rawblock2.pbegin, rawblock2.pbegin + BLOCK_HEADER_SIZE) == block2.GetHash());
+    BOOST_CHECK(rawblock3.Read(nFile3, nPos3, MAX_BLOCK_SIZE));
+    BOOST_CHECK(Hash(rawblock3.pbegin, rawblock3.pbegin + BLOCK_HEADER_SIZE) == block3.GetHash());
+    CloseBlockFile();
+    CloseBlockFileViews();
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_indexed_end)
+{
+    CBlock block1 = MakeTestBlock(2), block2 = MakeTestBlock(4), block3 = MakeTestBlock(8);
+    unsigned int nFile1, nPos1, nFile2, nPos2, nFile3, nPos3;
+    BOOST_CHECK(block1.WriteToDisk(nFile1, nPos1));
+    BOOST_CHECK(block2.WriteToDisk(nFile2, nPos2));
+    BOOST_REQUIRE_EQUAL(nFile2, nFile1);
+    CloseBlockFile();
+    unsigned int nEnd = boost::filesystem::file_size(BlockFilePath(nFile1));
+
+    // A damaged record in the middle doesn't stop the walk short of an
+    // indexed block
+    FILE* file = OpenBlockFile(nFile1, nPos1 - 8, "rb+");
+    BOOST_REQUIRE(file);
+    fputc(0, file);
+    fclose(file);
+    SetLastIndexedBlock(nFile1, nPos2);
+    BOOST_CHECK(block3.WriteToDisk(nFile3, nPos3));
+    BOOST_CHECK_EQUAL(nFile3, nFile1);
+    BOOST_CHECK_EQUAL(nPos3, nEnd + 8);
+
+    CRawBlock rawblock2;
+    BOOST_CHECK(rawblock2.Read(nFile2, nPos2, MAX_BLOCK_SIZE));
+    BOOST_CHECK(Hash(rawblock2.pbegin, rawblock2.pbegin + BLOCK_HEADER_SIZE) == block2.GetHash());
+    CloseBlockFile();
+    CloseBlockFileViews();
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_undo)
+{
+    CBlockUndo undo;
+    undo.hashBlock = GetRandHash();
+    for (int i = 0; i < 5; i++)
+    {
+        CTxIndex txindex(CDiskTxPos(1, 1000 * i, 1000 * i + 100), i + 2);
+        txindex.vSpent[i] = CDiskTxPos(2, 3, 4);
+        undo.vPrevTxIndex.push_back(std::make_pair(GetRandHash(), txindex));
+    }
+    unsigned int nFile, nPos, nFileEmpty, nPosEmpty;
+    BOOST_CHECK(undo.WriteToDisk(nFile, nPos));
+    CBlockUndo undoEmpty;
+    undoEmpty.hashBlock = GetRandHash();
+    BOOST_CHECK(undoEmpty.WriteToDisk(nFileEmpty, nPosEmpty));
+    CloseBlockFile();
+
+    CBlockUndo undoRead;
+    BOOST_CHECK(undoRead.ReadFromDisk(nFile, nPos, undo.hashBlock));
+    BOOST_CHECK(undoRead.vPrevTxIndex == undo.vPrevTxIndex);
+    BOOST_CHECK(undoRead.ReadFromDisk(nFileEmpty, nPosEmpty, undoEmpty.hashBlock));
+    BOOST_CHECK(undoRead.vPrevTxIndex.empty());
+
+    // Undo data of another block, or not at a record
+    BOOST_CHECK(!undoRead.ReadFromDisk(nFile, nPos, undoEmpty.hashBlock));
+    BOOST_CHECK(!undoRead.ReadFromDisk(nFile, nPos + 1, undo.hashBlock));
+
+    // A damaged record fails its checksum
+    FILE* file = fopen(UndoFilePath(nFile).string().c_str(), "rb+");
+    BOOST_REQUIRE(file);
+    fseek(file, nPos + 40, SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, nPos + 40, SEEK_SET);
+    fputc(ch ^ 1, file);
+    fclose(file);
+    BOOST_CHECK(!undoRead.ReadFromDisk(nFile, nPos, undo.hashBlock));
+    BOOST_CHECK(undoRead.ReadFromDisk(nFileEmpty, nPosEmpty, undoEmpty.hashBlock));
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_undo_indexed_end)
+{
+    if (!bitdb.IsMock())
+        bitdb.MakeMock();
+    CTxDB txdb("cr+");
+
+    CBlockUndo undo1, undo2, undo3;
+    undo1.hashBlock = GetRandHash();
+    undo2.hashBlock = GetRandHash();
+    undo3.hashBlock = GetRandHash();
+    undo2.vPrevTxIndex.push_back(std::make_pair(GetRandHash(), CTxIndex(CDiskTxPos(1, 100, 200), 2)));
+    unsigned int nFile1, nPos1, nFile2, nPos2, nFile3, nPos3;
+    BOOST_CHECK(undo1.WriteToDisk(nFile1, nPos1));
+    BOOST_CHECK(txdb.WriteBlockUndoPos(undo1.hashBlock, nFile1, nPos1));
+    BOOST_CHECK(undo2.WriteToDisk(nFile2, nPos2));
+    BOOST_CHECK(txdb.WriteBlockUndoPos(undo2.hashBlock, nFile2, nPos2));
+    BOOST_REQUIRE_EQUAL(nFile2, nFile1);
+    CloseBlockFile();
+    unsigned int nEnd = boost::filesystem::file_size(UndoFilePath(nFile1));
+
+    // The index keeps the last undo record of the file
+    std::map<unsigned int, unsigned int> mapLastPos;
+    BOOST_CHECK(txdb.ReadLastUndoPos(mapLastPos));
+    BOOST_CHECK(mapLastPos[nFile1] == nPos2);
+
+    // A damaged record in the middle doesn't stop the walk short of
+    // indexed undo data
+    FILE* file = fopen(UndoFilePath(nFile1).string().c_str(), "rb+");
+    BOOST_REQUIRE(file);
+    fseek(file, nPos1 - 8, SEEK_SET);
+    fputc(0, file);
+    fclose(file);
+    SetLastIndexedUndo(nFile1, mapLastPos[nFile1]);
+    BOOST_CHECK(undo3.WriteToDisk(nFile3, nPos3));
+    BOOST_CHECK_EQUAL(nFile3, nFile1);
+    BOOST_CHECK_EQUAL(nPos3, nEnd + 8);
+
+    CBlockUndo undoRead;
+    BOOST_CHECK(undoRead.ReadFromDisk(nFile2, nPos2, undo2.hashBlock));
+    BOOST_CHECK(undoRead.vPrevTxIndex == undo2.vPrevTxIndex);
+    CloseBlockFile();
+}
+
+// The index entries of prev, then of the block's transactions, empty for
+// those not in the index
+static std::vector<CTxIndex> ReadIndexes(CTxDB& txdb, const uint256& hashPrev, const CBlock& block)
+{
+    std::vector<CTxIndex> vTxIndex(1 + block.vtx.size());
+    txdb.ReadTxIndex(hashPrev, vTxIndex[0]);
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+        txdb.ReadTxIndex(block.vtx[i].GetHash(), vTxIndex[i + 1]);
+    return vTxIndex;
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_undo_disconnect)
+{
+    if (!bitdb.IsMock())
+        bitdb.MakeMock();
+    CTxDB txdb("cr+");
+
+    // A block spending two outputs of prev, and an output of a transaction
+    // in the block itself
+    uint256 hashPrev = GetRandHash();
+    CTxIndex txindexPrev(CDiskTxPos(1, 100, 200), 3);
+    txindexPrev.vSpent[2] = CDiskTxPos(1, 300, 400);
+    CBlock block = MakeTestBlock(3);
+    block.vtx[0].vin[0].prevout.SetNull();
+    block.vtx[1].vin.resize(2);
+    block.vtx[1].vin[0].prevout = COutPoint(hashPrev, 0);
+    block.vtx[1].vin[1].prevout = COutPoint(hashPrev, 1);
+    block.vtx[2].vin[0].prevout = COutPoint(block.vtx[1].GetHash(), 0);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex index;
+    index.phashBlock = &hashBlock;
+
+    // The index as ConnectBlock leaves it
+    std::vector<CTxIndex> vConnected(1 + block.vtx.size());
+    vConnected[0] = txindexPrev;
+    vConnected[0].vSpent[0] = CDiskTxPos(2, 100, 1100);
+    vConnected[0].vSpent[1] = CDiskTxPos(2, 100, 1100);
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+        vConnected[i + 1] = CTxIndex(CDiskTxPos(2, 100, 1000 + 100 * i), 1);
+    vConnected[2].vSpent[0] = CDiskTxPos(2, 100, 1200);
+
+    // Disconnect it by looking up the inputs, then from the undo data
+    std::vector<CTxIndex> vDisconnected[2];
+    for (int fUndo = 0; fUndo < 2; fUndo++)
+    {
+        BOOST_CHECK(txdb.UpdateTxIndex(hashPrev, vConnected[0]));
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+            BOOST_CHECK(txdb.UpdateTxIndex(block.vtx[i].GetHash(), vConnected[i + 1]));
+        if (fUndo)
+        {
+            CBlockUndo undo;
+            undo.hashBlock = hashBlock;
+            undo.vPrevTxIndex.push_back(std::make_pair(hashPrev, txindexPrev));
+            unsigned int nFile, nPos;
+            BOOST_CHECK(undo.WriteToDisk(nFile, nPos));
+            BOOST_CHECK(txdb.WriteBlockUndoPos(hashBlock, nFile, nPos));
+        }
+
+        BOOST_CHECK(block.DisconnectBlock(txdb, &index));
+        vDisconnected[fUndo] = ReadIndexes(txdb, hashPrev, block);
+        unsigned int nFile, nPos;
+        BOOST_CHECK(!txdb.ReadBlockUndoPos(hashBlock, nFile, nPos));
+    }
+
+    // Both leave prev as it was before the block, and drop the block's own
+    BOOST_CHECK(vDisconnected[0] == vDisconnected[1]);
+    BOOST_CHECK(vDisconnected[0][0] == txindexPrev);
+    for (unsigned int i = 1; i < vDisconnected[0].size(); i++)
+        BOOST_CHECK(vDisconnected[0][i].IsNull());
+    CloseBlockFile();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,55 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include "bloom.h"
+#include "util.h"
+
+BOOST_AUTO_TEST_SUITE(bloom_tests)
+
+BOOST_AUTO_TEST_CASE(rollingbloom)
+{
+    CRollingBloomFilter filter(100, 0.01);
+
+    std::vector<uint256> vData;
+    for (int i = 0; i < 100; i++)
+    {
+        vData.push_back(GetRandHash());
+        filter.insert(vData.back());
+    }
+    // The last nElements inserted are always found
+    BOOST_FOREACH(const uint256& hash, vData)
+        BOOST_CHECK(filter.contains(hash));
+
+    // and little else is
+    unsigned int nFalsePositives = 0;
+    for (int i = 0; i < 10000; i++)
+        if (filter.contains(GetRandHash()))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives < 250);
+
+    // Two more full windows push the first items out
+    for (int i = 0; i < 200; i++)
+        filter.insert(GetRandHash());
+    unsigned int nRemembered = 0;
+    BOOST_FOREACH(const uint256& hash, vData)
+        if (filter.contains(hash))
+            nRemembered++;
+    BOOST_CHECK(nRemembered < 10);
+
+    filter.insert(vData[0]);
+    BOOST_CHECK(filter.contains(vData[0]));
+    filter.reset();
+    BOOST_CHECK(!filter.contains(vData[0]));
+}
+
+BOOST_AUTO_TEST_CASE(rollingbloom_size)
+{
+    // What each peer spends on remembering its inventory
+    CRollingBloomFilter filter(5000, 0.000001);
+    BOOST_CHECK(filter.GetMemoryUsage() < 64 * 1024);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
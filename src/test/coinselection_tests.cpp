@@ -0,0 +1,89 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "coinselection.h"
+
+#include <algorithm>
+#include <functional>
+
+BOOST_AUTO_TEST_SUITE(coinselection_tests)
+
+static int64 SelectedTotal(const std::vector<int64>& vValue, const std::vector<char>& vfSelected, unsigned int& nSelected)
+{
+    int64 nTotal = 0;
+    nSelected = 0;
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        if (vfSelected[i])
+        {
+            nTotal += vValue[i];
+            nSelected++;
+        }
+    return nTotal;
+}
+
+BOOST_AUTO_TEST_CASE(coinselection_bnb)
+{
+    std::vector<int64> vValue;
+    for (int n = 10; n >= 1; n--)
+        vValue.push_back(n * CENT);
+
+    std::vector<char> vfSelected;
+    int64 nBest;
+    unsigned int nSelected;
+
+    // 10 + 9 is the fewest coins making 19 cents
+    BOOST_CHECK(SelectCoinsBnB(vValue, 19 * CENT, 0, vfSelected, nBest));
+    BOOST_CHECK_EQUAL(nBest, 19 * CENT);
+    BOOST_CHECK_EQUAL(SelectedTotal(vValue, vfSelected, nSelected), nBest);
+    BOOST_CHECK_EQUAL(nSelected, 2U);
+
+    // Nothing makes 19.5 cents exactly, but 20 is within the window
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 19 * CENT + CENT / 2, 0, vfSelected, nBest));
+    BOOST_CHECK(SelectCoinsBnB(vValue, 19 * CENT + CENT / 2, CENT, vfSelected, nBest));
+    BOOST_CHECK_EQUAL(nBest, 20 * CENT);
+
+    // All of them, and more than all of them
+    BOOST_CHECK(SelectCoinsBnB(vValue, 55 * CENT, 0, vfSelected, nBest));
+    BOOST_CHECK_EQUAL(SelectedTotal(vValue, vfSelected, nSelected), 55 * CENT);
+    BOOST_CHECK_EQUAL(nSelected, 10U);
+    BOOST_CHECK(!SelectCoinsBnB(vValue, 56 * CENT, 0, vfSelected, nBest));
+
+    // Many equal coins don't blow up the search
+    vValue.assign(100000, CENT);
+    vValue.push_back(CENT / 2);
+    BOOST_CHECK(SelectCoinsBnB(vValue, 50 * CENT + CENT / 2, 0, vfSelected, nBest));
+    BOOST_CHECK_EQUAL(SelectedTotal(vValue, vfSelected, nSelected), 50 * CENT + CENT / 2);
+    BOOST_CHECK_EQUAL(nSelected, 51U);
+}
+
+BOOST_AUTO_TEST_CASE(coinselection_knapsack)
+{
+    std::vector<int64> vValue;
+    for (int n = 0; n < 5000; n++)
+        vValue.push_back(CENT + n * 1000);
+    std::sort(vValue.begin(), vValue.end(), std::greater<int64>());
+
+    std::vector<char> vfSelected;
+    int64 nBest;
+    unsigned int nSelected;
+
+    ApproximateBestSubset(vValue, 20 * COIN, vfSelected, nBest);
+    BOOST_CHECK(nBest >= 20 * COIN);
+    BOOST_CHECK_EQUAL(SelectedTotal(vValue, vfSelected, nSelected), nBest);
+    // Only the largest MAX_KNAPSACK_COINS are considered
+    for (unsigned int i = MAX_KNAPSACK_COINS; i < vValue.size(); i++)
+        BOOST_CHECK(!vfSelected[i]);
+
+    // Unless it takes more of them to reach the target
+    int64 nAll = 0;
+    for (unsigned int i = 0; i < MAX_KNAPSACK_COINS + 10; i++)
+        nAll += vValue[i];
+    ApproximateBestSubset(vValue, nAll, vfSelected, nBest);
+    BOOST_CHECK_EQUAL(nBest, nAll);
+    BOOST_CHECK_EQUAL(SelectedTotal(vValue, vfSelected, nSelected), nAll);
+    BOOST_CHECK_EQUAL(nSelected, MAX_KNAPSACK_COINS + 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "compactblock.h"
+#include "test/txfactory.h"
+
+BOOST_AUTO_TEST_SUITE(compactblock_tests)
+
+BOOST_AUTO_TEST_CASE(siphash_vector)
+{
+    // SipHash-2-4 reference key 00..0f over the message 00..1f
+    BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL, uint256("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100")), 0x7127512f72f27cceULL);
+}
+
+BOOST_AUTO_TEST_CASE(compactblock_rebuild)
+{
+    CBlock block = MakeTestStakeBlock(20);
+    BOOST_CHECK(block.IsProofOfStake());
+
+    // The receiver has all but five in its mempool
+    std::vector<unsigned short> vExpectMissing;
+    for (unsigned int i = 2; i < block.vtx.size(); i++)
+    {
+        if (i % 4 == 0)
+            vExpectMissing.push_back(i);
+        else
+            mempool.addUnchecked(block.vtx[i].GetHash(), block.vtx[i]);
+    }
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CCompactBlock(block);
+    BOOST_CHECK_EQUAL(ss.size(), ::GetSerializeSize(CCompactBlock(block), SER_NETWORK, PROTOCOL_VERSION));
+    CCompactBlock cmpctblock;
+    ss >> cmpctblock;
+    BOOST_CHECK(cmpctblock.GetHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(cmpctblock.vPrefilled.size(), 2U);
+    BOOST_CHECK_EQUAL(cmpctblock.vShortTxIds.size(), 20U);
+
+    CBlock blockRebuilt;
+    std::vector<unsigned short> vMissing;
+    int nDoS = 0;
+    BOOST_CHECK(cmpctblock.FillBlock(blockRebuilt, vMissing, nDoS));
+    BOOST_CHECK(vMissing == vExpectMissing);
+
+    std::vector<CTransaction> vtx;
+    BOOST_FOREACH(unsigned short n, vMissing)
+        vtx.push_back(block.vtx[n]);
+    BOOST_CHECK(!FillMissingTransactions(blockRebuilt, vMissing, std::vector<CTransaction>(vtx.begin(), vtx.end() - 1)));
+    BOOST_CHECK(FillMissingTransactions(blockRebuilt, vMissing, vtx));
+    BOOST_CHECK(blockRebuilt.BuildMerkleTree() == block.hashMerkleRoot);
+    BOOST_CHECK(blockRebuilt.GetHash() == block.GetHash());
+    BOOST_CHECK(blockRebuilt.vchBlockSig == block.vchBlockSig);
+
+    for (unsigned int i = 2; i < block.vtx.size(); i++)
+        if (i % 4 != 0)
+            mempool.remove(block.vtx[i]);
+}
+
+BOOST_AUTO_TEST_CASE(compactblock_malformed)
+{
+    CBlock block = MakeTestStakeBlock(5);
+    CBlock blockRebuilt;
+    std::vector<unsigned short> vMissing;
+    int nDoS = 0;
+
+    CCompactBlock cmpctblock(block);
+    cmpctblock.vPrefilled[1].nIndex = 100;
+    BOOST_CHECK(!cmpctblock.FillBlock(blockRebuilt, vMissing, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 100);
+
+    cmpctblock = CCompactBlock(block);
+    cmpctblock.vPrefilled[1].nIndex = 0;
+    BOOST_CHECK(!cmpctblock.FillBlock(blockRebuilt, vMissing, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 100);
+
+    // Two transactions with one short id can't be told apart: not the
+    // peer's fault, the block is fetched whole instead
+    cmpctblock = CCompactBlock(block);
+    cmpctblock.vShortTxIds[1] = cmpctblock.vShortTxIds[0];
+    BOOST_CHECK(!cmpctblock.FillBlock(blockRebuilt, vMissing, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 0);
+
+    // More transactions than 16 bit indexes reach
+    cmpctblock = CCompactBlock(block);
+    for (unsigned int i = 0; cmpctblock.vShortTxIds.size() + cmpctblock.vPrefilled.size() <= MAX_COMPACT_BLOCK_TX; i++)
+        cmpctblock.vShortTxIds.push_back(CShortTxId(i));
+    BOOST_CHECK(!cmpctblock.FillBlock(blockRebuilt, vMissing, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 100);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
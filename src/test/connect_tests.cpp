@@ -0,0 +1,65 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "net.h"
+#include "sync.h"
+#include "util.h"
+
+BOOST_AUTO_TEST_SUITE(connect_tests)
+
+// A loopback port nothing listens on, so connecting to it is refused at once
+static unsigned short GetClosedPort()
+{
+    SOCKET hSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    BOOST_REQUIRE(hSocket != INVALID_SOCKET);
+    struct sockaddr_in sockaddr;
+    memset(&sockaddr, 0, sizeof(sockaddr));
+    sockaddr.sin_family = AF_INET;
+    sockaddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(sockaddr);
+    BOOST_REQUIRE(bind(hSocket, (struct sockaddr*)&sockaddr, sizeof(sockaddr)) == 0);
+    BOOST_REQUIRE(getsockname(hSocket, (struct sockaddr*)&sockaddr, &len) == 0);
+    closesocket(hSocket);
+    return ntohs(sockaddr.sin_port);
+}
+
+BOOST_AUTO_TEST_CASE(connect_parallel)
+{
+    unsigned short nPort = GetClosedPort();
+    int nConnectTimeoutSaved = nConnectTimeout;
+    nConnectTimeout = 1000;
+
+    // Each attempt takes over its outbound slot
+    CSemaphore sem(3);
+    for (int i = 1; i <= 3; i++)
+    {
+        CSemaphoreGrant grant(sem, true);
+        BOOST_REQUIRE((bool)grant);
+        BOOST_CHECK(StartConnectAttempt(CAddress(CService(strprintf("127.0.0.%d", i), nPort)), grant));
+        BOOST_CHECK(!(bool)grant);
+    }
+
+    // None connected, and all of them gave their slot back
+    JoinConnectAttempts();
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(sem.try_wait());
+    {
+        LOCK(cs_vNodes);
+        BOOST_CHECK(vNodes.empty());
+    }
+
+    // Once shutting down nothing new is started and the caller keeps its slot
+    sem.post();
+    CSemaphoreGrant grant(sem, true);
+    BOOST_REQUIRE((bool)grant);
+    fShutdown = true;
+    BOOST_CHECK(!StartConnectAttempt(CAddress(CService("127.0.0.1", nPort)), grant));
+    fShutdown = false;
+    BOOST_CHECK((bool)grant);
+
+    nConnectTimeout = nConnectTimeoutSaved;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
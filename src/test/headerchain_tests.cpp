@@ -0,0 +1,243 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+
+extern unsigned int nStakeTargetSpacing;
+
+BOOST_AUTO_TEST_SUITE(headerchain_tests)
+
+static const unsigned int nTestBits = 0x1d00ffff;
+
+// A block in mapBlockIndex for the header chain to start from, away from
+// the hardened checkpoints
+class CTestAnchor
+{
+public:
+    CBlockIndex* pindex;
+    CBlockIndex indexNext;
+
+    CTestAnchor(int nHeight, unsigned int nTime, bool fMainChain = true)
+    {
+        CBlock block;
+        block.nTime = nTime;
+        block.nBits = nTestBits;
+        block.nNonce = nHeight;
+        pindex = new CBlockIndex(0, 0, block);
+        CBlockIndexMap::iterator mi = mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first;
+        pindex->phashBlock = &((*mi).first);
+        pindex->nHeight = nHeight;
+        if (fMainChain)
+            pindex->pnext = &indexNext;
+    }
+
+    ~CTestAnchor()
+    {
+        mapBlockIndex.erase(pindex->GetBlockHash());
+        delete pindex;
+    }
+};
+
+static std::vector<CBlock> MakeHeaders(const uint256& hashPrev, unsigned int nTimeStart, int nCount, unsigned int nSalt = 0, unsigned int nSpacing = 600)
+{
+    std::vector<CBlock> vHeaders;
+    uint256 hash = hashPrev;
+    for (int i = 0; i < nCount; i++)
+    {
+        CBlock header;
+        header.hashPrevBlock = hash;
+        header.nTime = nTimeStart + i * nSpacing;
+        header.nBits = nTestBits;
+        header.nNonce = nSalt + i;
+        hash = header.GetHash();
+        vHeaders.push_back(header);
+    }
+    return vHeaders;
+}
+
+BOOST_AUTO_TEST_CASE(headerchain_connect)
+{
+    CTestAnchor anchor(100, 1400000000);
+    CHeaderChain chain;
+    int nDoS = 0;
+
+    std::vector<CBlock> vFirst = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000600, MAX_HEADERS_RESULTS);
+    BOOST_CHECK(chain.Connect(vFirst, 1, nDoS));
+    BOOST_CHECK_EQUAL(chain.Height(), 100 + (int)MAX_HEADERS_RESULTS);
+    BOOST_CHECK(chain.GetHash(101) == vFirst[0].GetHash());
+    BOOST_CHECK(chain.Contains(vFirst.back().GetHash()));
+
+    // The next batch continues from the last header
+    std::vector<CBlock> vSecond = MakeHeaders(vFirst.back().GetHash(), vFirst.back().nTime + 600, 10);
+    BOOST_CHECK(chain.Connect(vSecond, 1, nDoS));
+    BOOST_CHECK_EQUAL(chain.Height(), 110 + (int)MAX_HEADERS_RESULTS);
+
+    // The locator runs from the last header down through the base
+    CDataStream ssLocator(SER_NETWORK, PROTOCOL_VERSION);
+    ssLocator << chain.GetLocator();
+    int nVersion;
+    std::vector<uint256> vHave;
+    ssLocator >> nVersion >> vHave;
+    BOOST_CHECK(vHave.front() == vSecond.back().GetHash());
+    BOOST_CHECK(std::find(vHave.begin(), vHave.end(), anchor.pindex->GetBlockHash()) != vHave.end());
+
+    // A batch attaching lower down replaces everything above it
+    std::vector<CBlock> vFork = MakeHeaders(vFirst[999].GetHash(), vFirst[999].nTime + 300, 5, 1000000);
+    BOOST_CHECK(chain.Connect(vFork, 1, nDoS));
+    BOOST_CHECK_EQUAL(chain.Height(), 100 + 1000 + 5);
+    BOOST_CHECK(!chain.Contains(vSecond[0].GetHash()));
+    BOOST_CHECK(!chain.Contains(vFirst[1000].GetHash()));
+    BOOST_CHECK(chain.GetHash(1105) == vFork.back().GetHash());
+
+    // Headers that attach nowhere are ignored without a penalty
+    std::vector<CBlock> vLost = MakeHeaders(uint256(12345), 1400000600, 3);
+    BOOST_CHECK(!chain.Connect(vLost, 1, nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 0);
+    BOOST_CHECK_EQUAL(chain.Height(), 1105);
+}
+
+BOOST_AUTO_TEST_CASE(headerchain_rejects)
+{
+    CTestAnchor anchor(100, 1400000000);
+    int nDoS = 0;
+
+    // Gap in the chain
+    {
+        CHeaderChain chain;
+        std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000600, 20);
+        vHeaders.erase(vHeaders.begin() + 10);
+        BOOST_CHECK(!chain.Connect(vHeaders, 1, nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 20);
+        BOOST_CHECK_EQUAL(chain.Height(), 110);
+    }
+
+    // Timestamp not past the median of the previous blocks
+    {
+        CHeaderChain chain;
+        std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000600, 20);
+        vHeaders[15].nTime = vHeaders[9].nTime;
+        std::vector<CBlock> vTail = MakeHeaders(vHeaders[15].GetHash(), vHeaders[15].nTime + 600, 4);
+        vHeaders.resize(16);
+        vHeaders.insert(vHeaders.end(), vTail.begin(), vTail.end());
+        BOOST_CHECK(!chain.Connect(vHeaders, 1, nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 100);
+        BOOST_CHECK_EQUAL(chain.Height(), 115);
+    }
+
+    // Target above the proof-of-work limit
+    {
+        CHeaderChain chain;
+        std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000600, 1);
+        vHeaders[0].nBits = 0x2100ffff;
+        BOOST_CHECK(!chain.Connect(vHeaders, 1, nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 100);
+        BOOST_CHECK(chain.IsEmpty());
+    }
+
+    // Too far in the future
+    {
+        CHeaderChain chain;
+        std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), GetAdjustedTime() + nMaxClockDrift + 600, 1);
+        BOOST_CHECK(!chain.Connect(vHeaders, 1, nDoS));
+        BOOST_CHECK(chain.IsEmpty());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(headerchain_proof)
+{
+    int nDoS = 0;
+
+    // Not a branch off our chain below the last hardened checkpoint
+    {
+        CTestAnchor anchor(100, 1400000000, false);
+        CHeaderChain chain;
+        std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000600, 5);
+        BOOST_CHECK(!chain.Connect(vHeaders, 1, nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 100);
+        BOOST_CHECK(chain.IsEmpty());
+    }
+
+    // Past the stake limit, so it needs the work it doesn't have
+    {
+        CTestAnchor anchor(20000, 1400000000);
+        CHeaderChain chain;
+        std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000600, 1);
+        vHeaders[0].nBits = 0x1e0fffff;
+        arith_uint256 bnTarget;
+        bnTarget.SetCompact(vHeaders[0].nBits);
+        while (UintToArith256(vHeaders[0].GetHash()) <= bnTarget)
+            vHeaders[0].nNonce++;
+        BOOST_CHECK(!chain.Connect(vHeaders, 1, nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 100);
+        BOOST_CHECK(chain.IsEmpty());
+    }
+
+    // Past HF_BLOCK the target follows from the blocks before
+    {
+        int nHeight = HF_BLOCK + 10;
+        CTestAnchor anchorPrev(nHeight, 1400000000), anchor(nHeight + 1, 1400000240);
+        anchor.pindex->pprev = anchorPrev.pindex;
+        CHeaderChain chain;
+
+        // Blocks at the target spacing keep the target
+        std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000480, 10, 0, 240);
+        BOOST_CHECK(chain.Connect(vHeaders, 7, nDoS));
+        BOOST_CHECK_EQUAL(chain.Height(), nHeight + 11);
+        BOOST_CHECK_EQUAL(chain.GetNodeId(nHeight + 11), 7);
+
+        std::vector<CBlock> vBad = MakeHeaders(vHeaders.back().GetHash(), vHeaders.back().nTime + 240, 1, 0, 240);
+        vBad[0].nBits = 0x1c7fffff;
+        BOOST_CHECK(!chain.Connect(vBad, 8, nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 100);
+        BOOST_CHECK_EQUAL(chain.Height(), nHeight + 11);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(headerchain_spacing)
+{
+    // Headers past HF_BLOCK must not change the spacing the blocks below
+    // them still retarget on
+    unsigned int nSpacingBefore = nStakeTargetSpacing;
+    int nHeight = HF_BLOCK + 10;
+    CTestAnchor anchorPrev(nHeight, 1400000000), anchor(nHeight + 1, 1400000240);
+    anchor.pindex->pprev = anchorPrev.pindex;
+    CHeaderChain chain;
+    int nDoS = 0;
+
+    std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000480, 3, 0, 240);
+    BOOST_CHECK(chain.Connect(vHeaders, 1, nDoS));
+    BOOST_CHECK_EQUAL(chain.Height(), nHeight + 4);
+    BOOST_CHECK_EQUAL(nStakeTargetSpacing, nSpacingBefore);
+}
+
+BOOST_AUTO_TEST_CASE(headerchain_prune)
+{
+    CTestAnchor anchor(100, 1400000000);
+    CHeaderChain chain;
+    int nDoS = 0;
+
+    std::vector<CBlock> vHeaders = MakeHeaders(anchor.pindex->GetBlockHash(), 1400000600, 50);
+    BOOST_CHECK(chain.Connect(vHeaders, 1, nDoS));
+
+    // Once blocks arrive the base follows them
+    CBlockIndex index1(0, 0, vHeaders[0]), index2(0, 0, vHeaders[1]);
+    mapBlockIndex.insert(std::make_pair(vHeaders[0].GetHash(), &index1));
+    mapBlockIndex.insert(std::make_pair(vHeaders[1].GetHash(), &index2));
+    chain.Prune();
+    BOOST_CHECK_EQUAL(chain.BaseHeight(), 102);
+    BOOST_CHECK_EQUAL(chain.Height(), 150);
+    BOOST_CHECK(!chain.Contains(vHeaders[1].GetHash()));
+    BOOST_CHECK(chain.GetHash(103) == vHeaders[2].GetHash());
+
+    // and headers keep attaching at the tip
+    std::vector<CBlock> vMore = MakeHeaders(vHeaders.back().GetHash(), vHeaders.back().nTime + 600, 5);
+    BOOST_CHECK(chain.Connect(vMore, 1, nDoS));
+    BOOST_CHECK_EQUAL(chain.Height(), 155);
+
+    mapBlockIndex.erase(vHeaders[0].GetHash());
+    mapBlockIndex.erase(vHeaders[1].GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,26 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_TEST_INSECURERAND_H
+#define curecoin_TEST_INSECURERAND_H
+
+#include "util.h"
+
+/** Fast, seeded generator for test data, so a failing test fails the same
+ * way every run. Not for anything that needs real randomness. */
+class CInsecureRand
+{
+private:
+    uint64 nState;
+
+public:
+    explicit CInsecureRand(uint64 nSeed) : nState(nSeed) {}
+
+    uint64 Rand64()
+    {
+        nState = nState * 6364136223846793005ULL + 1442695040888963407ULL;
+        return nState ^ (nState >> 29);
+    }
+};
+
+#endif
@@ -0,0 +1,130 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "kernel.h"
+#include "main.h"
+#include "test/insecurerand.h"
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+static CInsecureRand insecureRand(0x9e3779b97f4a7c15ULL);
+
+// Block index entries registered in mapBlockIndex for as long as the object
+// lives. Timestamps jitter by up to an hour around a 10 minute spacing, so
+// they are not monotonic, and roughly one block in 30 generates a modifier.
+class CTestChain
+{
+public:
+    std::vector<CBlockIndex*> vIndex;
+
+    ~CTestChain()
+    {
+        BOOST_FOREACH(CBlockIndex* pindex, vIndex)
+        {
+            mapBlockIndex.erase(pindex->GetBlockHash());
+            delete pindex;
+        }
+    }
+
+    CBlockIndex* Extend(CBlockIndex* pindexPrev, int nBlocks)
+    {
+        for (int n = 0; n < nBlocks; n++)
+        {
+            CBlock block;
+            int nHeight = pindexPrev ? pindexPrev->nHeight + 1 : 0;
+            block.nTime = 1400000000 + nHeight * 600 + (insecureRand.Rand64() % 7200) - 3600;
+            block.nNonce = (unsigned int)insecureRand.Rand64();
+            block.hashPrevBlock = pindexPrev ? pindexPrev->GetBlockHash() : 0;
+
+            CBlockIndex* pindex = new CBlockIndex(0, 0, block);
+            CBlockIndexMap::iterator mi = mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first;
+            pindex->phashBlock = &((*mi).first);
+            pindex->pprev = pindexPrev;
+            pindex->nHeight = nHeight;
+            pindex->SetStakeModifier(insecureRand.Rand64(), nHeight == 0 || insecureRand.Rand64() % 30 == 0);
+            if (pindexPrev)
+                pindexPrev->pnext = pindex;
+            vIndex.push_back(pindex);
+            pindexPrev = pindex;
+        }
+        return pindexPrev;
+    }
+};
+
+// The original walk along pnext
+static bool ReferenceStakeModifier(const CBlockIndex* pindexFrom, int64 nSelectionInterval, uint64& nStakeModifier, int& nHeight, int64& nTime)
+{
+    nHeight = pindexFrom->nHeight;
+    nTime = pindexFrom->GetBlockTime();
+    const CBlockIndex* pindex = pindexFrom;
+    while (nTime < pindexFrom->GetBlockTime() + nSelectionInterval)
+    {
+        if (!pindex->pnext)
+            return false;
+        pindex = pindex->pnext;
+        if (pindex->GeneratedStakeModifier())
+        {
+            nHeight = pindex->nHeight;
+            nTime = pindex->GetBlockTime();
+        }
+    }
+    nStakeModifier = pindex->nStakeModifier;
+    return true;
+}
+
+static void CheckAgainstReference(const std::vector<CBlockIndex*>& vIndex, int64 nSelectionInterval)
+{
+    BOOST_FOREACH(const CBlockIndex* pindex, vIndex)
+    {
+        uint64 nExpected = 0;
+        int nExpectedHeight = 0;
+        int64 nExpectedTime = 0;
+        bool fExpected = ReferenceStakeModifier(pindex, nSelectionInterval, nExpected, nExpectedHeight, nExpectedTime);
+
+        // Twice, to cover both the lookup and the remembered answer
+        for (int i = 0; i < 2; i++)
+        {
+            uint64 nStakeModifier = 0;
+            int nHeight = 0;
+            int64 nTime = 0;
+            BOOST_CHECK_EQUAL(GetKernelStakeModifier(pindex->GetBlockHash(), nStakeModifier, nHeight, nTime, false), fExpected);
+            if (fExpected)
+            {
+                BOOST_CHECK_EQUAL(nStakeModifier, nExpected);
+                BOOST_CHECK_EQUAL(nHeight, nExpectedHeight);
+                BOOST_CHECK_EQUAL(nTime, nExpectedTime);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_cache_matches_walk)
+{
+    CTestChain chain;
+    CBlockIndex* pindexTip = chain.Extend(NULL, 4000);
+    pindexGenesisBlock = chain.vIndex[0];
+
+    int64 nSelectionInterval = GetStakeModifierSelectionInterval();
+    CheckAgainstReference(chain.vIndex, nSelectionInterval);
+
+    // Reorganize away the last 1000 blocks onto a longer branch
+    CBlockIndex* pindexFork = chain.vIndex[2999];
+    std::vector<CBlockIndex*> vStale(chain.vIndex.begin() + 3000, chain.vIndex.end());
+    for (CBlockIndex* pindex = pindexTip; pindex != pindexFork; pindex = pindex->pprev)
+        pindex->pprev->pnext = NULL;
+    TruncateStakeModifierCache(pindexFork);
+    size_t nBranch = chain.vIndex.size();
+    chain.Extend(pindexFork, 1500);
+
+    std::vector<CBlockIndex*> vMain(chain.vIndex.begin(), chain.vIndex.begin() + 3000);
+    vMain.insert(vMain.end(), chain.vIndex.begin() + nBranch, chain.vIndex.end());
+    CheckAgainstReference(vMain, nSelectionInterval);
+    CheckAgainstReference(vStale, nSelectionInterval);
+
+    TruncateStakeModifierCache(NULL);
+    pindexGenesisBlock = NULL;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,126 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "orphantx.h"
+#include "test/txfactory.h"
+
+BOOST_AUTO_TEST_SUITE(orphantx_tests)
+
+// Spends nIn outputs of hashParent (0, 1, ...), padded to about nSize bytes
+static CTransaction MakeOrphan(const uint256& hashParent, int nIn, unsigned int nSize = 0)
+{
+    CTransaction tx = MakeTestTransaction(0);
+    tx.vin.resize(nIn);
+    for (int i = 0; i < nIn; i++)
+        tx.vin[i].prevout = COutPoint(hashParent, i);
+    if (nSize > 100)
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(nSize - 100, 0x42);
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(orphantx_children)
+{
+    COrphanTxPool pool;
+    uint256 hashParent = GetRandHash(), hashOther = GetRandHash();
+
+    CTransaction tx1 = MakeOrphan(hashParent, 2);
+    CTransaction tx2 = MakeOrphan(hashParent, 1);
+    tx2.vout[0].nValue = 2 * COIN;
+    CTransaction tx3 = MakeOrphan(hashOther, 1);
+    BOOST_CHECK(pool.Add(tx1, tx1.GetHash(), 1));
+    BOOST_CHECK(pool.Add(tx2, tx2.GetHash(), 1));
+    BOOST_CHECK(pool.Add(tx3, tx3.GetHash(), 2));
+    BOOST_CHECK(!pool.Add(tx3, tx3.GetHash(), 2));
+    BOOST_CHECK_EQUAL(pool.Size(), 3U);
+    BOOST_CHECK(pool.Get(tx1.GetHash())->tx.GetHash() == tx1.GetHash());
+
+    // tx1 spends two outputs of the parent but is one child
+    std::vector<uint256> vChildren;
+    pool.GetChildren(hashParent, vChildren);
+    std::set<uint256> setChildren(vChildren.begin(), vChildren.end());
+    BOOST_CHECK_EQUAL(setChildren.size(), 2U);
+    BOOST_CHECK(setChildren.count(tx1.GetHash()) && setChildren.count(tx2.GetHash()));
+
+    BOOST_CHECK(pool.Erase(tx1.GetHash()));
+    BOOST_CHECK(!pool.Erase(tx1.GetHash()));
+    vChildren.clear();
+    pool.GetChildren(hashParent, vChildren);
+    BOOST_CHECK(vChildren.size() == 1 && vChildren[0] == tx2.GetHash());
+
+    size_t nBytes = pool.Bytes();
+    pool.EraseForPeer(2);
+    BOOST_CHECK_EQUAL(pool.Size(), 1U);
+    BOOST_CHECK(pool.Bytes() < nBytes);
+    vChildren.clear();
+    pool.GetChildren(hashOther, vChildren);
+    BOOST_CHECK(vChildren.empty());
+
+    pool.Erase(tx2.GetHash());
+    BOOST_CHECK_EQUAL(pool.Bytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(orphantx_limits)
+{
+    COrphanTxPool pool;
+
+    // Too large to keep at all
+    CTransaction txLarge = MakeOrphan(GetRandHash(), 1, MAX_ORPHAN_TX_SIZE + 100);
+    BOOST_CHECK(!pool.Add(txLarge, txLarge.GetHash(), 1));
+
+    // One peer stops at its share
+    unsigned int nAdded = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        CTransaction tx = MakeOrphan(GetRandHash(), 1, 4000);
+        if (!pool.Add(tx, tx.GetHash(), 1))
+            break;
+        nAdded++;
+    }
+    BOOST_CHECK(pool.Bytes() <= MAX_ORPHAN_PEER_BYTES);
+    BOOST_CHECK(nAdded < 1000);
+
+    // and the others together stop at the pool's
+    for (int nNode = 2; pool.Bytes() <= MAX_ORPHAN_POOL_BYTES; nNode++)
+        for (unsigned int i = 0; i < nAdded; i++)
+        {
+            CTransaction tx = MakeOrphan(GetRandHash(), 1, 4000);
+            pool.Add(tx, tx.GetHash(), nNode);
+        }
+    BOOST_CHECK(pool.Limit() > 0);
+    BOOST_CHECK(pool.Bytes() <= MAX_ORPHAN_POOL_BYTES);
+
+    // Small ones stop at the count
+    pool.Clear();
+    for (unsigned int i = 0; i <= MAX_ORPHAN_TRANSACTIONS + 10; i++)
+    {
+        CTransaction tx = MakeOrphan(GetRandHash(), 1);
+        pool.Add(tx, tx.GetHash(), i);
+    }
+    BOOST_CHECK_EQUAL(pool.Limit(), 11U);
+    BOOST_CHECK_EQUAL(pool.Size(), MAX_ORPHAN_TRANSACTIONS);
+}
+
+BOOST_AUTO_TEST_CASE(orphantx_expiry)
+{
+    COrphanTxPool pool;
+    int64 nNow = GetTime();
+    SetMockTime(nNow);
+
+    CTransaction tx1 = MakeOrphan(GetRandHash(), 1);
+    pool.Add(tx1, tx1.GetHash(), 1);
+    pool.Limit();
+    SetMockTime(nNow + ORPHAN_TX_EXPIRE_TIME / 2);
+    CTransaction tx2 = MakeOrphan(GetRandHash(), 1);
+    pool.Add(tx2, tx2.GetHash(), 1);
+
+    SetMockTime(nNow + ORPHAN_TX_EXPIRE_TIME + 1);
+    BOOST_CHECK_EQUAL(pool.Limit(), 0U);
+    BOOST_CHECK(!pool.Exists(tx1.GetHash()));
+    BOOST_CHECK(pool.Exists(tx2.GetHash()));
+
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,51 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#define BOOST_TEST_MODULE Curecoin Test Suite
+#include <boost/test/unit_test.hpp>
+
+#include "init.h"
+#include "main.h"
+#include "ui_interface.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+// init.cpp is not linked into the test binary, so provide the few globals
+// the core sources expect from it.
+CWallet* pwalletMain;
+CClientUIInterface uiInterface;
+
+void Shutdown(void* parg)
+{
+    exit(0);
+}
+
+void StartShutdown()
+{
+    exit(0);
+}
+
+struct TestingSetup
+{
+    boost::filesystem::path pathTemp;
+
+    TestingSetup()
+    {
+        // Keep debug output out of the user's data directory
+        fPrintToConsole = false;
+        fPrintToDebugger = true;
+
+        // and anything the tests write to disk
+        pathTemp = boost::filesystem::temp_directory_path() / strprintf("test_curecoin_%lu_%i", (unsigned long)GetTime(), (int)(GetRand(100000)));
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+    }
+
+    ~TestingSetup()
+    {
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+BOOST_GLOBAL_FIXTURE(TestingSetup);
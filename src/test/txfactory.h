@@ -0,0 +1,66 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef curecoin_TEST_TXFACTORY_H
+#define curecoin_TEST_TXFACTORY_H
+
+#include "main.h"
+
+/** Transactions and blocks for the tests. None of them are valid in the
+ * consensus sense; they only have the shape the code under test needs. */
+
+/** A transaction spending output n of a random transaction, paying
+ * (n + 1) coins to an anyone-can-spend script */
+inline CTransaction MakeTestTransaction(int n)
+{
+    CTransaction tx;
+    tx.nTime = 1400000000 + n;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = (n + 1) * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+/** A block of nTx transactions from MakeTestTransaction */
+inline CBlock MakeTestBlock(int nTx, unsigned int nBits = 0x207fffff)
+{
+    CBlock block;
+    block.nTime = 1400000000;
+    block.nBits = nBits;
+    for (int i = 0; i < nTx; i++)
+        block.vtx.push_back(MakeTestTransaction(i));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** A proof-of-stake block: coinbase, coinstake and nTx others */
+inline CBlock MakeTestStakeBlock(int nTx)
+{
+    CBlock block;
+    block.nTime = 1400000000;
+    block.nBits = 0x1d00ffff;
+
+    CTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vin[0].scriptSig = CScript() << 1000;
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+    block.vtx.push_back(txCoinBase);
+
+    CTransaction txCoinStake = MakeTestTransaction(-1);
+    txCoinStake.vout.resize(2);
+    txCoinStake.vout[0].SetEmpty();
+    txCoinStake.vout[1].nValue = 100 * COIN;
+    block.vtx.push_back(txCoinStake);
+
+    for (int i = 0; i < nTx; i++)
+        block.vtx.push_back(MakeTestTransaction(i));
+    block.vchBlockSig.assign(72, 0x30);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+#endif
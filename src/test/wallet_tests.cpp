@@ -0,0 +1,181 @@
+// Copyright (c) 2013-2025 The Curecoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#include <boost/test/unit_test.hpp>
+
+#include "db.h"
+#include "wallet.h"
+
+BOOST_AUTO_TEST_SUITE(wallet_tests)
+
+// A wallet holding one confirmed transaction that pays nCoins[k] coins of
+// nValue[k] to key k
+class CTestWallet
+{
+public:
+    CWallet wallet;
+    std::vector<CScript> vScript;
+    CBlockIndex index, indexNext;
+    CBlockIndex* pindexBestSaved;
+    uint256 hashBlock;
+
+    CTestWallet(const std::vector<int>& vCoins, const std::vector<int64>& vValue)
+    {
+        if (!bitdb.IsMock())
+            bitdb.MakeMock();
+        CTxDB txdbCreate("cr+");
+
+        CTransaction tx;
+        tx.nTime = GetAdjustedTime() - 60 * 60;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        for (unsigned int k = 0; k < vCoins.size(); k++)
+        {
+            CKey key;
+            key.MakeNewKey(true);
+            BOOST_REQUIRE(wallet.AddKey(key));
+            CScript script;
+            script.SetDestination(key.GetPubKey().GetID());
+            vScript.push_back(script);
+            for (int i = 0; i < vCoins[k]; i++)
+                tx.vout.push_back(CTxOut(vValue[k], script));
+        }
+
+        // Confirmed in a block on our best chain
+        hashBlock = GetRandHash();
+        index.phashBlock = &hashBlock;
+        index.nHeight = 1000;
+        index.pnext = &indexNext;
+        mapBlockIndex.insert(std::make_pair(hashBlock, &index));
+        pindexBestSaved = pindexBest;
+        pindexBest = &index;
+
+        // Inserted directly: AddToWallet orders the tx against accounting
+        // entries in wallet.dat, which this wallet does not have
+        CWalletTx wtx(&wallet, tx);
+        wtx.hashBlock = hashBlock;
+        wtx.nIndex = 1;
+        wtx.fMerkleVerified = true;
+        wtx.nTimeReceived = tx.nTime;
+        wallet.mapWallet.insert(std::make_pair(tx.GetHash(), wtx));
+    }
+
+    ~CTestWallet()
+    {
+        pindexBest = pindexBestSaved;
+        mapBlockIndex.erase(hashBlock);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(wallet_consolidate)
+{
+    // Key 0 has 12 small coins and a big one, key 1 has 11 small coins,
+    // key 2 too few to be worth a transaction
+    std::vector<int> vCoins;
+    std::vector<int64> vValue;
+    vCoins.push_back(12); vValue.push_back(3 * COIN / 2);
+    vCoins.push_back(1); vValue.push_back(50 * COIN);
+    vCoins.push_back(11); vValue.push_back(COIN / 2);
+    vCoins.push_back(MIN_CONSOLIDATE_INPUTS - 1); vValue.push_back(COIN / 2);
+    CTestWallet test(vCoins, vValue);
+    BOOST_CHECK(test.vScript.size() == 4);
+
+    std::vector<CWalletTx> vwtx;
+    int64 nFee;
+    BOOST_CHECK(test.wallet.CreateConsolidation(2 * COIN, 5 * COIN, 10 * COIN, vwtx, nFee));
+    BOOST_REQUIRE_EQUAL(vwtx.size(), 2U);
+
+    int64 nFeeSum = 0;
+    BOOST_FOREACH(const CWalletTx& wtx, vwtx)
+    {
+        // Coins of one address only, paid back to it
+        int64 nValueIn = 0, nValueOut = 0;
+        const CScript& script = wtx.vout[0].scriptPubKey;
+        BOOST_FOREACH(const CTxIn& txin, wtx.vin)
+        {
+            const CTxOut& txout = test.wallet.mapWallet[txin.prevout.hash].vout[txin.prevout.n];
+            BOOST_CHECK(txout.scriptPubKey == script);
+            BOOST_CHECK(txout.nValue < 2 * COIN);
+            nValueIn += txout.nValue;
+        }
+        BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+        {
+            BOOST_CHECK(txout.scriptPubKey == script);
+            nValueOut += txout.nValue;
+        }
+        BOOST_CHECK(nValueOut < nValueIn);
+        nFeeSum += nValueIn - nValueOut;
+
+        // Split into outputs of at least the target
+        BOOST_CHECK_EQUAL(wtx.vout.size(), (size_t)std::max((int64)1, nValueOut / (5 * COIN)));
+        BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+            BOOST_CHECK(txout.nValue >= 5 * COIN || wtx.vout.size() == 1);
+
+        if (script == test.vScript[0])
+        {
+            BOOST_CHECK_EQUAL(wtx.vin.size(), 12U);
+            BOOST_CHECK_EQUAL(wtx.vout.size(), 3U);
+        }
+        else
+        {
+            BOOST_CHECK(script == test.vScript[2]);
+            BOOST_CHECK_EQUAL(wtx.vin.size(), 11U);
+            BOOST_CHECK_EQUAL(wtx.vout.size(), 1U);
+        }
+    }
+    BOOST_CHECK_EQUAL(nFee, nFeeSum);
+
+    // Stops before the fee budget runs out
+    std::vector<CWalletTx> vwtxCapped;
+    int64 nFeeCapped;
+    BOOST_CHECK(test.wallet.CreateConsolidation(2 * COIN, 5 * COIN, nFee - 1, vwtxCapped, nFeeCapped));
+    BOOST_CHECK_EQUAL(vwtxCapped.size(), 1U);
+    BOOST_CHECK(nFeeCapped <= nFee - 1);
+    BOOST_CHECK(test.wallet.CreateConsolidation(2 * COIN, 5 * COIN, 0, vwtxCapped, nFeeCapped));
+    BOOST_CHECK(vwtxCapped.empty());
+    BOOST_CHECK_EQUAL(nFeeCapped, 0);
+
+    // A threshold under every coin leaves nothing to do
+    BOOST_CHECK(test.wallet.CreateConsolidation(COIN / 4, 5 * COIN, 10 * COIN, vwtx, nFee));
+    BOOST_CHECK(vwtx.empty());
+    BOOST_CHECK(!test.wallet.CreateConsolidation(2 * COIN, COIN, 10 * COIN, vwtx, nFee));
+}
+
+BOOST_AUTO_TEST_CASE(wallet_address_groups_book)
+{
+    // One coin to each of keys 0, 1 and 2, then a transaction spending
+    // key 0's coin to keys 1 and 2
+    std::vector<int> vCoins(3, 1);
+    std::vector<int64> vValue(3, 10 * COIN);
+    CTestWallet test(vCoins, vValue);
+    CTxDestination address[3];
+    for (int k = 0; k < 3; k++)
+        BOOST_REQUIRE(ExtractDestination(test.vScript[k], address[k]));
+
+    CTransaction tx;
+    tx.nTime = GetAdjustedTime();
+    tx.vin.push_back(CTxIn(COutPoint(test.wallet.mapWallet.begin()->first, 0)));
+    tx.vout.push_back(CTxOut(4 * COIN, test.vScript[1]));
+    tx.vout.push_back(CTxOut(5 * COIN, test.vScript[2]));
+    test.wallet.mapWallet.insert(std::make_pair(tx.GetHash(), CWalletTx(&test.wallet, tx)));
+
+    // Key 2 isn't in the address book, so it took the change
+    test.wallet.SetAddressBookName(address[1], "payee");
+    std::set< std::set<CTxDestination> > groupings = test.wallet.GetAddressGroupings();
+    std::set<CTxDestination> setChange;
+    setChange.insert(address[0]);
+    setChange.insert(address[2]);
+    BOOST_CHECK_EQUAL(groupings.size(), 2U);
+    BOOST_CHECK(groupings.count(setChange));
+
+    // Swapping which one is in the book leaves the book the same size
+    test.wallet.DelAddressBookName(address[1]);
+    test.wallet.SetAddressBookName(address[2], "payee");
+    groupings = test.wallet.GetAddressGroupings();
+    setChange.erase(address[2]);
+    setChange.insert(address[1]);
+    BOOST_CHECK_EQUAL(groupings.size(), 2U);
+    BOOST_CHECK(groupings.count(setChange));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include "ui_interface.h"
 #include <boost/algorithm/string/join.hpp>
 
+#include <atomic>
 #include <cstring>
 #include <map>
 #include <set>
@@ -64,6 +65,8 @@ namespace boost {
 
 #ifndef WIN32
 #include <execinfo.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 
@@ -198,6 +201,48 @@ uint256 GetRandHash()
     return hash;
 }
 
+#define ROTL(x, b) (uint64)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND do { \
+    v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; \
+    v0 = ROTL(v0, 32); \
+    v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; \
+    v2 = ROTL(v2, 32); \
+} while (0)
+
+uint64 SipHashUint256(uint64 k0, uint64 k1, const uint256& val)
+{
+    uint64 v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64 v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64 v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64 v3 = 0x7465646279746573ULL ^ k1;
+
+    for (int i = 0; i < 4; i++)
+    {
+        uint64 d = val.Get64(i);
+        v3 ^= d;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= d;
+    }
+
+    // Length (32 bytes) in the top byte of the last block
+    uint64 d = ((uint64)32) << 56;
+    v3 ^= d;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= d;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
 
 
 
@@ -1156,6 +1201,59 @@ void FileCommit(FILE *fileout)
 #endif
 }
 
+void TruncateFile(FILE *file, unsigned int nLength)
+{
+    fflush(file);
+#ifdef WIN32
+    _chsize(_fileno(file), nLength);
+#else
+    if (ftruncate(fileno(file), nLength) != 0)
+        printf("TruncateFile() : ftruncate failed, errno %d\n", errno);
+#endif
+}
+
+void AllocateFileRange(FILE *file, unsigned int nOffset, unsigned int nLength)
+{
+    fflush(file);
+    int64 nEnd = (int64)nOffset + nLength;
+#if defined(WIN32)
+    HANDLE hFile = (HANDLE)_get_osfhandle(_fileno(file));
+    LARGE_INTEGER nFileSize;
+    nFileSize.QuadPart = nEnd;
+    if (SetFilePointerEx(hFile, nFileSize, 0, FILE_BEGIN) && SetEndOfFile(hFile))
+        return;
+#elif defined(MAC_OSX)
+    fstore_t fst;
+    fst.fst_flags = F_ALLOCATECONTIG;
+    fst.fst_posmode = F_PEOFPOSMODE;
+    fst.fst_offset = 0;
+    fst.fst_length = nEnd;
+    fst.fst_bytesalloc = 0;
+    if (fcntl(fileno(file), F_PREALLOCATE, &fst) == -1)
+    {
+        fst.fst_flags = F_ALLOCATEALL;
+        fcntl(fileno(file), F_PREALLOCATE, &fst);
+    }
+    if (ftruncate(fileno(file), nEnd) == 0)
+        return;
+#elif defined(__linux__)
+    if (posix_fallocate(fileno(file), 0, nEnd) == 0)
+        return;
+#endif
+    // Fall back to writing zeros
+    static const char pchZero[65536] = {};
+    if (fseek(file, nOffset, SEEK_SET) != 0)
+        return;
+    while (nLength > 0)
+    {
+        unsigned int nNow = std::min(nLength, (unsigned int)sizeof(pchZero));
+        if (fwrite(pchZero, 1, nNow, file) != nNow)
+            break;
+        nLength -= nNow;
+    }
+    fflush(file);
+}
+
 int GetFilesize(FILE* file)
 {
     int nSavePos = ftell(file);
@@ -1364,3 +1462,113 @@ bool NewThread(void(*pfn)(void*), void* parg)
     }
     return true;
 }
+
+
+//
+// Network buffer pool
+//
+// CNetDataStream buffers grow by doubling, so requests are rounded up to a
+// power of two and freed chunks are kept on per thread free lists, one per
+// size class. The socket handler and message handler threads each allocate
+// and free their own buffers, so chunks are reused without any locking.
+//
+static const int NETBUFFER_MIN_SHIFT = 9;               // 512 bytes
+static const int NETBUFFER_MAX_SHIFT = 22;              // 4 MB, larger goes straight to malloc
+static const size_t NETBUFFER_MAX_CACHED = 8 << 20;     // per thread
+
+static std::atomic<uint64> nNetBufferInUse(0);
+static std::atomic<uint64> nNetBufferCached(0);
+static std::atomic<uint64> nNetBufferAllocs(0);
+static std::atomic<uint64> nNetBufferPoolHits(0);
+
+static int NetBufferSizeClass(size_t nSize)
+{
+    int nShift = NETBUFFER_MIN_SHIFT;
+    while (nShift <= NETBUFFER_MAX_SHIFT && ((size_t)1 << nShift) < nSize)
+        nShift++;
+    return nShift;
+}
+
+namespace {
+class CNetBufferCache
+{
+public:
+    std::vector<void*> vFree[NETBUFFER_MAX_SHIFT + 1];
+    size_t nCached;
+
+    CNetBufferCache() : nCached(0) {}
+    ~CNetBufferCache();
+};
+}
+
+// Set once the thread's cache is destroyed; later frees go straight to free()
+static thread_local bool fNetBufferCacheGone = false;
+
+CNetBufferCache::~CNetBufferCache()
+{
+    for (int i = NETBUFFER_MIN_SHIFT; i <= NETBUFFER_MAX_SHIFT; i++)
+        BOOST_FOREACH(void* p, vFree[i])
+            free(p);
+    nNetBufferCached -= nCached;
+    fNetBufferCacheGone = true;
+}
+
+static CNetBufferCache* GetNetBufferCache()
+{
+    if (fNetBufferCacheGone)
+        return NULL;
+    static thread_local CNetBufferCache cache;
+    return &cache;
+}
+
+void* NetBufferAllocate(size_t nSize)
+{
+    int nShift = NetBufferSizeClass(nSize);
+    size_t nChunk = nShift <= NETBUFFER_MAX_SHIFT ? (size_t)1 << nShift : nSize;
+    nNetBufferAllocs++;
+    nNetBufferInUse += nChunk;
+
+    CNetBufferCache* pcache = nShift <= NETBUFFER_MAX_SHIFT ? GetNetBufferCache() : NULL;
+    if (pcache && !pcache->vFree[nShift].empty())
+    {
+        void* p = pcache->vFree[nShift].back();
+        pcache->vFree[nShift].pop_back();
+        pcache->nCached -= nChunk;
+        nNetBufferCached -= nChunk;
+        nNetBufferPoolHits++;
+        return p;
+    }
+
+    void* p = malloc(nChunk);
+    if (!p)
+    {
+        nNetBufferInUse -= nChunk;
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void NetBufferDeallocate(void* p, size_t nSize)
+{
+    int nShift = NetBufferSizeClass(nSize);
+    size_t nChunk = nShift <= NETBUFFER_MAX_SHIFT ? (size_t)1 << nShift : nSize;
+    nNetBufferInUse -= nChunk;
+
+    CNetBufferCache* pcache = nShift <= NETBUFFER_MAX_SHIFT ? GetNetBufferCache() : NULL;
+    if (pcache && pcache->nCached + nChunk <= NETBUFFER_MAX_CACHED)
+    {
+        pcache->vFree[nShift].push_back(p);
+        pcache->nCached += nChunk;
+        nNetBufferCached += nChunk;
+        return;
+    }
+    free(p);
+}
+
+void GetNetBufferStats(uint64& nInUse, uint64& nCached, uint64& nAllocs, uint64& nPoolHits)
+{
+    nInUse = nNetBufferInUse;
+    nCached = nNetBufferCached;
+    nAllocs = nNetBufferAllocs;
+    nPoolHits = nNetBufferPoolHits;
+}
@@ -212,6 +212,9 @@ void ParseParameters(int argc, const char*const argv[]);
 bool WildcardMatch(const char* psz, const char* mask);
 bool WildcardMatch(const std::string& str, const std::string& mask);
 void FileCommit(FILE *fileout);
+void TruncateFile(FILE *file, unsigned int nLength);
+/** Make sure the disk space for nLength bytes from nOffset is taken, growing the file to the end of it */
+void AllocateFileRange(FILE *file, unsigned int nOffset, unsigned int nLength);
 int GetFilesize(FILE* file);
 bool RenameOver(boost::filesystem::path src, boost::filesystem::path dest);
 boost::filesystem::path GetDefaultDataDir();
@@ -349,6 +352,12 @@ inline int64 GetTimeMillis()
             boost::posix_time::ptime(boost::gregorian::date(1970,1,1))).total_milliseconds();
 }
 
+/** Microseconds from a monotonic clock; only meaningful for measuring intervals */
+inline int64 GetTimeMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 inline std::string DateTimeStrFormat(const char* pszFormat, int64 nTime)
 {
     time_t n = nTime;
@@ -536,6 +545,9 @@ inline uint160 Hash160(const std::vector<unsigned char>& vch)
     return hash2;
 }
 
+/** SipHash-2-4 of a 256-bit value */
+uint64 SipHashUint256(uint64 k0, uint64 k1, const uint256& val);
+
 
 /** Median filter over a stream of values.
  * Returns the median of the last N numbers
@@ -626,6 +638,9 @@ inline void ExitThread(size_t nExitCode)
 
 void RenameThread(const char* name);
 
+/** Totals of the network buffer pool (NetBufferAllocate), sizes in bytes */
+void GetNetBufferStats(uint64& nInUse, uint64& nCached, uint64& nAllocs, uint64& nPoolHits);
+
 inline uint32_t ByteReverse(uint32_t value)
 {
     value = ((value & 0xFF00FF00) >> 8) | ((value & 0x00FF00FF) << 8);
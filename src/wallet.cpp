@@ -10,9 +10,12 @@
 #include "base58.h"
 #include <boost/algorithm/string/replace.hpp>
 #include "kernel.h"
+#include "coinselection.h"
+#include "perf.h"
 
 
 #include <algorithm>
+#include <atomic>
 #include <list>
 #include <map>
 #include <set>
@@ -30,12 +33,11 @@ extern int nStakeMaxAge;
 // mapWallet
 //
 
-struct CompareValueOnly
+struct CompareOutputValueDescending
 {
-    bool operator()(const std::pair<int64, std::pair<const CWalletTx*, unsigned int> >& t1,
-                    const std::pair<int64, std::pair<const CWalletTx*, unsigned int> >& t2) const
+    bool operator()(const COutput& a, const COutput& b) const
     {
-        return t1.first < t2.first;
+        return a.tx->vout[a.i].nValue > b.tx->vout[b.i].nValue;
     }
 };
 
@@ -473,6 +475,11 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
             fUpdated |= wtx.UpdateSpent(wtxIn.vfSpent);
         }
 
+        // Also for transactions we already had: a rescan after a key import
+        // brings them back with outputs that have just become ours
+        if (fAddressIndexValid)
+            AddToAddressIndex(wtx);
+
         //// debug print
         printf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString().substr(0,10).c_str(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
@@ -548,7 +555,10 @@ bool CWallet::EraseFromWallet(uint256 hash)
     {
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
+        {
             CWalletDB(strWalletFile).EraseTx(hash);
+            fAddressIndexValid = false;
+        }
     }
     return true;
 }
@@ -1046,14 +1056,23 @@ void CWallet::AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed)
             if(pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0)
                 continue;
 
+            int nDepth = -1;
             for (unsigned int i = 0; i < pcoin->vout.size(); i++)
             {
+                if (pcoin->IsSpent(i) || pcoin->vout[i].nValue <= 0)
+                    continue;
                 isminetype mine = IsMine(pcoin->vout[i]);
-                if (!(pcoin->IsSpent(i)) && mine != MINE_NO && pcoin->vout[i].nValue > 0)
-                    vCoins.push_back(COutput(pcoin, i, pcoin->GetDepthInMainChain(), mine == MINE_SPENDABLE));
+                if (mine == MINE_NO)
+                    continue;
+                if (nDepth == -1)
+                    nDepth = pcoin->GetDepthInMainChain();
+                vCoins.push_back(COutput(pcoin, i, nDepth, mine == MINE_SPENDABLE));
             }
         }
     }
+
+    // Coin selection relies on this order
+    std::sort(vCoins.begin(), vCoins.end(), CompareOutputValueDescending());
 }
 
 void CWallet::AvailableCoinsMinConf(std::vector<COutput>& vCoins, int nConf) const
@@ -1082,44 +1101,6 @@ void CWallet::AvailableCoinsMinConf(std::vector<COutput>& vCoins, int nConf) con
     }
 }
 
-static void ApproximateBestSubset(std::vector<std::pair<int64, std::pair<const CWalletTx*,unsigned int> > >vValue, int64 nTotalLower, int64 nTargetValue,
-                                  std::vector<char>& vfBest, int64& nBest, int iterations = 1000)
-{
-    std::vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
-    {
-        vfIncluded.assign(vValue.size(), false);
-        int64 nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
-        {
-            for (unsigned int i = 0; i < vValue.size(); i++)
-            {
-                if (nPass == 0 ? rand() % 2 : !vfIncluded[i])
-                {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue)
-                    {
-                        fReachedTarget = true;
-                        if (nTotal < nBest)
-                        {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
-    }
-}
-
 // ppcoin: total coins staked (non-spendable until maturity)
 int64 CWallet::GetStake() const
 {
@@ -1147,20 +1128,19 @@ int64 CWallet::GetNewMint() const
     return nTotal;
 }
 
-bool CWallet::SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const
+bool CWallet::SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
 
-    // List of values less than target
+    // Coins less than target + CENT, largest first as in vCoins
     std::pair<int64, std::pair<const CWalletTx*,unsigned int> > coinLowestLarger;
     coinLowestLarger.first = std::numeric_limits<int64>::max();
     coinLowestLarger.second.first = NULL;
-    std::vector<std::pair<int64, std::pair<const CWalletTx*,unsigned int> > > vValue;
+    std::vector<int64> vValue;
+    std::vector<std::pair<const CWalletTx*,unsigned int> > vCoinsLower;
     int64 nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
     BOOST_FOREACH(const COutput &output, vCoins)
     {
         if (!output.fSpendable)
@@ -1178,32 +1158,28 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, in
 
         int64 n = pcoin->vout[i].nValue;
 
-        std::pair<int64,std::pair<const CWalletTx*,unsigned int> > coin = std::make_pair(n,std::make_pair(pcoin, i));
-
         if (n == nTargetValue)
         {
-            setCoinsRet.insert(coin.second);
-            nValueRet += coin.first;
+            setCoinsRet.insert(std::make_pair(pcoin, i));
+            nValueRet += n;
             return true;
         }
         else if (n < nTargetValue + CENT)
         {
-            vValue.push_back(coin);
+            vValue.push_back(n);
+            vCoinsLower.push_back(std::make_pair(pcoin, i));
             nTotalLower += n;
         }
         else if (n < coinLowestLarger.first)
         {
-            coinLowestLarger = coin;
+            coinLowestLarger = std::make_pair(n, std::make_pair(pcoin, i));
         }
     }
 
     if (nTotalLower == nTargetValue)
     {
-        for (unsigned int i = 0; i < vValue.size(); ++i)
-        {
-            setCoinsRet.insert(vValue[i].second);
-            nValueRet += vValue[i].first;
-        }
+        setCoinsRet.insert(vCoinsLower.begin(), vCoinsLower.end());
+        nValueRet = nTotalLower;
         return true;
     }
 
@@ -1216,14 +1192,24 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, in
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     std::vector<char> vfBest;
     int64 nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, 1000);
+    // A subset that overshoots by less than the smallest output we would
+    // make leaves no change: the excess goes to the fee
+    if (SelectCoinsBnB(vValue, nTargetValue, MIN_TXOUT_AMOUNT - 1, vfBest, nBest))
+    {
+        for (unsigned int i = 0; i < vValue.size(); i++)
+            if (vfBest[i])
+                setCoinsRet.insert(vCoinsLower[i]);
+        nValueRet = nBest;
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
+    ApproximateBestSubset(vValue, nTargetValue, vfBest, nBest, 1000);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + CENT)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + CENT, vfBest, nBest, 1000);
+        ApproximateBestSubset(vValue, nTargetValue + CENT, vfBest, nBest, 1000);
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
@@ -1237,8 +1223,8 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, in
         for (unsigned int i = 0; i < vValue.size(); i++)
             if (vfBest[i])
             {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
+                setCoinsRet.insert(vCoinsLower[i]);
+                nValueRet += vValue[i];
             }
 
         if (fDebug && GetBoolArg("-printpriority"))
@@ -1247,7 +1233,7 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, in
             printf("SelectCoins() best subset: ");
             for (unsigned int i = 0; i < vValue.size(); i++)
                 if (vfBest[i])
-                    printf("%s ", FormatMoney(vValue[i].first).c_str());
+                    printf("%s ", FormatMoney(vValue[i]).c_str());
             printf("total %s\n", FormatMoney(nBest).c_str());
         }
     }
@@ -1255,14 +1241,19 @@ bool CWallet::SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, in
     return true;
 }
 
+bool CWallet::SelectCoins(int64 nTargetValue, unsigned int nSpendTime, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const
+{
+    return (SelectCoinsMinConf(nTargetValue, nSpendTime, 1, 6, vCoins, setCoinsRet, nValueRet) ||
+            SelectCoinsMinConf(nTargetValue, nSpendTime, 1, 1, vCoins, setCoinsRet, nValueRet) ||
+            SelectCoinsMinConf(nTargetValue, nSpendTime, 0, 1, vCoins, setCoinsRet, nValueRet));
+}
+
 bool CWallet::SelectCoins(int64 nTargetValue, unsigned int nSpendTime, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const
 {
     std::vector<COutput> vCoins;
     AvailableCoins(vCoins);
 
-    return (SelectCoinsMinConf(nTargetValue, nSpendTime, 1, 6, vCoins, setCoinsRet, nValueRet) ||
-            SelectCoinsMinConf(nTargetValue, nSpendTime, 1, 1, vCoins, setCoinsRet, nValueRet) ||
-            SelectCoinsMinConf(nTargetValue, nSpendTime, 0, 1, vCoins, setCoinsRet, nValueRet));
+    return SelectCoins(nTargetValue, nSpendTime, vCoins, setCoinsRet, nValueRet);
 }
 
 // Select some coins without random shuffle or best subset approximation
@@ -1335,6 +1326,14 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, int64> >& v
         // txdb must be opened before the mapWallet lock
         CTxDB txdb("r");
         {
+            // The candidates don't change while the fee is worked out.
+            // Leave out coins worth less than the fee of spending them.
+            std::vector<COutput> vCoins;
+            AvailableCoins(vCoins);
+            int64 nInputFee = std::max(nTransactionFee, MIN_TX_FEE) * COIN_INPUT_SIZE / 1000;
+            while (!vCoins.empty() && vCoins.back().tx->vout[vCoins.back().i].nValue <= nInputFee)
+                vCoins.pop_back();
+
             nFeeRet = nTransactionFee;
             while (true)
             {
@@ -1351,7 +1350,7 @@ bool CWallet::CreateTransaction(const std::vector<std::pair<CScript, int64> >& v
                 // Choose coins to use
                 std::set<std::pair<const CWalletTx*,unsigned int> > setCoins;
                 int64 nValueIn = 0;
-                if (!SelectCoins(nTotalValue, wtxNew.nTime, setCoins, nValueIn))
+                if (!SelectCoins(nTotalValue, wtxNew.nTime, vCoins, setCoins, nValueIn))
                     return false;
                 BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
                 {
@@ -1506,9 +1505,85 @@ bool CWallet::GetStakeWeight(const CKeyStore& keystore, uint64& nMinWeight, uint
     return true;
 }
 
+static const int MAX_STAKE_THREADS = 16;
+static const int nMaxStakeSearchInterval = 60;
+
+// Kernel search over the candidate outputs of one CreateCoinStake round,
+// shared by the staking threads. Candidates are handed out in order and once
+// a kernel is found no thread starts on a later one, so the result is the
+// kernel the single threaded search would have found.
+class CKernelSearch
+{
+public:
+    const std::vector<std::pair<const CWalletTx*, unsigned int> >& vCoins;
+    unsigned int nBits;
+    unsigned int nTimeTx;
+    int64 nSearchInterval;
+
+    std::atomic<unsigned int> nNext;
+    std::atomic<unsigned int> nFound;   // index of the kernel found, vCoins.size() if none
+    unsigned int nFoundTimeOffset;
+    int64 nFoundBlockTime;
+    CCriticalSection cs;
+
+    CKernelSearch(const std::vector<std::pair<const CWalletTx*, unsigned int> >& vCoinsIn, unsigned int nBitsIn, unsigned int nTimeTxIn, int64 nSearchIntervalIn) :
+        vCoins(vCoinsIn), nBits(nBitsIn), nTimeTx(nTimeTxIn), nSearchInterval(nSearchIntervalIn),
+        nNext(0), nFound(vCoinsIn.size()), nFoundTimeOffset(0), nFoundBlockTime(0) {}
+
+    void Run()
+    {
+        CTxDB txdb("r");
+        while (!fShutdown)
+        {
+            unsigned int i = nNext++;
+            if (i >= vCoins.size() || i > nFound)
+                break;
+            const CWalletTx* pcoin = vCoins[i].first;
+
+            CTxIndex txindex;
+            if (!txdb.ReadTxIndex(pcoin->GetHash(), txindex))
+                continue;
+
+            // Read block header
+            CBlock block;
+            if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
+                continue;
+            if (block.GetBlockTime() + nStakeMinAge > nTimeTx - nMaxStakeSearchInterval)
+                continue; // only count coins meeting min age requirement
+
+            // Search backward in time from the given txNew timestamp
+            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
+            COutPoint prevoutStake = COutPoint(pcoin->GetHash(), vCoins[i].second);
+            for (unsigned int n=0; n<std::min(nSearchInterval,(int64)nMaxStakeSearchInterval) && !fShutdown; n++)
+            {
+                uint256 hashProofOfStake = 0;
+                if (CheckStakeKernelHash(nBits, block, txindex.pos.nTxPos - txindex.pos.nBlockPos, *pcoin, prevoutStake, nTimeTx - n, hashProofOfStake))
+                {
+                    LOCK(cs);
+                    if (i < nFound)
+                    {
+                        nFound = i;
+                        nFoundTimeOffset = n;
+                        nFoundBlockTime = block.GetBlockTime();
+                    }
+                    break;
+                }
+            }
+        }
+    }
+};
+
+static void ThreadKernelSearch(CKernelSearch* psearch)
+{
+    RenameThread("curecoin-stake");
+    psearch->Run();
+}
+
 // ppcoin: create coin stake transaction
 bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64 nSearchInterval, CTransaction& txNew)
 {
+    PERF_TIMER(PERF_CREATECOINSTAKE);
+
     // The following split & combine thresholds are important to security
     // Should not be adjusted if you don't understand the consequences
     static unsigned int nStakeSplitAge = (60 * 60 * 24 * 90);
@@ -1517,10 +1592,10 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if(pIndex0->pprev)
         nCombineThreshold = GetProofOfWorkReward(pIndex0->nHeight, MIN_TX_FEE, pIndex0->pprev->GetBlockHash()) / 3;
 
-    CBigNum bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-
-    LOCK2(cs_main, cs_wallet);
+    // cs_main keeps the chain, and with it the wallet's transactions, still
+    // while the kernel is searched. cs_wallet is only held to choose the
+    // coins and to build the coinstake.
+    LOCK(cs_main);
     txNew.vin.clear();
     txNew.vout.clear();
     // Mark coin stake transaction
@@ -1528,96 +1603,89 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     scriptEmpty.clear();
     txNew.vout.push_back(CTxOut(0, scriptEmpty));
     // Choose coins to use
-    int64 nBalance = GetBalance();
+    int64 nBalance;
     int64 nReserveBalance = 0;
-    if (mapArgs.count("-reservebalance") && !ParseMoney(mapArgs["-reservebalance"], nReserveBalance))
-        return error("CreateCoinStake : invalid reserve balance amount");
-    if (nBalance <= nReserveBalance)
-        return false;
     std::set<std::pair<const CWalletTx*,unsigned int> > setCoins;
-    std::vector<const CWalletTx*> vwtxPrev;
-    int64 nValueIn = 0;
-    if (!SelectCoins(nBalance - nReserveBalance, txNew.nTime, setCoins, nValueIn))
-        return false;
-    if (setCoins.empty())
+    std::vector<std::pair<const CWalletTx*,unsigned int> > vKernelCoins;
+    {
+        LOCK(cs_wallet);
+        nBalance = GetBalance();
+        if (mapArgs.count("-reservebalance") && !ParseMoney(mapArgs["-reservebalance"], nReserveBalance))
+            return error("CreateCoinStake : invalid reserve balance amount");
+        if (nBalance <= nReserveBalance)
+            return false;
+        int64 nValueIn = 0;
+        if (!SelectCoins(nBalance - nReserveBalance, txNew.nTime, setCoins, nValueIn))
+            return false;
+        if (setCoins.empty())
+            return false;
+
+        // Only pay to public key and pay to address outputs, with the key
+        // at hand, can be a kernel
+        BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
+        {
+            std::vector<valtype> vSolutions;
+            txnouttype whichType;
+            if (!Solver(pcoin.first->vout[pcoin.second].scriptPubKey, whichType, vSolutions))
+                continue;
+            if (whichType == TX_PUBKEYHASH ? keystore.HaveKey(uint160(vSolutions[0])) : whichType == TX_PUBKEY)
+                vKernelCoins.push_back(pcoin);
+        }
+    }
+
+    CKernelSearch search(vKernelCoins, nBits, txNew.nTime, nSearchInterval);
+    int nThreads = std::max(1, std::min((int)GetArg("-stakethreads", 1), MAX_STAKE_THREADS));
+    nThreads = std::min(nThreads, (int)vKernelCoins.size());
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; i++)
+        vThreads.push_back(std::thread(ThreadKernelSearch, &search));
+    search.Run();
+    BOOST_FOREACH(std::thread& thread, vThreads)
+        thread.join();
+
+    if (fShutdown || search.nFound == vKernelCoins.size())
         return false;
+
+    LOCK2(cs_main, cs_wallet);
     int64 nCredit = 0;
     CScript scriptPubKeyKernel;
-    BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
+    std::vector<const CWalletTx*> vwtxPrev;
     {
-        CTxDB txdb("r");
-        CTxIndex txindex;
-        if (!txdb.ReadTxIndex(pcoin.first->GetHash(), txindex))
-            continue;
-
-        // Read block header
-        CBlock block;
-        if (!block.ReadFromDisk(txindex.pos.nFile, txindex.pos.nBlockPos, false))
-            continue;
-        static int nMaxStakeSearchInterval = 60;
-        if (block.GetBlockTime() + nStakeMinAge > txNew.nTime - nMaxStakeSearchInterval)
-            continue; // only count coins meeting min age requirement
-
-        bool fKernelFound = false;
-        for (unsigned int n=0; n<std::min(nSearchInterval,(int64)nMaxStakeSearchInterval) && !fKernelFound && !fShutdown; n++)
-        {
-            // Search backward in time from the given txNew timestamp 
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            uint256 hashProofOfStake = 0;
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            if (CheckStakeKernelHash(nBits, block, txindex.pos.nTxPos - txindex.pos.nBlockPos, *pcoin.first, prevoutStake, txNew.nTime - n, hashProofOfStake))
-            {
-                // Found a kernel
-                if (fDebug && GetBoolArg("-printcoinstake"))
-                    printf("CreateCoinStake : kernel found\n");
-                std::vector<valtype> vSolutions;
-                txnouttype whichType;
-                CScript scriptPubKeyOut;
-                scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-                if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-                {
-                    if (fDebug && GetBoolArg("-printcoinstake"))
-                        printf("CreateCoinStake : failed to parse kernel\n");
-                    break;
-                }
-                if (fDebug && GetBoolArg("-printcoinstake"))
-                    printf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-                if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
-                {
-                    if (fDebug && GetBoolArg("-printcoinstake"))
-                        printf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                    break;  // only support pay to public key and pay to address
-                }
-                if (whichType == TX_PUBKEYHASH) // pay to address type
-                {
-                    // convert to pay to public key type
-                    CKey key;
-                    if (!keystore.GetKey(uint160(vSolutions[0]), key))
-                    {
-                        if (fDebug && GetBoolArg("-printcoinstake"))
-                            printf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
-                    scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-                }
-                else
-                    scriptPubKeyOut = scriptPubKeyKernel;
-
-                txNew.nTime -= n; 
-                txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-                nCredit += pcoin.first->vout[pcoin.second].nValue;
-                vwtxPrev.push_back(pcoin.first);
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
-                if (block.GetBlockTime() + nStakeSplitAge > txNew.nTime)
-                    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
-                if (fDebug && GetBoolArg("-printcoinstake"))
-                    printf("CreateCoinStake : added kernel type=%d\n", whichType);
-                fKernelFound = true;
-                break;
-            }
+        // Found a kernel
+        const CWalletTx* pcoinKernel = vKernelCoins[search.nFound].first;
+        unsigned int nOut = vKernelCoins[search.nFound].second;
+        if (pcoinKernel->IsSpent(nOut))
+            return false;   // spent while searching
+        if (fDebug && GetBoolArg("-printcoinstake"))
+            printf("CreateCoinStake : kernel found\n");
+        std::vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoinKernel->vout[nOut].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+            return error("CreateCoinStake : failed to parse kernel");
+        if (fDebug && GetBoolArg("-printcoinstake"))
+            printf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            // convert to pay to public key type
+            CKey key;
+            if (!keystore.GetKey(uint160(vSolutions[0]), key))
+                return error("CreateCoinStake : failed to get key for kernel type=%d", whichType);
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
         }
-        if (fKernelFound || fShutdown)
-            break; // if kernel is found stop searching
+        else
+            scriptPubKeyOut = scriptPubKeyKernel;
+
+        txNew.nTime -= search.nFoundTimeOffset;
+        txNew.vin.push_back(CTxIn(pcoinKernel->GetHash(), nOut));
+        nCredit += pcoinKernel->vout[nOut].nValue;
+        vwtxPrev.push_back(pcoinKernel);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        if (search.nFoundBlockTime + nStakeSplitAge > txNew.nTime)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        if (fDebug && GetBoolArg("-printcoinstake"))
+            printf("CreateCoinStake : added kernel type=%d\n", whichType);
     }
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -1643,6 +1711,9 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
             // Do not add input that is still too young
             if (pcoin.first->nTime + nStakeMaxAge > txNew.nTime)
                 continue;
+            // Nor one spent while the kernel was searched
+            if (pcoin.first->IsSpent(pcoin.second))
+                continue;
             txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
             nCredit += pcoin.first->vout[pcoin.second].nValue;
             vwtxPrev.push_back(pcoin.first);
@@ -1810,6 +1881,160 @@ std::string CWallet::SendMoneyToDestination(const CTxDestination& address, int64
     return SendMoney(scriptPubKey, nValue, wtxNew, fAskFee, strTxComment);
 }
 
+bool CWallet::CreateConsolidation(int64 nThreshold, int64 nTarget, int64 nMaxFee, std::vector<CWalletTx>& vwtxRet, int64& nFeeRet)
+{
+    vwtxRet.clear();
+    nFeeRet = 0;
+    if (nThreshold <= 0 || nTarget < nThreshold)
+        return error("CreateConsolidation() : bad threshold or target");
+
+    LOCK2(cs_main, cs_wallet);
+    // txdb must be opened before the mapWallet lock
+    CTxDB txdb("r");
+
+    std::vector<COutput> vCoins;
+    AvailableCoins(vCoins);
+
+    // Small confirmed coins by the script they pay, largest first. Coins
+    // are only combined with others of the same address, as a coinstake
+    // does, so no addresses are linked that weren't already.
+    unsigned int nTime = GetAdjustedTime();
+    int64 nInputFee = std::max(nTransactionFee, MIN_TX_FEE) * COIN_INPUT_SIZE / 1000;
+    std::map<CScript, std::vector<const COutput*> > mapSmallCoins;
+    BOOST_FOREACH(const COutput& output, vCoins)
+    {
+        int64 nValue = output.tx->vout[output.i].nValue;
+        if (!output.fSpendable || output.nDepth < 1 || nValue >= nThreshold || nValue <= nInputFee)
+            continue;
+        if (output.tx->nTime > nTime)
+            continue;  // ppcoin: timestamp must not exceed spend time
+        mapSmallCoins[output.tx->vout[output.i].scriptPubKey].push_back(&output);
+    }
+
+    for (std::map<CScript, std::vector<const COutput*> >::const_iterator it = mapSmallCoins.begin(); it != mapSmallCoins.end(); ++it)
+    {
+        const std::vector<const COutput*>& vSmall = (*it).second;
+        for (unsigned int nStart = 0; nStart + MIN_CONSOLIDATE_INPUTS <= vSmall.size(); nStart += MAX_CONSOLIDATE_INPUTS)
+        {
+            unsigned int nEnd = std::min((unsigned int)vSmall.size(), nStart + MAX_CONSOLIDATE_INPUTS);
+
+            CWalletTx wtx;
+            wtx.BindWallet(this);
+            wtx.fFromMe = true;
+            wtx.nTime = nTime;
+            int64 nValueIn = 0;
+            for (unsigned int i = nStart; i < nEnd; i++)
+            {
+                wtx.vin.push_back(CTxIn(vSmall[i]->tx->GetHash(), vSmall[i]->i));
+                nValueIn += vSmall[i]->tx->vout[vSmall[i]->i].nValue;
+            }
+
+            // Start from the fee for the size the signed transaction should
+            // have, so it is usually signed only once
+            int64 nFee = nTransactionFee * (1 + (int64)(wtx.vin.size() * COIN_INPUT_SIZE) / 1000);
+            while (true)
+            {
+                int64 nValueOut = nValueIn - nFee;
+                if (nValueOut < MIN_TXOUT_AMOUNT)
+                    break;
+                // Stop once the fee budget is spent, before signing for it
+                if (nFeeRet + nFee > nMaxFee)
+                    return true;
+                int64 nOutputs = std::max((int64)1, nValueOut / nTarget);
+                wtx.vout.assign(nOutputs, CTxOut(nValueOut / nOutputs, (*it).first));
+                wtx.vout.back().nValue += nValueOut % nOutputs;
+
+                for (unsigned int i = nStart; i < nEnd; i++)
+                    if (!SignSignature(*this, *vSmall[i]->tx, wtx, i - nStart))
+                        return error("CreateConsolidation() : signing failed");
+
+                unsigned int nBytes = ::GetSerializeSize(*(CTransaction*)&wtx, SER_NETWORK, PROTOCOL_VERSION);
+                if (nBytes >= MAX_BLOCK_SIZE_GEN/5)
+                    return error("CreateConsolidation() : transaction too large");
+                int64 nPayFee = std::max(nTransactionFee * (1 + (int64)nBytes / 1000), wtx.GetMinFee(1, false, GMF_SEND));
+                if (nFee >= nPayFee)
+                    break;
+                nFee = nPayFee;
+            }
+            if (nValueIn - nFee < MIN_TXOUT_AMOUNT)
+                continue;
+
+            wtx.AddSupportingTransactions(txdb);
+            wtx.fTimeReceivedIsTxTime = true;
+            vwtxRet.push_back(wtx);
+            nFeeRet += nFee;
+        }
+    }
+
+    return true;
+}
+
+bool GetConsolidationSettings(int64& nThreshold, int64& nTarget, int64& nMaxFee)
+{
+    nThreshold = DEFAULT_CONSOLIDATE_THRESHOLD;
+    nTarget = DEFAULT_CONSOLIDATE_TARGET;
+    nMaxFee = DEFAULT_CONSOLIDATE_MAX_FEE;
+    if (mapArgs.count("-consolidatethreshold") && !ParseMoney(mapArgs["-consolidatethreshold"], nThreshold))
+        return false;
+    if (mapArgs.count("-consolidatetarget") && !ParseMoney(mapArgs["-consolidatetarget"], nTarget))
+        return false;
+    if (mapArgs.count("-consolidatemaxfee") && !ParseMoney(mapArgs["-consolidatemaxfee"], nMaxFee))
+        return false;
+    return nThreshold > 0 && nTarget >= nThreshold;
+}
+
+// Combines small outputs in the background, once an hour at most and only
+// after the wallet has been left alone for a while
+void ThreadConsolidateCoins(void* parg)
+{
+    RenameThread("curecoin-consolidate");
+    CWallet* pwallet = (CWallet*)parg;
+
+    unsigned int nLastSeen = nWalletDBUpdated;
+    int64 nLastActivity = GetTime();
+    int64 nLastRun = GetTime();
+    while (!fShutdown)
+    {
+        Sleep(1000);
+
+        if (nLastSeen != nWalletDBUpdated)
+        {
+            nLastSeen = nWalletDBUpdated;
+            nLastActivity = GetTime();
+        }
+        int64 nNow = GetTime();
+        if (nNow - nLastRun < CONSOLIDATE_INTERVAL || nNow - nLastActivity < CONSOLIDATE_IDLE_TIME)
+            continue;
+        bool fConnected;
+        {
+            LOCK(cs_vNodes);
+            fConnected = !vNodes.empty();
+        }
+        // Sends fee-paying transactions, so not when unlocked for minting only
+        if (!fConnected || IsInitialBlockDownload() || pwallet->IsLocked() || fWalletUnlockMintOnly)
+            continue;
+        nLastRun = nNow;
+
+        int64 nThreshold, nTarget, nMaxFee;
+        if (!GetConsolidationSettings(nThreshold, nTarget, nMaxFee))
+            continue;
+        std::vector<CWalletTx> vwtx;
+        int64 nFee;
+        if (!pwallet->CreateConsolidation(nThreshold, nTarget, nMaxFee, vwtx, nFee) || vwtx.empty())
+            continue;
+
+        unsigned int nSent = 0;
+        BOOST_FOREACH(CWalletTx& wtx, vwtx)
+        {
+            CReserveKey reservekey(pwallet);
+            if (!pwallet->CommitTransaction(wtx, reservekey))
+                break;
+            nSent++;
+        }
+        printf("ThreadConsolidateCoins : sent %u of %" PRIszu " consolidation transactions, fee %s\n", nSent, vwtx.size(), FormatMoney(nFee).c_str());
+    }
+}
+
 
 
 
@@ -1865,6 +2090,7 @@ bool CWallet::SetAddressBookName(const CTxDestination& address, const std::strin
 {
     std::map<CTxDestination, std::string>::iterator mi = mapAddressBook.find(address);
     mapAddressBook[address] = strName;
+    fAddressIndexValid = false;
     NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address) != MINE_NO, (mi == mapAddressBook.end()) ? CT_NEW : CT_UPDATED);
     if (!fFileBacked)
         return false;
@@ -1874,6 +2100,7 @@ bool CWallet::SetAddressBookName(const CTxDestination& address, const std::strin
 bool CWallet::DelAddressBookName(const CTxDestination& address)
 {
     mapAddressBook.erase(address);
+    fAddressIndexValid = false;
     NotifyAddressBookChanged(this, address, "", ::IsMine(*this, address) != MINE_NO, CT_DELETED);
     if (!fFileBacked)
         return false;
@@ -2088,127 +2315,110 @@ int64 CWallet::GetOldestKeyPoolTime()
     return keypool.nTime;
 }
 
-std::map<CTxDestination, int64> CWallet::GetAddressBalances()
+void CWallet::AddToAddressIndex(const CWalletTx& wtx)
 {
-    std::map<CTxDestination, int64> balances;
-
+    // Input addresses of a transaction we funded are grouped with each
+    // other and with its change
+    if (wtx.vin.size() > 0 && IsMine(wtx.vin[0]) != MINE_NO)
     {
-        LOCK(cs_wallet);
-        BOOST_FOREACH(PAIRTYPE(uint256, CWalletTx) walletEntry, mapWallet)
+        std::vector<CTxDestination> vGroup;
+        BOOST_FOREACH(const CTxIn& txin, wtx.vin)
         {
-            CWalletTx *pcoin = &walletEntry.second;
-
-            if (!pcoin->IsFinal() || !pcoin->IsConfirmed())
+            std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+            if (mi == mapWallet.end() || txin.prevout.n >= (*mi).second.vout.size())
                 continue;
+            CTxDestination address;
+            if (ExtractDestination((*mi).second.vout[txin.prevout.n].scriptPubKey, address))
+                vGroup.push_back(address);
+        }
+        BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+        {
+            CTxDestination address;
+            if (IsChange(txout) && ExtractDestination(txout.scriptPubKey, address))
+                vGroup.push_back(address);
+        }
+        for (unsigned int i = 1; i < vGroup.size(); i++)
+            addressGroups.Merge(vGroup[0], vGroup[i]);
+        if (vGroup.size() == 1)
+            addressGroups.Add(vGroup[0]);
+    }
 
-            if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+    {
+        CTxDestination address;
+        if (IsMine(wtx.vout[i]) == MINE_NO || !ExtractDestination(wtx.vout[i].scriptPubKey, address))
+            continue;
+        addressGroups.Add(address);
+        mapAddressOutputs[address].insert(std::make_pair(&wtx, i));
+    }
+}
 
-            int nDepth = pcoin->GetDepthInMainChain();
-            if (nDepth < (pcoin->IsFromMe() ? 0 : 1))
-                continue;
+void CWallet::UpdateAddressIndex()
+{
+    // The size also catches entries added with mapAddressBook[] directly
+    if (fAddressIndexValid && nAddressIndexBookSize == mapAddressBook.size())
+        return;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-            {
-                CTxDestination addr;
-                if (IsMine(pcoin->vout[i]) == MINE_NO)
-                    continue;
-                if(!ExtractDestination(pcoin->vout[i].scriptPubKey, addr))
-                    continue;
+    addressGroups.Clear();
+    mapAddressOutputs.clear();
+    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        AddToAddressIndex((*it).second);
+    fAddressIndexValid = true;
+    nAddressIndexBookSize = mapAddressBook.size();
+}
 
-                int64 n = pcoin->IsSpent(i) ? 0 : pcoin->vout[i].nValue;
+bool CWallet::IsAddressBalanceTx(const CWalletTx& wtx) const
+{
+    if (!wtx.IsFinal() || !wtx.IsConfirmed())
+        return false;
 
-                if (!balances.count(addr))
-                    balances[addr] = 0;
-                balances[addr] += n;
-            }
-        }
-    }
+    if ((wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.GetBlocksToMaturity() > 0)
+        return false;
 
-    return balances;
+    int nDepth = wtx.GetDepthInMainChain();
+    return nDepth >= (wtx.IsFromMe() ? 0 : 1);
 }
 
-std::set< std::set<CTxDestination> > CWallet::GetAddressGroupings()
+std::map<CTxDestination, int64> CWallet::GetAddressBalances()
 {
-    std::set< std::set<CTxDestination> > groupings;
-    std::set<CTxDestination> grouping;
+    std::map<CTxDestination, int64> balances;
 
-    BOOST_FOREACH(PAIRTYPE(uint256, CWalletTx) walletEntry, mapWallet)
     {
-        CWalletTx *pcoin = &walletEntry.second;
+        LOCK(cs_wallet);
+        UpdateAddressIndex();
 
-        if (pcoin->vin.size() > 0 && IsMine(pcoin->vin[0]) != MINE_NO)
+        std::map<const CWalletTx*, bool> mapCounted;
+        for (std::map<CTxDestination, std::set<std::pair<const CWalletTx*, unsigned int> > >::const_iterator it = mapAddressOutputs.begin(); it != mapAddressOutputs.end(); ++it)
         {
-            // group all input addresses with each other
-            BOOST_FOREACH(CTxIn txin, pcoin->vin)
+            BOOST_FOREACH(const PAIRTYPE(const CWalletTx*, unsigned int)& output, (*it).second)
             {
-                CTxDestination address;
-                if(!ExtractDestination(mapWallet[txin.prevout.hash].vout[txin.prevout.n].scriptPubKey, address))
+                std::map<const CWalletTx*, bool>::iterator mi = mapCounted.find(output.first);
+                if (mi == mapCounted.end())
+                    mi = mapCounted.insert(std::make_pair(output.first, IsAddressBalanceTx(*output.first))).first;
+                if (!(*mi).second)
                     continue;
-                grouping.insert(address);
-            }
-
-            // group change with input addresses
-            BOOST_FOREACH(CTxOut txout, pcoin->vout)
-                if (IsChange(txout))
-                {
-                    CWalletTx tx = mapWallet[pcoin->vin[0].prevout.hash];
-                    CTxDestination txoutAddr;
-                    if(!ExtractDestination(txout.scriptPubKey, txoutAddr))
-                        continue;
-                    grouping.insert(txoutAddr);
-                }
-            groupings.insert(grouping);
-            grouping.clear();
-        }
 
-        // group lone addrs by themselves
-        for (unsigned int i = 0; i < pcoin->vout.size(); i++)
-            if (IsMine(pcoin->vout[i]) != MINE_NO)
-            {
-                CTxDestination address;
-                if(!ExtractDestination(pcoin->vout[i].scriptPubKey, address))
-                    continue;
-                grouping.insert(address);
-                groupings.insert(grouping);
-                grouping.clear();
+                int64& nBalance = balances[(*it).first];
+                if (!output.first->IsSpent(output.second))
+                    nBalance += output.first->vout[output.second].nValue;
             }
+        }
     }
 
-    std::set< std::set<CTxDestination>* > uniqueGroupings; // a set of pointers to groups of addresses
-    std::map< CTxDestination, std::set<CTxDestination>* > setmap;  // map addresses to the unique group containing it
-    BOOST_FOREACH(std::set<CTxDestination> grouping, groupings)
-    {
-        // make a set of all the groups hit by this new group
-        std::set< std::set<CTxDestination>* > hits;
-        std::map< CTxDestination, std::set<CTxDestination>* >::iterator it;
-        BOOST_FOREACH(CTxDestination address, grouping)
-            if ((it = setmap.find(address)) != setmap.end())
-                hits.insert((*it).second);
-
-        // merge all hit groups into a new single group and delete old groups
-        std::set<CTxDestination>* merged = new std::set<CTxDestination>(grouping);
-        BOOST_FOREACH(std::set<CTxDestination>* hit, hits)
-        {
-            merged->insert(hit->begin(), hit->end());
-            uniqueGroupings.erase(hit);
-            delete hit;
-        }
-        uniqueGroupings.insert(merged);
+    return balances;
+}
 
-        // update setmap
-        BOOST_FOREACH(CTxDestination element, *merged)
-            setmap[element] = merged;
-    }
+std::set< std::set<CTxDestination> > CWallet::GetAddressGroupings()
+{
+    std::set< std::set<CTxDestination> > groupings;
 
-    std::set< std::set<CTxDestination> > ret;
-    BOOST_FOREACH(std::set<CTxDestination>* uniqueGrouping, uniqueGroupings)
     {
-        ret.insert(*uniqueGrouping);
-        delete uniqueGrouping;
+        LOCK(cs_wallet);
+        UpdateAddressIndex();
+        addressGroups.GetGroups(groupings);
     }
 
-    return ret;
+    return groupings;
 }
 
 // ppcoin: check 'spent' consistency between wallet and txindex
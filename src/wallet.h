@@ -11,6 +11,7 @@
 #include <stdlib.h>
 
 #include "main.h"
+#include "addressgroups.h"
 #include "key.h"
 #include "keystore.h"
 #include "script.h"
@@ -24,6 +25,21 @@ class CWalletTx;
 class CReserveKey;
 class COutput;
 
+/** Outputs below this are combined by -consolidate (default) */
+static const int64 DEFAULT_CONSOLIDATE_THRESHOLD = COIN;
+/** Size of the outputs they are combined into (default) */
+static const int64 DEFAULT_CONSOLIDATE_TARGET = 10 * COIN;
+/** Most fee paid by one consolidation run (default) */
+static const int64 DEFAULT_CONSOLIDATE_MAX_FEE = COIN / 10;
+/** Most inputs in one consolidation transaction, well within MAX_BLOCK_SIZE_GEN/5 */
+static const unsigned int MAX_CONSOLIDATE_INPUTS = 500;
+/** Fewest small outputs of one address worth a consolidation transaction */
+static const unsigned int MIN_CONSOLIDATE_INPUTS = 10;
+/** Seconds between background consolidation runs */
+static const int64 CONSOLIDATE_INTERVAL = 60 * 60;
+/** Seconds without wallet activity before the background job runs */
+static const int64 CONSOLIDATE_IDLE_TIME = 10 * 60;
+
 /** (client) version numbers for particular wallet features */
 enum WalletFeature
 {
@@ -71,6 +87,7 @@ class CWallet : public CCryptoKeyStore
 private:
     bool SelectCoinsSimple(int64 nTargetValue, unsigned int nSpendTime, int nMinConf, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
     bool SelectCoins(int64 nTargetValue, unsigned int nSpendTime, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
+    bool SelectCoins(int64 nTargetValue, unsigned int nSpendTime, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
 
     CWalletDB *pwalletdbEncryption;
 
@@ -80,6 +97,19 @@ private:
     // the maximum wallet format version: memory-only variable that specifies to what version this wallet may be upgraded
     int nWalletMaxVersion;
 
+    // Address index: our outputs by address and the address groupings,
+    // updated as transactions are added to the wallet. It is built on first
+    // use and again when a transaction is erased or the address book
+    // is written to (which changes what counts as change).
+    CAddressGroups addressGroups;
+    std::map<CTxDestination, std::set<std::pair<const CWalletTx*, unsigned int> > > mapAddressOutputs;
+    bool fAddressIndexValid;
+    size_t nAddressIndexBookSize;
+
+    void AddToAddressIndex(const CWalletTx& wtx);
+    void UpdateAddressIndex();
+    bool IsAddressBalanceTx(const CWalletTx& wtx) const;
+
 public:
     mutable CCriticalSection cs_wallet;
 
@@ -101,6 +131,8 @@ public:
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
         nOrderPosNext = 0;
+        fAddressIndexValid = false;
+        nAddressIndexBookSize = 0;
     }
     CWallet(std::string strWalletFileIn)
     {
@@ -111,6 +143,8 @@ public:
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
         nOrderPosNext = 0;
+        fAddressIndexValid = false;
+        nAddressIndexBookSize = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -125,8 +159,12 @@ public:
     bool CanSupportFeature(enum WalletFeature wf) { return nWalletMaxVersion >= wf; }
 
     void AvailableCoinsMinConf(std::vector<COutput>& vCoins, int nConf) const;
+    /** Unspent outputs we can spend or watch, largest first */
     void AvailableCoins(std::vector<COutput>& vCoins, bool fOnlyConfirmed=true) const;
-    bool SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
+    /** Pick coins from vCoins, which must be ordered as AvailableCoins
+     * orders them: an exact match if there is one, else a subset with no
+     * change, else the best subset found by stochastic approximation */
+    bool SelectCoinsMinConf(int64 nTargetValue, unsigned int nSpendTime, int nConfMine, int nConfTheirs, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64& nValueRet) const;
     // keystore implementation
     // Generate a new key
     CPubKey GenerateNewKey();
@@ -188,6 +226,10 @@ public:
     bool CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64 nSearchInterval, CTransaction& txNew);
     std::string SendMoney(CScript scriptPubKey, int64 nValue, CWalletTx& wtxNew, bool fAskFee=false, std::string strTxComment = "");
     std::string SendMoneyToDestination(const CTxDestination &address, int64 nValue, CWalletTx& wtxNew, bool fAskFee=false, std::string strTxComment = "");
+    /** Build transactions that combine the outputs below nThreshold paid to
+     * each address into outputs of about nTarget to that same address,
+     * paying at most nMaxFee in all. They are signed but not committed. */
+    bool CreateConsolidation(int64 nThreshold, int64 nTarget, int64 nMaxFee, std::vector<CWalletTx>& vwtxRet, int64& nFeeRet);
     // Custom function to create and send a Research Core registration TX
     std::string SendRegistrationTx(const std::string& username, std::string& strError);
 
@@ -875,5 +917,8 @@ private:
 };
 
 bool GetWalletFile(CWallet* pwallet, std::string &strWalletFileOut);
+/** -consolidatethreshold, -consolidatetarget and -consolidatemaxfee, or their defaults */
+bool GetConsolidationSettings(int64& nThreshold, int64& nTarget, int64& nMaxFee);
+void ThreadConsolidateCoins(void* parg);
 
 #endif